@@ -14,7 +14,8 @@
 
 - (id)initWithHost:(NSString *)host;
 
-// Returns an image that progressively gains representations
+// Returns an image that progressively gains representations. It may have none yet, so display it
+// in an AvatarImageView (or observe AvatarImageDidUpdateNotification) to redraw as they arrive.
 - (NSImage *)imageForAccountIdentifier:(NSNumber *)accountIdentifier avatarURL:(NSURL *)avatarURL;
 
 @end
@@ -13,15 +13,26 @@
 #import "Defaults.h"
 #import "Extras.h"
 
+#import <ImageIO/ImageIO.h>
 #import <libkern/OSAtomic.h>
 
 NSString *const AvatarImageDidUpdateNotification = @"AvatarImageDidUpdateNotification";
 
+static const NSUInteger AvatarMaxConcurrentRevalidations = 4;
+static const NSUInteger AvatarCacheCostLimit = 64 * 1024 * 1024; // bytes of decoded bitmaps
+
 @interface AvatarManager ()
 
 @property (copy) NSString *ghHost;
 @property NSString *cachePath;
 @property NSCache *cache;
+@property NSURLSession *session;
+@property dispatch_queue_t ioQ; // reads, decodes and writes avatar files
+
+// Only accessed on the main thread
+@property NSMutableArray<dispatch_block_t> *pendingRevalidations; // most recently requested last
+@property NSMutableSet<NSNumber *> *revalidating; // identifiers pending or in flight
+@property NSUInteger revalidationsInFlight;
 
 @end
 
@@ -49,6 +60,18 @@ NSString *const AvatarImageDidUpdateNotification = @"AvatarImageDidUpdateNotific
     if (self = [super init]) {
         self.ghHost = host;
         self.cache = [NSCache new];
+        self.cache.totalCostLimit = AvatarCacheCostLimit;
+        
+        // Revalidations are conditional, so skip the URL cache, which would turn a 304 back into the full image.
+        NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
+        config.URLCache = nil;
+        config.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+        config.HTTPMaximumConnectionsPerHost = AvatarMaxConcurrentRevalidations;
+        self.session = [NSURLSession sessionWithConfiguration:config];
+        
+        self.ioQ = dispatch_queue_create("AvatarManager.io", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INITIATED, 0));
+        self.pendingRevalidations = [NSMutableArray new];
+        self.revalidating = [NSMutableSet new];
         
         DataStore *store = [DataStore activeStore];
         Auth *auth = [store auth];
@@ -60,91 +83,192 @@ NSString *const AvatarImageDidUpdateNotification = @"AvatarImageDidUpdateNotific
     return self;
 }
 
+- (void)dealloc {
+    [_session finishTasksAndInvalidate];
+}
+
 - (CGSize)defaultSize {
     return CGSizeMake(128, 128);
 }
 
+- (CGFloat)pixelWidth {
+    return [self defaultSize].width * [[NSScreen mainScreen] backingScaleFactor];
+}
+
 - (NSString *)imagePathForIdentifier:(NSNumber *)identifier {
-    CGFloat w = [self defaultSize].width;
-    w *= [[NSScreen mainScreen] backingScaleFactor];
-    NSString *imageName = [NSString stringWithFormat:@"%@.%.0f.png", identifier, w];
+    NSString *imageName = [NSString stringWithFormat:@"%@.%.0f.png", identifier, [self pixelWidth]];
     NSString *imagePath = [_cachePath stringByAppendingPathComponent:imageName];
     return imagePath;
 }
 
+// Decodes data into a bitmap no larger than it will be displayed, so that nothing is left to decode
+// lazily when it's first drawn on the main thread.
+static NSBitmapImageRep *DecodeAvatar(NSData *data, CGSize pointSize, CGFloat pixelWidth) {
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+    if (!source) return nil;
+    
+    NSDictionary *options = @{ (__bridge id)kCGImageSourceCreateThumbnailFromImageAlways : @YES,
+                               (__bridge id)kCGImageSourceCreateThumbnailWithTransform : @YES,
+                               (__bridge id)kCGImageSourceShouldCacheImmediately : @YES,
+                               (__bridge id)kCGImageSourceThumbnailMaxPixelSize : @(pixelWidth) };
+    CGImageRef cgImage = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)options);
+    CFRelease(source);
+    if (!cgImage) return nil;
+    
+    NSBitmapImageRep *rep = [[NSBitmapImageRep alloc] initWithCGImage:cgImage];
+    CGImageRelease(cgImage);
+    rep.size = pointSize;
+    return rep;
+}
+
+static NSUInteger CostOf(NSBitmapImageRep *rep) {
+    return rep.bytesPerRow * rep.pixelsHigh;
+}
+
+// Call on the main thread
+- (void)setRepresentation:(NSBitmapImageRep *)rep ofImage:(NSImage *)image identifier:(NSNumber *)identifier {
+    NSArray *existing = image.representations;
+    [image addRepresentation:rep];
+    for (NSImageRep *oldRep in existing) {
+        [image removeRepresentation:oldRep];
+    }
+    [image recache];
+    
+    if ([_cache objectForKey:identifier] == image) {
+        [_cache setObject:image forKey:identifier cost:CostOf(rep)];
+    }
+    
+    [[NSNotificationCenter defaultCenter] postNotificationName:AvatarImageDidUpdateNotification object:image];
+}
+
+- (void)loadImage:(NSImage *)image identifier:(NSNumber *)identifier avatarURL:(NSURL *)avatarURL {
+    NSString *imagePath = [self imagePathForIdentifier:identifier];
+    CGSize size = [self defaultSize];
+    CGFloat pixelWidth = [self pixelWidth];
+    
+    dispatch_async(_ioQ, ^{
+        NSData *data = [[NSData alloc] initWithContentsOfFile:imagePath options:0 error:NULL];
+        NSBitmapImageRep *rep = data ? DecodeAvatar(data, size, pixelWidth) : nil;
+        if (rep) {
+            RunOnMain(^{
+                // A revalidation may have beaten us to it with something newer
+                if (image.representations.count == 0) {
+                    [self setRepresentation:rep ofImage:image identifier:identifier];
+                }
+            });
+        }
+    });
+}
+
 - (void)checkForUpdatesToImage:(NSImage *)image identifier:(NSNumber *)identifier avatarURL:(NSURL *)avatarURL
 {
     NSDate *lastChecked = [image extras_representedObject];
     if (lastChecked && [lastChecked timeIntervalSinceNow] > -300.0) {
         return; // if we checked in last 5 minutes, we're good.
     }
+    
+    if ([_revalidating containsObject:identifier]) {
+        return; // already on its way
+    }
+    [_revalidating addObject:identifier];
     image.extras_representedObject = [NSDate date];
     
+    [_pendingRevalidations addObject:^{
+        [self revalidateImageWithIdentifier:identifier avatarURL:avatarURL];
+    }];
+    [self startPendingRevalidations];
+}
+
+// Call on the main thread
+- (void)startPendingRevalidations {
+    // Newest first, as those are the ones most likely to still be on screen.
+    while (_revalidationsInFlight < AvatarMaxConcurrentRevalidations && _pendingRevalidations.count) {
+        dispatch_block_t revalidation = [_pendingRevalidations lastObject];
+        [_pendingRevalidations removeLastObject];
+        _revalidationsInFlight++;
+        revalidation();
+    }
+}
+
+// Call on the main thread
+- (void)finishedRevalidatingIdentifier:(NSNumber *)identifier {
+    [_revalidating removeObject:identifier];
+    _revalidationsInFlight--;
+    [self startPendingRevalidations];
+}
+
+- (void)revalidateImageWithIdentifier:(NSNumber *)identifier avatarURL:(NSURL *)avatarURL {
     NSString *imagePath = [self imagePathForIdentifier:identifier];
-    NSDictionary *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:imagePath error:NULL];
-    NSDate *lastModified = attrs[NSFileModificationDate];
+    CGSize size = [self defaultSize];
+    CGFloat pixelWidth = [self pixelWidth];
     
     NSString *host = _ghHost;
     NSURL *imageURL;
     if ([host isEqualToString:@"api.github.com"]) {
-        CGFloat w = [self defaultSize].width;
-        w *= [[NSScreen mainScreen] backingScaleFactor];
-        NSString *imageURLStr = [NSString stringWithFormat:@"https://avatars.githubusercontent.com/u/%@?v=3&s=%.0f", identifier, w];
+        NSString *imageURLStr = [NSString stringWithFormat:@"https://avatars.githubusercontent.com/u/%@?v=3&s=%.0f", identifier, pixelWidth];
         imageURL = [NSURL URLWithString:imageURLStr];
     } else {
         imageURL = avatarURL;
     }
     
+    if (!imageURL) {
+        [self finishedRevalidatingIdentifier:identifier];
+        return;
+    }
     
-    NSURLRequest *request = [NSURLRequest requestWithURL:imageURL];
-    [[[NSURLSession sharedSession] dataTaskWithRequest:request completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
-        if (error) {
-            ErrLog(@"%@", error);
+    dispatch_async(_ioQ, ^{
+        // Our copy's modification date is the Last-Modified it was served with.
+        NSDictionary *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:imagePath error:NULL];
+        NSDate *lastModified = attrs[NSFileModificationDate];
+        
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:imageURL];
+        if (lastModified) {
+            [request setValue:[lastModified HTTPHeaderString] forHTTPHeaderField:@"If-Modified-Since"];
         }
-        NSHTTPURLResponse *resp = (id)response;
-        NSDate *headerLastModified = [NSDate dateWithHTTPHeaderString:resp.allHeaderFields[@"Last-Modified"]];
-        if (data && [resp isSuccessStatusCode] && ![NSObject object:headerLastModified isEqual:lastModified])
-        {
-            NSBitmapImageRep *rep = [[NSBitmapImageRep alloc] initWithData:data];
-            if (rep) {
-                [data writeToFile:imagePath atomically:YES];
-                if (headerLastModified) {
-                    [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate: headerLastModified} ofItemAtPath:imagePath error:NULL];
-                }
-                RunOnMain(^{
-                    NSArray *existing = image.representations;
-                    [image addRepresentation:rep];
-                    for (NSImageRep *oldRep in existing) {
-                        [image removeRepresentation:oldRep];
+        
+        [[_session dataTaskWithRequest:request completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
+            if (error) {
+                ErrLog(@"%@", error);
+            }
+            NSHTTPURLResponse *resp = (id)response;
+            NSDate *headerLastModified = [NSDate dateWithHTTPHeaderString:resp.allHeaderFields[@"Last-Modified"]];
+            if (data && [resp isSuccessStatusCode] && ![NSObject object:headerLastModified isEqual:lastModified])
+            {
+                dispatch_async(_ioQ, ^{
+                    NSBitmapImageRep *rep = DecodeAvatar(data, size, pixelWidth);
+                    if (rep) {
+                        [data writeToFile:imagePath atomically:YES];
+                        if (headerLastModified) {
+                            [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate: headerLastModified} ofItemAtPath:imagePath error:NULL];
+                        }
                     }
-                    [image recache];
-                    [[NSNotificationCenter defaultCenter] postNotificationName:AvatarImageDidUpdateNotification object:image];
+                    RunOnMain(^{
+                        // The image requested may since have been evicted and replaced, so update whichever is current.
+                        // If there's none, the next request loads what was just written.
+                        NSImage *image = [_cache objectForKey:identifier];
+                        if (rep && image) {
+                            [self setRepresentation:rep ofImage:image identifier:identifier];
+                        }
+                        [self finishedRevalidatingIdentifier:identifier];
+                    });
+                });
+            } else {
+                // Including 304 Not Modified
+                RunOnMain(^{
+                    [self finishedRevalidatingIdentifier:identifier];
                 });
             }
-        }
-    }] resume];
-}
-
-- (void)loadImage:(NSImage *)image identifier:(NSNumber *)identifier avatarURL:(NSURL *)avatarURL {
-    NSString *imagePath = [self imagePathForIdentifier:identifier];
-    NSData *data = [[NSData alloc] initWithContentsOfFile:imagePath options:0 error:NULL];
-    if (data) {
-        NSBitmapImageRep *rep = [[NSBitmapImageRep alloc] initWithData:data];
-        if (rep) {
-            [image addRepresentation:rep];
-            image.extras_representedObject = [[NSFileManager defaultManager] attributesOfItemAtPath:imagePath error:NULL][NSFileModificationDate];
-            [image recache];
-            [[NSNotificationCenter defaultCenter] postNotificationName:AvatarImageDidUpdateNotification object:image];
-        }
-    }
+        }] resume];
+    });
 }
 
 - (NSImage *)imageForAccountIdentifier:(NSNumber *)accountIdentifier avatarURL:(NSURL *)avatarURL
 {
     NSImage *image = [_cache objectForKey:accountIdentifier];
     if (!image) {
+        // Concurrent requests for the same account share this image, which gains its representation once loaded.
         image = [[NSImage alloc] initWithSize:[self defaultSize]];
-        [_cache setObject:image forKey:accountIdentifier];
+        [_cache setObject:image forKey:accountIdentifier cost:0];
         [self loadImage:image identifier:accountIdentifier avatarURL:avatarURL];
     }
     [self checkForUpdatesToImage:image identifier:accountIdentifier avatarURL:avatarURL];
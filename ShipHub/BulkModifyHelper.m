@@ -8,6 +8,7 @@
 
 #import "BulkModifyHelper.h"
 
+#import "CompiledIssuePredicate.h"
 #import "Error.h"
 #import "DataStore.h"
 #import "MetadataStore.h"
@@ -109,7 +110,7 @@
         return;
     }
     
-    NSArray *uneditable = [bulkController.issues filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"repository.canPush = NO"]];
+    NSArray *uneditable = [bulkController.issues filteredArrayUsingPredicate:[CompiledIssuePredicate compiledPredicateWithPredicate:[NSPredicate predicateWithFormat:@"repository.canPush = NO"]]];
     
     if (uneditable.count > 0) {
         NSAlert *err = [NSAlert new];
@@ -117,7 +117,7 @@
     
     [[DataStore activeStore] timeSeriesMatchingPredicate:basePredicate startDate:start endDate:end completion:^(TimeSeries *series, NSError *error) {
         if (generation == _searchGeneration) {
-            _resultsCount = series.records.count;
+            _resultsCount = series.count;
             [self timeSeriesToJSON:series partition:config.partitionKeyPath completion:^(NSString *js) {
                 if (generation == _searchGeneration) {
                     [self evaluateJavaScript:js];
@@ -144,16 +144,6 @@ static NSInteger dateToJSONTS(NSDate *d) {
     return val;
 }
 
-static NSSet *uniqueKeyPathsInRecords(NSArray *records, NSString *keyPath) {
-    NSMutableSet *s = [NSMutableSet new];
-    for (id record in records) {
-        id val = [record valueForKeyPath:keyPath];
-        if (!val) val = [NSNull null];
-        [s addObject:val];
-    }
-    return s;
-}
-
 - (void)timeSeriesToJSON:(TimeSeries *)timeSeries partition:(NSString *)partitionPath completion:(void (^)(NSString *js))completion {
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
         [timeSeries generateIntervalsWithCalendarUnit:NSCalendarUnitDay];
@@ -161,12 +151,12 @@ static NSSet *uniqueKeyPathsInRecords(NSArray *records, NSString *keyPath) {
         NSMutableDictionary *d = [NSMutableDictionary new];
         d[@"startDate"] = @(dateToJSONTS(timeSeries.startDate));
         d[@"endDate"] = @(dateToJSONTS(timeSeries.endDate));
-        d[@"count"] = @(timeSeries.records.count);
+        d[@"count"] = @(timeSeries.count);
         
         d[@"intervals"] = [timeSeries.intervals arrayByMappingObjects:^id(id obj) {
             return @{ @"startDate" : @(dateToJSONTS([obj startDate])),
                       @"endDate" : @(dateToJSONTS([obj endDate])),
-                      @"count" : @([[obj records] count]) };
+                      @"count" : @([obj count]) };
         }] ?: @[];
         
         if (partitionPath) {
@@ -175,10 +165,11 @@ static NSSet *uniqueKeyPathsInRecords(NSArray *records, NSString *keyPath) {
             // realartists/shiphub-cocoa#243 State partition chart can be wrong if all matching issues are currently closed
             // Treat state partition specially as even though all the issues in timeSeries might be closed
             // right now, that wasn't always true, so be sure to check the full set of states.
-            if ([partitionPath isEqualToString:@"state"]) {
+            BOOL statePartition = [partitionPath isEqualToString:@"state"];
+            if (statePartition) {
                 partitionValues = [NSSet setWithObjects:@"open", @"closed", nil];
             } else {
-                partitionValues = uniqueKeyPathsInRecords(timeSeries.records, partitionPath);
+                partitionValues = [timeSeries.index valuesForKeyPath:partitionPath];
             }
             
             NSMutableArray *partitionedSeries = [NSMutableArray arrayWithCapacity:partitionValues.count];
@@ -187,7 +178,8 @@ static NSSet *uniqueKeyPathsInRecords(NSArray *records, NSString *keyPath) {
                 id val = partitionValue == [NSNull null] ? nil : partitionValue;
                 NSPredicate *partitionPredicate = [NSPredicate predicateWithFormat:@"%K = %@", partitionPath, val];
                 TimeSeries *ts = [[TimeSeries alloc] initWithPredicate:partitionPredicate startDate:timeSeries.startDate endDate:timeSeries.endDate];
-                [ts selectRecordsFrom:timeSeries.records];
+                // the state clause of partitionPredicate is applied by the time series itself
+                [ts selectRecordsFromIndex:statePartition ? timeSeries.index : [timeSeries.index indexOfIssuesWhereKeyPath:partitionPath equals:val]];
                 [ts generateIntervalsWithCalendarUnit:NSCalendarUnitDay];
                 [partitionedSeries addObject:ts];
                 
@@ -196,7 +188,7 @@ static NSSet *uniqueKeyPathsInRecords(NSArray *records, NSString *keyPath) {
                                               @"intervals" : [ts.intervals arrayByMappingObjects:^id(id obj) {
                     return @{ @"startDate" : @(dateToJSONTS([obj startDate])),
                               @"endDate" : @(dateToJSONTS([obj endDate])),
-                              @"count" : @([[obj records] count]) };}] ?: @[]
+                              @"count" : @([obj count]) };}] ?: @[]
                                               }];
             }
         }
@@ -0,0 +1,45 @@
+//
+//  CompiledIssuePredicate.h
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ CompiledIssuePredicate evaluates an NSPredicate against Issue objects without going through
+ NSExpression and KVC for each one.
+
+ The predicate is compiled once into a tree of blocks which read Issue properties directly.
+ The compiled subset is:
+   AND, OR, NOT, TRUEPREDICATE and FALSEPREDICATE
+   keyPath <op> constant (either way around), where op is one of =, !=, <, <=, >, >=, IN,
+     CONTAINS, BEGINSWITH or ENDSWITH, with [cd] options, and ANY / ALL on to-many key paths
+   count(toMany) or toMany.@count <op> constant
+ Key paths start with an Issue property. Dates and BOOLs on Issue itself (createdAt, closed, ...)
+ are compared without boxing. Key paths into repository, milestone, originator, closedBy,
+ assignee(s), labels and notification are read directly where known, and by KVC otherwise.
+
+ Anything else (SUBQUERY, LIKE, MATCHES, variables, block predicates, ...) is evaluated by
+ NSPredicate, a subpredicate at a time, so the result is always the same as the original's.
+ Objects that aren't Issues are evaluated entirely by the original predicate.
+
+ Functions of constants (e.g. FUNCTION(now(), ...)) are folded when compiling, so compile just
+ before filtering rather than holding on to the result.
+
+ CompiledIssuePredicate is immutable and thread safe.
+*/
+
+@interface CompiledIssuePredicate : NSPredicate
+
+// Returns predicate compiled for evaluation against Issues.
++ (CompiledIssuePredicate *)compiledPredicateWithPredicate:(NSPredicate *)predicate;
+
+@property (readonly) NSPredicate *originalPredicate;
+
+// YES if no part of originalPredicate needs to fall back to NSPredicate.
+@property (readonly, getter=isFullyCompiled) BOOL fullyCompiled;
+
+@end
@@ -0,0 +1,643 @@
+//
+//  CompiledIssuePredicate.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "CompiledIssuePredicate.h"
+
+#import "Account.h"
+#import "Extras.h"
+#import "Issue.h"
+#import "IssueNotification.h"
+#import "Label.h"
+#import "Milestone.h"
+#import "NSPredicate+Extras.h"
+#import "Repo.h"
+
+typedef BOOL (^IssueTest)(Issue *issue);
+typedef BOOL (^ValueTest)(id value);
+typedef id (^ValueStep)(id obj);
+
+// Relative costs, used to order the terms of an AND or OR so the cheap ones run first.
+static const NSInteger CostDirect = 1;
+static const NSInteger CostObject = 2;
+static const NSInteger CostToMany = 4;
+static const NSInteger CostKVC = 4;
+static const NSInteger CostFallback = 16;
+
+#pragma mark - Key Paths
+
+// A step from an object to one of its properties.
+@interface KeyStep : NSObject
+
+@property (copy) ValueStep step;
+@property (copy) NSString *resultClass; // nil if not known, in which case further steps use KVC
+
+@end
+
+@implementation KeyStep
+
++ (KeyStep *)step:(ValueStep)step resultClass:(NSString *)resultClass {
+    KeyStep *s = [KeyStep new];
+    s.step = step;
+    s.resultClass = resultClass;
+    return s;
+}
+
+@end
+
+// A key path relative to Issue.
+@interface CompiledKeyPath : NSObject
+
+// For to-one key paths, the value of the key path. For to-many, the related objects.
+@property (copy) id (^value)(Issue *issue);
+
+// For to-many key paths, maps a related object to the value of the rest of the key path. nil if there is no rest.
+@property (copy) ValueStep elementValue;
+
+// Set for dates and BOOLs on Issue itself, so they can be compared without boxing.
+@property (copy) NSTimeInterval (^date)(Issue *issue); // NAN if nil
+@property (copy) BOOL (^flag)(Issue *issue);
+
+@property (copy) NSString *resultClass;
+@property BOOL toMany;
+@property NSInteger cost;
+
+@end
+
+@implementation CompiledKeyPath
+
++ (CompiledKeyPath *)value:(id (^)(Issue *))value resultClass:(NSString *)resultClass {
+    CompiledKeyPath *kp = [CompiledKeyPath new];
+    kp.value = value;
+    kp.resultClass = resultClass;
+    kp.cost = CostObject;
+    return kp;
+}
+
++ (CompiledKeyPath *)toMany:(id (^)(Issue *))value resultClass:(NSString *)resultClass {
+    CompiledKeyPath *kp = [self value:value resultClass:resultClass];
+    kp.toMany = YES;
+    kp.cost = CostToMany;
+    return kp;
+}
+
++ (CompiledKeyPath *)date:(NSDate *(^)(Issue *))value {
+    CompiledKeyPath *kp = [self value:value resultClass:@"NSDate"];
+    kp.date = ^NSTimeInterval(Issue *i) {
+        NSDate *d = value(i);
+        return d ? d.timeIntervalSinceReferenceDate : NAN;
+    };
+    return kp;
+}
+
++ (CompiledKeyPath *)flag:(BOOL (^)(Issue *))flag {
+    CompiledKeyPath *kp = [self value:^id(Issue *i) { return flag(i) ? @YES : @NO; } resultClass:@"NSNumber"];
+    kp.flag = flag;
+    return kp;
+}
+
+@end
+
+static NSDictionary<NSString *, CompiledKeyPath *> *IssueKeyPaths() {
+    static dispatch_once_t onceToken;
+    static NSDictionary *roots;
+    dispatch_once(&onceToken, ^{
+        roots = @{ @"identifier" : [CompiledKeyPath value:^id(Issue *i) { return i.identifier; } resultClass:@"NSNumber"],
+                   @"number" : [CompiledKeyPath value:^id(Issue *i) { return i.number; } resultClass:@"NSNumber"],
+                   @"fullIdentifier" : [CompiledKeyPath value:^id(Issue *i) { return i.fullIdentifier; } resultClass:@"NSString"],
+                   @"title" : [CompiledKeyPath value:^id(Issue *i) { return i.title; } resultClass:@"NSString"],
+                   @"body" : [CompiledKeyPath value:^id(Issue *i) { return i.body; } resultClass:@"NSString"],
+                   @"state" : [CompiledKeyPath value:^id(Issue *i) { return i.state; } resultClass:@"NSString"],
+                   @"reactionsCount" : [CompiledKeyPath value:^id(Issue *i) { return @(i.reactionsCount); } resultClass:@"NSNumber"],
+                   @"upNextPriority" : [CompiledKeyPath value:^id(Issue *i) { return i.upNextPriority; } resultClass:@"NSNumber"],
+                   @"pullRequestIdentifier" : [CompiledKeyPath value:^id(Issue *i) { return i.pullRequestIdentifier; } resultClass:@"NSNumber"],
+                   @"merged" : [CompiledKeyPath value:^id(Issue *i) { return i.merged; } resultClass:@"NSNumber"],
+                   
+                   @"closed" : [CompiledKeyPath flag:^BOOL(Issue *i) { return i.closed; }],
+                   @"locked" : [CompiledKeyPath flag:^BOOL(Issue *i) { return i.locked; }],
+                   @"pullRequest" : [CompiledKeyPath flag:^BOOL(Issue *i) { return i.pullRequest; }],
+                   @"unread" : [CompiledKeyPath flag:^BOOL(Issue *i) { return i.unread; }],
+                   
+                   @"createdAt" : [CompiledKeyPath date:^NSDate *(Issue *i) { return i.createdAt; }],
+                   @"updatedAt" : [CompiledKeyPath date:^NSDate *(Issue *i) { return i.updatedAt; }],
+                   @"closedAt" : [CompiledKeyPath date:^NSDate *(Issue *i) { return i.closedAt; }],
+                   @"mergedAt" : [CompiledKeyPath date:^NSDate *(Issue *i) { return i.mergedAt; }],
+                   
+                   @"assignee" : [CompiledKeyPath value:^id(Issue *i) { return i.assignee; } resultClass:@"Account"],
+                   @"originator" : [CompiledKeyPath value:^id(Issue *i) { return i.originator; } resultClass:@"Account"],
+                   @"closedBy" : [CompiledKeyPath value:^id(Issue *i) { return i.closedBy; } resultClass:@"Account"],
+                   @"mergedBy" : [CompiledKeyPath value:^id(Issue *i) { return i.mergedBy; } resultClass:@"Account"],
+                   @"repository" : [CompiledKeyPath value:^id(Issue *i) { return i.repository; } resultClass:@"Repo"],
+                   @"milestone" : [CompiledKeyPath value:^id(Issue *i) { return i.milestone; } resultClass:@"Milestone"],
+                   @"notification" : [CompiledKeyPath value:^id(Issue *i) { return i.notification; } resultClass:@"IssueNotification"],
+                   
+                   @"assignees" : [CompiledKeyPath toMany:^id(Issue *i) { return i.assignees; } resultClass:@"Account"],
+                   @"labels" : [CompiledKeyPath toMany:^id(Issue *i) { return i.labels; } resultClass:@"Label"] };
+    });
+    return roots;
+}
+
+// Keyed by class name and property, e.g. Account.login
+static NSDictionary<NSString *, KeyStep *> *MemberSteps() {
+    static dispatch_once_t onceToken;
+    static NSDictionary *steps;
+    dispatch_once(&onceToken, ^{
+        steps = @{ @"Account.identifier" : [KeyStep step:^id(Account *a) { return a.identifier; } resultClass:@"NSNumber"],
+                   @"Account.login" : [KeyStep step:^id(Account *a) { return a.login; } resultClass:@"NSString"],
+                   @"Account.name" : [KeyStep step:^id(Account *a) { return a.name; } resultClass:@"NSString"],
+                   
+                   @"Repo.identifier" : [KeyStep step:^id(Repo *r) { return r.identifier; } resultClass:@"NSNumber"],
+                   @"Repo.fullName" : [KeyStep step:^id(Repo *r) { return r.fullName; } resultClass:@"NSString"],
+                   @"Repo.name" : [KeyStep step:^id(Repo *r) { return r.name; } resultClass:@"NSString"],
+                   @"Repo.owner" : [KeyStep step:^id(Repo *r) { return r.owner; } resultClass:@"Account"],
+                   @"Repo.canPush" : [KeyStep step:^id(Repo *r) { return r ? (r.canPush ? @YES : @NO) : nil; } resultClass:@"NSNumber"],
+                   
+                   @"Milestone.identifier" : [KeyStep step:^id(Milestone *m) { return m.identifier; } resultClass:@"NSNumber"],
+                   @"Milestone.title" : [KeyStep step:^id(Milestone *m) { return m.title; } resultClass:@"NSString"],
+                   @"Milestone.number" : [KeyStep step:^id(Milestone *m) { return m.number; } resultClass:@"NSNumber"],
+                   
+                   @"Label.name" : [KeyStep step:^id(Label *l) { return l.name; } resultClass:@"NSString"],
+                   
+                   @"IssueNotification.identifier" : [KeyStep step:^id(IssueNotification *n) { return n.identifier; } resultClass:@"NSNumber"],
+                   @"IssueNotification.reason" : [KeyStep step:^id(IssueNotification *n) { return n.reason; } resultClass:@"NSString"],
+                   @"IssueNotification.unread" : [KeyStep step:^id(IssueNotification *n) { return n ? (n.unread ? @YES : @NO) : nil; } resultClass:@"NSNumber"] };
+    });
+    return steps;
+}
+
+static ValueStep ComposeSteps(NSArray<ValueStep> *steps) {
+    if (steps.count == 1) return steps[0];
+    return ^id(id obj) {
+        for (ValueStep step in steps) {
+            obj = step(obj);
+            if (!obj) break;
+        }
+        return obj;
+    };
+}
+
+// Returns nil if keyPath can't be compiled.
+static CompiledKeyPath *CompileKeyPath(NSString *keyPath) {
+    NSArray *components = [keyPath componentsSeparatedByString:@"."];
+    CompiledKeyPath *root = IssueKeyPaths()[components[0]];
+    if (!root) return nil;
+    if (components.count == 1) return root;
+    
+    if (root.toMany && components.count == 2 && [components[1] isEqualToString:@"@count"]) {
+        id (^elements)(Issue *) = root.value;
+        return [CompiledKeyPath value:^id(Issue *i) { return @([elements(i) count]); } resultClass:@"NSNumber"];
+    }
+    
+    NSMutableArray *steps = [NSMutableArray new];
+    NSString *resultClass = root.resultClass;
+    NSInteger cost = root.cost;
+    for (NSString *key in [components subarrayWithRange:NSMakeRange(1, components.count - 1)]) {
+        if ([key hasPrefix:@"@"]) return nil; // leave collection operators to NSPredicate
+        
+        KeyStep *member = resultClass ? MemberSteps()[[NSString stringWithFormat:@"%@.%@", resultClass, key]] : nil;
+        if (member) {
+            [steps addObject:member.step];
+            resultClass = member.resultClass;
+        } else {
+            [steps addObject:^id(id obj) { return [obj valueForKey:key]; }];
+            resultClass = nil;
+            cost += CostKVC;
+        }
+    }
+    
+    ValueStep rest = ComposeSteps(steps);
+    CompiledKeyPath *kp = [CompiledKeyPath new];
+    kp.resultClass = resultClass;
+    kp.cost = cost;
+    if (root.toMany) {
+        kp.toMany = YES;
+        kp.value = root.value;
+        kp.elementValue = rest;
+    } else {
+        id (^first)(Issue *) = root.value;
+        kp.value = ^id(Issue *i) { return rest(first(i)); };
+    }
+    return kp;
+}
+
+// count(toMany)
+static CompiledKeyPath *CompileCountFunction(NSExpression *expr) {
+    if (![expr.function isEqualToString:@"count:"] || expr.arguments.count != 1) return nil;
+    NSExpression *arg = expr.arguments[0];
+    if (arg.expressionType != NSKeyPathExpressionType) return nil;
+    CompiledKeyPath *kp = CompileKeyPath(arg.keyPath);
+    if (!kp.toMany || kp.elementValue) return nil;
+    id (^elements)(Issue *) = kp.value;
+    return [CompiledKeyPath value:^id(Issue *i) { return @([elements(i) count]); } resultClass:@"NSNumber"];
+}
+
+#pragma mark - Values
+
+static NSStringCompareOptions StringCompareOptions(NSComparisonPredicateOptions options) {
+    NSStringCompareOptions opts = 0;
+    if (options & NSCaseInsensitivePredicateOption) opts |= NSCaseInsensitiveSearch;
+    if (options & NSDiacriticInsensitivePredicateOption) opts |= NSDiacriticInsensitiveSearch;
+    return opts;
+}
+
+// The class whose instances can be ordered against constant without NSPredicate's help.
+static Class OrderedClass(id constant) {
+    for (Class c in @[[NSString class], [NSNumber class], [NSDate class]]) {
+        if ([constant isKindOfClass:c]) return c;
+    }
+    return Nil;
+}
+
+// Returns a test of a value against constant, or nil if the comparison isn't supported.
+// Values the test doesn't expect are handed to an equivalent NSPredicate on the value itself.
+static ValueTest CompileValueTest(NSPredicateOperatorType op, NSComparisonPredicateOptions options, id constant) {
+    if (options & ~(NSCaseInsensitivePredicateOption|NSDiacriticInsensitivePredicateOption)) return nil;
+    
+    if (constant == [NSNull null]) constant = nil;
+    NSStringCompareOptions stringOptions = StringCompareOptions(options);
+    NSNull *null = [NSNull null];
+    
+    NSPredicate *valuePredicate = [NSComparisonPredicate predicateWithLeftExpression:[NSExpression expressionForEvaluatedObject] rightExpression:[NSExpression expressionForConstantValue:constant] modifier:NSDirectPredicateModifier type:op options:options];
+    ValueTest fallback = ^BOOL(id value) {
+        return [valuePredicate evaluateWithObject:value];
+    };
+    
+    switch (op) {
+        case NSEqualToPredicateOperatorType:
+        case NSNotEqualToPredicateOperatorType: {
+            BOOL negate = op == NSNotEqualToPredicateOperatorType;
+            if (!constant) {
+                return ^BOOL(id value) {
+                    return (value == nil || value == null) != negate;
+                };
+            } else if (stringOptions && [constant isKindOfClass:[NSString class]]) {
+                return ^BOOL(id value) {
+                    if (![value isKindOfClass:[NSString class]]) return fallback(value);
+                    return ([value compare:constant options:stringOptions] == NSOrderedSame) != negate;
+                };
+            } else {
+                return ^BOOL(id value) {
+                    if (value == null) value = nil;
+                    return [constant isEqual:value] != negate;
+                };
+            }
+        }
+        case NSLessThanPredicateOperatorType:
+        case NSLessThanOrEqualToPredicateOperatorType:
+        case NSGreaterThanPredicateOperatorType:
+        case NSGreaterThanOrEqualToPredicateOperatorType: {
+            Class cls = OrderedClass(constant);
+            if (!cls) return nil;
+            BOOL isString = cls == [NSString class];
+            return ^BOOL(id value) {
+                if (![value isKindOfClass:cls]) return fallback(value);
+                NSComparisonResult r = isString ? [value compare:constant options:stringOptions] : [value compare:constant];
+                switch (op) {
+                    case NSLessThanPredicateOperatorType: return r == NSOrderedAscending;
+                    case NSLessThanOrEqualToPredicateOperatorType: return r != NSOrderedDescending;
+                    case NSGreaterThanPredicateOperatorType: return r == NSOrderedDescending;
+                    default: return r != NSOrderedAscending;
+                }
+            };
+        }
+        case NSInPredicateOperatorType: {
+            NSArray *members = nil;
+            if ([constant isKindOfClass:[NSArray class]]) {
+                members = constant;
+            } else if ([constant isKindOfClass:[NSSet class]]) {
+                members = [constant allObjects];
+            } else if ([constant isKindOfClass:[NSOrderedSet class]]) {
+                members = [constant array];
+            } else {
+                return nil;
+            }
+            
+            if (stringOptions) {
+                return ^BOOL(id value) {
+                    if (![value isKindOfClass:[NSString class]]) return fallback(value);
+                    for (id member in members) {
+                        if ([member isKindOfClass:[NSString class]] && [value compare:member options:stringOptions] == NSOrderedSame) {
+                            return YES;
+                        }
+                    }
+                    return NO;
+                };
+            } else {
+                NSSet *set = [NSSet setWithArray:members];
+                return ^BOOL(id value) {
+                    if (value == nil || value == null || [value isKindOfClass:[NSArray class]] || [value isKindOfClass:[NSSet class]]) return fallback(value);
+                    return [set containsObject:value];
+                };
+            }
+        }
+        case NSContainsPredicateOperatorType:
+        case NSBeginsWithPredicateOperatorType:
+        case NSEndsWithPredicateOperatorType: {
+            if (![constant isKindOfClass:[NSString class]] || [constant length] == 0) return nil;
+            NSStringCompareOptions searchOptions = stringOptions;
+            if (op == NSBeginsWithPredicateOperatorType) searchOptions |= NSAnchoredSearch;
+            if (op == NSEndsWithPredicateOperatorType) searchOptions |= NSAnchoredSearch|NSBackwardsSearch;
+            return ^BOOL(id value) {
+                if (![value isKindOfClass:[NSString class]]) return fallback(value);
+                return [value rangeOfString:constant options:searchOptions].location != NSNotFound;
+            };
+        }
+        default:
+            return nil;
+    }
+}
+
+// Comparisons of a date or BOOL on Issue itself that can skip boxing, or nil.
+static IssueTest CompileDirectTest(CompiledKeyPath *kp, NSPredicateOperatorType op, NSComparisonPredicateOptions options, id constant) {
+    if (options) return nil;
+    if (constant == [NSNull null]) constant = nil;
+    
+    if (kp.date && (!constant || [constant isKindOfClass:[NSDate class]])) {
+        NSTimeInterval (^date)(Issue *) = kp.date;
+        if (!constant) {
+            if (op == NSEqualToPredicateOperatorType) return ^BOOL(Issue *i) { return isnan(date(i)); };
+            if (op == NSNotEqualToPredicateOperatorType) return ^BOOL(Issue *i) { return !isnan(date(i)); };
+            return nil;
+        }
+        NSTimeInterval t = [constant timeIntervalSinceReferenceDate];
+        // Comparisons with NAN are false, which is what NSPredicate gives for nil
+        switch (op) {
+            case NSEqualToPredicateOperatorType: return ^BOOL(Issue *i) { return date(i) == t; };
+            case NSNotEqualToPredicateOperatorType: return ^BOOL(Issue *i) { return !(date(i) == t); };
+            case NSLessThanPredicateOperatorType: return ^BOOL(Issue *i) { return date(i) < t; };
+            case NSLessThanOrEqualToPredicateOperatorType: return ^BOOL(Issue *i) { return date(i) <= t; };
+            case NSGreaterThanPredicateOperatorType: return ^BOOL(Issue *i) { return date(i) > t; };
+            case NSGreaterThanOrEqualToPredicateOperatorType: return ^BOOL(Issue *i) { return date(i) >= t; };
+            default: return nil;
+        }
+    }
+    
+    if (kp.flag && (op == NSEqualToPredicateOperatorType || op == NSNotEqualToPredicateOperatorType)
+        && ([constant isEqual:@YES] || [constant isEqual:@NO]))
+    {
+        BOOL (^flag)(Issue *) = kp.flag;
+        BOOL expected = [constant boolValue] == (op == NSEqualToPredicateOperatorType);
+        return ^BOOL(Issue *i) { return flag(i) == expected; };
+    }
+    
+    return nil;
+}
+
+#pragma mark - Compiler
+
+@interface IssuePredicateCompiler : NSObject
+
+@property BOOL fullyCompiled;
+
+@end
+
+@implementation IssuePredicateCompiler
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _fullyCompiled = YES;
+    }
+    return self;
+}
+
+- (IssueTest)fallbackForPredicate:(NSPredicate *)predicate cost:(NSInteger *)cost {
+    _fullyCompiled = NO;
+    *cost = CostFallback;
+    return ^BOOL(Issue *i) {
+        return [predicate evaluateWithObject:i];
+    };
+}
+
+static NSPredicateOperatorType ReversedOperator(NSPredicateOperatorType op, BOOL *ok) {
+    *ok = YES;
+    switch (op) {
+        case NSEqualToPredicateOperatorType:
+        case NSNotEqualToPredicateOperatorType:
+            return op;
+        case NSLessThanPredicateOperatorType: return NSGreaterThanPredicateOperatorType;
+        case NSLessThanOrEqualToPredicateOperatorType: return NSGreaterThanOrEqualToPredicateOperatorType;
+        case NSGreaterThanPredicateOperatorType: return NSLessThanPredicateOperatorType;
+        case NSGreaterThanOrEqualToPredicateOperatorType: return NSLessThanOrEqualToPredicateOperatorType;
+        default:
+            *ok = NO;
+            return op;
+    }
+}
+
+- (CompiledKeyPath *)keyPathForExpression:(NSExpression *)expr {
+    switch (expr.expressionType) {
+        case NSKeyPathExpressionType: return CompileKeyPath(expr.keyPath);
+        case NSFunctionExpressionType: return CompileCountFunction(expr);
+        default: return nil;
+    }
+}
+
+- (IssueTest)compileComparison:(NSComparisonPredicate *)c cost:(NSInteger *)cost {
+    if (c.predicateOperatorType == NSCustomSelectorPredicateOperatorType) return nil;
+    
+    NSExpression *lhs = c.leftExpression;
+    NSExpression *rhs = c.rightExpression;
+    NSPredicateOperatorType op = c.predicateOperatorType;
+    
+    CompiledKeyPath *kp = nil;
+    id constant = nil;
+    if (rhs.expressionType == NSConstantValueExpressionType && (kp = [self keyPathForExpression:lhs])) {
+        constant = rhs.constantValue;
+    } else if (lhs.expressionType == NSConstantValueExpressionType && (kp = [self keyPathForExpression:rhs])) {
+        BOOL ok;
+        op = ReversedOperator(op, &ok);
+        if (!ok) return nil;
+        constant = lhs.constantValue;
+    } else {
+        return nil;
+    }
+    
+    NSComparisonPredicateModifier modifier = c.comparisonPredicateModifier;
+    if (modifier == NSDirectPredicateModifier && !kp.toMany) {
+        IssueTest direct = CompileDirectTest(kp, op, c.options, constant);
+        if (direct) {
+            *cost = CostDirect;
+            return direct;
+        }
+    }
+    
+    ValueTest test = CompileValueTest(op, c.options, constant);
+    if (!test) return nil;
+    
+    *cost = kp.cost;
+    id (^value)(Issue *) = kp.value;
+    
+    if (modifier == NSDirectPredicateModifier) {
+        if (kp.toMany) return nil;
+        return ^BOOL(Issue *i) {
+            return test(value(i));
+        };
+    }
+    
+    if (!kp.toMany) return nil;
+    
+    ValueStep elementValue = kp.elementValue;
+    NSNull *null = [NSNull null];
+    if (modifier == NSAnyPredicateModifier) {
+        return ^BOOL(Issue *i) {
+            for (id element in value(i)) {
+                id v = elementValue ? (elementValue(element) ?: null) : element;
+                if (test(v)) return YES;
+            }
+            return NO;
+        };
+    } else /* NSAllPredicateModifier */ {
+        return ^BOOL(Issue *i) {
+            for (id element in value(i)) {
+                id v = elementValue ? (elementValue(element) ?: null) : element;
+                if (!test(v)) return NO;
+            }
+            return YES;
+        };
+    }
+}
+
+- (IssueTest)compileCompound:(NSCompoundPredicate *)c cost:(NSInteger *)cost {
+    NSCompoundPredicateType type = c.compoundPredicateType;
+    
+    if (type == NSNotPredicateType) {
+        if (c.subpredicates.count != 1) return nil;
+        IssueTest sub = [self compile:c.subpredicates[0] cost:cost];
+        return ^BOOL(Issue *i) {
+            return !sub(i);
+        };
+    }
+    
+    // Terms have no side effects, so run the cheapest first.
+    NSMutableArray *terms = [NSMutableArray new];
+    NSInteger total = 0;
+    for (NSPredicate *sub in c.subpredicates) {
+        NSInteger subCost = 0;
+        IssueTest test = [self compile:sub cost:&subCost];
+        [terms addObject:@[@(subCost), test]];
+        total += subCost;
+    }
+    [terms sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSArray *a, NSArray *b) {
+        return [a[0] compare:b[0]];
+    }];
+    NSArray<IssueTest> *tests = [terms arrayByMappingObjects:^id(NSArray *term) {
+        return term[1];
+    }];
+    *cost = total;
+    
+    if (type == NSAndPredicateType) {
+        if (tests.count == 2) {
+            IssueTest a = tests[0], b = tests[1];
+            return ^BOOL(Issue *i) { return a(i) && b(i); };
+        }
+        return ^BOOL(Issue *i) {
+            for (IssueTest test in tests) {
+                if (!test(i)) return NO;
+            }
+            return YES;
+        };
+    } else {
+        if (tests.count == 2) {
+            IssueTest a = tests[0], b = tests[1];
+            return ^BOOL(Issue *i) { return a(i) || b(i); };
+        }
+        return ^BOOL(Issue *i) {
+            for (IssueTest test in tests) {
+                if (test(i)) return YES;
+            }
+            return NO;
+        };
+    }
+}
+
+- (IssueTest)compile:(NSPredicate *)predicate cost:(NSInteger *)cost {
+    IssueTest test = nil;
+    *cost = CostDirect;
+    
+    if ([predicate isEqual:[NSPredicate predicateWithValue:YES]]) {
+        test = ^BOOL(Issue *i) { return YES; };
+    } else if ([predicate isEqual:[NSPredicate predicateWithValue:NO]]) {
+        test = ^BOOL(Issue *i) { return NO; };
+    } else if ([predicate isKindOfClass:[NSCompoundPredicate class]]) {
+        test = [self compileCompound:(id)predicate cost:cost];
+    } else if ([predicate isKindOfClass:[NSComparisonPredicate class]]) {
+        test = [self compileComparison:(id)predicate cost:cost];
+    }
+    
+    return test ?: [self fallbackForPredicate:predicate cost:cost];
+}
+
+@end
+
+#pragma mark -
+
+@implementation CompiledIssuePredicate {
+    IssueTest _test;
+}
+
++ (CompiledIssuePredicate *)compiledPredicateWithPredicate:(NSPredicate *)predicate {
+    NSParameterAssert(predicate);
+    
+    if ([predicate isKindOfClass:[CompiledIssuePredicate class]]) {
+        return (id)predicate;
+    }
+    
+    return [[self alloc] initWithPredicate:predicate];
+}
+
+- (instancetype)initWithPredicate:(NSPredicate *)predicate {
+    if (self = [super init]) {
+        _originalPredicate = predicate;
+        
+        IssuePredicateCompiler *compiler = [IssuePredicateCompiler new];
+        NSInteger cost = 0;
+        NSPredicate *folded = predicate;
+        @try {
+            folded = [predicate predicateByFoldingExpressions];
+        } @catch (id exc) {
+            ErrLog(@"Unable to fold %@: %@", predicate, exc);
+        }
+        _test = [compiler compile:folded cost:&cost];
+        _fullyCompiled = compiler.fullyCompiled;
+    }
+    return self;
+}
+
+- (BOOL)evaluateWithObject:(id)object {
+    return [self evaluateWithObject:object substitutionVariables:nil];
+}
+
+- (BOOL)evaluateWithObject:(id)object substitutionVariables:(NSDictionary<NSString *,id> *)bindings {
+    static Class issueClass;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        issueClass = [Issue class];
+    });
+    
+    if (bindings.count == 0 && [object isKindOfClass:issueClass]) {
+        return _test(object);
+    }
+    return [_originalPredicate evaluateWithObject:object substitutionVariables:bindings];
+}
+
+- (NSPredicate *)predicateWithSubstitutionVariables:(NSDictionary<NSString *,id> *)variables {
+    return [_originalPredicate predicateWithSubstitutionVariables:variables];
+}
+
+- (NSString *)predicateFormat {
+    return [_originalPredicate predicateFormat];
+}
+
+- (NSString *)description {
+    return [_originalPredicate description];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+@end
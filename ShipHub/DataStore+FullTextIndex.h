@@ -0,0 +1,35 @@
+//
+//  DataStore+FullTextIndex.h
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "DataStore.h"
+
+@interface DataStore (FullTextIndex)
+
+// Returns the identifiers of issues whose title, body or comments contain every word of query,
+// best match first, as described in FullTextIndex.h. The results can be used in an issue predicate
+// (identifier IN results) alongside anything else.
+// Returns nil if the index isn't built yet, in which case callers should fall back to CONTAINS.
+- (NSArray<NSNumber *> *)issueIdentifiersMatchingText:(NSString *)query;
+
+@end
+
+// Posted on the main queue once the index is built, and each time saved changes have been applied to it.
+// Results from issueIdentifiersMatchingText: taken before then may be out of date.
+extern NSString *const DataStoreDidUpdateFullTextIndexNotification;
+
+@interface DataStore (FullTextIndexInternal)
+
+// Builds the index from scratch in a background read, replacing any existing index once done.
+- (void)rebuildFullTextIndex;
+
+// Called by DataStore on its write context's queue
+- (void)updateFullTextIndexWithChange:(NSNotification *)note;
+- (void)commitFullTextIndexChanges;
+- (void)discardFullTextIndexChanges; // the unsaved changes were rolled back
+
+@end
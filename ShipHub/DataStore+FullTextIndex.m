@@ -0,0 +1,257 @@
+//
+//  DataStore+FullTextIndex.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "DataStore+FullTextIndex.h"
+
+#import "DataStoreInternal.h"
+#import "Extras.h"
+#import "FullTextIndex.h"
+#import "LocalComment.h"
+#import "LocalIssue.h"
+
+#import <objc/runtime.h>
+
+NSString *const DataStoreDidUpdateFullTextIndexNotification = @"DataStoreDidUpdateFullTextIndexNotification";
+
+static const NSUInteger FullTextIndexBuildBatchSize = 1000;
+
+typedef void (^FullTextIndexUpdate)(FullTextIndex *index);
+
+@interface FullTextIndexState : NSObject
+
+@property (readonly) dispatch_queue_t q; // serializes updates to the index and building it
+
+@property (atomic) FullTextIndex *index; // nil until first built
+
+// Only accessed on q
+@property BOOL building;
+@property BOOL needsRebuild; // another rebuild was requested while building
+@property NSMutableArray<FullTextIndexUpdate> *buildUpdates; // saved while building, replayed onto the new index once built
+
+// Only accessed on the write context's queue
+@property (readonly) NSMutableArray<FullTextIndexUpdate> *unsaved;
+
+@end
+
+@implementation FullTextIndexState
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _q = dispatch_queue_create("DataStore.FullTextIndex", NULL);
+        _unsaved = [NSMutableArray new];
+    }
+    return self;
+}
+
+@end
+
+@implementation DataStore (FullTextIndex)
+
+static const void *FullTextIndexStateKey = &FullTextIndexStateKey;
+
+- (FullTextIndexState *)fullTextIndexState {
+    @synchronized (self) {
+        FullTextIndexState *state = objc_getAssociatedObject(self, FullTextIndexStateKey);
+        if (!state) {
+            state = [FullTextIndexState new];
+            objc_setAssociatedObject(self, FullTextIndexStateKey, state, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+        }
+        return state;
+    }
+}
+
+- (NSArray<NSNumber *> *)issueIdentifiersMatchingText:(NSString *)query {
+    FullTextIndex *index = self.fullTextIndexState.index;
+    return index ? [index issueIdentifiersMatchingQuery:query] : nil;
+}
+
+#pragma mark - Building
+
+// Fetches properties of the first batch of entityName after identifier after (or the first batch, if after is nil), as dictionaries.
+static NSArray<NSDictionary *> *FetchBatch(NSManagedObjectContext *moc, NSString *entityName, NSArray *properties, NSNumber *after) {
+    NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:entityName];
+    fetch.resultType = NSDictionaryResultType;
+    fetch.propertiesToFetch = properties;
+    fetch.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"identifier" ascending:YES]];
+    fetch.fetchLimit = FullTextIndexBuildBatchSize;
+    if (after) {
+        fetch.predicate = [NSPredicate predicateWithFormat:@"identifier > %@", after];
+    }
+    
+    NSError *err = nil;
+    NSArray<NSDictionary *> *rows = [moc executeFetchRequest:fetch error:&err];
+    if (err) {
+        ErrLog(@"%@", err);
+    }
+    return rows;
+}
+
+// Calls block with every entityName, a batch at a time in order of identifier, so that building the index doesn't need
+// every body in memory at once. Each batch is a separate read, and is indexed after its read is done, so a build never
+// holds a read context (and with it, every write and read queued behind it) for longer than one fetch.
+// Saves that land between batches are covered by buildUpdates.
+- (void)fetchBatchesOfEntity:(NSString *)entityName properties:(NSArray *)properties after:(NSNumber *)after block:(void (^)(NSDictionary *row))block completion:(dispatch_block_t)completion
+{
+    [self performRead:^(NSManagedObjectContext *moc) {
+        NSArray<NSDictionary *> *rows = FetchBatch(moc, entityName, properties, after);
+        
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            @autoreleasepool {
+                for (NSDictionary *row in rows) {
+                    block(row);
+                }
+            }
+            
+            NSNumber *last = [rows lastObject][@"identifier"];
+            if (last != nil && rows.count == FullTextIndexBuildBatchSize) {
+                [self fetchBatchesOfEntity:entityName properties:properties after:last block:block completion:completion];
+            } else {
+                completion();
+            }
+        });
+    }];
+}
+
+- (void)rebuildFullTextIndex {
+    FullTextIndexState *state = self.fullTextIndexState;
+    dispatch_async(state.q, ^{
+        if (state.building) {
+            state.needsRebuild = YES;
+            return;
+        }
+        
+        // Anything saved from here on is replayed onto the new index, as the reads below may or may not see it.
+        state.building = YES;
+        state.buildUpdates = [NSMutableArray new];
+        
+        double start = [NSDate extras_monotonicTime];
+        FullTextIndex *index = [FullTextIndex new];
+        
+        [self fetchBatchesOfEntity:@"LocalIssue" properties:@[@"identifier", @"title", @"body"] after:nil block:^(NSDictionary *row) {
+            [index setTitle:row[@"title"] body:row[@"body"] forIssue:row[@"identifier"]];
+        } completion:^{
+            [self fetchBatchesOfEntity:@"LocalComment" properties:@[@"identifier", @"body", @"issue.identifier"] after:nil block:^(NSDictionary *row) {
+                [index setBody:row[@"body"] forComment:row[@"identifier"] issue:row[@"issue.identifier"]];
+            } completion:^{
+                [index compact];
+                
+                DebugLog(@"Indexed %tu issues (%tu terms) in %.0fms", index.issueCount, index.termCount, ([NSDate extras_monotonicTime] - start) * 1000.0);
+                
+                dispatch_async(state.q, ^{
+                    for (FullTextIndexUpdate update in state.buildUpdates) {
+                        update(index);
+                    }
+                    state.buildUpdates = nil;
+                    state.index = index;
+                    state.building = NO;
+                    [self postNotification:DataStoreDidUpdateFullTextIndexNotification userInfo:nil];
+                    
+                    if (state.needsRebuild) {
+                        state.needsRebuild = NO;
+                        [self rebuildFullTextIndex];
+                    }
+                });
+            }];
+        }];
+    });
+}
+
+#pragma mark - Maintenance
+
+static FullTextIndexUpdate IssueUpdate(LocalIssue *issue, CoreDataModificationType modType) {
+    NSNumber *identifier = issue.identifier;
+    if (!identifier) return nil;
+    
+    if (modType == CoreDataModificationTypeDeleted) {
+        return ^(FullTextIndex *index) {
+            [index removeIssue:identifier];
+        };
+    }
+    
+    if (modType == CoreDataModificationTypeUpdated) {
+        NSDictionary *changed = issue.changedValuesForCurrentEvent;
+        if (!changed[@"title"] && !changed[@"body"]) return nil;
+    }
+    
+    NSString *title = [issue.title copy];
+    NSString *body = [issue.body copy];
+    return ^(FullTextIndex *index) {
+        [index setTitle:title body:body forIssue:identifier];
+    };
+}
+
+static FullTextIndexUpdate CommentUpdate(LocalComment *comment, CoreDataModificationType modType) {
+    NSNumber *identifier = comment.identifier;
+    if (!identifier) return nil;
+    
+    if (modType == CoreDataModificationTypeDeleted) {
+        return ^(FullTextIndex *index) {
+            [index removeComment:identifier];
+        };
+    }
+    
+    if (modType == CoreDataModificationTypeUpdated) {
+        NSDictionary *changed = comment.changedValuesForCurrentEvent;
+        if (!changed[@"body"] && !changed[@"issue"]) return nil;
+    }
+    
+    NSString *body = [comment.body copy];
+    NSNumber *issueIdentifier = comment.issue.identifier;
+    return ^(FullTextIndex *index) {
+        [index setBody:body forComment:identifier issue:issueIdentifier];
+    };
+}
+
+- (void)updateFullTextIndexWithChange:(NSNotification *)note {
+    FullTextIndexState *state = self.fullTextIndexState;
+    
+    if (note.userInfo[NSInvalidatedAllObjectsKey]) {
+        [state.unsaved removeAllObjects];
+        return;
+    }
+    
+    // Capture text now, while it's still readable from deleted objects, but only apply it once saved.
+    NSMutableArray *unsaved = state.unsaved;
+    [note enumerateModifiedObjects:^(id obj, CoreDataModificationType modType, BOOL *stop) {
+        FullTextIndexUpdate update = nil;
+        if ([obj isKindOfClass:[LocalIssue class]]) {
+            update = IssueUpdate(obj, modType);
+        } else if ([obj isKindOfClass:[LocalComment class]]) {
+            update = CommentUpdate(obj, modType);
+        }
+        if (update) {
+            [unsaved addObject:update];
+        }
+    }];
+}
+
+- (void)commitFullTextIndexChanges {
+    FullTextIndexState *state = self.fullTextIndexState;
+    if (state.unsaved.count == 0) return;
+    
+    NSArray<FullTextIndexUpdate> *updates = [state.unsaved copy];
+    [state.unsaved removeAllObjects];
+    
+    // Applied off the write queue, in the order saved.
+    dispatch_async(state.q, ^{
+        [state.buildUpdates addObjectsFromArray:updates];
+        FullTextIndex *index = state.index;
+        if (index) {
+            for (FullTextIndexUpdate update in updates) {
+                update(index);
+            }
+            [self postNotification:DataStoreDidUpdateFullTextIndexNotification userInfo:nil];
+        }
+    });
+}
+
+- (void)discardFullTextIndexChanges {
+    [self.fullTextIndexState.unsaved removeAllObjects];
+}
+
+@end
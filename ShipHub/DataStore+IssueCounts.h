@@ -0,0 +1,54 @@
+//
+//  DataStore+IssueCounts.h
+//  ShipHub
+//
+//  Created by James Howard on 3/11/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "DataStore.h"
+
+@interface IssueCounts : NSObject
+
+@property (readonly) NSInteger open;
+@property (readonly) NSInteger closed;
+@property (readonly) NSInteger total;
+
+// closed / total, or -1 if no issues match
+@property (readonly) double progress;
+
+@end
+
+@interface DataStore (IssueCounts)
+
+// Counts the open and closed issues matching each of predicates, in a single read.
+// Predicates that only constrain repository.identifier, milestone.identifier, milestone = nil
+// and closed (and conjunctions thereof) are all answered from one query grouped by repo, milestone
+// and state. Any others are counted individually within the same read.
+// counts is in the same order as predicates.
+- (void)issueCountsMatchingPredicates:(NSArray<NSPredicate *> *)predicates completion:(void (^)(NSArray<IssueCounts *> *counts, NSError *error))completion;
+
+// Maintains counts for predicates, which are keyed however the caller likes, replacing any previously set.
+// All of the counts are posted in a DataStoreDidUpdateIssueCountsNotification once they've been counted.
+// After that, predicates of the form described above are kept up to date incrementally, from the issues
+// changed by each save, and only the counts that change are posted. Any other predicates are recounted
+// after saves that may affect them.
+// Returns the generation posted with the counts for these predicates. Counts for predicates set before
+// may still be posted after this returns, and can be told apart by their generation.
+- (int64_t)setCountedPredicates:(NSDictionary<id<NSCopying>, NSPredicate *> *)predicates;
+
+@end
+
+extern NSString *const DataStoreDidUpdateIssueCountsNotification;
+extern NSString *const DataStoreIssueCountsKey; // => NSDictionary of key => IssueCounts, for the counts that changed
+extern NSString *const DataStoreIssueCountDeltasKey; // => NSDictionary of key => IssueCounts, the change in each (may be negative). Absent if recounted.
+extern NSString *const DataStoreIssueCountsGenerationKey; // => NSNumber, as returned by the setCountedPredicates: call the counts are for
+
+@interface DataStore (IssueCountsInternal)
+
+// Called by DataStore on its write context's queue
+- (void)updateIssueCountsWithChange:(NSNotification *)note;
+- (void)commitIssueCountChanges;
+- (void)discardIssueCountChanges; // the unsaved changes were rolled back
+
+@end
@@ -0,0 +1,661 @@
+//
+//  DataStore+IssueCounts.m
+//  ShipHub
+//
+//  Created by James Howard on 3/11/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "DataStore+IssueCounts.h"
+
+#import "DataStoreInternal.h"
+#import "DataStore+IssuesPredicate.h"
+#import "Error.h"
+#import "Extras.h"
+#import "LocalBilling.h"
+#import "LocalHidden.h"
+#import "LocalIssue.h"
+#import "LocalMilestone.h"
+#import "LocalRepo.h"
+
+#import <libkern/OSAtomic.h>
+#import <objc/runtime.h>
+
+NSString *const DataStoreDidUpdateIssueCountsNotification = @"DataStoreDidUpdateIssueCountsNotification";
+NSString *const DataStoreIssueCountsKey = @"DataStoreIssueCounts";
+NSString *const DataStoreIssueCountDeltasKey = @"DataStoreIssueCountDeltas";
+NSString *const DataStoreIssueCountsGenerationKey = @"DataStoreIssueCountsGeneration";
+
+static NSString *const GroupRepoKey = @"repository.identifier";
+static NSString *const GroupMilestoneKey = @"milestone.identifier";
+static NSString *const GroupClosedKey = @"closed";
+static NSString *const GroupCountKey = @"count";
+
+@interface IssueCounts ()
+
+@property (readwrite) NSInteger open;
+@property (readwrite) NSInteger closed;
+
+@end
+
+@implementation IssueCounts
+
+- (NSInteger)total {
+    return _open + _closed;
+}
+
+- (double)progress {
+    NSInteger total = self.total;
+    return total > 0 ? (double)_closed / (double)total : -1.0;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> open: %td closed: %td", NSStringFromClass([self class]), self, _open, _closed];
+}
+
+@end
+
+// The state of an issue as far as IssueCountsFilters are concerned
+@interface IssueCountsSnapshot : NSObject
+
+@property BOOL visible; // matches issuesVisiblePredicate
+@property id repo; // repository.identifier
+@property id milestone; // milestone.identifier
+@property BOOL closed;
+
+@end
+
+@implementation IssueCountsSnapshot
+
++ (IssueCountsSnapshot *)none {
+    static IssueCountsSnapshot *none;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        none = [IssueCountsSnapshot new];
+    });
+    return none;
+}
+
+// values holds repository, milestone, closed and pullRequest, as from -committedValuesForKeys:
++ (IssueCountsSnapshot *)snapshotWithValues:(NSDictionary *)values visiblePredicate:(NSPredicate *)visiblePredicate {
+    LocalRepo *repo = values[@"repository"];
+    if (!repo || (id)repo == [NSNull null]) {
+        return [self none];
+    }
+
+    id pullRequest = values[@"pullRequest"];
+    if (!pullRequest || pullRequest == [NSNull null]) pullRequest = @NO;
+
+    IssueCountsSnapshot *snapshot = [IssueCountsSnapshot new];
+    snapshot.visible = [visiblePredicate evaluateWithObject:@{ @"repository" : repo, @"pullRequest" : pullRequest }];
+    snapshot.repo = repo.identifier;
+
+    LocalMilestone *milestone = values[@"milestone"];
+    snapshot.milestone = (id)milestone == [NSNull null] ? nil : milestone.identifier;
+
+    id closed = values[@"closed"];
+    snapshot.closed = closed != [NSNull null] && [closed boolValue];
+
+    return snapshot;
+}
+
+@end
+
+// A predicate that can be answered from the grouped counts.
+// nil properties are unconstrained.
+@interface IssueCountsFilter : NSObject
+
+@property NSSet *repos;
+@property NSSet *milestones;
+@property BOOL noMilestone;
+@property NSNumber *closed;
+@property BOOL matchesNothing;
+
+@end
+
+@implementation IssueCountsFilter
+
+static NSSet *ConstantSet(NSPredicateOperatorType op, id value) {
+    if (op == NSEqualToPredicateOperatorType) {
+        return value ? [NSSet setWithObject:value] : nil;
+    } else if (op == NSInPredicateOperatorType && [value conformsToProtocol:@protocol(NSFastEnumeration)]) {
+        NSMutableSet *set = [NSMutableSet new];
+        for (id v in value) [set addObject:v];
+        return set;
+    }
+    return nil;
+}
+
+static NSSet *Intersect(NSSet *existing, NSSet *values) {
+    if (!existing) return values;
+    NSMutableSet *s = [existing mutableCopy];
+    [s intersectSet:values];
+    return s;
+}
+
+// Returns NO if p isn't of a form the grouped counts can answer
+- (BOOL)addPredicate:(NSPredicate *)p {
+    if ([p isEqual:[NSPredicate predicateWithValue:YES]]) {
+        return YES;
+    }
+
+    if ([p isEqual:[NSPredicate predicateWithValue:NO]]) {
+        _matchesNothing = YES;
+        return YES;
+    }
+
+    if ([p isKindOfClass:[NSCompoundPredicate class]]) {
+        NSCompoundPredicate *c = (id)p;
+        if (c.compoundPredicateType != NSAndPredicateType) return NO;
+        for (NSPredicate *sub in c.subpredicates) {
+            if (![self addPredicate:sub]) return NO;
+        }
+        return YES;
+    }
+
+    if (![p isKindOfClass:[NSComparisonPredicate class]]) return NO;
+
+    NSComparisonPredicate *c = (id)p;
+    if (c.comparisonPredicateModifier != NSDirectPredicateModifier
+        || c.leftExpression.expressionType != NSKeyPathExpressionType
+        || c.rightExpression.expressionType != NSConstantValueExpressionType)
+    {
+        return NO;
+    }
+
+    NSString *keyPath = c.leftExpression.keyPath;
+    id value = c.rightExpression.constantValue;
+    if (value == [NSNull null]) value = nil;
+    NSPredicateOperatorType op = c.predicateOperatorType;
+
+    if ([keyPath isEqualToString:GroupRepoKey]) {
+        NSSet *repos = ConstantSet(op, value);
+        if (!repos) return NO;
+        _repos = Intersect(_repos, repos);
+        return YES;
+    } else if ([keyPath isEqualToString:GroupMilestoneKey]) {
+        NSSet *milestones = ConstantSet(op, value);
+        if (!milestones) return NO;
+        _milestones = Intersect(_milestones, milestones);
+        return YES;
+    } else if ([keyPath isEqualToString:@"milestone"] && op == NSEqualToPredicateOperatorType && value == nil) {
+        _noMilestone = YES;
+        return YES;
+    } else if ([keyPath isEqualToString:GroupClosedKey] && op == NSEqualToPredicateOperatorType && [value isKindOfClass:[NSNumber class]]) {
+        if (_closed && [_closed boolValue] != [value boolValue]) {
+            _matchesNothing = YES;
+        }
+        _closed = @([value boolValue]);
+        return YES;
+    }
+
+    return NO;
+}
+
+- (BOOL)matchesSnapshot:(IssueCountsSnapshot *)snapshot {
+    if (!snapshot.visible) return NO;
+    if (_closed && [_closed boolValue] != snapshot.closed) return NO;
+    return [self matchesRepo:snapshot.repo milestone:snapshot.milestone];
+}
+
+- (BOOL)matchesRepo:(id)repo milestone:(id)milestone {
+    if (milestone == [NSNull null]) milestone = nil;
+    if (_matchesNothing) return NO;
+    if (_repos && ![_repos containsObject:repo]) return NO;
+    if (_noMilestone && milestone) return NO;
+    if (_milestones && (!milestone || ![_milestones containsObject:milestone])) return NO;
+    return YES;
+}
+
+@end
+
+static NSArray *FiltersForPredicates(NSArray<NSPredicate *> *predicates) {
+    NSMutableArray *filters = [NSMutableArray arrayWithCapacity:predicates.count];
+    for (NSPredicate *predicate in predicates) {
+        IssueCountsFilter *filter = [IssueCountsFilter new];
+        [filters addObject:[filter addPredicate:predicate] ? filter : [NSNull null]];
+    }
+    return filters;
+}
+
+/*
+ The predicates registered with setCountedPredicates:, their current counts, and the changes
+ seen since the last save. Only accessed on the write context's queue.
+*/
+@interface IssueCountsRegistry : NSObject
+
+@property (readonly) int64_t generation;
+@property (readonly) NSArray<id<NSCopying>> *keys;
+@property (readonly) NSArray<NSPredicate *> *predicates;
+@property (readonly) NSArray *filters; // IssueCountsFilter, or NSNull where the predicate must be counted by query
+@property (readonly) NSMutableArray<IssueCounts *> *counts;
+
+@property (readonly) NSDictionary<id, NSIndexSet *> *filtersByRepo; // filters that only match specific repos
+@property (readonly) NSIndexSet *unscopedFilters; // filters that may match any repo
+@property (readonly) NSIndexSet *queriedPredicates; // predicates without filters
+
+// Changes since the last save
+@property (readonly) NSMutableDictionary<NSManagedObjectID *, IssueCountsSnapshot *> *accounted; // each changed issue, as of the last delta taken
+@property (readonly) NSMutableDictionary<NSNumber *, IssueCounts *> *deltas; // filter index => change in counts
+@property BOOL queriedPredicatesDirty; // something changed that predicates without filters may depend on
+@property BOOL needsRecount; // something changed that issuesVisiblePredicate depends on
+
+@property BOOL recountScheduled;
+@property BOOL queriedRecountScheduled;
+@property NSUInteger commitCount; // saves that changed anything counted, so a recount can tell if it raced one
+
+@end
+
+@implementation IssueCountsRegistry
+
+- (instancetype)initWithPredicates:(NSDictionary<id<NSCopying>, NSPredicate *> *)predicates generation:(int64_t)generation {
+    if (self = [super init]) {
+        _generation = generation;
+        _keys = [predicates allKeys];
+        _predicates = [predicates objectsForKeys:_keys notFoundMarker:[NSNull null]];
+        _filters = FiltersForPredicates(_predicates);
+        _counts = [NSMutableArray arrayWithCapacity:_keys.count];
+        for (NSUInteger i = 0; i < _keys.count; i++) {
+            [_counts addObject:[IssueCounts new]];
+        }
+
+        NSMutableDictionary *byRepo = [NSMutableDictionary new];
+        NSMutableIndexSet *unscoped = [NSMutableIndexSet new];
+        NSMutableIndexSet *queried = [NSMutableIndexSet new];
+        [_filters enumerateObjectsUsingBlock:^(IssueCountsFilter *filter, NSUInteger idx, BOOL *stop) {
+            if ((id)filter == [NSNull null]) {
+                [queried addIndex:idx];
+            } else if (filter.repos) {
+                for (id repo in filter.repos) {
+                    NSMutableIndexSet *indexes = byRepo[repo];
+                    if (!indexes) byRepo[repo] = indexes = [NSMutableIndexSet new];
+                    [indexes addIndex:idx];
+                }
+            } else {
+                [unscoped addIndex:idx];
+            }
+        }];
+        _filtersByRepo = byRepo;
+        _unscopedFilters = unscoped;
+        _queriedPredicates = queried;
+
+        _accounted = [NSMutableDictionary new];
+        _deltas = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void)addSnapshot:(IssueCountsSnapshot *)snapshot sign:(NSInteger)sign {
+    if (!snapshot.visible) return;
+
+    void (^visit)(NSUInteger, BOOL *) = ^(NSUInteger idx, BOOL *stop) {
+        IssueCountsFilter *filter = _filters[idx];
+        if (![filter matchesSnapshot:snapshot]) return;
+
+        IssueCounts *delta = _deltas[@(idx)];
+        if (!delta) _deltas[@(idx)] = delta = [IssueCounts new];
+        if (snapshot.closed) {
+            delta.closed += sign;
+        } else {
+            delta.open += sign;
+        }
+    };
+
+    [_filtersByRepo[snapshot.repo] enumerateIndexesUsingBlock:visit];
+    [_unscopedFilters enumerateIndexesUsingBlock:visit];
+}
+
+- (void)issue:(LocalIssue *)issue changed:(CoreDataModificationType)modType visiblePredicate:(NSPredicate *)visiblePredicate {
+    static NSArray *keys;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        keys = @[@"repository", @"milestone", @"closed", @"pullRequest"];
+    });
+
+    // A context can report the same issue several times before it saves, so take each delta
+    // from where the last one left off, starting from what's in the store.
+    NSManagedObjectID *objectID = issue.objectID;
+    IssueCountsSnapshot *before = _accounted[objectID];
+    if (!before) {
+        before = modType == CoreDataModificationTypeInserted ? [IssueCountsSnapshot none] : [IssueCountsSnapshot snapshotWithValues:[issue committedValuesForKeys:keys] visiblePredicate:visiblePredicate];
+    }
+
+    IssueCountsSnapshot *after = modType == CoreDataModificationTypeDeleted ? [IssueCountsSnapshot none] : [IssueCountsSnapshot snapshotWithValues:[issue dictionaryWithValuesForKeys:keys] visiblePredicate:visiblePredicate];
+
+    _accounted[objectID] = after;
+
+    [self addSnapshot:before sign:-1];
+    [self addSnapshot:after sign:1];
+}
+
+- (void)discardChanges {
+    [_accounted removeAllObjects];
+    [_deltas removeAllObjects];
+    _queriedPredicatesDirty = NO;
+    _needsRecount = NO;
+}
+
+@end
+
+@interface DataStore (IssueCountsRegistry)
+
+@property (nonatomic) IssueCountsRegistry *issueCountsRegistry;
+
+- (void)scheduleIssueRecount:(IssueCountsRegistry *)registry queriedOnly:(BOOL)queriedOnly;
+
+@end
+
+@implementation DataStore (IssueCounts)
+
+static NSExpressionDescription *CountExpression() {
+    NSExpressionDescription *count = [NSExpressionDescription new];
+    count.name = GroupCountKey;
+    count.expression = [NSExpression expressionForFunction:@"count:" arguments:@[[NSExpression expressionForKeyPath:@"identifier"]]];
+    count.expressionResultType = NSInteger64AttributeType;
+    return count;
+}
+
+static void AddGroupedCount(IssueCounts *counts, NSDictionary *row, NSNumber *closedFilter) {
+    BOOL closed = [row[GroupClosedKey] boolValue];
+    if (closedFilter && [closedFilter boolValue] != closed) return;
+
+    NSInteger count = [row[GroupCountKey] integerValue];
+    if (closed) {
+        counts.closed += count;
+    } else {
+        counts.open += count;
+    }
+}
+
+// Counts predicate grouped by closed alone.
+- (IssueCounts *)_issueCountsMatchingPredicate:(NSPredicate *)predicate moc:(NSManagedObjectContext *)moc error:(NSError *__autoreleasing *)outError {
+    IssueCounts *counts = [IssueCounts new];
+    @try {
+        NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+        fetch.predicate = [self issuesPredicate:predicate moc:moc];
+        fetch.resultType = NSDictionaryResultType;
+        fetch.propertiesToGroupBy = @[GroupClosedKey];
+        fetch.propertiesToFetch = @[GroupClosedKey, CountExpression()];
+
+        NSError *err = nil;
+        NSArray *rows = [moc executeFetchRequest:fetch error:&err];
+        if (err) {
+            ErrLog(@"%@", err);
+        }
+        for (NSDictionary *row in rows) {
+            AddGroupedCount(counts, row, nil);
+        }
+    } @catch (id exc) {
+        if (outError) *outError = [NSError shipErrorWithCode:ShipErrorCodeInvalidQuery];
+        ErrLog(@"%@", exc);
+    }
+    return counts;
+}
+
+// Counts each of predicates at indexes, answering those with filters from a single grouped query.
+- (NSArray<IssueCounts *> *)_issueCountsMatchingPredicates:(NSArray<NSPredicate *> *)predicates filters:(NSArray *)filters indexes:(NSIndexSet *)indexes moc:(NSManagedObjectContext *)moc error:(NSError *__autoreleasing *)outError {
+    __block NSError *error = nil;
+
+    NSUInteger firstFilter = [indexes indexPassingTest:^BOOL(NSUInteger idx, BOOL *stop) {
+        return filters[idx] != [NSNull null];
+    }];
+
+    NSArray<NSDictionary *> *groups = nil;
+    if (firstFilter != NSNotFound) {
+        @try {
+            NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+            fetch.predicate = [self issuesPredicate:[NSPredicate predicateWithValue:YES] moc:moc];
+            fetch.resultType = NSDictionaryResultType;
+            fetch.propertiesToGroupBy = @[GroupRepoKey, GroupMilestoneKey, GroupClosedKey];
+            fetch.propertiesToFetch = [fetch.propertiesToGroupBy arrayByAddingObject:CountExpression()];
+
+            NSError *err = nil;
+            groups = [moc executeFetchRequest:fetch error:&err];
+            if (err) {
+                ErrLog(@"%@", err);
+            }
+        } @catch (id exc) {
+            error = [NSError shipErrorWithCode:ShipErrorCodeInvalidQuery];
+            ErrLog(@"%@", exc);
+        }
+    }
+
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:indexes.count];
+    [indexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        IssueCountsFilter *filter = filters[idx];
+        if ((id)filter == [NSNull null]) {
+            NSError *err = nil;
+            [results addObject:[self _issueCountsMatchingPredicate:predicates[idx] moc:moc error:&err]];
+            if (err) error = err;
+            return;
+        }
+
+        IssueCounts *counts = [IssueCounts new];
+        for (NSDictionary *row in groups) {
+            if ([filter matchesRepo:row[GroupRepoKey] milestone:row[GroupMilestoneKey]]) {
+                AddGroupedCount(counts, row, filter.closed);
+            }
+        }
+        [results addObject:counts];
+    }];
+
+    if (outError) *outError = error;
+    return results;
+}
+
+- (void)issueCountsMatchingPredicates:(NSArray<NSPredicate *> *)predicates completion:(void (^)(NSArray<IssueCounts *> *counts, NSError *error))completion {
+    NSParameterAssert(predicates);
+    NSParameterAssert(completion);
+
+    NSArray *filters = FiltersForPredicates(predicates);
+
+    [self performRead:^(NSManagedObjectContext *moc) {
+        NSError *error = nil;
+        NSArray *results = [self _issueCountsMatchingPredicates:predicates filters:filters indexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, predicates.count)] moc:moc error:&error];
+
+        RunOnMain(^{
+            completion(results, error);
+        });
+    }];
+}
+
+#pragma mark - Maintained counts
+
+static const void *IssueCountsRegistryKey = &IssueCountsRegistryKey;
+
+// Only accessed on the write context's queue, so needn't be atomic
+- (IssueCountsRegistry *)issueCountsRegistry {
+    return objc_getAssociatedObject(self, IssueCountsRegistryKey);
+}
+
+- (void)setIssueCountsRegistry:(IssueCountsRegistry *)registry {
+    objc_setAssociatedObject(self, IssueCountsRegistryKey, registry, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+
+- (int64_t)setCountedPredicates:(NSDictionary<id<NSCopying>, NSPredicate *> *)predicates {
+    static int64_t lastGeneration = 0;
+    int64_t generation = OSAtomicIncrement64(&lastGeneration);
+    
+    IssueCountsRegistry *registry = predicates.count ? [[IssueCountsRegistry alloc] initWithPredicates:predicates generation:generation] : nil;
+    [self performWrite:^(NSManagedObjectContext *moc) {
+        self.issueCountsRegistry = registry;
+        if (registry) {
+            [self scheduleIssueRecount:registry queriedOnly:NO];
+        }
+    }];
+    
+    return generation;
+}
+
+// A recount that raced this many saves in a row is done within a write instead, so it can't be put off forever.
+static const NSUInteger IssueRecountMaxReadAttempts = 3;
+
+// Call on the write context's queue.
+// Counts on a read context, so that saves don't wait on the count queries, then applies the counts on
+// the write context's queue. If a save changed anything counted in the meantime, the counts may or may
+// not include it, so they're thrown away and taken again.
+- (void)scheduleIssueRecount:(IssueCountsRegistry *)registry queriedOnly:(BOOL)queriedOnly {
+    if (registry.recountScheduled) return; // a full recount covers everything
+    if (queriedOnly) {
+        if (registry.queriedRecountScheduled) return;
+        registry.queriedRecountScheduled = YES;
+    } else {
+        registry.recountScheduled = YES;
+    }
+    
+    [self recountIssueCounts:registry queriedOnly:queriedOnly attempt:0];
+}
+
+- (void)recountIssueCounts:(IssueCountsRegistry *)registry queriedOnly:(BOOL)queriedOnly attempt:(NSUInteger)attempt {
+    NSIndexSet *indexes = queriedOnly ? registry.queriedPredicates : [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, registry.keys.count)];
+    
+    if (attempt < IssueRecountMaxReadAttempts) {
+        NSUInteger commitCount = registry.commitCount;
+        [self performRead:^(NSManagedObjectContext *moc) {
+            NSArray *counts = [self _issueCountsMatchingPredicates:registry.predicates filters:registry.filters indexes:indexes moc:moc error:NULL];
+            [self performWrite:^(NSManagedObjectContext *writeMoc) {
+                if (registry.commitCount != commitCount && registry == self.issueCountsRegistry) {
+                    [self recountIssueCounts:registry queriedOnly:queriedOnly attempt:attempt + 1];
+                } else {
+                    [self applyIssueRecount:counts registry:registry indexes:indexes queriedOnly:queriedOnly];
+                }
+            }];
+        }];
+    } else {
+        // Within the write, nothing can be saved between counting and applying
+        [self performWrite:^(NSManagedObjectContext *moc) {
+            NSArray *counts = [self _issueCountsMatchingPredicates:registry.predicates filters:registry.filters indexes:indexes moc:moc error:NULL];
+            [self applyIssueRecount:counts registry:registry indexes:indexes queriedOnly:queriedOnly];
+        }];
+    }
+}
+
+// Call on the write context's queue
+- (void)applyIssueRecount:(NSArray<IssueCounts *> *)counts registry:(IssueCountsRegistry *)registry indexes:(NSIndexSet *)indexes queriedOnly:(BOOL)queriedOnly {
+    if (queriedOnly) {
+        registry.queriedRecountScheduled = NO;
+        if (registry.recountScheduled) return; // a full recount is coming
+    } else {
+        registry.recountScheduled = NO;
+    }
+    
+    if (registry != self.issueCountsRegistry) return;
+    
+    NSMutableDictionary *published = [NSMutableDictionary new];
+    __block NSUInteger i = 0;
+    [indexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        IssueCounts *c = counts[i++];
+        IssueCounts *existing = registry.counts[idx];
+        if (queriedOnly && existing.open == c.open && existing.closed == c.closed) return;
+        registry.counts[idx] = c;
+        published[registry.keys[idx]] = c;
+    }];
+
+    if (published.count) {
+        [self postNotification:DataStoreDidUpdateIssueCountsNotification userInfo:@{ DataStoreIssueCountsKey : published, DataStoreIssueCountsGenerationKey : @(registry.generation) }];
+    }
+}
+
+@end
+
+@implementation DataStore (IssueCountsInternal)
+
+// Whether a change to obj can change issuesVisiblePredicate, or which issues it matches:
+// repos being hidden, disabled, made private or named, and the billing state.
+static BOOL ChangesVisibleIssues(NSManagedObject *obj, CoreDataModificationType modType) {
+    if ([obj isKindOfClass:[LocalHidden class]] || [obj isKindOfClass:[LocalBilling class]]) {
+        return YES;
+    }
+    if ([obj isKindOfClass:[LocalRepo class]]) {
+        if (modType != CoreDataModificationTypeUpdated) return YES;
+        
+        static NSSet *keys;
+        static dispatch_once_t onceToken;
+        dispatch_once(&onceToken, ^{
+            keys = [NSSet setWithArray:@[@"private", @"disabled", @"hidden", @"fullName"]];
+        });
+        return [keys intersectsSet:[NSSet setWithArray:[[obj changedValues] allKeys]]];
+    }
+    return NO;
+}
+
+// Whether a change to an object of entity can change which issues a predicate matches.
+// That's issues themselves, and anything an issue relates to (labels, assignees, milestones, notifications...).
+static BOOL ChangesIssuePredicates(NSEntityDescription *entity) {
+    if ([entity.name isEqualToString:@"LocalIssue"]) return YES;
+    for (NSRelationshipDescription *rel in [entity.relationshipsByName allValues]) {
+        if ([rel.destinationEntity.name isEqualToString:@"LocalIssue"]) return YES;
+    }
+    return NO;
+}
+
+- (void)updateIssueCountsWithChange:(NSNotification *)note {
+    IssueCountsRegistry *registry = self.issueCountsRegistry;
+    if (!registry) return;
+
+    if (note.userInfo[NSInvalidatedAllObjectsKey]) {
+        // the context was reset without saving
+        [registry discardChanges];
+        return;
+    }
+
+    NSPredicate *visiblePredicate = [self issuesVisiblePredicate];
+    [note enumerateModifiedObjects:^(id obj, CoreDataModificationType modType, BOOL *stop) {
+        if (ChangesVisibleIssues(obj, modType)) {
+            registry.needsRecount = YES;
+        }
+        if (!registry.queriedPredicatesDirty && ChangesIssuePredicates([obj entity])) {
+            registry.queriedPredicatesDirty = YES;
+        }
+        if ([obj isKindOfClass:[LocalIssue class]]) {
+            [registry issue:obj changed:modType visiblePredicate:visiblePredicate];
+        }
+    }];
+}
+
+- (void)commitIssueCountChanges {
+    IssueCountsRegistry *registry = self.issueCountsRegistry;
+    if (!registry) return;
+
+    if (registry.needsRecount || registry.queriedPredicatesDirty || registry.accounted.count) {
+        registry.commitCount++;
+    }
+
+    if (registry.needsRecount) {
+        [self scheduleIssueRecount:registry queriedOnly:NO];
+        [registry discardChanges];
+        return;
+    }
+
+    if (registry.queriedPredicatesDirty && registry.queriedPredicates.count) {
+        [self scheduleIssueRecount:registry queriedOnly:YES];
+    }
+
+    NSMutableDictionary *published = [NSMutableDictionary new];
+    NSMutableDictionary *deltas = [NSMutableDictionary new];
+    [registry.deltas enumerateKeysAndObjectsUsingBlock:^(NSNumber *idx, IssueCounts *delta, BOOL *stop) {
+        if (delta.open == 0 && delta.closed == 0) return;
+
+        IssueCounts *existing = registry.counts[idx.unsignedIntegerValue];
+        IssueCounts *c = [IssueCounts new];
+        c.open = existing.open + delta.open;
+        c.closed = existing.closed + delta.closed;
+        registry.counts[idx.unsignedIntegerValue] = c;
+
+        id key = registry.keys[idx.unsignedIntegerValue];
+        published[key] = c;
+        deltas[key] = delta;
+    }];
+
+    [registry discardChanges];
+
+    if (published.count) {
+        [self postNotification:DataStoreDidUpdateIssueCountsNotification userInfo:@{ DataStoreIssueCountsKey : published, DataStoreIssueCountDeltasKey : deltas, DataStoreIssueCountsGenerationKey : @(registry.generation) }];
+    }
+}
+
+- (void)discardIssueCountChanges {
+    [self.issueCountsRegistry discardChanges];
+}
+
+@end
@@ -0,0 +1,65 @@
+//
+//  DataStore+IssueCursor.h
+//  ShipHub
+//
+//  Created by James Howard on 3/12/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "DataStore.h"
+
+@class Issue;
+
+// A sorted window onto the issues matching a predicate, for tables too large to hold in memory.
+// Issues are read a page at a time, sorted by the database, and pages next to ones already read
+// are found by key ("the next pageSize after key K") rather than by offset.
+// Not thread safe. Use from the main thread.
+@interface IssueCursor : NSObject
+
+@property (readonly) NSPredicate *predicate;
+@property (readonly) NSArray<NSSortDescriptor *> *sortDescriptors; // Issue key paths, as given
+@property (readonly) NSUInteger count;
+@property (readonly) NSUInteger pageSize;
+
+// Whether sortDescriptors could be translated into a database sort.
+// If not, the cursor has a count, but can't load anything.
+@property (readonly, getter=isSortable) BOOL sortable;
+
+// Whether sortDescriptors (on Issue key paths, as used by IssueTableController) can be sorted by the database.
++ (BOOL)canSortWithDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors;
+
+// sortDescriptors, changed to sort Issues in memory in the same order the database does, so that a
+// result is ordered the same whether it is paged through a cursor or not. Strings compare by their bytes,
+// fullIdentifier by repository then number, and unread keeps issues without a notification apart from read ones.
+// Descriptors the database can't sort by are left as they are.
++ (NSArray<NSSortDescriptor *> *)memorySortDescriptorsForSortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors;
+
+// Returns the issue at idx if it has been loaded, otherwise nil.
+- (Issue *)issueAtIndex:(NSUInteger)idx;
+
+// Whether every index in indexes is in a loaded page.
+- (BOOL)isLoadedAtIndexes:(NSIndexSet *)indexes;
+
+// Loads any pages in range not already loaded. Only the most recently used pages are kept.
+// completion is called with the indexes that are newly loaded.
+- (void)loadRange:(NSRange)range completion:(void (^)(NSIndexSet *loaded))completion;
+
+// Reads the issues at indexes, in sort order, whether or not their pages are loaded. Loaded pages are left as they are.
+// For acting on a selection that spans more than the cursor keeps in memory.
+- (void)loadIssuesAtIndexes:(NSIndexSet *)indexes completion:(void (^)(NSArray<Issue *> *issues, NSError *error))completion;
+
+// Returns a new cursor for the same predicate in a different order.
+- (void)cursorWithSortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors completion:(void (^)(IssueCursor *cursor, NSError *error))completion;
+
+// Reads every matching issue in sortDescriptors order, sorting in memory if the database can't.
+- (void)loadAllIssues:(void (^)(NSArray<Issue *> *issues, NSError *error))completion;
+
+@end
+
+@interface DataStore (IssueCursor)
+
+// Counts the issues matching predicate and returns a cursor over them, sorted by sortDescriptors (on Issue key paths).
+// options are as for issuesMatchingPredicate:sortDescriptors:options:completion:. Issues are built with IssueOptionTableRow.
+- (void)issueCursorWithPredicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors options:(NSDictionary *)options completion:(void (^)(IssueCursor *cursor, NSError *error))completion;
+
+@end
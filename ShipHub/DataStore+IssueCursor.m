@@ -0,0 +1,542 @@
+//
+//  DataStore+IssueCursor.m
+//  ShipHub
+//
+//  Created by James Howard on 3/12/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "DataStore+IssueCursor.h"
+
+#import "DataStoreInternal.h"
+#import "DataStore+IssuesPredicate.h"
+#import "Error.h"
+#import "Extras.h"
+#import "Issue.h"
+#import "LocalIssue.h"
+#import "MetadataStore.h"
+
+static const NSUInteger IssueCursorPageSize = 100;
+static const NSUInteger IssueCursorMaxPages = 32;
+
+@interface IssueCursor () {
+    NSMutableDictionary<NSNumber *, NSArray<Issue *> *> *_pages;
+    NSMutableArray<NSNumber *> *_recentPages; // most recently used last
+    NSMutableIndexSet *_loadingPages;
+    
+    // The sort keys of the first and last issue in each page ever loaded.
+    // Kept after the page itself is evicted, so it can be found again by key.
+    NSMutableDictionary<NSNumber *, NSArray *> *_firstKeys;
+    NSMutableDictionary<NSNumber *, NSArray *> *_lastKeys;
+}
+
+@property (strong) DataStore *store;
+@property (readwrite) NSPredicate *predicate;
+@property (readwrite) NSArray<NSSortDescriptor *> *sortDescriptors;
+@property (strong) NSArray<NSSortDescriptor *> *fetchSortDescriptors; // LocalIssue key paths, ending in identifier
+@property (strong) NSDictionary *options;
+@property (readwrite) NSUInteger count;
+@property (readwrite) NSUInteger pageSize;
+
+@end
+
+// Maps the sort keys IssueTableController uses onto LocalIssue key paths. A leading - reverses the order.
+static NSDictionary<NSString *, NSArray<NSString *> *> *IssueSortKeyPaths() {
+    static NSDictionary *keyPaths;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        keyPaths = @{ @"number" : @[@"number"],
+                      @"title" : @[@"title"],
+                      @"fullIdentifier" : @[@"repository.fullName", @"number"],
+                      @"repository.fullName" : @[@"repository.fullName"],
+                      @"milestone.title" : @[@"milestone.title"],
+                      @"originator.login" : @[@"originator.login"],
+                      @"closedBy.login" : @[@"closedBy.login"],
+                      @"state" : @[@"-closed"], // "closed" sorts before "open"
+                      @"updatedAt" : @[@"updatedAt"],
+                      @"createdAt" : @[@"createdAt"],
+                      @"closedAt" : @[@"closedAt"],
+                      @"unread" : @[@"notification.unread"],
+                      @"pullRequest" : @[@"pullRequest"],
+                      @"mergedAt" : @[@"pr.mergedAt"] };
+    });
+    return keyPaths;
+}
+
+// The sort keys IssueTableController uses whose values are strings.
+static NSSet<NSString *> *IssueSortStringKeys() {
+    static NSSet *keys;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        keys = [NSSet setWithArray:@[@"title", @"repository.fullName", @"milestone.title", @"originator.login", @"closedBy.login", @"state"]];
+    });
+    return keys;
+}
+
+// Returns nil if sortDescriptors can't be sorted by the database.
+static NSArray<NSSortDescriptor *> *FetchSortDescriptors(NSArray<NSSortDescriptor *> *sortDescriptors) {
+    NSDictionary *keyPaths = IssueSortKeyPaths();
+    NSMutableArray *result = [NSMutableArray new];
+    NSMutableSet *seen = [NSMutableSet new];
+    
+    for (NSSortDescriptor *sd in sortDescriptors) {
+        NSArray *mapped = keyPaths[sd.key];
+        if (!mapped || (sd.selector && sd.selector != @selector(compare:))) {
+            return nil;
+        }
+        for (NSString *mappedKeyPath in mapped) {
+            BOOL reversed = [mappedKeyPath hasPrefix:@"-"];
+            NSString *keyPath = reversed ? [mappedKeyPath substringFromIndex:1] : mappedKeyPath;
+            if ([seen containsObject:keyPath]) continue;
+            [seen addObject:keyPath];
+            [result addObject:[NSSortDescriptor sortDescriptorWithKey:keyPath ascending:sd.ascending != reversed]];
+        }
+    }
+    
+    // identifier is unique, so the order is total and every issue has a distinct key
+    if (![seen containsObject:@"identifier"]) {
+        [result addObject:[NSSortDescriptor sortDescriptorWithKey:@"identifier" ascending:YES]];
+    }
+    
+    return result;
+}
+
+static NSArray<NSSortDescriptor *> *ReversedSortDescriptors(NSArray<NSSortDescriptor *> *sortDescriptors) {
+    return [sortDescriptors arrayByMappingObjects:^id(NSSortDescriptor *sd) {
+        return [sd reversedSortDescriptor];
+    }];
+}
+
+static NSArray *SortKeyForIssue(LocalIssue *li, NSArray<NSSortDescriptor *> *sortDescriptors) {
+    if (!li) return nil;
+    return [sortDescriptors arrayByMappingObjects:^id(NSSortDescriptor *sd) {
+        return [li valueForKeyPath:sd.key] ?: [NSNull null];
+    }];
+}
+
+// keyPath is nil, or any relationship along it is
+static NSPredicate *IsNilPredicate(NSString *keyPath) {
+    NSArray *parts = [keyPath componentsSeparatedByString:@"."];
+    NSMutableArray *subpredicates = [NSMutableArray new];
+    for (NSUInteger i = 1; i <= parts.count; i++) {
+        NSString *prefix = [[parts subarrayWithRange:NSMakeRange(0, i)] componentsJoinedByString:@"."];
+        [subpredicates addObject:[NSPredicate predicateWithFormat:@"%K = nil", prefix]];
+    }
+    return subpredicates.count == 1 ? subpredicates[0] : [NSCompoundPredicate orPredicateWithSubpredicates:subpredicates];
+}
+
+static NSPredicate *EqualPredicate(NSString *keyPath, id value) {
+    if (value == [NSNull null]) {
+        return IsNilPredicate(keyPath);
+    }
+    return [NSPredicate predicateWithFormat:@"%K = %@", keyPath, value];
+}
+
+// The database sorts NULL before everything else ascending, and after everything else descending.
+static NSPredicate *AfterPredicate(NSString *keyPath, id value, BOOL ascending) {
+    BOOL isNil = value == [NSNull null];
+    if (ascending) {
+        if (isNil) {
+            return [NSCompoundPredicate notPredicateWithSubpredicate:IsNilPredicate(keyPath)];
+        }
+        return [NSPredicate predicateWithFormat:@"%K > %@", keyPath, value];
+    } else {
+        if (isNil) {
+            return [NSPredicate predicateWithValue:NO];
+        }
+        return [NSCompoundPredicate orPredicateWithSubpredicates:@[[NSPredicate predicateWithFormat:@"%K < %@", keyPath, value], IsNilPredicate(keyPath)]];
+    }
+}
+
+// Matches the issues that sort strictly after key:
+// (k1 after v1) OR (k1 = v1 AND k2 after v2) OR ...
+static NSPredicate *KeysetPredicate(NSArray<NSSortDescriptor *> *sortDescriptors, NSArray *key) {
+    NSMutableArray *disjuncts = [NSMutableArray arrayWithCapacity:sortDescriptors.count];
+    NSMutableArray *equalities = [NSMutableArray arrayWithCapacity:sortDescriptors.count];
+    
+    [sortDescriptors enumerateObjectsUsingBlock:^(NSSortDescriptor *sd, NSUInteger i, BOOL *stop) {
+        NSPredicate *after = AfterPredicate(sd.key, key[i], sd.ascending);
+        [disjuncts addObject:[NSCompoundPredicate andPredicateWithSubpredicates:[equalities arrayByAddingObject:after]]];
+        [equalities addObject:EqualPredicate(sd.key, key[i])];
+    }];
+    
+    return [NSCompoundPredicate orPredicateWithSubpredicates:disjuncts];
+}
+
+@implementation IssueCursor
+
++ (BOOL)canSortWithDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors {
+    return FetchSortDescriptors(sortDescriptors) != nil;
+}
+
++ (NSArray<NSSortDescriptor *> *)memorySortDescriptorsForSortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors {
+    NSSet *stringKeys = IssueSortStringKeys();
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:sortDescriptors.count];
+    
+    for (NSSortDescriptor *sd in sortDescriptors) {
+        if (!IssueSortKeyPaths()[sd.key] || (sd.selector && sd.selector != @selector(compare:))) {
+            [result addObject:sd];
+            continue;
+        }
+        NSArray *keys = @[sd.key];
+        if ([sd.key isEqualToString:@"fullIdentifier"]) {
+            keys = @[@"repository.fullName", @"number"];
+        } else if ([sd.key isEqualToString:@"unread"]) {
+            keys = @[@"notificationUnread"]; // issues without a notification are NULL to the database, not NO
+        }
+        for (NSString *key in keys) {
+            SEL selector = [stringKeys containsObject:key] ? @selector(utf8Compare:) : @selector(compare:);
+            [result addObject:[NSSortDescriptor sortDescriptorWithKey:key ascending:sd.ascending selector:selector]];
+        }
+    }
+    
+    return result;
+}
+
+- (instancetype)initWithStore:(DataStore *)store predicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors options:(NSDictionary *)options count:(NSUInteger)count
+{
+    if (self = [super init]) {
+        _store = store;
+        _predicate = predicate;
+        _sortDescriptors = [sortDescriptors copy];
+        _fetchSortDescriptors = FetchSortDescriptors(sortDescriptors);
+        
+        NSMutableDictionary *rowOptions = [options mutableCopy] ?: [NSMutableDictionary new];
+        rowOptions[IssueOptionTableRow] = @YES;
+        _options = rowOptions;
+        
+        _count = count;
+        _pageSize = IssueCursorPageSize;
+        
+        _pages = [NSMutableDictionary new];
+        _recentPages = [NSMutableArray new];
+        _loadingPages = [NSMutableIndexSet new];
+        _firstKeys = [NSMutableDictionary new];
+        _lastKeys = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (BOOL)isSortable {
+    return _fetchSortDescriptors != nil;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> %tu issues matching %@ sorted by %@", NSStringFromClass([self class]), self, _count, _predicate, _fetchSortDescriptors];
+}
+
+- (Issue *)issueAtIndex:(NSUInteger)idx {
+    if (idx >= _count) return nil;
+    NSArray *page = _pages[@(idx / _pageSize)];
+    NSUInteger offset = idx % _pageSize;
+    return offset < page.count ? page[offset] : nil;
+}
+
+- (BOOL)isLoadedAtIndexes:(NSIndexSet *)indexes {
+    __block BOOL loaded = YES;
+    [indexes enumerateRangesUsingBlock:^(NSRange range, BOOL *stop) {
+        if (NSMaxRange(range) > _count) {
+            loaded = NO;
+        } else {
+            for (NSUInteger page = range.location / _pageSize; page <= (NSMaxRange(range) - 1) / _pageSize; page++) {
+                if (!_pages[@(page)]) {
+                    loaded = NO;
+                    break;
+                }
+            }
+        }
+        *stop = !loaded;
+    }];
+    return loaded;
+}
+
+- (void)touchPage:(NSUInteger)page {
+    [_recentPages removeObject:@(page)];
+    [_recentPages addObject:@(page)];
+}
+
+- (void)evictPages {
+    while (_recentPages.count > IssueCursorMaxPages) {
+        NSNumber *page = _recentPages.firstObject;
+        [_recentPages removeObjectAtIndex:0];
+        [_pages removeObjectForKey:page];
+    }
+}
+
+- (void)loadRange:(NSRange)range completion:(void (^)(NSIndexSet *loaded))completion {
+    NSParameterAssert(completion);
+    dispatch_assert_current_queue(dispatch_get_main_queue());
+    
+    if (!self.sortable || _count == 0 || range.length == 0 || range.location >= _count) {
+        completion([NSIndexSet indexSet]);
+        return;
+    }
+    
+    NSUInteger firstPage = range.location / _pageSize;
+    NSUInteger lastPage = (MIN(NSMaxRange(range), _count) - 1) / _pageSize;
+    
+    NSMutableIndexSet *pages = [NSMutableIndexSet new];
+    for (NSUInteger page = firstPage; page <= lastPage; page++) {
+        if (_pages[@(page)]) {
+            [self touchPage:page];
+        } else if (![_loadingPages containsIndex:page]) {
+            [pages addIndex:page];
+        }
+    }
+    
+    if (pages.count == 0) {
+        completion([NSIndexSet indexSet]);
+        return;
+    }
+    
+    [self loadPages:pages completion:completion];
+}
+
+// Reads pages in a single read, each one found by key from a neighbor where possible.
+// Works backwards when that's the side with a known neighbor (e.g. scrolling to the end).
+- (void)loadPages:(NSIndexSet *)pages completion:(void (^)(NSIndexSet *loaded))completion {
+    NSUInteger finalPage = (_count - 1) / _pageSize;
+    BOOL knowPrevious = pages.firstIndex > 0 && _lastKeys[@(pages.firstIndex - 1)] != nil;
+    BOOL knowNext = pages.lastIndex == finalPage || _firstKeys[@(pages.lastIndex + 1)] != nil;
+    BOOL backwards = knowNext && !knowPrevious && pages.firstIndex != 0;
+    
+    NSMutableDictionary *firstKeys = [_firstKeys mutableCopy];
+    NSMutableDictionary *lastKeys = [_lastKeys mutableCopy];
+    [_loadingPages addIndexes:pages];
+    
+    DataStore *store = _store;
+    [store performRead:^(NSManagedObjectContext *moc) {
+        NSMutableDictionary *loaded = [NSMutableDictionary new];
+        @try {
+            NSPredicate *predicate = [store issuesPredicate:_predicate moc:moc];
+            MetadataStore *ms = store.metadataStore;
+            
+            [pages enumerateIndexesWithOptions:backwards ? NSEnumerationReverse : 0 usingBlock:^(NSUInteger page, BOOL *stop) {
+                @autoreleasepool {
+                    NSArray *issues = [self readPage:page predicate:predicate firstKeys:firstKeys lastKeys:lastKeys metadataStore:ms moc:moc];
+                    if (issues) {
+                        loaded[@(page)] = issues;
+                    }
+                    [moc reset];
+                }
+            }];
+        } @catch (id exc) {
+            ErrLog(@"%@", exc);
+        }
+        
+        RunOnMain(^{
+            [_loadingPages removeIndexes:pages];
+            [_firstKeys addEntriesFromDictionary:firstKeys];
+            [_lastKeys addEntriesFromDictionary:lastKeys];
+            
+            NSMutableIndexSet *loadedIndexes = [NSMutableIndexSet new];
+            [loaded enumerateKeysAndObjectsUsingBlock:^(NSNumber *page, NSArray *issues, BOOL *stop) {
+                _pages[page] = issues;
+                [self touchPage:page.unsignedIntegerValue];
+                [loadedIndexes addIndexesInRange:NSMakeRange(page.unsignedIntegerValue * _pageSize, issues.count)];
+            }];
+            [self evictPages];
+            
+            completion(loadedIndexes);
+        });
+    }];
+}
+
+// Called within a read. Records the keys of the page read in firstKeys and lastKeys.
+- (NSArray<Issue *> *)readPage:(NSUInteger)page predicate:(NSPredicate *)predicate firstKeys:(NSMutableDictionary *)firstKeys lastKeys:(NSMutableDictionary *)lastKeys metadataStore:(MetadataStore *)ms moc:(NSManagedObjectContext *)moc
+{
+    NSUInteger start = page * _pageSize;
+    if (start >= _count) return nil;
+    NSUInteger length = MIN(_pageSize, _count - start);
+    
+    NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+    fetch.relationshipKeyPathsForPrefetching = @[@"assignees", @"labels", @"notification.unread", @"pr"];
+    fetch.returnsObjectsAsFaults = NO;
+    fetch.fetchLimit = length;
+    
+    NSArray *previousKey = page > 0 ? lastKeys[@(page - 1)] : nil;
+    NSArray *nextKey = firstKeys[@(page + 1)];
+    BOOL reversed = NO;
+    
+    if (page == 0) {
+        fetch.predicate = predicate;
+        fetch.sortDescriptors = _fetchSortDescriptors;
+    } else if (previousKey) {
+        fetch.predicate = [predicate and:KeysetPredicate(_fetchSortDescriptors, previousKey)];
+        fetch.sortDescriptors = _fetchSortDescriptors;
+    } else if (nextKey) {
+        NSArray *reversedSort = ReversedSortDescriptors(_fetchSortDescriptors);
+        fetch.predicate = [predicate and:KeysetPredicate(reversedSort, nextKey)];
+        fetch.sortDescriptors = reversedSort;
+        reversed = YES;
+    } else if (start + length == _count) {
+        // The last page is the first page of the reverse order
+        fetch.predicate = predicate;
+        fetch.sortDescriptors = ReversedSortDescriptors(_fetchSortDescriptors);
+        reversed = YES;
+    } else {
+        // Nothing nearby is known, so this is the one case that has to skip over rows
+        fetch.predicate = predicate;
+        fetch.sortDescriptors = _fetchSortDescriptors;
+        fetch.fetchOffset = start;
+    }
+    
+    NSError *error = nil;
+    NSArray *entities = [moc executeFetchRequest:fetch error:&error];
+    if (error) {
+        ErrLog(@"%@", error);
+        return nil;
+    }
+    if (reversed) {
+        entities = [[entities reverseObjectEnumerator] allObjects];
+    }
+    
+    if (entities.count) {
+        firstKeys[@(page)] = SortKeyForIssue(entities.firstObject, _fetchSortDescriptors);
+        lastKeys[@(page)] = SortKeyForIssue(entities.lastObject, _fetchSortDescriptors);
+    }
+    
+    NSDictionary *options = _options;
+    return [entities arrayByMappingObjects:^id(LocalIssue *li) {
+        return [[Issue alloc] initWithLocalIssue:li metadataStore:ms options:options];
+    }];
+}
+
+- (void)loadIssuesAtIndexes:(NSIndexSet *)indexes completion:(void (^)(NSArray<Issue *> *issues, NSError *error))completion {
+    NSParameterAssert(completion);
+    dispatch_assert_current_queue(dispatch_get_main_queue());
+    
+    if (!self.sortable || indexes.count == 0 || indexes.firstIndex >= _count) {
+        completion(@[], nil);
+        return;
+    }
+    
+    DataStore *store = _store;
+    NSPredicate *cursorPredicate = _predicate;
+    NSArray *fetchSortDescriptors = _fetchSortDescriptors;
+    NSDictionary *options = _options;
+    NSUInteger batchSize = _pageSize * 10;
+    
+    [store performRead:^(NSManagedObjectContext *moc) {
+        NSMutableArray *results = nil;
+        NSError *error = nil;
+        @try {
+            // Object IDs alone are cheap enough to read across the whole span, in order
+            NSFetchRequest *idsFetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+            idsFetch.predicate = [store issuesPredicate:cursorPredicate moc:moc];
+            idsFetch.sortDescriptors = fetchSortDescriptors;
+            idsFetch.resultType = NSManagedObjectIDResultType;
+            idsFetch.fetchOffset = indexes.firstIndex;
+            idsFetch.fetchLimit = indexes.lastIndex - indexes.firstIndex + 1;
+            
+            NSArray<NSManagedObjectID *> *spanIDs = [moc executeFetchRequest:idsFetch error:&error];
+            if (error) {
+                ErrLog(@"%@", error);
+            } else {
+                NSMutableArray *objectIDs = [NSMutableArray arrayWithCapacity:indexes.count];
+                [indexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+                    NSUInteger offset = idx - indexes.firstIndex;
+                    if (offset < spanIDs.count) {
+                        [objectIDs addObject:spanIDs[offset]];
+                    } else {
+                        *stop = YES;
+                    }
+                }];
+                
+                MetadataStore *ms = store.metadataStore;
+                results = [NSMutableArray arrayWithCapacity:objectIDs.count];
+                
+                for (NSUInteger start = 0; start < objectIDs.count; start += batchSize) {
+                    @autoreleasepool {
+                        NSArray *batchIDs = [objectIDs subarrayWithRange:NSMakeRange(start, MIN(batchSize, objectIDs.count - start))];
+                        
+                        NSFetchRequest *batchFetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+                        batchFetch.predicate = [NSPredicate predicateWithFormat:@"SELF IN %@", batchIDs];
+                        batchFetch.relationshipKeyPathsForPrefetching = @[@"assignees", @"labels", @"notification.unread", @"pr"];
+                        batchFetch.returnsObjectsAsFaults = NO;
+                        
+                        NSError *err = nil;
+                        NSArray *entities = [moc executeFetchRequest:batchFetch error:&err];
+                        if (err) {
+                            ErrLog(@"%@", err);
+                        }
+                        
+                        NSDictionary *entitiesByID = [NSDictionary lookupWithObjects:entities keyPath:@"objectID"];
+                        for (NSManagedObjectID *objectID in batchIDs) {
+                            LocalIssue *li = entitiesByID[objectID];
+                            if (li) {
+                                [results addObject:[[Issue alloc] initWithLocalIssue:li metadataStore:ms options:options]];
+                            }
+                        }
+                        
+                        for (LocalIssue *li in entities) {
+                            [moc refreshObject:li mergeChanges:NO];
+                        }
+                    }
+                }
+            }
+        } @catch (id exc) {
+            results = nil;
+            error = [NSError shipErrorWithCode:ShipErrorCodeInvalidQuery];
+            ErrLog(@"%@", exc);
+        }
+        
+        RunOnMain(^{
+            completion(results, error);
+        });
+    }];
+}
+
+- (void)cursorWithSortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors completion:(void (^)(IssueCursor *cursor, NSError *error))completion {
+    [_store issueCursorWithPredicate:_predicate sortDescriptors:sortDescriptors options:_options completion:completion];
+}
+
+- (void)loadAllIssues:(void (^)(NSArray<Issue *> *issues, NSError *error))completion {
+    NSArray *memorySortDescriptors = _fetchSortDescriptors ? nil : [IssueCursor memorySortDescriptorsForSortDescriptors:_sortDescriptors];
+    [_store issueRowsMatchingPredicate:_predicate sortDescriptors:_fetchSortDescriptors options:_options pageSize:1000 completion:^(NSArray<Issue *> *issues, BOOL complete, NSError *error) {
+        if (complete) {
+            if (memorySortDescriptors && issues) {
+                @try {
+                    issues = [issues sortedArrayUsingDescriptors:memorySortDescriptors];
+                } @catch (id exc) {
+                    ErrLog(@"Error sorting issues with descriptors %@: %@", memorySortDescriptors, exc);
+                }
+            }
+            completion(issues, error);
+        }
+    }];
+}
+
+@end
+
+@implementation DataStore (IssueCursor)
+
+- (void)issueCursorWithPredicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors options:(NSDictionary *)options completion:(void (^)(IssueCursor *cursor, NSError *error))completion
+{
+    NSParameterAssert(predicate);
+    NSParameterAssert(completion);
+    
+    [self performRead:^(NSManagedObjectContext *moc) {
+        IssueCursor *cursor = nil;
+        NSError *error = nil;
+        @try {
+            NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+            fetch.predicate = [self issuesPredicate:predicate moc:moc];
+            NSUInteger count = [moc countForFetchRequest:fetch error:&error];
+            if (error) {
+                ErrLog(@"%@", error);
+            } else {
+                cursor = [[IssueCursor alloc] initWithStore:self predicate:predicate sortDescriptors:sortDescriptors options:options count:count];
+            }
+        } @catch (id exc) {
+            error = [NSError shipErrorWithCode:ShipErrorCodeInvalidQuery];
+            ErrLog(@"%@", exc);
+        }
+        
+        RunOnMain(^{
+            completion(cursor, error);
+        });
+    }];
+}
+
+@end
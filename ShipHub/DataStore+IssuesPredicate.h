@@ -8,8 +8,44 @@
 
 #import "DataStore.h"
 
+@interface IssuesPredicateCacheStats : NSObject
+
+@property (readonly) NSUInteger hits;
+@property (readonly) NSUInteger misses; // includes stale
+@property (readonly) NSUInteger stale; // found, but invalidated by a write to an entity it depends on
+@property (readonly) NSUInteger uncacheable; // rewrites not cached, e.g. for predicates with object constants
+@property (readonly) NSUInteger count; // plans currently cached
+@property (readonly) NSUInteger rewrites;
+
+@property (readonly) double hitRate; // hits / (hits + misses), or 0 if there have been no lookups
+@property (readonly) NSTimeInterval rewriteTime; // total time spent rewriting, in seconds
+@property (readonly) NSTimeInterval averageRewriteTime;
+
+@end
+
+// Returns values as a predicate constant that keeps predicates using it out of the rewrite cache.
+// For values that change with every save (e.g. full text index matches), which would otherwise
+// fill the cache with plans that are never looked up again.
+extern NSArray *IssuesPredicateUncachedConstant(NSArray *values);
+
 @interface DataStore (IssuesPredicate)
 
+// Rewrites basePredicate for fetching LocalIssues: optimized, with complex subqueries expanded,
+// folded for Core Data and limited to visible issues. Rewrites are cached by the predicate's
+// format, and stay valid until a save touches an entity they read while expanding subqueries.
 - (NSPredicate *)issuesPredicate:(NSPredicate *)basePredicate moc:(NSManagedObjectContext *)moc;
 
+- (IssuesPredicateCacheStats *)issuesPredicateCacheStats;
+
+// The clause issuesPredicate:moc: adds to every query, limiting it to issues in visible, enabled repos.
+// Only refers to repository and pullRequest, so it can be evaluated against a dictionary holding those keys.
+- (NSPredicate *)issuesVisiblePredicate;
+
+@end
+
+@interface DataStore (IssuesPredicateInternal)
+
+// Called by DataStore on its write context's queue
+- (void)invalidateIssuesPredicatesWithSave:(NSNotification *)note;
+
 @end
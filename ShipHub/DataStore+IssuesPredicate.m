@@ -8,12 +8,215 @@
 
 #import "DataStore+IssuesPredicate.h"
 
+#import <objc/runtime.h>
+
 #import "Billing.h"
 #import "Extras.h"
 #import "NSPredicate+Extras.h"
 #import "QueryOptimizer.h"
 #import "DataStoreInternal.h"
 
+@interface IssuesPredicateCacheStats ()
+
+@property (readwrite) NSUInteger hits;
+@property (readwrite) NSUInteger misses;
+@property (readwrite) NSUInteger stale;
+@property (readwrite) NSUInteger uncacheable;
+@property (readwrite) NSUInteger count;
+@property (readwrite) NSUInteger rewrites;
+@property (readwrite) NSTimeInterval rewriteTime;
+
+@end
+
+@implementation IssuesPredicateCacheStats
+
+- (double)hitRate {
+    NSUInteger lookups = _hits + _misses;
+    return lookups ? (double)_hits / lookups : 0.0;
+}
+
+- (NSTimeInterval)averageRewriteTime {
+    return _rewrites ? _rewriteTime / _rewrites : 0.0;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> hits: %tu misses: %tu (stale: %tu) uncacheable: %tu count: %tu hitRate: %.2f averageRewriteTime: %.3fms", NSStringFromClass([self class]), self, _hits, _misses, _stale, _uncacheable, _count, self.hitRate, self.averageRewriteTime * 1000.0];
+}
+
+@end
+
+// The result of QueryOptimizer and subquery expansion for a base predicate.
+@interface IssuesPredicatePlan : NSObject
+
+@property NSPredicate *predicate;
+@property NSDictionary<NSString *, NSNumber *> *generations; // entity name => generation, for each entity read to expand subqueries
+@property NSUInteger epoch;
+
+@end
+
+@implementation IssuesPredicatePlan
+
+@end
+
+// Thread safe.
+@interface IssuesPredicateCache : NSObject {
+    NSMutableDictionary<NSString *, IssuesPredicatePlan *> *_plans;
+    NSMutableArray<NSString *> *_lru; // least recently used first
+    NSMutableDictionary<NSString *, NSNumber *> *_generations; // entity name => number of saves that have touched it
+    NSUInteger _epoch; // bumped when all objects are invalidated
+    IssuesPredicateCacheStats *_stats;
+}
+
+@end
+
+static const NSUInteger IssuesPredicateCacheLimit = 256;
+
+@implementation IssuesPredicateCache
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _plans = [NSMutableDictionary new];
+        _lru = [NSMutableArray new];
+        _generations = [NSMutableDictionary new];
+        _stats = [IssuesPredicateCacheStats new];
+    }
+    return self;
+}
+
+- (BOOL)isPlanValid:(IssuesPredicatePlan *)plan {
+    if (plan.generations.count == 0) return YES; // optimizer output depends only on the predicate
+    if (plan.epoch != _epoch) return NO;
+    for (NSString *entity in plan.generations) {
+        if (![plan.generations[entity] isEqual:_generations[entity] ?: @0]) return NO;
+    }
+    return YES;
+}
+
+// Returns a valid plan for key, or nil.
+- (IssuesPredicatePlan *)planForKey:(NSString *)key {
+    @synchronized (self) {
+        IssuesPredicatePlan *plan = _plans[key];
+        if (plan && ![self isPlanValid:plan]) {
+            [_plans removeObjectForKey:key];
+            [_lru removeObject:key];
+            _stats.stale++;
+            plan = nil;
+        }
+        if (plan) {
+            _stats.hits++;
+            [_lru removeObject:key];
+            [_lru addObject:key];
+        } else {
+            _stats.misses++;
+        }
+        return plan;
+    }
+}
+
+- (void)setPlan:(IssuesPredicatePlan *)plan forKey:(NSString *)key {
+    @synchronized (self) {
+        if (_plans[key]) {
+            [_lru removeObject:key];
+        }
+        _plans[key] = plan;
+        [_lru addObject:key];
+        while (_lru.count > IssuesPredicateCacheLimit) {
+            [_plans removeObjectForKey:_lru[0]];
+            [_lru removeObjectAtIndex:0];
+        }
+    }
+}
+
+// Captured before rewriting, so that a save made while rewriting leaves the plan stale rather than wrong.
+- (NSDictionary<NSString *, NSNumber *> *)currentGenerations:(NSUInteger *)outEpoch {
+    @synchronized (self) {
+        *outEpoch = _epoch;
+        return [_generations copy];
+    }
+}
+
+- (void)recordRewriteTime:(NSTimeInterval)elapsed cacheable:(BOOL)cacheable {
+    @synchronized (self) {
+        _stats.rewrites++;
+        _stats.rewriteTime += elapsed;
+        if (!cacheable) {
+            _stats.uncacheable++;
+        }
+    }
+}
+
+- (void)entitiesDidChange:(NSSet<NSString *> *)entityNames {
+    @synchronized (self) {
+        for (NSString *name in entityNames) {
+            _generations[name] = @([_generations[name] unsignedIntegerValue] + 1);
+        }
+    }
+}
+
+- (void)invalidateAll {
+    @synchronized (self) {
+        _epoch++;
+    }
+}
+
+- (IssuesPredicateCacheStats *)stats {
+    @synchronized (self) {
+        IssuesPredicateCacheStats *stats = [IssuesPredicateCacheStats new];
+        stats.hits = _stats.hits;
+        stats.misses = _stats.misses;
+        stats.stale = _stats.stale;
+        stats.uncacheable = _stats.uncacheable;
+        stats.rewrites = _stats.rewrites;
+        stats.rewriteTime = _stats.rewriteTime;
+        stats.count = _plans.count;
+        return stats;
+    }
+}
+
+@end
+
+// An array that IsCacheableConstant rejects, to opt a predicate out of the cache.
+@interface IssuesPredicateUncachedArray : NSArray {
+    NSArray *_values;
+}
+
+- (instancetype)initWithValues:(NSArray *)values;
+
+@end
+
+@implementation IssuesPredicateUncachedArray
+
+- (instancetype)initWithValues:(NSArray *)values {
+    if (self = [super init]) {
+        _values = [values copy];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return _values.count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+    return _values[index];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+@end
+
+NSArray *IssuesPredicateUncachedConstant(NSArray *values) {
+    return [[IssuesPredicateUncachedArray alloc] initWithValues:values];
+}
+
+@interface DataStore (IssuesPredicateCache)
+
+- (IssuesPredicateCache *)issuesPredicateCache;
+
+@end
+
 @implementation DataStore (IssuesPredicate)
 
 static BOOL IsComplexIssueSubqueryPredicateOperator(NSPredicateOperatorType op) {
@@ -104,7 +307,25 @@ static BOOL IsComplexIssueSubqueryPredicateOperator(NSPredicateOperatorType op)
     return NO;
 }
 
-- (NSPredicate *)simplifyComplexIssuePredicateSubqueries:(NSPredicate *)basePredicate moc:(NSManagedObjectContext *)moc {
+// Adds the names of entity and of each entity reached by the key paths in predicate (relative to entity) to entityNames.
+- (void)addEntitiesReadByPredicate:(NSPredicate *)predicate entity:(NSEntityDescription *)entity to:(NSMutableSet *)entityNames {
+    [entityNames addObject:entity.name];
+    [predicate syntaxTreeContainsExpressionsMatchingPredicate:[NSPredicate predicateWithBlock:^BOOL(NSExpression *expr, NSDictionary *bindings) {
+        if (expr.expressionType == NSKeyPathExpressionType) {
+            NSEntityDescription *current = entity;
+            for (NSString *key in [expr.keyPath componentsSeparatedByString:@"."]) {
+                current = current.relationshipsByName[key].destinationEntity;
+                if (!current) break;
+                [entityNames addObject:current.name];
+            }
+        }
+        return NO;
+    }]];
+}
+
+// entityNames collects the entities read to expand subqueries. cacheable is set to NO if the expansion
+// may differ without any of them changing (e.g. because it uses now()).
+- (NSPredicate *)simplifyComplexIssuePredicateSubqueries:(NSPredicate *)basePredicate moc:(NSManagedObjectContext *)moc entitiesRead:(NSMutableSet *)entityNames cacheable:(BOOL *)cacheable {
     return [basePredicate predicateByRewriting:^NSPredicate *(NSPredicate *original) {
         // look for expressions of the form count(subquery(keypath, $x, $x OP expr [OR|AND ...])) where OP is not one of {IN, =, !=}
         if ([original isKindOfClass:[NSComparisonPredicate class]]) {
@@ -117,15 +338,23 @@ static BOOL IsComplexIssueSubqueryPredicateOperator(NSPredicateOperatorType op)
                 && [c0.leftExpression.arguments.firstObject expressionType] == NSSubqueryExpressionType
                 && [self isComplexIssueSubquery:c0.leftExpression.arguments.firstObject entityName:&entityName entityProperty:&entityProperty entityPredicate:&entityPredicate])
             {
+                // Object IDs, rather than objects, so the result can be cached and used with other contexts.
                 NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:entityName];
                 fetch.predicate = entityPredicate;
+                fetch.resultType = NSManagedObjectIDResultType;
                 NSError *error = nil;
                 NSArray *matches = [moc executeFetchRequest:fetch error:&error];
                 if (error) {
                     ErrLog(@"%@", error);
+                    *cacheable = NO;
                     return original;
                 }
                 
+                [self addEntitiesReadByPredicate:entityPredicate entity:self.mom.entitiesByName[entityName] to:entityNames];
+                if ([entityPredicate syntaxTreeContainsExpressionsMatchingPredicate:[NSPredicate predicateWithFormat:@"expressionType == %ld", NSFunctionExpressionType]]) {
+                    *cacheable = NO;
+                }
+                
                 NSComparisonPredicate *subqP = [NSComparisonPredicate predicateWithLeftExpression:[NSExpression expressionForVariable:@"x"] rightExpression:[NSExpression expressionForConstantValue:matches] modifier:NSDirectPredicateModifier type:NSInPredicateOperatorType options:0];
                 NSExpression *newSubq = [NSExpression expressionForSubquery:[NSExpression expressionForKeyPath:entityProperty] usingIteratorVariable:@"x" predicate:subqP];
                 
@@ -140,7 +369,7 @@ static BOOL IsComplexIssueSubqueryPredicateOperator(NSPredicateOperatorType op)
     }];
 }
 
-- (NSPredicate *)issuesPredicate:(NSPredicate *)basePredicate moc:(NSManagedObjectContext *)moc {
+- (NSPredicate *)issuesVisiblePredicate {
     NSPredicate *extra = nil;
     if (self.billing.limited) {
         if (DefaultsPullRequestsEnabled()) {
@@ -155,11 +384,133 @@ static BOOL IsComplexIssueSubqueryPredicateOperator(NSPredicateOperatorType op)
             extra = [NSPredicate predicateWithFormat:@"repository.disabled = NO AND repository.hidden = nil AND repository.fullName != nil AND pullRequest = NO"];
         }
     }
+    return extra;
+}
+
+static BOOL IsCacheableConstant(id value) {
+    if ([value isKindOfClass:[IssuesPredicateUncachedArray class]]) {
+        return NO;
+    }
+    if (!value || value == [NSNull null]
+        || [value isKindOfClass:[NSString class]]
+        || [value isKindOfClass:[NSNumber class]]
+        || [value isKindOfClass:[NSDate class]])
+    {
+        return YES;
+    }
+    if ([value isKindOfClass:[NSArray class]] || [value isKindOfClass:[NSSet class]] || [value isKindOfClass:[NSOrderedSet class]]) {
+        for (id member in value) {
+            if (!IsCacheableConstant(member)) return NO;
+        }
+        return YES;
+    }
+    return NO;
+}
+
+// Returns the key to cache basePredicate's rewrite under, or nil if it shouldn't be cached.
+// The format identifies a predicate, as long as it is made only of comparisons of plain values
+// (objects and blocks print as pointers, which may be reused).
+static NSString *IssuesPredicateCacheKey(NSPredicate *basePredicate) {
+    __block BOOL cacheable = YES;
+    [basePredicate predicateByRewriting:^NSPredicate *(NSPredicate *original) {
+        if ([original isKindOfClass:[NSComparisonPredicate class]]) {
+            NSComparisonPredicate *c0 = (id)original;
+            if (c0.predicateOperatorType == NSCustomSelectorPredicateOperatorType) {
+                cacheable = NO;
+            } else if ([original syntaxTreeContainsExpressionsMatchingPredicate:[NSPredicate predicateWithBlock:^BOOL(NSExpression *expr, NSDictionary *bindings) {
+                return expr.expressionType == NSBlockExpressionType
+                    || (expr.expressionType == NSConstantValueExpressionType && !IsCacheableConstant(expr.constantValue));
+            }]]) {
+                cacheable = NO;
+            }
+        } else if (![original isKindOfClass:[NSCompoundPredicate class]]) {
+            NSString *format = original.predicateFormat;
+            if (![format isEqualToString:@"TRUEPREDICATE"] && ![format isEqualToString:@"FALSEPREDICATE"]) {
+                cacheable = NO;
+            }
+        }
+        return original;
+    }];
+    return cacheable ? basePredicate.predicateFormat : nil;
+}
+
+static const void *IssuesPredicateCacheAssociatedKey = &IssuesPredicateCacheAssociatedKey;
+
+- (IssuesPredicateCache *)issuesPredicateCache {
+    @synchronized (self) {
+        IssuesPredicateCache *cache = objc_getAssociatedObject(self, IssuesPredicateCacheAssociatedKey);
+        if (!cache) {
+            cache = [IssuesPredicateCache new];
+            objc_setAssociatedObject(self, IssuesPredicateCacheAssociatedKey, cache, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+        }
+        return cache;
+    }
+}
+
+- (IssuesPredicateCacheStats *)issuesPredicateCacheStats {
+    return [[self issuesPredicateCache] stats];
+}
+
+- (NSPredicate *)issuesPredicate:(NSPredicate *)basePredicate moc:(NSManagedObjectContext *)moc {
+    NSPredicate *extra = [self issuesVisiblePredicate];
     
-    NSPredicate *rewrite = [QueryOptimizer optimizeIssuesPredicate:basePredicate];
-    rewrite = [self simplifyComplexIssuePredicateSubqueries:rewrite moc:moc];
+    IssuesPredicateCache *cache = [self issuesPredicateCache];
+    NSString *key = IssuesPredicateCacheKey(basePredicate);
+    IssuesPredicatePlan *plan = key ? [cache planForKey:key] : nil;
     
-    return [[rewrite coreDataPredicate] and:extra];
+    if (!plan) {
+        double start = [NSDate extras_monotonicTime];
+        NSUInteger epoch = 0;
+        NSDictionary *generations = [cache currentGenerations:&epoch];
+        NSMutableSet *entitiesRead = [NSMutableSet new];
+        BOOL cacheable = key != nil;
+        
+        NSPredicate *rewrite = [QueryOptimizer optimizeIssuesPredicate:basePredicate];
+        rewrite = [self simplifyComplexIssuePredicateSubqueries:rewrite moc:moc entitiesRead:entitiesRead cacheable:&cacheable];
+        
+        plan = [IssuesPredicatePlan new];
+        plan.predicate = rewrite;
+        plan.epoch = epoch;
+        NSMutableDictionary *dependencies = [NSMutableDictionary new];
+        for (NSString *entity in entitiesRead) {
+            dependencies[entity] = generations[entity] ?: @0;
+        }
+        plan.generations = dependencies;
+        
+        [cache recordRewriteTime:[NSDate extras_monotonicTime] - start cacheable:cacheable];
+        if (cacheable) {
+            [cache setPlan:plan forKey:key];
+        }
+    }
+    
+    // Folded on each use, as the plan may contain functions such as now()
+    return [[plan.predicate coreDataPredicate] and:extra];
+}
+
+@end
+
+@implementation DataStore (IssuesPredicateInternal)
+
+- (void)invalidateIssuesPredicatesWithSave:(NSNotification *)note {
+    IssuesPredicateCache *cache = [self issuesPredicateCache];
+    if (note.userInfo[NSInvalidatedAllObjectsKey]) {
+        [cache invalidateAll];
+        return;
+    }
+    
+    NSMutableSet *entityNames = [NSMutableSet new];
+    for (NSString *changeKey in @[NSInsertedObjectsKey, NSUpdatedObjectsKey, NSDeletedObjectsKey, NSInvalidatedObjectsKey, NSRefreshedObjectsKey]) {
+        for (NSManagedObject *obj in note.userInfo[changeKey]) {
+            // Plans record the destination entity of the relationships they read, which may be
+            // an abstract parent of the entity saved here (e.g. LocalAccount for a LocalUser)
+            for (NSEntityDescription *entity = obj.entity; entity; entity = entity.superentity) {
+                [entityNames addObject:entity.name];
+            }
+        }
+    }
+    if (entityNames.count) {
+        [cache entitiesDidChange:entityNames];
+    }
 }
 
 @end
@@ -26,6 +26,8 @@
 @class PRComment;
 @class PRReview;
 @class CommitComment;
+@class ReadContextPoolStats;
+@class WriteCoalescerStats;
 
 @interface DataStore : NSObject
 
@@ -56,11 +58,23 @@
 
 @property (readonly) ServerConnection *serverConnection;
 
-@property (readonly) NSUInteger readWidth; // Number of parallel readers available for querying DataStore
+@property (readonly) NSUInteger readWidth; // Maximum number of parallel readers available for querying DataStore
+
+- (ReadContextPoolStats *)readStats; // Wait and execution times and queue depth of reads so far
+- (WriteCoalescerStats *)writeStats; // Batch sizes and latency of coalesced writes so far
 
 - (void)issuesMatchingPredicate:(NSPredicate *)predicate completion:(void (^)(NSArray<Issue*> *issues, NSError *error))completion;
 - (void)issuesMatchingPredicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor*> *)sortDescriptors completion:(void (^)(NSArray<Issue*> *issues, NSError *error))completion;
 - (void)issuesMatchingPredicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor*> *)sortDescriptors options:(NSDictionary *)options completion:(void (^)(NSArray<Issue*> *issues, NSError *error))completion;
+
+// For tables of potentially many issues. Issues are built with IssueOptionTableRow, a page at a time.
+// completion is called with the first pageSize issues as soon as they're ready (complete = NO), unless that's all of them,
+// and then again with all of them (complete = YES).
+- (void)issueRowsMatchingPredicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor*> *)sortDescriptors options:(NSDictionary *)options pageSize:(NSUInteger)pageSize completion:(void (^)(NSArray<Issue*> *issues, BOOL complete, NSError *error))completion;
+
+// As above, but if more than limit issues match, none of them are read, and completion is called once with nil issues and no error.
+- (void)issueRowsMatchingPredicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor*> *)sortDescriptors options:(NSDictionary *)options pageSize:(NSUInteger)pageSize limit:(NSUInteger)limit completion:(void (^)(NSArray<Issue*> *issues, BOOL complete, NSError *error))completion;
+
 - (void)countIssuesMatchingPredicate:(NSPredicate *)predicate completion:(void (^)(NSUInteger count, NSError *error))completion;
 
 // Utility for returning a predicate matching issues with fullIdentifier in issueIdentifiers.
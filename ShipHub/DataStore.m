@@ -8,6 +8,8 @@
 
 #import "DataStoreInternal.h"
 #import "DataStore+IssuesPredicate.h"
+#import "DataStore+IssueCounts.h"
+#import "DataStore+FullTextIndex.h"
 
 #import "Analytics.h"
 #import "Auth.h"
@@ -21,10 +23,14 @@
 #import "NSPredicate+Extras.h"
 #import "JSON.h"
 #import "TimeSeries.h"
+#import "IssueTimeIndex.h"
 #import "GHNotificationManager.h"
 #import "Billing.h"
 #import "RequestPager.h"
 #import "QueryOptimizer.h"
+#import "ReadContextPool.h"
+#import "WriteCoalescer.h"
+#import "SyncWritePlan.h"
 
 #import "LocalAccount.h"
 #import "LocalRepo.h"
@@ -115,8 +121,6 @@ NSString *const DataStoreRateLimitUpdatedEndDateKey = @"DataStoreRateLimitUpdate
 
 @interface ReadOnlyManagedObjectContext : NSManagedObjectContext
 
-@property NSUInteger writeGeneration;
-
 @end
 
 /*
@@ -151,16 +155,19 @@ static const NSInteger CurrentLocalModelVersion = 23;
     NSString *_purgeVersion;
     
     NSMutableDictionary *_syncCache; // only manipulated within _moc.
+    BOOL _syncCacheIsComplete; // YES if every unsaved object in _writeMoc is in _syncCache
     
     NSInteger _initialSyncProgress;
     
     BOOL _sentNetworkActivityBegan;
     
     dispatch_queue_t _dbq;
-    dispatch_queue_t _readMocsQ;
-    dispatch_semaphore_t _readSema;
+    ReadContextPool *_readPool;
+    WriteCoalescer *_writeCoalescer;
     
-    NSUInteger _writeGeneration;
+    MetadataChangeSet *_unsavedMetadataChanges; // only manipulated within _writeMoc.
+    MetadataChangeSet *_pendingMetadataChanges; // saved, but not yet in metadataStore. protected by @synchronized(self).
+    BOOL _metadataUpdateScheduled;
     
     NSTimer *_rateLimitTimer;
     
@@ -178,7 +185,6 @@ static const NSInteger CurrentLocalModelVersion = 23;
 @property (strong) NSManagedObjectModel *mom;
 @property (strong) NSDictionary *syncEntityToMomEntity;
 @property (strong) NSManagedObjectContext *writeMoc;
-@property (strong) NSMutableArray<ReadOnlyManagedObjectContext *> *readMocs;
 @property (strong) NSPersistentStore *persistentStore;
 @property (strong) NSPersistentStoreCoordinator *persistentCoordinator;
 
@@ -287,6 +293,7 @@ static DataStore *sActiveStore = nil;
         
         [self loadMetadata];
         [self loadQueries];
+        [self rebuildFullTextIndex];
         [self updateSyncConnectionWithVersions];
         
         _ghNotificationManager = [[GHNotificationManager alloc] initWithDataStore:self];
@@ -331,15 +338,7 @@ static NSString *const LastUpdated = @"LastUpdated";
     _mom = [[NSManagedObjectModel alloc] initWithContentsOfURL:momURL];
     NSAssert(_mom, @"Must load mom from %@", momURL);
     
-    NSMutableDictionary *syncEntityToMomEntity = [NSMutableDictionary new];
-    for (NSEntityDescription *entityDesc in _mom.entities) {
-        NSString *entityName = entityDesc.name;
-        if ([entityName hasPrefix:@"Local"]) {
-            NSString *syncName = [[entityName substringFromIndex:5] lowercaseString];
-            syncEntityToMomEntity[syncName] = entityName;
-        }
-    }
-    _syncEntityToMomEntity = syncEntityToMomEntity;
+    _syncEntityToMomEntity = [SyncWritePlan syncEntityNamesForModel:_mom];
     
     _persistentCoordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:_mom];
     NSAssert(_persistentCoordinator, @"Must load coordinator");
@@ -422,30 +421,40 @@ static NSString *const LastUpdated = @"LastUpdated";
     _writeMoc.persistentStoreCoordinator = _persistentCoordinator;
     _writeMoc.undoManager = nil; // don't care about undo-ing here, and it costs performance to have an undo manager.
     
+    // Read contexts are made on demand, up to one per CPU, and trimmed back to 2 when idle.
     NSUInteger ncpus = [[NSProcessInfo processInfo] processorCount];
-    NSMutableArray *readMocs = [NSMutableArray arrayWithCapacity:ncpus];
-    for (NSUInteger i = 0; i < ncpus; i++) {
+    BOOL sharedCoordinator = &NSPersistentStoreConnectionPoolMaxSizeKey != NULL; // 10.12 / iOS 10
+    NSPersistentStoreCoordinator *writeCoordinator = _persistentCoordinator;
+    NSManagedObjectModel *mom = _mom;
+    _readPool = [[ReadContextPool alloc] initWithMinimumSize:MIN(2, ncpus) maximumSize:MAX(ncpus, 1) mergesSaves:sharedCoordinator factory:^NSManagedObjectContext *{
         NSManagedObjectContext *readMoc = [[ReadOnlyManagedObjectContext alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType];
         
-        if (&NSPersistentStoreConnectionPoolMaxSizeKey != NULL) {
-            readMoc.persistentStoreCoordinator = _persistentCoordinator; // 10.12 / iOS 10
+        if (sharedCoordinator) {
+            readMoc.persistentStoreCoordinator = writeCoordinator;
         } else {
             // 10.11 / iOS 9
-            NSPersistentStoreCoordinator *pc = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:_mom];
+            NSPersistentStoreCoordinator *pc = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:mom];
             [pc addPersistentStoreWithType:NSSQLiteStoreType configuration:@"Default" URL:storeURL options:@{NSReadOnlyPersistentStoreOption : @YES } error:NULL];
             readMoc.persistentStoreCoordinator = pc;
         }
         
         readMoc.undoManager = nil;
-        [readMocs addObject:readMoc];
-    }
-    _readMocs = readMocs;
-    _readMocsQ = dispatch_queue_create("DataStore.readMocs", NULL);
-    _readWidth = readMocs.count;
-    _readSema = dispatch_semaphore_create(_readMocs.count);
+        return readMoc;
+    }];
+    _readWidth = _readPool.maximumSize;
     _dbq = dispatch_queue_create("DataStore.dbq", DISPATCH_QUEUE_CONCURRENT);
     
+    NSTimeInterval groupCommitWindow = [[Defaults defaults] integerForKey:DefaultsGroupCommitWindowKey fallback:10] / 1000.0;
+    __weak __typeof(self) weakSelf = self;
+    _writeCoalescer = [[WriteCoalescer alloc] initWithWindow:groupCommitWindow maximumBatchSize:64 schedule:^{
+        [weakSelf commitCoalescedWrites];
+    }];
+    _writeCoalescer.didRollback = ^(NSManagedObjectContext *moc) {
+        [weakSelf discardUnsavedChangeTracking];
+    };
+    
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(mocDidChange:) name:NSManagedObjectContextObjectsDidChangeNotification object:_writeMoc];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(mocDidSave:) name:NSManagedObjectContextDidSaveNotification object:_writeMoc];
     
     BOOL needsSnapshotRebuild = NO;
     BOOL needsKeywordUsageRebuild = NO;
@@ -651,51 +660,66 @@ static NSString *const LastUpdated = @"LastUpdated";
 - (void)performWrite:(void (^)(NSManagedObjectContext *moc))block {
     NSParameterAssert(block);
     
+    [_writeCoalescer flush];
     dispatch_barrier_async(_dbq, ^{
         [_writeMoc performBlockAndWait:^{
             block(_writeMoc);
             [_writeMoc reset];
         }];
-        _writeGeneration++;
     });
 }
 
 - (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block {
     NSParameterAssert(block);
     
+    [_writeCoalescer flush];
     dispatch_barrier_sync(_dbq, ^{
         [_writeMoc performBlockAndWait:^{
             block(_writeMoc);
         }];
-        _writeGeneration++;
     });
 }
 
+// Like performWrite:, but block is saved together with other coalesced writes queued around the same time.
+// block must not call save:. completion is called with the result of the save, on _writeMoc's queue.
+// Writes queued by performWrite: or performWriteAndWait: are ordered after any coalesced writes queued before them.
+- (void)performCoalescedWrite:(void (^)(NSManagedObjectContext *moc))block completion:(void (^)(NSError *error))completion {
+    NSParameterAssert(block);
+    
+    [_writeCoalescer addWrite:block completion:completion];
+}
+
+- (void)commitCoalescedWrites {
+    dispatch_barrier_async(_dbq, ^{
+        [_writeMoc performBlockAndWait:^{
+            [_writeCoalescer commitInContext:_writeMoc];
+        }];
+    });
+}
+
+- (WriteCoalescerStats *)writeStats {
+    return [_writeCoalescer stats];
+}
+
 - (void)performRead:(void (^)(NSManagedObjectContext *moc))block {
+    double requested = [_readPool readRequested];
     dispatch_async(_dbq, ^{
-        dispatch_semaphore_wait(_readSema, DISPATCH_TIME_FOREVER);
-        __block ReadOnlyManagedObjectContext *reader = nil;
-        dispatch_sync(_readMocsQ, ^{
-            reader = [_readMocs lastObject];
-            [_readMocs removeLastObject];
-        });
-        
-        
-        [reader performBlockAndWait:^{
-            if (reader.writeGeneration != _writeGeneration) {
-                [reader reset];
-                reader.writeGeneration = _writeGeneration;
-            }
-            block(reader);
-        }];
-        
-        dispatch_sync(_readMocsQ, ^{
-            [_readMocs addObject:reader];
-        });
-        dispatch_semaphore_signal(_readSema);
+        [_readPool performRead:block requestedAt:requested];
+    });
+}
+
+// Like performRead:, but excludes other reads and writes while block runs.
+- (void)performBarrierRead:(void (^)(NSManagedObjectContext *moc))block {
+    double requested = [_readPool readRequested];
+    dispatch_barrier_async(_dbq, ^{
+        [_readPool performRead:block requestedAt:requested];
     });
 }
 
+- (ReadContextPoolStats *)readStats {
+    return [_readPool stats];
+}
+
 - (void)migrationRebuildSnapshots:(BOOL)rebuildSnapshots
               rebuildKeywordUsage:(BOOL)rebuildKeywordUsage
                      withProgress:(NSProgress *)progress
@@ -840,7 +864,7 @@ static NSString *const LastUpdated = @"LastUpdated";
     if (!obj) {
         NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:entityName];
         fetch.predicate = [NSPredicate predicateWithFormat:@"identifier = %@", identifier];
-        fetch.includesPendingChanges = _syncCache == nil; // If it were pending, we'd already know about it in our cache
+        fetch.includesPendingChanges = !_syncCacheIsComplete; // If it were pending, we'd already know about it in our cache
         fetch.fetchLimit = 1;
         obj = [[_writeMoc executeFetchRequest:fetch error:NULL] firstObject];
         if (obj) {
@@ -871,7 +895,7 @@ static NSString *const LastUpdated = @"LastUpdated";
     if (toFetch.count) {
         NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:entityName];
         fetch.predicate = [NSPredicate predicateWithFormat:@"identifier IN %@", toFetch];
-        fetch.includesPendingChanges = _syncCache == nil; // If it were pending, we'd already know about it in our cache
+        fetch.includesPendingChanges = !_syncCacheIsComplete; // If it were pending, we'd already know about it in our cache
         NSArray *found = [_writeMoc executeFetchRequest:fetch error:NULL];
         for (id obj in found) {
             NSNumber *identifier = [obj identifier];
@@ -1084,128 +1108,6 @@ static NSString *const LastUpdated = @"LastUpdated";
     }
 }
 
-- (NSDictionary<NSString *, NSSet *> *)identifiersInSyncEntries:(NSArray<SyncEntry *> *)entries {
-    NSArray *entriesByEntity = [entries partitionByKeyPath:@"entityName"];
-    NSMutableDictionary *identifiers = [NSMutableDictionary new];
-    
-    void (^note)(NSString *, NSNumber *) = ^(NSString *entityName, NSNumber *identifier) {
-        NSMutableSet *s = identifiers[entityName];
-        if (!s) {
-            identifiers[entityName] = s = [NSMutableSet new];
-        }
-        [s addObject:identifier];
-    };
-    
-    void (^noteArr)(NSString *, NSArray *) = ^(NSString *entityName, NSArray *arr) {
-        NSMutableSet *s = identifiers[entityName];
-        if (!s) {
-            identifiers[entityName] = s = [NSMutableSet new];
-        }
-        [s addObjectsFromArray:arr];
-    };
-    
-    for (NSArray *part in entriesByEntity) {
-        SyncEntry *r = part[0];
-        NSString *type = r.entityName;
-        NSString *entityName = _syncEntityToMomEntity[type];
-        if (!entityName) continue;
-        NSEntityDescription *entity = _mom.entitiesByName[entityName];
-        NSAssert(entity != nil, @"must find entity");
-        
-        for (SyncEntry *e in part) {
-            note(entityName, e.data[@"identifier"]);
-        }
-        
-        NSDictionary *relationships = entity.relationshipsByName;
-        for (NSString *key in [relationships allKeys]) {
-            NSRelationshipDescription *rel = relationships[key];
-            
-            if ([key isEqualToString:@"labels"]) {
-                continue;
-            }
-            
-            NSString *syncDictKey = rel.userInfo[@"jsonKey"];
-            if (!syncDictKey) syncDictKey = key;
-            
-            for (SyncEntry *e in part) {
-                if (e.action != SyncEntryActionSet) continue;
-                
-                if (rel.toMany) {
-                    // to many relationships refer by identifiers or by actual populated objects that have identifiers
-                    NSArray *related = e.data[syncDictKey];
-                    
-                    if (!related) {
-                        continue;
-                    }
-                    
-                    NSArray *relatedIDs = nil;
-                    if ([[related firstObject] isKindOfClass:[NSDictionary class]]) {
-                        relatedIDs = [related arrayByMappingObjects:^id(NSDictionary *x) {
-                            return x[@"identifier"];
-                        }];
-                    } else {
-                        relatedIDs = related;
-                    }
-                    if (!relatedIDs) relatedIDs = @[];
-                    
-                    noteArr(rel.destinationEntity.name, relatedIDs);
-                } else {
-                    id related = e.data[syncDictKey];
-                    
-                    if (!related) continue;
-                    
-                    id relatedID = related;
-                    if ([related isKindOfClass:[NSDictionary class]]) {
-                        relatedID = related[@"identifier"];
-                    } else if (related == [NSNull null]) {
-                        relatedID = nil;
-                    }
-
-                    if (relatedID) {
-                        note(rel.destinationEntity.name, relatedID);
-                    }
-                }
-            }
-        }
-    }
-    
-    return identifiers;
-}
-
-// must be called on _writeMoc. Does not call save:.
-- (void)ensureEntitiesForIdentifiers:(NSDictionary<NSString *, NSSet *> *)identifiers {
-    for (NSString *entityName in identifiers) {
-        NSSet *idNums = identifiers[entityName];
-        
-        NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:entityName];
-        fetch.predicate = [NSPredicate predicateWithFormat:@"identifier IN %@", idNums];
-        
-        NSError *err = nil;
-        NSArray *existing = [_writeMoc executeFetchRequest:fetch error:&err];
-        if (err) {
-            ErrLog(@"%@", err);
-            err = nil;
-        }
-        
-        NSDictionary *lookup = [NSDictionary lookupWithObjects:existing keyPath:@"identifier"];
-        
-        for (NSNumber *identifier in idNums) {
-            NSManagedObject *obj = lookup[identifier];
-            if (!obj) {
-                NSEntityDescription *entity = _mom.entitiesByName[entityName];
-                if (!entity.abstract) {
-                    obj = [NSEntityDescription insertNewObjectForEntityForName:entityName inManagedObjectContext:_writeMoc];
-                    [obj setValue:identifier forKey:@"identifier"];
-                } else {
-                    continue;
-                }
-            }
-            id key = [self cacheKeyWithObject:obj];
-            _syncCache[key] = obj;
-        }
-    }
-}
-
 static void partitionMixedSyncEntries(NSArray<SyncEntry *> *mixedEntries, NSArray<SyncEntry *> *__autoreleasing* ghEntries, NSArray<SyncEntry *> *__autoreleasing* queryEntries) {
     NSMutableArray *gh = [NSMutableArray arrayWithCapacity:mixedEntries.count];
     NSMutableArray *q = [NSMutableArray arrayWithCapacity:0];
@@ -1227,21 +1129,24 @@ static void partitionMixedSyncEntries(NSArray<SyncEntry *> *mixedEntries, NSArra
     NSArray<SyncEntry *> *entries = nil, *queryEntries = nil;
     partitionMixedSyncEntries(mixedEntries, &entries, &queryEntries);
     
-    NSDictionary *identifiers = [self identifiersInSyncEntries:entries];
+    // Plan outside of the write queue. Nothing here touches Core Data.
+    SyncWritePlan *plan = [[SyncWritePlan alloc] initWithModel:_mom syncEntityNames:_syncEntityToMomEntity];
+    [plan addEntries:entries];
     
-    [self performWrite:^(NSManagedObjectContext *moc) {
-        _syncCache = [NSMutableDictionary new];
+    // Sync frames can arrive in quick succession, so save them in batches.
+    [self performCoalescedWrite:^(NSManagedObjectContext *moc) {
+        BOOL hadChanges = moc.hasChanges; // from earlier writes in the same batch
+        [plan executeInContext:moc];
         
-        [self ensureEntitiesForIdentifiers:identifiers];
+        _syncCache = [plan.objectCache mutableCopy];
+        _syncCacheIsComplete = !hadChanges;
         
-        [self writeSyncObjects:entries];
         [self writeSyncQueries:queryEntries];
         [self updateSyncVersions:versions];
         
         _syncCache = nil;
-        
-        NSError *error = nil;
-        [moc save:&error];
+        _syncCacheIsComplete = NO;
+    } completion:^(NSError *error) {
         if (error) ErrLog("%@", error);
         
         dispatch_async(dispatch_get_main_queue(), ^{
@@ -1474,14 +1379,18 @@ static void partitionMixedSyncEntries(NSArray<SyncEntry *> *mixedEntries, NSArra
 - (void)mocDidChange:(NSNotification *)note {
     //DebugLog(@"%@", note);
     
-    if ([MetadataStore changeNotificationContainsMetadata:note]) {
-        DebugLog(@"Updating metadata store");
-        MetadataStore *store = [[MetadataStore alloc] initWithMOC:_writeMoc billingState:_billing.state currentUserIdentifier:_auth.account.ghIdentifier];
-        self.metadataStore = store;
-        dispatch_async(dispatch_get_main_queue(), ^{
-            NSDictionary *userInfo = @{ DataStoreMetadataKey : store };
-            [[NSNotificationCenter defaultCenter] postNotificationName:DataStoreDidUpdateMetadataNotification object:self userInfo:userInfo];
-        });
+    MetadataChangeSet *metadataChanges = [MetadataStore changeSetWithNotification:note];
+    [self updateIssueCountsWithChange:note];
+    [self updateFullTextIndexWithChange:note];
+    
+    if (note.userInfo[NSInvalidatedAllObjectsKey]) {
+        _unsavedMetadataChanges = nil;
+    } else if (metadataChanges) {
+        if (_unsavedMetadataChanges) {
+            [_unsavedMetadataChanges unionChangeSet:metadataChanges];
+        } else {
+            _unsavedMetadataChanges = metadataChanges;
+        }
     }
     
     [self checkForCustomQueryChanges:note];
@@ -1498,6 +1407,97 @@ static void partitionMixedSyncEntries(NSArray<SyncEntry *> *mixedEntries, NSArra
     }
 }
 
+// Forgets what mocDidChange: accumulated for _writeMoc's unsaved changes, after they've been rolled back.
+- (void)discardUnsavedChangeTracking {
+    [self discardIssueCountChanges];
+    [self discardFullTextIndexChanges];
+    _unsavedMetadataChanges = nil;
+}
+
+- (void)mocDidSave:(NSNotification *)note {
+    [_readPool writeContextDidSave:note];
+    [self commitIssueCountChanges];
+    [self commitFullTextIndexChanges];
+    [self invalidateIssuesPredicatesWithSave:note];
+    
+    if (_unsavedMetadataChanges) {
+        MetadataChangeSet *changes = _unsavedMetadataChanges;
+        _unsavedMetadataChanges = nil;
+        if (changes.containsInsertions) {
+            [self applyMetadataChangesInWriteContext:changes];
+        } else {
+            [self scheduleMetadataUpdate:changes];
+        }
+    }
+}
+
+// Call within _writeMoc, inside the write that saved changes.
+// Changes that insert metadata are applied before the write barrier ends, so that no read queued
+// behind the write sees an issue referring to (say) a new milestone before the store has it.
+- (void)applyMetadataChangesInWriteContext:(MetadataChangeSet *)changes {
+    MetadataChangeSet *pending = changes;
+    @synchronized (self) {
+        // Fold in anything saved earlier that's still waiting for a read, so the store only moves forward.
+        // The scheduled read will find nothing left to do.
+        if (_pendingMetadataChanges) {
+            [_pendingMetadataChanges unionChangeSet:changes];
+            pending = _pendingMetadataChanges;
+            _pendingMetadataChanges = nil;
+        }
+    }
+    
+    [self updateMetadataStoreWithChanges:pending moc:_writeMoc];
+}
+
+// Rebuilds the metadata store from a read context once the write that saved changes completes,
+// re-reading only what changes touched. Reads run in the meantime keep using the previous store,
+// which is fine as long as changes don't insert anything (see applyMetadataChangesInWriteContext:).
+- (void)scheduleMetadataUpdate:(MetadataChangeSet *)changes {
+    BOOL schedule = NO;
+    @synchronized (self) {
+        if (_pendingMetadataChanges) {
+            [_pendingMetadataChanges unionChangeSet:changes];
+        } else {
+            _pendingMetadataChanges = changes;
+        }
+        if (!_metadataUpdateScheduled) {
+            schedule = YES;
+            _metadataUpdateScheduled = YES;
+        }
+    }
+    
+    if (!schedule) return;
+    
+    [self performRead:^(NSManagedObjectContext *moc) {
+        MetadataChangeSet *pending = nil;
+        @synchronized (self) {
+            pending = _pendingMetadataChanges;
+            _pendingMetadataChanges = nil;
+            _metadataUpdateScheduled = NO;
+        }
+        if (!pending) return;
+        
+        [self updateMetadataStoreWithChanges:pending moc:moc];
+    }];
+}
+
+// Must be called on moc's queue, once changes have been saved.
+- (void)updateMetadataStoreWithChanges:(MetadataChangeSet *)changes moc:(NSManagedObjectContext *)moc {
+    DebugLog(@"Updating metadata store with %@", changes);
+    MetadataStore *previous = self.metadataStore;
+    MetadataStore *store = nil;
+    if (previous) {
+        store = [previous storeByApplyingChangeSet:changes moc:moc billingState:_billing.state currentUserIdentifier:_auth.account.ghIdentifier];
+    } else {
+        store = [[MetadataStore alloc] initWithMOC:moc billingState:_billing.state currentUserIdentifier:_auth.account.ghIdentifier];
+    }
+    self.metadataStore = store;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        NSDictionary *userInfo = @{ DataStoreMetadataKey : store };
+        [[NSNotificationCenter defaultCenter] postNotificationName:DataStoreDidUpdateMetadataNotification object:self userInfo:userInfo];
+    });
+}
+
 - (void)issuesMatchingPredicate:(NSPredicate *)predicate completion:(void (^)(NSArray<Issue*> *issues, NSError *error))completion {
     return [self issuesMatchingPredicate:predicate sortDescriptors:@[] options:nil completion:completion];
 }
@@ -1544,6 +1544,103 @@ static void partitionMixedSyncEntries(NSArray<SyncEntry *> *mixedEntries, NSArra
 
 }
 
+- (void)issueRowsMatchingPredicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor*> *)sortDescriptors options:(NSDictionary *)options pageSize:(NSUInteger)pageSize completion:(void (^)(NSArray<Issue*> *issues, BOOL complete, NSError *error))completion {
+    [self issueRowsMatchingPredicate:predicate sortDescriptors:sortDescriptors options:options pageSize:pageSize limit:NSUIntegerMax completion:completion];
+}
+
+- (void)issueRowsMatchingPredicate:(NSPredicate *)predicate sortDescriptors:(NSArray<NSSortDescriptor*> *)sortDescriptors options:(NSDictionary *)options pageSize:(NSUInteger)pageSize limit:(NSUInteger)limit completion:(void (^)(NSArray<Issue*> *issues, BOOL complete, NSError *error))completion {
+    NSParameterAssert(pageSize > 0);
+    
+    NSMutableDictionary *rowOptions = [options mutableCopy] ?: [NSMutableDictionary new];
+    rowOptions[IssueOptionTableRow] = @YES;
+    
+    [self performRead:^(NSManagedObjectContext *moc) {
+        NSMutableArray *results = nil;
+        NSError *error = nil;
+        @try {
+#if DEBUG
+            CFAbsoluteTime t0 = CFAbsoluteTimeGetCurrent();
+#endif
+            // Find the matching issues and their order without reading any of them
+            NSFetchRequest *idsFetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+            idsFetch.predicate = [self issuesPredicate:predicate moc:moc];
+            idsFetch.sortDescriptors = sortDescriptors;
+            idsFetch.resultType = NSManagedObjectIDResultType;
+            if (limit < NSUIntegerMax) {
+                idsFetch.fetchLimit = limit + 1;
+            }
+            
+            NSError *err = nil;
+            NSArray<NSManagedObjectID *> *objectIDs = [moc executeFetchRequest:idsFetch error:&err];
+            if (err) {
+                ErrLog(@"%@", err);
+            }
+            
+            if (objectIDs.count > limit) {
+                RunOnMain(^{
+                    completion(nil, YES, nil);
+                });
+                return;
+            }
+            
+            MetadataStore *ms = self.metadataStore;
+            results = [NSMutableArray arrayWithCapacity:objectIDs.count];
+            
+            for (NSUInteger start = 0; start < objectIDs.count; start += pageSize) {
+                @autoreleasepool {
+                    NSArray *pageIDs = [objectIDs subarrayWithRange:NSMakeRange(start, MIN(pageSize, objectIDs.count - start))];
+                    
+                    NSFetchRequest *pageFetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+                    pageFetch.predicate = [NSPredicate predicateWithFormat:@"SELF IN %@", pageIDs];
+                    pageFetch.relationshipKeyPathsForPrefetching = @[@"assignees", @"labels", @"notification.unread", @"pr"];
+                    pageFetch.returnsObjectsAsFaults = NO;
+                    
+                    NSArray *entities = [moc executeFetchRequest:pageFetch error:&err];
+                    if (err) {
+                        ErrLog(@"%@", err);
+                    }
+                    
+                    NSDictionary *entitiesByID = [NSDictionary lookupWithObjects:entities keyPath:@"objectID"];
+                    for (NSManagedObjectID *objectID in pageIDs) {
+                        LocalIssue *li = entitiesByID[objectID];
+                        if (li) {
+                            [results addObject:[[Issue alloc] initWithLocalIssue:li metadataStore:ms options:rowOptions]];
+                        }
+                    }
+                    
+                    // Nothing refers to the managed objects once the page is built. Turning them back into faults breaks
+                    // the cycles with their prefetched relationships, so they're freed with the pool, but unlike a reset,
+                    // leaves everything else this pooled context has registered alone.
+                    for (LocalIssue *li in entities) {
+                        [moc refreshObject:li mergeChanges:NO];
+                    }
+                }
+                
+                if (start == 0 && pageSize < objectIDs.count) {
+                    NSArray *firstPage = [results copy];
+#if DEBUG
+                    DebugLog(@"loaded first %td of %td issues in %.3fs", firstPage.count, objectIDs.count, CFAbsoluteTimeGetCurrent()-t0);
+#endif
+                    RunOnMain(^{
+                        completion(firstPage, NO, nil);
+                    });
+                }
+            }
+#if DEBUG
+            DebugLog(@"loaded %td issues in %.3fs", results.count, CFAbsoluteTimeGetCurrent()-t0);
+#endif
+        } @catch (id exc) {
+            results = nil;
+            error = [NSError shipErrorWithCode:ShipErrorCodeInvalidQuery];
+            ErrLog(@"%@", exc);
+        }
+        
+        RunOnMain(^{
+            completion(results, YES, error);
+        });
+    }];
+}
+
 - (void)countIssuesMatchingPredicate:(NSPredicate *)predicate completion:(void (^)(NSUInteger count, NSError *error))completion {
     __block NSUInteger result = 0;
     __block NSError *error = nil;
@@ -3734,7 +3831,7 @@ static void partitionMixedSyncEntries(NSArray<SyncEntry *> *mixedEntries, NSArra
             NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
             fetchRequest.predicate = [TimeSeries timeSeriesPredicateWithPredicate:[self issuesPredicate:predicate moc:moc] startDate:startDate endDate:endDate];
             fetchRequest.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"createdAt" ascending:YES]];
-            fetchRequest.relationshipKeyPathsForPrefetching = @[@"assignees", @"labels", @"notification.unread", @"pr"];
+            fetchRequest.relationshipKeyPathsForPrefetching = @[@"assignees", @"labels"];
             
             NSError *err = nil;
             NSArray *entities = [moc executeFetchRequest:fetchRequest error:&err];
@@ -3742,13 +3839,9 @@ static void partitionMixedSyncEntries(NSArray<SyncEntry *> *mixedEntries, NSArra
                 ErrLog(@"%@", err);
                 error = error;
             }
-            MetadataStore *ms = self.metadataStore;
-            NSArray<Issue *> *issues = [entities arrayByMappingObjects:^id(LocalIssue *obj) {
-                return [[Issue alloc] initWithLocalIssue:obj metadataStore:ms];
-            }];
             
             TimeSeries *ts = [[TimeSeries alloc] initWithPredicate:predicate startDate:startDate endDate:endDate];
-            ts.records = issues;
+            ts.index = [[IssueTimeIndex alloc] initWithLocalIssues:entities metadataStore:self.metadataStore];
             
             dispatch_async(dispatch_get_main_queue(), ^{
                 completion(error==nil?ts:nil, error);
@@ -4582,6 +4675,7 @@ static void partitionMixedSyncEntries(NSArray<SyncEntry *> *mixedEntries, NSArra
             dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
                 [self loadMetadata];
                 [self loadQueries];
+                [self rebuildFullTextIndex];
                 [self updateSyncConnectionWithVersions];
                 
                 dispatch_async(dispatch_get_main_queue(), ^{
@@ -17,6 +17,7 @@
 
 - (void)performWrite:(void (^)(NSManagedObjectContext *moc))block;
 - (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+- (void)performCoalescedWrite:(void (^)(NSManagedObjectContext *moc))block completion:(void (^)(NSError *error))completion;
 - (void)performRead:(void (^)(NSManagedObjectContext *moc))block;
 
 - (void)postNotification:(NSString *)notificationName userInfo:(NSDictionary *)userInfo;
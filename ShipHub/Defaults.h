@@ -23,6 +23,8 @@ extern NSString *const DefaultsLocalStoragePathKey;
 
 extern NSString *const DefaultsDisableAutoWatchKey;
 
+extern NSString *const DefaultsGroupCommitWindowKey; // milliseconds sync writes wait to be saved together. 0 saves each as soon as possible.
+
 // Debugging defaults
 extern NSString *const DefaultsSimulateConflictsKey;
 extern NSString *const DefaultsShipHostKey;
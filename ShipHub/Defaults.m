@@ -32,6 +32,7 @@ NSString *const DefaultsAnalyticsCohortKey = @"AnalyticsCohort";
 NSString *const DefaultsLocalStoragePathKey = @"LocalStorage";
 NSString *const DefaultsLastUsedAccountKey = @"LastLoginPair";
 NSString *const DefaultsDisableAutoWatchKey = @"DisableAutoWatch";
+NSString *const DefaultsGroupCommitWindowKey = @"GroupCommitWindow";
 NSString *const DefaultsShipHostKey = @"ShipHost";
 NSString *const DefaultsGHHostKey = @"GHHost";
 NSString *const DefaultsPullRequestsEnabledKey = @"EnablePR";
@@ -42,6 +42,8 @@
 
 + (NSComparator)comparatorWithOptions:(NSStringCompareOptions)options;
 
+- (NSComparisonResult)utf8Compare:(NSString *)other; // by UTF-8 bytes, as SQLite's default collation does
+
 - (BOOL)validateEmail;
 
 - (NSString *)stringByCollapsingNewlines; // replace one or more newlines with a single space.
@@ -79,9 +81,11 @@
 + (double)extras_monotonicTime;
 
 + (NSDate *)dateWithJSONString:(NSString *)date;
++ (NSDate *)extras_8601Fast:(NSString *)str; // yyyy-MM-dd'T'HH:mm:ss[.S](Z|+00:00) only, without a formatter. nil for anything else.
 - (NSString *)JSONString;
 
 + (NSDate *)dateWithHTTPHeaderString:(NSString *)str;
+- (NSString *)HTTPHeaderString; // RFC 1123, e.g. for If-Modified-Since
 
 - (NSString *)shortUserInterfaceString;
 - (NSString *)longUserInterfaceString;
@@ -124,6 +128,7 @@
 @interface NSData (Extras)
 
 - (NSData *)inflate;
+- (NSData *)inflateWithSizeHint:(NSUInteger)sizeHint; // sizeHint is the expected inflated length, or 0 if unknown
 - (NSData *)deflate;
 
 - (NSString *)MD5String;
@@ -148,6 +148,12 @@ static inline uint8_t h2b(uint8_t v) {
     };
 }
 
+- (NSComparisonResult)utf8Compare:(NSString *)other {
+    if (!other) return NSOrderedDescending; // as SQLite sorts NULL first
+    int r = strcmp([self UTF8String], [other UTF8String]);
+    return r < 0 ? NSOrderedAscending : (r > 0 ? NSOrderedDescending : NSOrderedSame);
+}
+
 - (BOOL)validateEmail {
     NSString *email = [self trim];
     
@@ -332,54 +338,89 @@ static inline uint8_t h2b(uint8_t v) {
     return CACurrentMediaTime();
 }
 
+// Cumulative days before each month (1-12) in a non leap year.
+static const uint16_t DaysBeforeMonth[13] = { 0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+// Days from 0001-01-01 to 1970-01-01 in the proleptic Gregorian calendar.
+static const int64_t DaysBeforeEpoch = 719162;
+
+static inline uint32_t Digit8601(const char *p, uint32_t *bad) {
+    uint32_t v = (uint32_t)(uint8_t)*p - '0';
+    *bad |= (v > 9);
+    return v;
+}
+
+static inline uint32_t TwoDigits8601(const char *p, uint32_t *bad) {
+    return Digit8601(p, bad) * 10 + Digit8601(p + 1, bad);
+}
+
+// Parses yyyy-MM-dd'T'HH:mm:ss, optionally followed by . and 1-9 digits, then Z or +00:00.
+// Fixed fields are all read and checked before anything is tested, so the common case doesn't branch per character.
+// Out of range days (e.g. Feb 30) roll over into the next month, as timegm would.
+static BOOL Parse8601(const char *s, size_t len, double *outTime) {
+    if (len < 20) return NO;
+    
+    uint32_t bad = 0;
+    uint32_t y = TwoDigits8601(s, &bad) * 100 + TwoDigits8601(s + 2, &bad);
+    uint32_t M = TwoDigits8601(s + 5, &bad);
+    uint32_t d = TwoDigits8601(s + 8, &bad);
+    uint32_t H = TwoDigits8601(s + 11, &bad);
+    uint32_t m = TwoDigits8601(s + 14, &bad);
+    uint32_t sec = TwoDigits8601(s + 17, &bad);
+    bad |= (uint32_t)((s[4] ^ '-') | (s[7] ^ '-') | (s[10] ^ 'T') | (s[13] ^ ':') | (s[16] ^ ':'));
+    bad |= (y == 0) | (M - 1 > 11) | (d - 1 > 30) | (H > 23) | (m > 59) | (sec > 60);
+    
+    size_t i = 19;
+    uint32_t nanos = 0;
+    if (s[i] == '.') {
+        size_t start = ++i;
+        uint32_t scale = 100000000;
+        while (i < len && (uint32_t)(uint8_t)s[i] - '0' <= 9) {
+            nanos += ((uint32_t)s[i] - '0') * scale;
+            scale /= 10;
+            i++;
+        }
+        size_t digits = i - start;
+        bad |= (digits == 0) | (digits > 9);
+    }
+    
+    size_t zoneLen = len - i;
+    if (zoneLen == 1) {
+        bad |= (s[i] != 'Z');
+    } else if (zoneLen == 6) {
+        bad |= (memcmp(s + i, "+00:00", 6) != 0);
+    } else {
+        return NO;
+    }
+    
+    if (bad) return NO;
+    
+    uint32_t leap = (y % 4 == 0) & ((y % 100 != 0) | (y % 400 == 0));
+    int64_t yy = (int64_t)y - 1;
+    int64_t days = yy * 365 + yy / 4 - yy / 100 + yy / 400 + DaysBeforeMonth[M] + (leap & (M > 2)) + d - 1 - DaysBeforeEpoch;
+    int64_t seconds = days * 86400 + H * 3600 + m * 60 + sec;
+    
+    *outTime = (double)seconds + ((double)nanos / (double)NSEC_PER_SEC);
+    return YES;
+}
+
 + (NSDate *)extras_8601Fast:(NSString *)str {
     if (!str) return nil;
     
     // Handles just dates of the form yyyy-MM-dd'T'HH:mm:ss.SSSSSSSZ
     // Or dates of the form yyyy-MM-dd'T'HH:mm:ss.SSSSSSS+00:00
-    int y, M, d, H, m, s, S;
-    y = M = d = H = m = s = S = 0;
-    
-    NSScanner *scanner = [[NSScanner alloc] initWithString:str];
-    
-    if (![scanner scanInt:&y]) return nil;
-    if (![scanner scanString:@"-" intoString:NULL]) return nil;
-    if (![scanner scanInt:&M]) return nil;
-    if (![scanner scanString:@"-" intoString:NULL]) return nil;
-    if (![scanner scanInt:&d]) return nil;
-    if (![scanner scanString:@"T" intoString:NULL]) return nil;
-    if (![scanner scanInt:&H]) return nil;
-    if (![scanner scanString:@":" intoString:NULL]) return nil;
-    if (![scanner scanInt:&m]) return nil;
-    if (![scanner scanString:@":" intoString:NULL]) return nil;
-    if (![scanner scanInt:&s]) return nil;
-    // Optional . and S
-    if ([scanner scanString:@"." intoString:NULL]) {
-        NSUInteger pos = scanner.scanLocation;
-        if (![scanner scanInt:&S]) return nil;
-        NSUInteger SLen = scanner.scanLocation - pos;
-        if (SLen > 9) return nil;
-        // want S to represent nanoseconds, so it should be 9 digits long
-        for (NSUInteger i = SLen; i < 9; i++) {
-            S *= 10;
-        }
-    }
-    if (!([scanner scanString:@"Z" intoString:NULL] || [scanner scanString:@"+00:00" intoString:NULL])) return nil;
-    if (![scanner isAtEnd]) return nil;
+    char buf[40];
+    NSUInteger len = str.length;
+    if (len < 20 || len >= sizeof(buf)) return nil;
     
-    struct tm t;
-    memset(&t, 0, sizeof(t));
-    t.tm_sec = s;
-    t.tm_min = m;
-    t.tm_hour = H;
-    t.tm_mday = d;
-    t.tm_mon = M - 1;
-    t.tm_year = y - 1900;
-    
-    time_t tt = timegm(&t);
+    const char *s = CFStringGetCStringPtr((__bridge CFStringRef)str, kCFStringEncodingASCII);
+    if (!s) {
+        if (![str getCString:buf maxLength:sizeof(buf) encoding:NSASCIIStringEncoding]) return nil;
+        s = buf;
+    }
     
-    NSTimeInterval ti = (double)tt;
-    ti += ((double)S / (double)NSEC_PER_SEC);
+    double ti = 0.0;
+    if (!Parse8601(s, len, &ti)) return nil;
     
     return [NSDate dateWithTimeIntervalSince1970:ti];
 }
@@ -448,6 +489,18 @@ static inline uint8_t h2b(uint8_t v) {
     }
 }
 
+- (NSString *)HTTPHeaderString {
+    static dispatch_once_t onceToken;
+    static NSDateFormatter *rfc1123;
+    dispatch_once(&onceToken, ^{
+        rfc1123 = [NSDateFormatter new];
+        rfc1123.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+        rfc1123.timeZone = [[NSTimeZone alloc] initWithName:@"GMT"];
+        rfc1123.dateFormat = @"EEE',' dd MMM yyyy HH':'mm':'ss 'GMT'";
+    });
+    return [rfc1123 stringFromDate:self];
+}
+
 - (NSString *)shortUserInterfaceString {
     NSDateFormatter *formatter = nil;
     if ([self timeIntervalSinceNow] + (12 * 60 * 60) > 0 && [self timeIntervalSinceNow] < (12 * 60 * 60)) {
@@ -1002,72 +1055,68 @@ CGRect IntegralRect(CGRect r) {
 #define CHUNK 4096
 
 - (NSData *)inflate {
-    NSInputStream *input = [NSInputStream inputStreamWithData:self];
-    NSOutputStream *output = [NSOutputStream outputStreamToMemory];
-    
-    [input open];
-    [output open];
-    
-    int ret;
-    unsigned have;
-    z_stream strm;
-    unsigned char inb[CHUNK];
-    unsigned char outb[CHUNK];
-    
-    /* allocate inflate state */
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    strm.avail_in = 0;
-    strm.next_in = Z_NULL;
-    ret = inflateInit2(&strm, MAX_WBITS|32);
-    if (ret != Z_OK)
+    return [self inflateWithSizeHint:0];
+}
+
+- (NSData *)inflateWithSizeHint:(NSUInteger)sizeHint {
+    // zlib remembers the stream's address, so the block captures a pointer to it rather than the stream itself.
+    z_stream stream = { 0 };
+    z_stream *strm = &stream;
+    if (inflateInit2(strm, MAX_WBITS|32) != Z_OK)
         return nil;
     
-    /* decompress until deflate stream ends or end of file */
-    do {
-        NSInteger read = (uInt)[input read:inb maxLength:CHUNK];
-        if (read < 0) {
-            (void)inflateEnd(&strm);
-            return nil;
-        }
-        strm.avail_in = (uInt)read;
-        if (strm.avail_in == 0)
-            break;
-        strm.next_in = inb;
+    // Inflate into one buffer, grown as needed, straight from each of our byte ranges in turn.
+    // This avoids copying self into a contiguous buffer first if it isn't already (e.g. dispatch_data_t),
+    // and avoids copying the output from chunk to chunk.
+    __block NSUInteger capacity = MAX(sizeHint, MAX(self.length * 4, CHUNK));
+    __block uint8_t *outb = malloc(capacity);
+    __block NSUInteger have = 0;
+    __block int ret = outb ? Z_OK : Z_MEM_ERROR;
+    
+    [self enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        strm->next_in = (Bytef *)bytes;
+        strm->avail_in = (uInt)byteRange.length;
         
-        /* run inflate() on input until output buffer not full */
-        do {
-            strm.avail_out = CHUNK;
-            strm.next_out = outb;
+        /* run inflate() on this range until it's used up and there's no more output pending */
+        while (ret == Z_OK && (strm->avail_in > 0 || strm->avail_out == 0)) {
+            if (have == capacity) {
+                uint8_t *grown = realloc(outb, capacity * 2);
+                if (!grown) {
+                    ret = Z_MEM_ERROR;
+                    break;
+                }
+                outb = grown;
+                capacity *= 2;
+            }
+            
+            strm->next_out = outb + have;
+            strm->avail_out = (uInt)MIN(capacity - have, UINT_MAX);
+            uInt avail = strm->avail_out;
             
-            ret = inflate(&strm, Z_NO_FLUSH);
+            ret = inflate(strm, Z_NO_FLUSH);
             assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
-            switch (ret) {
-                case Z_NEED_DICT:
-                    /* ret = Z_DATA_ERROR; */     /* and fall through */
-                case Z_DATA_ERROR:
-                case Z_MEM_ERROR:
-                    (void)inflateEnd(&strm);
-                    return nil;
-            }
+            have += avail - strm->avail_out;
             
-            have = CHUNK - strm.avail_out;
-            if (![output write:outb length:have]) {
-                (void)inflateEnd(&strm);
-                return nil;
+            if (ret == Z_BUF_ERROR) {
+                ret = Z_OK; /* no progress possible until the next range */
             }
-        } while (strm.avail_out == 0);
-        /* done when inflate() says it's done */
-    } while (ret != Z_STREAM_END);
+        }
+        
+        if (ret != Z_OK) {
+            *stop = YES;
+        }
+    }];
     
     /* clean up and return */
-    (void)inflateEnd(&strm);
+    (void)inflateEnd(strm);
     
     if (ret == Z_STREAM_END) {
-        NSData *data = [output propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
-        return data;
+        if (have > 0 && have < capacity) {
+            outb = realloc(outb, have) ?: outb;
+        }
+        return [NSData dataWithBytesNoCopy:outb length:have freeWhenDone:YES];
     } else {
+        free(outb);
         return nil;
     }
 }
@@ -0,0 +1,54 @@
+//
+//  FullTextIndex.h
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ FullTextIndex is an in memory inverted index of issue titles, bodies and comment bodies.
+ 
+ Text is folded for case, diacritics and width, and split into words at anything that isn't a
+ letter or a digit. Each issue and each comment is indexed as its own document, and a comment's
+ words count towards the issue it belongs to, so replacing one comment only reindexes that comment.
+ 
+ A query matches the issues containing every one of its words, in any of their text. The last word
+ of a query also matches as a prefix (once it's FullTextIndexMinimumPrefixLength long), so results
+ keep up with typing. Matches are ranked by how often their words appear, with rarer words and words
+ in the title counting for more.
+ 
+ Removal is lazy: postings for replaced or removed documents are dropped the next time a query
+ reads them.
+ 
+ FullTextIndex is thread safe.
+*/
+
+extern const NSUInteger FullTextIndexMinimumPrefixLength;
+
+@interface FullTextIndex : NSObject
+
+// Replaces the indexed text of the issue. Its comments are unaffected.
+- (void)setTitle:(NSString *)title body:(NSString *)body forIssue:(NSNumber *)issueIdentifier;
+
+// Removes the issue from results, along with its comments.
+- (void)removeIssue:(NSNumber *)issueIdentifier;
+
+// Replaces the indexed text of the comment, which may be moved to another issue.
+- (void)setBody:(NSString *)body forComment:(NSNumber *)commentIdentifier issue:(NSNumber *)issueIdentifier;
+- (void)removeComment:(NSNumber *)commentIdentifier;
+
+// Returns the identifiers of issues matching query, best match first.
+// Returns an empty array if query has no words in it.
+- (NSArray<NSNumber *> *)issueIdentifiersMatchingQuery:(NSString *)query;
+
+// Sorts the terms used for prefix matching and compacts postings. Call after loading in bulk,
+// so that the first query doesn't have to.
+- (void)compact;
+
+@property (readonly) NSUInteger issueCount;
+@property (readonly) NSUInteger termCount;
+
+@end
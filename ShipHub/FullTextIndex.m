@@ -0,0 +1,627 @@
+//
+//  FullTextIndex.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "FullTextIndex.h"
+
+#import "Extras.h"
+
+const NSUInteger FullTextIndexMinimumPrefixLength = 3;
+
+static const NSUInteger FullTextMaxTextLength = 32 * 1024; // characters indexed per title, body or comment
+static const NSUInteger FullTextMaxWordLength = 64; // longer runs are hashes, base64 and the like
+static const NSUInteger FullTextMaxQueryWords = 32; // one bit each in the match masks
+static const uint32_t FullTextTitleWeight = 4;
+static const uint32_t FullTextBodyWeight = 1;
+static const uint32_t FullTextMaxWeight = 255;
+static const uint32_t FullTextGenerationMask = 0xFFFFFF;
+static const uint32_t FullTextUnsortedTermLimit = 4096; // new terms scanned linearly for prefixes before they're merged in
+static const size_t FullTextMinStalePostings = 64 * 1024; // stale postings tolerated before compacting everything
+static const uint32_t FullTextNotFound = UINT32_MAX;
+
+typedef struct {
+    uint32_t doc;
+    uint32_t generation : 24; // the doc's generation when added. postings from earlier generations are stale.
+    uint32_t weight : 8;
+} FTPosting;
+
+typedef struct {
+    uint32_t offset; // into _termChars
+    uint32_t length;
+    FTPosting *postings; // in the order added
+    uint32_t count;
+    uint32_t capacity;
+} FTTerm;
+
+typedef struct {
+    int64_t identifier;
+    uint32_t issue; // the issue doc this doc's words count towards (itself, for issues)
+    uint32_t generation : 24;
+    uint32_t comment : 1;
+    uint32_t live : 1; // has indexed text. issue docs are created for comments that arrive before their issue.
+    uint32_t postingCount; // for the current generation
+} FTDoc;
+
+typedef struct {
+    float score;
+    int64_t identifier;
+} FTMatch;
+
+static void Reserve(void **array, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) return;
+    size_t newCapacity = MAX(needed, MAX(*capacity * 2, 16));
+    *array = reallocf(*array, newCapacity * size);
+    *capacity = newCapacity;
+}
+
+static inline BOOL IsWordCharacter(UniChar c) {
+    if (c < 0x80) {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z');
+    }
+    static CFCharacterSetRef alphanumerics;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        alphanumerics = CFCharacterSetGetPredefined(kCFCharacterSetAlphaNumeric);
+    });
+    return CFCharacterSetIsCharacterMember(alphanumerics, c);
+}
+
+// Finds the next word at or after *index, skipping any that are too long to index.
+// Returns NO when there are no more.
+static inline BOOL NextWord(const UniChar *chars, NSUInteger length, NSUInteger *index, NSRange *word) {
+    NSUInteger i = *index;
+    while (i < length) {
+        while (i < length && !IsWordCharacter(chars[i])) i++;
+        NSUInteger start = i;
+        while (i < length && IsWordCharacter(chars[i])) i++;
+        if (i > start && i - start <= FullTextMaxWordLength) {
+            *index = i;
+            *word = NSMakeRange(start, i - start);
+            return YES;
+        }
+    }
+    *index = i;
+    return NO;
+}
+
+// Returns the first FullTextMaxTextLength characters of text, folded for case, diacritics
+// and width, in a buffer the caller must free.
+static UniChar *CopyFoldedCharacters(NSString *text, NSUInteger *outLength) {
+    NSUInteger length = text.length;
+    if (length == 0) {
+        *outLength = 0;
+        return NULL;
+    }
+    
+    if (length > FullTextMaxTextLength) {
+        length = [text rangeOfComposedCharacterSequenceAtIndex:FullTextMaxTextLength].location;
+        text = [text substringToIndex:length];
+    }
+    
+    CFMutableStringRef folded = CFStringCreateMutableCopy(NULL, 0, (__bridge CFStringRef)text);
+    CFStringFold(folded, kCFCompareCaseInsensitive | kCFCompareDiacriticInsensitive | kCFCompareWidthInsensitive, NULL);
+    length = CFStringGetLength(folded);
+    UniChar *chars = malloc(MAX(length, 1) * sizeof(UniChar));
+    CFStringGetCharacters(folded, CFRangeMake(0, length), chars);
+    CFRelease(folded);
+    
+    *outLength = length;
+    return chars;
+}
+
+// FNV-1a
+static inline uint64_t HashWord(const UniChar *word, NSUInteger length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (NSUInteger i = 0; i < length; i++) {
+        hash ^= word[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static inline int CompareCharacters(const UniChar *a, NSUInteger aLength, const UniChar *b, NSUInteger bLength) {
+    NSUInteger length = MIN(aLength, bLength);
+    for (NSUInteger i = 0; i < length; i++) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+static inline BOOL HasPrefix(const UniChar *chars, NSUInteger length, const UniChar *prefix, NSUInteger prefixLength) {
+    return length >= prefixLength && memcmp(chars, prefix, prefixLength * sizeof(UniChar)) == 0;
+}
+
+static inline BOOL IsCurrent(FTPosting posting, const FTDoc *docs) {
+    const FTDoc *doc = &docs[posting.doc];
+    return doc->live && doc->generation == posting.generation;
+}
+
+static uint32_t CompactPostings(FTTerm *term, const FTDoc *docs) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < term->count; i++) {
+        if (IsCurrent(term->postings[i], docs)) {
+            term->postings[kept++] = term->postings[i];
+        }
+    }
+    uint32_t removed = term->count - kept;
+    term->count = kept;
+    return removed;
+}
+
+@interface FullTextIndex () {
+    NSLock *_lock;
+    
+    FTDoc *_docs;
+    size_t _docCount, _docCapacity;
+    NSMutableDictionary<NSNumber *, NSNumber *> *_issueDocs; // issue identifier => doc
+    NSMutableDictionary<NSNumber *, NSNumber *> *_commentDocs; // comment identifier => doc
+    NSUInteger _issueCount; // live issue docs
+    
+    FTTerm *_terms;
+    size_t _termCount, _termCapacity;
+    UniChar *_termChars;
+    size_t _termCharsCount, _termCharsCapacity;
+    
+    // Open addressed hash table of words to terms
+    uint32_t *_slots; // term + 1, or 0 if empty
+    uint64_t *_slotHashes;
+    size_t _slotCapacity; // a power of 2
+    
+    uint32_t *_sortedTerms; // terms in character order, for prefix matching
+    size_t _sortedCount; // terms from _sortedCount on are newer and not in _sortedTerms yet
+    
+    size_t _postingCount;
+    size_t _stalePostingCount; // postings of retired generations not yet compacted away
+    
+    // Words of the document being indexed
+    uint8_t *_docWeights; // term => weight in the document, parallel to _terms
+    uint32_t *_docTerms; // terms with non-zero _docWeights
+    size_t _docTermCount, _docTermCapacity;
+}
+
+@end
+
+@implementation FullTextIndex
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _lock = [NSLock new];
+        _issueDocs = [NSMutableDictionary new];
+        _commentDocs = [NSMutableDictionary new];
+        _slotCapacity = 1024;
+        _slots = calloc(_slotCapacity, sizeof(uint32_t));
+        _slotHashes = calloc(_slotCapacity, sizeof(uint64_t));
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (size_t i = 0; i < _termCount; i++) {
+        free(_terms[i].postings);
+    }
+    free(_terms);
+    free(_termChars);
+    free(_docs);
+    free(_slots);
+    free(_slotHashes);
+    free(_sortedTerms);
+    free(_docWeights);
+    free(_docTerms);
+}
+
+#pragma mark - Terms
+
+// Call with _lock held
+- (void)growSlots {
+    size_t capacity = _slotCapacity * 2;
+    size_t mask = capacity - 1;
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    uint64_t *hashes = calloc(capacity, sizeof(uint64_t));
+    
+    for (size_t i = 0; i < _slotCapacity; i++) {
+        if (!_slots[i]) continue;
+        size_t j = _slotHashes[i] & mask;
+        while (slots[j]) j = (j + 1) & mask;
+        slots[j] = _slots[i];
+        hashes[j] = _slotHashes[i];
+    }
+    
+    free(_slots);
+    free(_slotHashes);
+    _slots = slots;
+    _slotHashes = hashes;
+    _slotCapacity = capacity;
+}
+
+// Call with _lock held. Returns FullTextNotFound if word isn't a term and create is NO.
+- (uint32_t)termForWord:(const UniChar *)word length:(NSUInteger)length create:(BOOL)create {
+    uint64_t hash = HashWord(word, length);
+    size_t mask = _slotCapacity - 1;
+    size_t i = hash & mask;
+    while (_slots[i]) {
+        uint32_t term = _slots[i] - 1;
+        if (_slotHashes[i] == hash && _terms[term].length == length && memcmp(_termChars + _terms[term].offset, word, length * sizeof(UniChar)) == 0) {
+            return term;
+        }
+        i = (i + 1) & mask;
+    }
+    
+    if (!create) {
+        return FullTextNotFound;
+    }
+    
+    size_t oldCapacity = _termCapacity;
+    Reserve((void **)&_terms, &_termCapacity, _termCount + 1, sizeof(FTTerm));
+    if (_termCapacity != oldCapacity) {
+        _docWeights = reallocf(_docWeights, _termCapacity);
+        memset(_docWeights + oldCapacity, 0, _termCapacity - oldCapacity);
+    }
+    Reserve((void **)&_termChars, &_termCharsCapacity, _termCharsCount + length, sizeof(UniChar));
+    
+    uint32_t term = (uint32_t)_termCount++;
+    memcpy(_termChars + _termCharsCount, word, length * sizeof(UniChar));
+    _terms[term] = (FTTerm){ .offset = (uint32_t)_termCharsCount, .length = (uint32_t)length };
+    _termCharsCount += length;
+    
+    _slots[i] = term + 1;
+    _slotHashes[i] = hash;
+    if (_termCount * 2 > _slotCapacity) {
+        [self growSlots];
+    }
+    
+    return term;
+}
+
+static inline int CompareTerms(const FTTerm *terms, const UniChar *chars, uint32_t a, uint32_t b) {
+    return CompareCharacters(chars + terms[a].offset, terms[a].length, chars + terms[b].offset, terms[b].length);
+}
+
+// Call with _lock held. Sorts the terms added since last time, and merges them into _sortedTerms.
+- (void)sortTerms {
+    size_t added = _termCount - _sortedCount;
+    if (added == 0) return;
+    
+    const FTTerm *terms = _terms;
+    const UniChar *chars = _termChars;
+    
+    uint32_t *tail = malloc(added * sizeof(uint32_t));
+    for (size_t i = 0; i < added; i++) {
+        tail[i] = (uint32_t)(_sortedCount + i);
+    }
+    qsort_b(tail, added, sizeof(uint32_t), ^int(const void *a, const void *b) {
+        return CompareTerms(terms, chars, *(const uint32_t *)a, *(const uint32_t *)b);
+    });
+    
+    uint32_t *merged = malloc(_termCount * sizeof(uint32_t));
+    size_t i = 0, j = 0, k = 0;
+    while (i < _sortedCount && j < added) {
+        if (CompareTerms(terms, chars, _sortedTerms[i], tail[j]) <= 0) {
+            merged[k++] = _sortedTerms[i++];
+        } else {
+            merged[k++] = tail[j++];
+        }
+    }
+    while (i < _sortedCount) merged[k++] = _sortedTerms[i++];
+    while (j < added) merged[k++] = tail[j++];
+    
+    free(tail);
+    free(_sortedTerms);
+    _sortedTerms = merged;
+    _sortedCount = _termCount;
+}
+
+// Call with _lock held
+- (void)enumerateTermsWithPrefix:(const UniChar *)prefix length:(NSUInteger)length block:(void (^)(uint32_t term))block {
+    if (_termCount - _sortedCount > FullTextUnsortedTermLimit) {
+        [self sortTerms];
+    }
+    
+    // Find the first sorted term >= prefix
+    size_t lo = 0, hi = _sortedCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const FTTerm *term = &_terms[_sortedTerms[mid]];
+        if (CompareCharacters(_termChars + term->offset, term->length, prefix, length) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    for (size_t i = lo; i < _sortedCount; i++) {
+        const FTTerm *term = &_terms[_sortedTerms[i]];
+        if (!HasPrefix(_termChars + term->offset, term->length, prefix, length)) break;
+        block(_sortedTerms[i]);
+    }
+    
+    for (size_t i = _sortedCount; i < _termCount; i++) {
+        const FTTerm *term = &_terms[i];
+        if (HasPrefix(_termChars + term->offset, term->length, prefix, length)) {
+            block((uint32_t)i);
+        }
+    }
+}
+
+#pragma mark - Documents
+
+// Call with _lock held
+- (uint32_t)docForIdentifier:(NSNumber *)identifier comment:(BOOL)comment create:(BOOL)create {
+    NSMutableDictionary *docs = comment ? _commentDocs : _issueDocs;
+    NSNumber *existing = docs[identifier];
+    if (existing) {
+        return [existing unsignedIntValue];
+    }
+    
+    if (!create) {
+        return FullTextNotFound;
+    }
+    
+    Reserve((void **)&_docs, &_docCapacity, _docCount + 1, sizeof(FTDoc));
+    uint32_t doc = (uint32_t)_docCount++;
+    _docs[doc] = (FTDoc){ .identifier = [identifier longLongValue], .issue = doc, .comment = comment ? 1 : 0 };
+    docs[identifier] = @(doc);
+    return doc;
+}
+
+// Call with _lock held. Makes the doc's postings stale.
+- (void)retireDoc:(uint32_t)doc {
+    FTDoc *d = &_docs[doc];
+    if (d->live && !d->comment) {
+        _issueCount--;
+    }
+    d->live = 0;
+    d->generation = (d->generation + 1) & FullTextGenerationMask;
+    _stalePostingCount += d->postingCount;
+    d->postingCount = 0;
+}
+
+// Call with _lock held. Accumulates the words of chars into the document being indexed.
+- (void)addWords:(const UniChar *)chars length:(NSUInteger)length weight:(uint32_t)weight {
+    NSUInteger i = 0;
+    NSRange word;
+    while (NextWord(chars, length, &i, &word)) {
+        uint32_t term = [self termForWord:chars + word.location length:word.length create:YES];
+        if (_docWeights[term] == 0) {
+            Reserve((void **)&_docTerms, &_docTermCapacity, _docTermCount + 1, sizeof(uint32_t));
+            _docTerms[_docTermCount++] = term;
+        }
+        _docWeights[term] = (uint8_t)MIN(_docWeights[term] + weight, FullTextMaxWeight);
+    }
+}
+
+// Call with _lock held. Adds a posting for each word accumulated by addWords:, and makes doc live.
+- (void)finishDoc:(uint32_t)doc {
+    FTDoc *d = &_docs[doc];
+    d->live = 1;
+    d->postingCount = (uint32_t)_docTermCount;
+    if (!d->comment) {
+        _issueCount++;
+    }
+    
+    for (size_t i = 0; i < _docTermCount; i++) {
+        uint32_t termIndex = _docTerms[i];
+        FTTerm *term = &_terms[termIndex];
+        if (term->count == term->capacity) {
+            term->capacity = term->capacity ? term->capacity * 2 : 2;
+            term->postings = reallocf(term->postings, term->capacity * sizeof(FTPosting));
+        }
+        term->postings[term->count++] = (FTPosting){ .doc = doc, .generation = d->generation, .weight = _docWeights[termIndex] };
+        _docWeights[termIndex] = 0;
+    }
+    _postingCount += _docTermCount;
+    _docTermCount = 0;
+    
+    if (_stalePostingCount > FullTextMinStalePostings && _stalePostingCount * 2 > _postingCount) {
+        [self compactPostings];
+    }
+}
+
+// Call with _lock held
+- (void)compactPostings {
+    for (size_t i = 0; i < _termCount; i++) {
+        _postingCount -= CompactPostings(&_terms[i], _docs);
+    }
+    _stalePostingCount = 0;
+}
+
+- (void)setTitle:(NSString *)title body:(NSString *)body forIssue:(NSNumber *)issueIdentifier {
+    NSParameterAssert(issueIdentifier);
+    
+    NSUInteger titleLength = 0, bodyLength = 0;
+    UniChar *titleChars = CopyFoldedCharacters(title, &titleLength);
+    UniChar *bodyChars = CopyFoldedCharacters(body, &bodyLength);
+    
+    [_lock lock];
+    uint32_t doc = [self docForIdentifier:issueIdentifier comment:NO create:YES];
+    [self retireDoc:doc];
+    [self addWords:titleChars length:titleLength weight:FullTextTitleWeight];
+    [self addWords:bodyChars length:bodyLength weight:FullTextBodyWeight];
+    [self finishDoc:doc];
+    [_lock unlock];
+    
+    free(titleChars);
+    free(bodyChars);
+}
+
+- (void)removeIssue:(NSNumber *)issueIdentifier {
+    NSParameterAssert(issueIdentifier);
+    
+    [_lock lock];
+    // The doc stays, as its comments still refer to it. They're excluded along with it while it isn't live.
+    uint32_t doc = [self docForIdentifier:issueIdentifier comment:NO create:NO];
+    if (doc != FullTextNotFound) {
+        [self retireDoc:doc];
+    }
+    [_lock unlock];
+}
+
+- (void)setBody:(NSString *)body forComment:(NSNumber *)commentIdentifier issue:(NSNumber *)issueIdentifier {
+    NSParameterAssert(commentIdentifier);
+    
+    if (!issueIdentifier) {
+        [self removeComment:commentIdentifier];
+        return;
+    }
+    
+    NSUInteger bodyLength = 0;
+    UniChar *bodyChars = CopyFoldedCharacters(body, &bodyLength);
+    
+    [_lock lock];
+    uint32_t issueDoc = [self docForIdentifier:issueIdentifier comment:NO create:YES];
+    uint32_t doc = [self docForIdentifier:commentIdentifier comment:YES create:YES];
+    [self retireDoc:doc];
+    _docs[doc].issue = issueDoc;
+    [self addWords:bodyChars length:bodyLength weight:FullTextBodyWeight];
+    [self finishDoc:doc];
+    [_lock unlock];
+    
+    free(bodyChars);
+}
+
+- (void)removeComment:(NSNumber *)commentIdentifier {
+    NSParameterAssert(commentIdentifier);
+    
+    [_lock lock];
+    uint32_t doc = [self docForIdentifier:commentIdentifier comment:YES create:NO];
+    if (doc != FullTextNotFound) {
+        [self retireDoc:doc];
+    }
+    [_lock unlock];
+}
+
+#pragma mark - Queries
+
+// Call with _lock held. Adds bit to the mask of each issue with a current posting for term, and
+// the term's weight to its score. Compacts the postings if most of them were stale.
+- (void)addTerm:(uint32_t)termIndex bit:(uint32_t)bit masks:(uint32_t *)masks scores:(float *)scores {
+    FTTerm *term = &_terms[termIndex];
+    const FTDoc *docs = _docs;
+    float idf = logf(1.0f + (float)_docCount / (1.0f + (float)term->count));
+    
+    uint32_t stale = 0;
+    for (uint32_t i = 0; i < term->count; i++) {
+        FTPosting posting = term->postings[i];
+        if (!IsCurrent(posting, docs)) {
+            stale++;
+            continue;
+        }
+        uint32_t issue = docs[posting.doc].issue;
+        masks[issue] |= bit;
+        scores[issue] += idf * posting.weight;
+    }
+    
+    if (stale * 2 > term->count) {
+        uint32_t removed = CompactPostings(term, docs);
+        _postingCount -= removed;
+        _stalePostingCount -= MIN(_stalePostingCount, removed);
+    }
+}
+
+- (NSArray<NSNumber *> *)issueIdentifiersMatchingQuery:(NSString *)query {
+    NSUInteger length = 0;
+    UniChar *chars = CopyFoldedCharacters(query, &length);
+    
+    NSRange words[FullTextMaxQueryWords];
+    NSUInteger wordCount = 0;
+    NSUInteger i = 0;
+    while (wordCount < FullTextMaxQueryWords && NextWord(chars, length, &i, &words[wordCount])) {
+        wordCount++;
+    }
+    
+    if (wordCount == 0) {
+        free(chars);
+        return @[];
+    }
+    
+    // The last word may be incomplete if it runs to the end of the query
+    NSRange lastWord = words[wordCount - 1];
+    BOOL prefixLast = NSMaxRange(lastWord) == length && lastWord.length >= FullTextIndexMinimumPrefixLength;
+    
+    [_lock lock];
+    size_t docCount = _docCount;
+    uint32_t *masks = calloc(MAX(docCount, 1), sizeof(uint32_t));
+    float *scores = calloc(MAX(docCount, 1), sizeof(float));
+    
+    BOOL matchedAll = YES;
+    for (NSUInteger w = 0; w < wordCount && matchedAll; w++) {
+        uint32_t bit = 1u << w;
+        const UniChar *word = chars + words[w].location;
+        NSUInteger wordLength = words[w].length;
+        
+        if (prefixLast && w == wordCount - 1) {
+            __block BOOL matched = NO;
+            [self enumerateTermsWithPrefix:word length:wordLength block:^(uint32_t term) {
+                [self addTerm:term bit:bit masks:masks scores:scores];
+                matched = YES;
+            }];
+            matchedAll = matched;
+        } else {
+            uint32_t term = [self termForWord:word length:wordLength create:NO];
+            if (term != FullTextNotFound) {
+                [self addTerm:term bit:bit masks:masks scores:scores];
+            } else {
+                matchedAll = NO;
+            }
+        }
+    }
+    
+    FTMatch *matches = NULL;
+    size_t matchCount = 0, matchCapacity = 0;
+    if (matchedAll) {
+        uint32_t all = wordCount == 32 ? UINT32_MAX : (1u << wordCount) - 1;
+        for (size_t doc = 0; doc < docCount; doc++) {
+            if (masks[doc] == all && _docs[doc].live && !_docs[doc].comment) {
+                Reserve((void **)&matches, &matchCapacity, matchCount + 1, sizeof(FTMatch));
+                matches[matchCount++] = (FTMatch){ .score = scores[doc], .identifier = _docs[doc].identifier };
+            }
+        }
+    }
+    [_lock unlock];
+    
+    free(masks);
+    free(scores);
+    free(chars);
+    
+    // Best first, then newest
+    qsort_b(matches, matchCount, sizeof(FTMatch), ^int(const void *a, const void *b) {
+        const FTMatch *ma = a, *mb = b;
+        if (ma->score != mb->score) return ma->score > mb->score ? -1 : 1;
+        if (ma->identifier != mb->identifier) return ma->identifier > mb->identifier ? -1 : 1;
+        return 0;
+    });
+    
+    NSMutableArray *identifiers = [NSMutableArray arrayWithCapacity:matchCount];
+    for (size_t m = 0; m < matchCount; m++) {
+        [identifiers addObject:@(matches[m].identifier)];
+    }
+    free(matches);
+    
+    return identifiers;
+}
+
+- (void)compact {
+    [_lock lock];
+    [self sortTerms];
+    [self compactPostings];
+    [_lock unlock];
+}
+
+- (NSUInteger)issueCount {
+    [_lock lock];
+    NSUInteger count = _issueCount;
+    [_lock unlock];
+    return count;
+}
+
+- (NSUInteger)termCount {
+    [_lock lock];
+    NSUInteger count = _termCount;
+    [_lock unlock];
+    return count;
+}
+
+@end
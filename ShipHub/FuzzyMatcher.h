@@ -0,0 +1,34 @@
+//
+//  FuzzyMatcher.h
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/*
+ FuzzyMatcher ranks a fixed set of candidate strings against a query, as typed into Open Quickly.
+ 
+ A candidate matches if every character of the query appears in it, in order, ignoring case,
+ diacritics and whitespace in the query. Matches score higher for characters that are consecutive
+ or start a word (at the start, after a separator or on a camel case hump), and for matching within
+ the last path component. Shorter candidates win ties.
+ 
+ Candidates are folded into one buffer up front. When a query extends the previous one, as it does
+ while typing, only the previous query's matches are scored again.
+ 
+ FuzzyMatcher is not thread safe.
+*/
+
+@interface FuzzyMatcher : NSObject
+
+- (instancetype)initWithCandidates:(NSArray<NSString *> *)candidates;
+
+@property (readonly) NSUInteger count;
+
+// Returns the indexes in candidates of the best limit matches for query, best first.
+- (NSArray<NSNumber *> *)indexesMatchingQuery:(NSString *)query limit:(NSUInteger)limit;
+
+@end
@@ -0,0 +1,344 @@
+//
+//  FuzzyMatcher.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "FuzzyMatcher.h"
+
+static const int FuzzyScoreMatch = 16;
+static const int FuzzyScoreGapStart = -3;
+static const int FuzzyScoreGapExtension = -1;
+static const int FuzzyBonusPathBoundary = 10; // start of the candidate or of a path component
+static const int FuzzyBonusBoundary = 8; // after a space, _, -, . or :
+static const int FuzzyBonusCamelCase = 7; // lower to upper case, or letter to digit
+static const int FuzzyBonusConsecutive = 4;
+static const int FuzzyBonusFirstCharacterMultiplier = 2;
+static const int FuzzyBonusBasename = 12; // the whole match is within the last path component
+static const int FuzzyNoMatch = INT_MIN;
+
+typedef struct {
+    int score;
+    uint32_t length;
+    uint32_t index;
+} FuzzyResult;
+
+static inline BOOL IsSeparator(UniChar c) {
+    return c == ' ' || c == '_' || c == '-' || c == '.' || c == ':' || c == '\t';
+}
+
+static inline BOOL IsLower(UniChar c) {
+    if (c < 0x80) return c >= 'a' && c <= 'z';
+    return CFCharacterSetIsCharacterMember(CFCharacterSetGetPredefined(kCFCharacterSetLowercaseLetter), c);
+}
+
+static inline BOOL IsUpper(UniChar c) {
+    if (c < 0x80) return c >= 'A' && c <= 'Z';
+    return CFCharacterSetIsCharacterMember(CFCharacterSetGetPredefined(kCFCharacterSetUppercaseLetter), c);
+}
+
+static inline BOOL IsDigit(UniChar c) {
+    return c >= '0' && c <= '9';
+}
+
+// chars must not be case folded yet
+static uint8_t BonusAt(const UniChar *chars, NSUInteger i) {
+    if (i == 0) return FuzzyBonusPathBoundary;
+    UniChar prev = chars[i - 1];
+    UniChar c = chars[i];
+    if (prev == '/') return FuzzyBonusPathBoundary;
+    if (IsSeparator(prev)) return FuzzyBonusBoundary;
+    if (IsLower(prev) && IsUpper(c)) return FuzzyBonusCamelCase;
+    if (IsDigit(c) && !IsDigit(prev) && !IsSeparator(prev)) return FuzzyBonusCamelCase;
+    return 0;
+}
+
+// Scores the match ending at end, starting as late as possible, which is the shortest match ending there.
+static int ScoreWindow(const UniChar *text, const uint8_t *bonus, uint32_t end, const UniChar *query, uint32_t queryLength, uint32_t *outStart) {
+    uint32_t start = end;
+    uint32_t q = queryLength;
+    while (q > 0) {
+        start--;
+        if (text[start] == query[q - 1]) q--;
+    }
+    *outStart = start;
+    
+    int score = 0;
+    int chunkBonus = 0;
+    BOOL consecutive = NO;
+    BOOL inGap = NO;
+    q = 0;
+    for (uint32_t i = start; i < end; i++) {
+        if (q < queryLength && text[i] == query[q]) {
+            int b = bonus[i];
+            if (!consecutive) {
+                chunkBonus = b;
+            } else {
+                // A run of matches keeps the bonus of the word it started, unless it reaches a better one
+                if (b >= FuzzyBonusBoundary && b > chunkBonus) chunkBonus = b;
+                b = MAX(b, MAX(chunkBonus, FuzzyBonusConsecutive));
+            }
+            if (q == 0) b *= FuzzyBonusFirstCharacterMultiplier;
+            score += FuzzyScoreMatch + b;
+            consecutive = YES;
+            inGap = NO;
+            q++;
+        } else {
+            score += inGap ? FuzzyScoreGapExtension : FuzzyScoreGapStart;
+            consecutive = NO;
+            inGap = YES;
+        }
+    }
+    return score;
+}
+
+// Returns the end of the first match of query in text[from, length), or 0 if there is none.
+static inline uint32_t MatchEnd(const UniChar *text, uint32_t from, uint32_t length, const UniChar *query, uint32_t queryLength) {
+    uint32_t q = 0;
+    for (uint32_t i = from; i < length; i++) {
+        if (text[i] == query[q] && ++q == queryLength) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static int ScoreCandidate(const UniChar *text, const uint8_t *bonus, uint32_t length, uint32_t basename, const UniChar *query, uint32_t queryLength) {
+    uint32_t end = MatchEnd(text, 0, length, query, queryLength);
+    if (end == 0) return FuzzyNoMatch;
+    
+    uint32_t start = 0;
+    int score = ScoreWindow(text, bonus, end, query, queryLength, &start);
+    if (start >= basename) {
+        return score + FuzzyBonusBasename;
+    }
+    
+    // The leftmost match strays out of the last path component. See if one fits inside it.
+    if (basename > 0) {
+        uint32_t basenameEnd = MatchEnd(text, basename, length, query, queryLength);
+        if (basenameEnd) {
+            uint32_t basenameStart = 0;
+            int basenameScore = ScoreWindow(text, bonus, basenameEnd, query, queryLength, &basenameStart);
+            if (basenameStart >= basename) {
+                score = MAX(score, basenameScore + FuzzyBonusBasename);
+            }
+        }
+    }
+    
+    return score;
+}
+
+static inline BOOL IsBetter(FuzzyResult a, FuzzyResult b) {
+    if (a.score != b.score) return a.score > b.score;
+    if (a.length != b.length) return a.length < b.length;
+    return a.index < b.index;
+}
+
+// heap is a min heap (worst result first) of the best results so far
+static void HeapSiftDown(FuzzyResult *heap, NSUInteger count, NSUInteger i) {
+    while (YES) {
+        NSUInteger worst = i;
+        NSUInteger l = 2 * i + 1, r = 2 * i + 2;
+        if (l < count && IsBetter(heap[worst], heap[l])) worst = l;
+        if (r < count && IsBetter(heap[worst], heap[r])) worst = r;
+        if (worst == i) return;
+        FuzzyResult tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+}
+
+static void HeapSiftUp(FuzzyResult *heap, NSUInteger i) {
+    while (i > 0) {
+        NSUInteger parent = (i - 1) / 2;
+        if (!IsBetter(heap[parent], heap[i])) return;
+        FuzzyResult tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+@interface FuzzyMatcher () {
+    UniChar *_chars; // folded candidates, back to back
+    uint8_t *_bonus; // parallel to _chars
+    uint32_t *_starts; // offset of each candidate in _chars, plus one past the last
+    uint32_t *_basenames; // offset of each candidate's last path component, relative to its start
+    
+    UniChar *_lastQuery;
+    uint32_t _lastQueryLength;
+    uint32_t *_lastMatches; // every candidate matching _lastQuery, or NULL
+    uint32_t _lastMatchCount;
+}
+
+@end
+
+@implementation FuzzyMatcher
+
+- (instancetype)initWithCandidates:(NSArray<NSString *> *)candidates {
+    if (self = [super init]) {
+        _count = candidates.count;
+        
+        size_t capacity = 0;
+        for (NSString *candidate in candidates) {
+            capacity += candidate.length;
+        }
+        capacity = MAX(capacity, 16);
+        
+        _chars = malloc(capacity * sizeof(UniChar));
+        _bonus = malloc(capacity);
+        _starts = malloc((_count + 1) * sizeof(uint32_t));
+        _basenames = malloc(MAX(_count, 1) * sizeof(uint32_t));
+        
+        size_t used = 0;
+        NSUInteger i = 0;
+        for (NSString *candidate in candidates) {
+            NSString *str = candidate;
+            NSUInteger length = str.length;
+            
+            // Paths are nearly always ASCII, and can be copied as is. Anything else is folded first.
+            BOOL ascii = [str canBeConvertedToEncoding:NSASCIIStringEncoding];
+            if (!ascii) {
+                NSMutableString *folded = [str mutableCopy];
+                CFStringFold((__bridge CFMutableStringRef)folded, kCFCompareDiacriticInsensitive | kCFCompareWidthInsensitive, NULL);
+                str = folded;
+                length = str.length;
+            }
+            
+            if (used + length > capacity) {
+                capacity = MAX(capacity * 2, used + length);
+                _chars = reallocf(_chars, capacity * sizeof(UniChar));
+                _bonus = reallocf(_bonus, capacity);
+            }
+            
+            UniChar *chars = _chars + used;
+            [str getCharacters:chars range:NSMakeRange(0, length)];
+            
+            uint32_t basename = 0;
+            for (NSUInteger j = 0; j < length; j++) {
+                _bonus[used + j] = BonusAt(chars, j);
+                if (chars[j] == '/' && j + 1 < length) basename = (uint32_t)(j + 1);
+            }
+            
+            // Lower case in place, now that the bonuses have seen the original case.
+            for (NSUInteger j = 0; j < length; j++) {
+                UniChar c = chars[j];
+                if (c < 0x80) {
+                    if (c >= 'A' && c <= 'Z') chars[j] = c + ('a' - 'A');
+                } else {
+                    UniChar lower = c;
+                    CFMutableStringRef one = CFStringCreateMutable(NULL, 1);
+                    CFStringAppendCharacters(one, &c, 1);
+                    CFStringLowercase(one, NULL);
+                    if (CFStringGetLength(one) == 1) lower = CFStringGetCharacterAtIndex(one, 0);
+                    CFRelease(one);
+                    chars[j] = lower;
+                }
+            }
+            
+            _starts[i] = (uint32_t)used;
+            _basenames[i] = basename;
+            used += length;
+            i++;
+        }
+        _starts[_count] = (uint32_t)used;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_chars);
+    free(_bonus);
+    free(_starts);
+    free(_basenames);
+    free(_lastQuery);
+    free(_lastMatches);
+}
+
+// Returns query folded the same way as the candidates, without whitespace, in a buffer the caller must free.
+static UniChar *CopyFoldedQuery(NSString *query, uint32_t *outLength) {
+    NSMutableString *folded = [query mutableCopy] ?: [NSMutableString new];
+    CFStringFold((__bridge CFMutableStringRef)folded, kCFCompareCaseInsensitive | kCFCompareDiacriticInsensitive | kCFCompareWidthInsensitive, NULL);
+    
+    NSUInteger length = folded.length;
+    UniChar *chars = malloc(MAX(length, 1) * sizeof(UniChar));
+    [folded getCharacters:chars range:NSMakeRange(0, length)];
+    
+    uint32_t kept = 0;
+    NSCharacterSet *whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    for (NSUInteger i = 0; i < length; i++) {
+        if (![whitespace characterIsMember:chars[i]]) {
+            chars[kept++] = chars[i];
+        }
+    }
+    
+    *outLength = kept;
+    return chars;
+}
+
+- (NSArray<NSNumber *> *)indexesMatchingQuery:(NSString *)query limit:(NSUInteger)limit {
+    uint32_t queryLength = 0;
+    UniChar *queryChars = CopyFoldedQuery(query, &queryLength);
+    
+    if (queryLength == 0 || limit == 0) {
+        free(queryChars);
+        return @[];
+    }
+    
+    // Typing another character can only narrow the matches, so only they need checking.
+    BOOL refine = _lastQuery && queryLength >= _lastQueryLength && memcmp(queryChars, _lastQuery, _lastQueryLength * sizeof(UniChar)) == 0;
+    uint32_t candidateCount = refine ? _lastMatchCount : (uint32_t)_count;
+    const uint32_t *candidates = refine ? _lastMatches : NULL;
+    
+    uint32_t *matches = malloc(MAX(candidateCount, 1) * sizeof(uint32_t));
+    uint32_t matchCount = 0;
+    
+    FuzzyResult *heap = malloc(MIN(limit, MAX(candidateCount, 1)) * sizeof(FuzzyResult));
+    NSUInteger heapCount = 0;
+    
+    for (uint32_t c = 0; c < candidateCount; c++) {
+        uint32_t idx = candidates ? candidates[c] : c;
+        uint32_t start = _starts[idx];
+        uint32_t length = _starts[idx + 1] - start;
+        if (length < queryLength) continue;
+        
+        int score = ScoreCandidate(_chars + start, _bonus + start, length, _basenames[idx], queryChars, queryLength);
+        if (score == FuzzyNoMatch) continue;
+        
+        matches[matchCount++] = idx;
+        
+        FuzzyResult result = { score, length, idx };
+        if (heapCount < limit) {
+            heap[heapCount] = result;
+            HeapSiftUp(heap, heapCount);
+            heapCount++;
+        } else if (IsBetter(result, heap[0])) {
+            heap[0] = result;
+            HeapSiftDown(heap, heapCount, 0);
+        }
+    }
+    
+    free(_lastQuery);
+    free(_lastMatches);
+    _lastQuery = queryChars;
+    _lastQueryLength = queryLength;
+    _lastMatches = matches;
+    _lastMatchCount = matchCount;
+    
+    qsort_b(heap, heapCount, sizeof(FuzzyResult), ^int(const void *a, const void *b) {
+        return IsBetter(*(const FuzzyResult *)a, *(const FuzzyResult *)b) ? -1 : 1;
+    });
+    
+    NSMutableArray *indexes = [NSMutableArray arrayWithCapacity:heapCount];
+    for (NSUInteger i = 0; i < heapCount; i++) {
+        [indexes addObject:@(heap[i].index)];
+    }
+    free(heap);
+    
+    return indexes;
+}
+
+@end
@@ -357,7 +357,7 @@ static id accountsWithRepos(NSArray *accounts, NSArray *repos) {
     
     __block NSInteger remaining = repos.count;
     
-    // XXX: This is truly awful since it doesn't stream and there's no progress ...
+    // XXX: There's still no progress ...
     // But this whole class is a gross hack that needs to die in a radioactive fire so ...
     
     for (NSDictionary *repo in repos) {
@@ -378,36 +378,41 @@ static id accountsWithRepos(NSArray *accounts, NSArray *repos) {
         
         NSString *endpoint = [NSString stringWithFormat:@"repos/%@/%@/issues", repo[@"owner"][@"login"], repo[@"name"]];
         
-        [_pager fetchPaged:[_pager get:endpoint params:params headers:@{ @"Accept" : @"application/vnd.github.squirrel-girl-preview"}] completion:^(NSArray *data, NSError *err) {
-            NSArray *issues = nil;
+        // Pages arrive in order of ascending updated_at, so each page's version can be yielded as soon as it lands:
+        // if a later page fails, the next sync resumes from there.
+        __block NSString *maxDate = nil;
+        
+        [_pager streamPagesInOrder:[_pager get:endpoint params:params headers:@{ @"Accept" : @"application/vnd.github.squirrel-girl-preview"}] pageHandler:^(NSArray *data, NSHTTPURLResponse *response, dispatch_block_t next) {
+            NSArray *issues = [data arrayByMappingObjects:^id(id obj) {
+                NSMutableDictionary *issue = [obj mutableCopy];
+                issue[@"repository"] = repo[@"id"];
+                return issue;
+            }];
             
-            if (data) {
-                issues = [data arrayByMappingObjects:^id(id obj) {
-                    NSMutableDictionary *issue = [obj mutableCopy];
-                    issue[@"repository"] = repo[@"id"];
-                    return issue;
-                }];
-                
-                if ([issues count]) {
-                    // calculate the max date in all of issues and that's our latest since str
-                    NSString *maxDate = nil;
-                    for (NSDictionary *issue in issues) {
-                        NSString *created = issue[@"created_at"];
-                        NSString *updated = issue[@"updated_at"];
-                        
-                        if (!maxDate || [created compare:maxDate] == NSOrderedDescending) {
-                            maxDate = created;
-                        }
-                        
-                        if (!maxDate || [updated compare:maxDate] == NSOrderedDescending) {
-                            maxDate = updated;
-                        }
-                    }
+            if ([issues count]) {
+                // calculate the max date in all of issues and that's our latest since str
+                for (NSDictionary *issue in issues) {
+                    NSString *created = issue[@"created_at"];
+                    NSString *updated = issue[@"updated_at"];
                     
-                    NSDictionary *version = @{ versionField: @([[NSDate dateWithJSONString:maxDate] timeIntervalSinceReferenceDate] * 1000)};
+                    if (!maxDate || [created compare:maxDate] == NSOrderedDescending) {
+                        maxDate = created;
+                    }
                     
-                    [self yield:issues type:@"issue" version:version];
+                    if (!maxDate || [updated compare:maxDate] == NSOrderedDescending) {
+                        maxDate = updated;
+                    }
                 }
+                
+                NSDictionary *version = @{ versionField: @([[NSDate dateWithJSONString:maxDate] timeIntervalSinceReferenceDate] * 1000)};
+                
+                [self yield:issues type:@"issue" version:version];
+            }
+            
+            next();
+        } completion:^(NSError *err) {
+            if (err) {
+                ErrLog(@"Unable to fetch issues for %@: %@", endpoint, err);
             }
             
             remaining--;
@@ -35,7 +35,8 @@ typedef NS_ENUM(NSInteger, DiffFileMode) {
 };
 
 typedef void (^GitDiffFileTextCompletion)(NSString *oldFile, NSString *newFile, NSString *patch, NSError *error);
-typedef void (^GitDiffFileBinaryCompletion)(NSData *oldFile, NSData *newFile, NSError *error);
+// oldObjectPath and newObjectPath are set when the data is an LFS object, to where it is kept in the LFS store.
+typedef void (^GitDiffFileBinaryCompletion)(NSData *oldFile, NSData *newFile, NSString *oldObjectPath, NSString *newObjectPath, NSError *error);
 
 @interface GitDiffFile : NSObject
 
@@ -63,6 +64,7 @@ typedef void (^GitDiffFileBinaryCompletion)(NSData *oldFile, NSData *newFile, NS
 
 @end
 
+// GitFileTree nodes build their children on first access, so should be used from the main thread.
 @interface GitFileTree : NSObject
 
 @property (readonly) NSString *name;
@@ -70,11 +72,21 @@ typedef void (^GitDiffFileBinaryCompletion)(NSData *oldFile, NSData *newFile, NS
 @property (readonly) NSString *path;
 @property (readonly) NSArray /*either GitFileTree or GitFile*/ *children;
 
+// All files beneath this tree, in the order they'd appear with every folder expanded.
+// Doesn't build any children.
+@property (readonly) NSArray<GitDiffFile *> *inorderFiles;
+
 @property (readonly, weak) GitFileTree *parentTree; // may be nil
 @property (readonly, weak) GitDiff *parentDiff;
 
 @end
 
+// Posted on the main queue when background rename detection finishes for a diff.
+// Each renamed file replaces the added file at its path, and the deleted file at its oldPath is removed.
+extern NSString *const GitDiffDidDetectRenamesNotification;
+extern NSString *const GitDiffRenamedFilesKey; // NSArray<GitDiffFile *>
+extern NSString *const GitDiffReplacedFilesKey; // NSArray<GitDiffFile *>, both the added and deleted files
+
 @interface GitDiff : NSObject
 
 // equivalent to git diff baseRev...headRev
@@ -93,6 +105,10 @@ typedef void (^GitDiffFileBinaryCompletion)(NSData *oldFile, NSData *newFile, NS
 @property (readonly) NSString *baseRev;
 @property (readonly) NSString *headRev;
 
+// Diffs are returned before renames are detected, which happens on a background queue.
+// See GitDiffDidDetectRenamesNotification.
+@property (readonly, getter=isDetectingRenames) BOOL detectingRenames;
+
 - (GitDiff *)copyByFilteringFilesWithPredicate:(NSPredicate *)predicate;
 
 // Text search allFiles
@@ -14,14 +14,29 @@
 #import "NSError+Git.h"
 #import "NSString+Git.h"
 #import "GitRepoInternal.h"
+#import "GitDiffCache.h"
 #import "GitLFS.h"
+#import "GitLFSStore.h"
 #import "GitFileSearch.h"
 #import "GitModules.h"
+#import "GitPatchMapping.h"
 #import <git2.h>
 
 static NSRegularExpression *hunkStartRE(void);
 
-static uint64_t MaxLFSDownload = 50 * 1024 * 1024; /* 50MB */
+static uint64_t MaxLFSDownload = 512 * 1024 * 1024; /* 512MB, so that an old and new pair take at most half the LFS store */
+
+// Literal searches are prefiltered on the UTF-8 bytes of each file, so that only lines
+// which contain the query are decoded and given to NSRegularExpression.
+@interface GitTextSearchFilter : NSObject
+
+// Returns nil if search can't be prefiltered
++ (instancetype)filterForSearch:(GitFileSearch *)search;
+
+@property (readonly) NSData *needle; // UTF-8, and lowercased if caseInsensitive
+@property (readonly) BOOL caseInsensitive;
+
+@end
 
 @interface GitDiffFile ()
 
@@ -39,36 +54,100 @@ static uint64_t MaxLFSDownload = 50 * 1024 * 1024; /* 50MB */
 @property DiffFileMode oldMode;
 
 @property (readwrite, weak) GitFileTree *parentTree;
+@property (weak) GitDiff *parentDiff; // the diff that created this file
+@property (weak) GitDiff *treeDiff; // the diff most recently created with this file, whose fileTree is presented
 
 @property GitRepo *repo;
 @property (getter=isBinary) BOOL binary;
 
 - (void)_loadContentsAsText:(GitDiffFileTextCompletion)textCompletion asBinary:(GitDiffFileBinaryCompletion)binaryCompletion progress:(NSProgress *)progress allowLFS:(BOOL)allowLFS completionQueue:(dispatch_queue_t)completionQueue;
 
+// Does the work of _loadContentsAsText: on the calling thread. If completionQueue is nil, the completion is
+// called before this returns, which requires allowLFS to be NO, as LFS objects may have to be downloaded.
+- (void)_readContentsAsText:(GitDiffFileTextCompletion)textCompletion asBinary:(GitDiffFileBinaryCompletion)binaryCompletion progress:(NSProgress *)progress allowLFS:(BOOL)allowLFS completionQueue:(dispatch_queue_t)completionQueue;
+
+// Synchronous searches used by -[GitDiff performTextSearch:handler:]
+- (NSArray<GitFileSearchResult *> *)_searchNewContentsMatching:(NSRegularExpression *)re filter:(GitTextSearchFilter *)filter;
+- (NSArray<GitFileSearchResult *> *)_searchAddedLinesMatching:(NSRegularExpression *)re;
+
 @end
 
 @interface GitDiff ()
 
 @property NSArray<GitDiffFile *> *allFiles;
-@property GitFileTree *fileTree;
+@property NSArray<GitDiffFile *> *pathSortedFiles;
 
 @property NSString *baseRev;
 @property NSString *headRev;
 
+@property (readwrite, getter=isDetectingRenames) BOOL detectingRenames;
+
+- (void)_detectRenamesInRepo:(GitRepo *)repo diff:(git_diff *)diff;
+- (void)_applyRenames:(NSArray<GitDiffFile *> *)renamed;
+
 @end
 
 @interface GitFileTree ()
 
+- (id)initWithPath:(NSString *)path files:(NSArray<GitDiffFile *> *)pathSortedFiles parentDiff:(GitDiff *)parentDiff;
+
 @property NSString *dirname;
 @property NSString *path;
-@property NSMutableArray *mutableChildren;
 
 @property (readwrite, weak) GitFileTree *parentTree;
 @property (readwrite, weak) GitDiff *parentDiff;
 
+- (GitFileTree *)_treeContainingFile:(GitDiffFile *)file;
+- (BOOL)_replaceFile:(GitDiffFile *)file withFile:(GitDiffFile *)replacement;
+
 @end
 
-@implementation GitDiff
+NSString *const GitDiffDidDetectRenamesNotification = @"GitDiffDidDetectRenames";
+NSString *const GitDiffRenamedFilesKey = @"GitDiffRenamedFiles";
+NSString *const GitDiffReplacedFilesKey = @"GitDiffReplacedFiles";
+
+@implementation GitTextSearchFilter
+
++ (instancetype)filterForSearch:(GitFileSearch *)search {
+    if (search.flags & GitFileSearchFlagRegex) {
+        return nil;
+    }
+    
+    NSData *query = [search.query dataUsingEncoding:NSUTF8StringEncoding];
+    if ([query length] == 0) {
+        return nil;
+    }
+    
+    // A query containing a line terminator can never match within a line, which is left to the regular expression to decide.
+    NSRange terminator = [search.query rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:[NSString stringWithFormat:@"\n\r%C%C%C", (unichar)0x0085, (unichar)0x2028, (unichar)0x2029]]];
+    if (terminator.location != NSNotFound) {
+        return nil;
+    }
+    
+    BOOL caseInsensitive = (search.flags & GitFileSearchFlagCaseInsensitive) != 0;
+    if (caseInsensitive) {
+        // Only ASCII case folding is done on bytes. Unicode case folding is left to the regular expression.
+        const uint8_t *bytes = query.bytes;
+        NSMutableData *lowered = [NSMutableData dataWithLength:query.length];
+        uint8_t *out = lowered.mutableBytes;
+        for (NSUInteger i = 0; i < query.length; i++) {
+            if (bytes[i] & 0x80) return nil;
+            out[i] = (uint8_t)tolower(bytes[i]);
+        }
+        query = lowered;
+    }
+    
+    GitTextSearchFilter *filter = [GitTextSearchFilter new];
+    filter->_needle = query;
+    filter->_caseInsensitive = caseInsensitive;
+    return filter;
+}
+
+@end
+
+@implementation GitDiff {
+    GitFileTree *_fileTree;
+}
 
 static int fileVisitor(const git_diff_delta *delta, float progress, void *ctx)
 {
@@ -77,6 +156,14 @@ static int fileVisitor(const git_diff_delta *delta, float progress, void *ctx)
     return 0;
 }
 
+static int renameVisitor(const git_diff_delta *delta, float progress, void *ctx)
+{
+    if (delta->status == GIT_DELTA_RENAMED) {
+        return fileVisitor(delta, progress, ctx);
+    }
+    return 0;
+}
+
 #define CHK(X) \
     do { \
         int giterr = (X); \
@@ -196,21 +283,55 @@ static int fileVisitor(const git_diff_delta *delta, float progress, void *ctx)
     
     CHK(git_diff_tree_to_tree(&diff, repo.repo, baseTree, headTree, NULL));
     
-    git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
-    opts.flags = GIT_DIFF_FIND_RENAMES;
-    CHK(git_diff_find_similar(diff, &opts));
-    
+    // Rename detection compares the contents of every added file with every deleted one,
+    // so it's left to _detectRenamesInRepo:diff:, and the files are returned as added and deleted for now.
     NSMutableArray *files = [NSMutableArray new];
     NSDictionary *info = @{@"files":files, @"repo":repo};
     CHK(git_diff_foreach(diff, fileVisitor, NULL /*binary cb*/, NULL /*hunk cb*/, NULL /*line cb*/, (__bridge void *)info));
     
     GitDiff *result = [[GitDiff alloc] initWithFiles:files baseRev:baseRev headRev:headRev];
     
+    BOOL hasAdded = NO, hasDeleted = NO;
+    for (GitDiffFile *file in files) {
+        file.parentDiff = result;
+        hasAdded = hasAdded || file.operation == DiffFileOperationAdded;
+        hasDeleted = hasDeleted || file.operation == DiffFileOperationDeleted;
+    }
+    
+    if (hasAdded && hasDeleted) {
+        // similarity is found on the diff already built, which now belongs to _detectRenamesInRepo:diff:
+        [result _detectRenamesInRepo:repo diff:diff];
+        diff = NULL;
+    }
+    
     cleanup();
     
     return result;
 }
 
+// Finds renames in diff, and returns the renamed files, or nil on error. Frees diff.
+static NSArray<GitDiffFile *> *findRenames(GitRepo *repo, git_diff *diff, NSError *__autoreleasing *error)
+{
+    [repo readLock];
+    
+    dispatch_block_t cleanup = ^{
+        git_diff_free(diff);
+        [repo unlock];
+    };
+    
+    git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+    opts.flags = GIT_DIFF_FIND_RENAMES;
+    CHK(git_diff_find_similar(diff, &opts));
+    
+    NSMutableArray *files = [NSMutableArray new];
+    NSDictionary *info = @{@"files":files, @"repo":repo};
+    CHK(git_diff_foreach(diff, renameVisitor, NULL /*binary cb*/, NULL /*hunk cb*/, NULL /*line cb*/, (__bridge void *)info));
+    
+    cleanup();
+    
+    return files;
+}
+
 + (GitDiff *)emptyDiffAtRev:(NSString *)rev {
     GitDiff *diff = [[GitDiff alloc] initWithFiles:@[] baseRev:rev headRev:rev];
     return diff;
@@ -223,48 +344,102 @@ static int fileVisitor(const git_diff_delta *delta, float progress, void *ctx)
         self.baseRev = baseRev;
         self.headRev = headRev;
         self.allFiles = files;
-        [self buildFileTree];
+        
+        // files may be shared with the diff this was copied from, which remains their parentDiff
+        for (GitDiffFile *file in files) {
+            file.treeDiff = self;
+            file.parentTree = nil;
+        }
+        
+        // Sort here, as diffs are generally created off of the main thread, and the tree itself is built lazily.
+        self.pathSortedFiles = [files sortedArrayUsingComparator:^NSComparisonResult(GitDiffFile *a, GitDiffFile *b) {
+            return [a.path localizedStandardCompare:b.path];
+        }];
     }
     return self;
 }
 
-- (void)buildFileTree {
+- (GitFileTree *)fileTree {
     /*
-     This method builds a file tree, suitable for presentation to the user.
+     Returns a file tree, suitable for presentation to the user.
+     Only the root is created here. Folders build their children as they're expanded.
     */
-     
-    NSArray *pathSorted = [_allFiles sortedArrayUsingComparator:^NSComparisonResult(GitDiffFile *a, GitDiffFile *b) {
-        return [a.path localizedStandardCompare:b.path];
-    }];
     
-    GitFileTree *root = [GitFileTree new];
-    root.parentDiff = self;
-    NSMutableDictionary *parents = [NSMutableDictionary new];
-    parents[@""] = root;
-    
-    for (GitDiffFile *file in pathSorted) {
-        // ensure parents
-        id lastItem = file;
-        NSString *pp = file.path;
-        do {
-            pp = [pp stringByDeletingLastPathComponent];
-            GitFileTree *ancestor = parents[pp];
-            id nextAncestor = nil;
-            if (!ancestor) {
-                ancestor = [GitFileTree new];
-                ancestor.parentDiff = self;
-                ancestor.path = pp;
-                ancestor.dirname = [pp lastPathComponent];
-                parents[pp] = ancestor;
-                nextAncestor = ancestor;
+    if (!_fileTree) {
+        _fileTree = [[GitFileTree alloc] initWithPath:@"" files:_pathSortedFiles parentDiff:self];
+    }
+    return _fileTree;
+}
+
+// Takes ownership of diff
+- (void)_detectRenamesInRepo:(GitRepo *)repo diff:(git_diff *)diff {
+    self.detectingRenames = YES;
+    
+    __weak GitDiff *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        NSError *error = nil;
+        NSArray *renamed = findRenames(repo, diff, &error);
+        if (error) {
+            ErrLog(@"Unable to detect renames: %@", error);
+        }
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [weakSelf _applyRenames:renamed];
+        });
+    });
+}
+
+- (void)_applyRenames:(NSArray<GitDiffFile *> *)renamed {
+    NSMutableDictionary *added = [NSMutableDictionary new];
+    NSMutableDictionary *deleted = [NSMutableDictionary new];
+    for (GitDiffFile *file in _allFiles) {
+        if (file.operation == DiffFileOperationAdded) {
+            added[file.path] = file;
+        } else if (file.operation == DiffFileOperationDeleted) {
+            deleted[file.path] = file;
+        }
+    }
+    
+    NSMapTable *replacements = [NSMapTable strongToStrongObjectsMapTable]; // added or deleted file -> renamed file or NSNull
+    NSMutableArray *applied = [NSMutableArray new];
+    for (GitDiffFile *file in renamed) {
+        GitDiffFile *addedFile = added[file.path];
+        GitDiffFile *deletedFile = deleted[file.oldPath];
+        if (addedFile && deletedFile) {
+            file.parentDiff = self;
+            file.treeDiff = self;
+            [replacements setObject:file forKey:addedFile];
+            [replacements setObject:[NSNull null] forKey:deletedFile];
+            [applied addObject:file];
+        }
+    }
+    
+    NSArray *(^patch)(NSArray *) = ^(NSArray *files) {
+        NSMutableArray *result = [NSMutableArray arrayWithCapacity:files.count];
+        for (GitDiffFile *file in files) {
+            id replacement = [replacements objectForKey:file] ?: file;
+            if (replacement != [NSNull null]) {
+                [result addObject:replacement];
             }
-            [ancestor.mutableChildren addObject:lastItem];
-            [lastItem setParentTree:ancestor];
-            lastItem = nextAncestor;
-        } while ([pp length] && lastItem);
+        }
+        return result;
+    };
+    
+    if (applied.count) {
+        self.allFiles = patch(_allFiles);
+        self.pathSortedFiles = patch(_pathSortedFiles);
+        
+        // patch rather than rebuild the tree, so anyone presenting it can keep their expanded folders
+        for (GitDiffFile *file in replacements) {
+            id replacement = [replacements objectForKey:file];
+            [_fileTree _replaceFile:file withFile:replacement != [NSNull null] ? replacement : nil];
+        }
     }
     
-    self.fileTree = root;
+    self.detectingRenames = NO;
+    
+    NSArray *replaced = [[replacements keyEnumerator] allObjects];
+    [[NSNotificationCenter defaultCenter] postNotificationName:GitDiffDidDetectRenamesNotification object:self userInfo:@{ GitDiffRenamedFilesKey : applied, GitDiffReplacedFilesKey : replaced }];
 }
 
 - (GitDiff *)copyByFilteringFilesWithPredicate:(NSPredicate *)predicate {
@@ -337,18 +512,178 @@ static NSArray<GitFileSearchResult *> *_searchDiff(NSRegularExpression *re, GitD
     return results;
 }
 
+static BOOL IsASCII(const uint8_t *bytes, size_t length) {
+    // 8 bytes at a time
+    uint64_t acc = 0;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        acc |= word;
+    }
+    for (; i < length; i++) {
+        acc |= bytes[i];
+    }
+    return (acc & 0x8080808080808080ULL) == 0;
+}
+
+// Strict UTF-8 validation: no overlong forms, surrogates, or code points past U+10FFFF.
+static BOOL IsValidUTF8(const uint8_t *bytes, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        // skip runs of ASCII quickly
+        while (i + 8 <= length) {
+            uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            if (word & 0x8080808080808080ULL) break;
+            i += 8;
+        }
+        if (i >= length) break;
+        
+        uint8_t c = bytes[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        
+        size_t n;
+        uint8_t lo = 0x80, hi = 0xBF; // bounds for the second byte
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return NO;
+        }
+        
+        if (i + n >= length) return NO;
+        if (bytes[i+1] < lo || bytes[i+1] > hi) return NO;
+        for (size_t k = 2; k <= n; k++) {
+            if ((bytes[i+k] & 0xC0) != 0x80) return NO;
+        }
+        i += n + 1;
+    }
+    return YES;
+}
+
+// Finds the end of the line beginning at start, using the same line terminators as -[NSString enumerateLinesUsingBlock:]
+static void LineBounds(const uint8_t *bytes, size_t length, size_t start, size_t *contentsEnd, size_t *lineEnd) {
+    for (size_t i = start; i < length; i++) {
+        uint8_t c = bytes[i];
+        if (c == '\n') {
+            *contentsEnd = i;
+            *lineEnd = i + 1;
+            return;
+        } else if (c == '\r') {
+            *contentsEnd = i;
+            *lineEnd = (i + 1 < length && bytes[i+1] == '\n') ? i + 2 : i + 1;
+            return;
+        } else if (c == 0xC2 && i + 1 < length && bytes[i+1] == 0x85) {
+            *contentsEnd = i;
+            *lineEnd = i + 2;
+            return;
+        } else if (c == 0xE2 && i + 2 < length && bytes[i+1] == 0x80 && (bytes[i+2] == 0xA8 || bytes[i+2] == 0xA9)) {
+            *contentsEnd = i;
+            *lineEnd = i + 3;
+            return;
+        }
+    }
+    *contentsEnd = length;
+    *lineEnd = length;
+}
+
+// memchr for the first byte of needle (which libc vectorizes), then memcmp for the rest
+static const uint8_t *FindBytes(const uint8_t *haystack, size_t length, const uint8_t *needle, size_t needleLength) {
+    if (needleLength > length) return NULL;
+    
+    const uint8_t *p = haystack;
+    const uint8_t *last = haystack + (length - needleLength);
+    while (p <= last) {
+        p = memchr(p, needle[0], (size_t)(last - p) + 1);
+        if (!p) return NULL;
+        if (memcmp(p + 1, needle + 1, needleLength - 1) == 0) return p;
+        p++;
+    }
+    return NULL;
+}
+
+// Searches the UTF-8 contents of a file line by line, with the same results as decoding it and calling _searchFile.
+static NSArray<GitFileSearchResult *> *_searchFileBytes(NSRegularExpression *re, GitTextSearchFilter *filter, GitDiffFile *file, const uint8_t *bytes, size_t length) {
+    if (!filter || !IsValidUTF8(bytes, length) || (filter.caseInsensitive && !IsASCII(bytes, length))) {
+        NSString *contents = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+        return _searchFile(re, file, contents);
+    }
+    
+    uint8_t *lowered = NULL;
+    const uint8_t *haystack = bytes;
+    if (filter.caseInsensitive) {
+        lowered = malloc(MAX(length, 1));
+        for (size_t i = 0; i < length; i++) {
+            uint8_t c = bytes[i];
+            lowered[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        }
+        haystack = lowered;
+    }
+    
+    NSData *needle = filter.needle;
+    NSMutableArray *results = nil;
+    NSInteger lineNumber = 0;
+    size_t lineStart = 0;
+    
+    while (lineStart < length) {
+        const uint8_t *hit = FindBytes(haystack + lineStart, length - lineStart, needle.bytes, needle.length);
+        if (!hit) break;
+        size_t hitOffset = hit - haystack;
+        
+        // count the lines up to the hit
+        size_t contentsEnd, lineEnd;
+        LineBounds(bytes, length, lineStart, &contentsEnd, &lineEnd);
+        while (contentsEnd <= hitOffset) {
+            lineStart = lineEnd;
+            lineNumber++;
+            LineBounds(bytes, length, lineStart, &contentsEnd, &lineEnd);
+        }
+        
+        NSString *line = [[NSString alloc] initWithBytes:bytes + lineStart length:contentsEnd - lineStart encoding:NSUTF8StringEncoding];
+        NSArray *matches = [re matchesInString:line options:0 range:NSMakeRange(0, line.length)];
+        if (matches.count) {
+            GitFileSearchResult *result = [GitFileSearchResult new];
+            result.file = file;
+            result.matchedResults = matches;
+            result.matchedLineNumber = lineNumber;
+            result.matchedLineText = line;
+            if (!results) {
+                results = [NSMutableArray new];
+            }
+            [results addObject:result];
+        }
+        
+        lineStart = lineEnd;
+        lineNumber++;
+    }
+    
+    free(lowered);
+    
+    return results;
+}
+
 - (NSProgress *)performTextSearch:(GitFileSearch *)search handler:(void (^)(NSArray<GitFileSearchResult *> *result))handler {
-    // Concurrent processing in 2 parallel pipelines:
-    //   Load: read contents of GitDiffFiles from git
-    //   Search: search contents of files
-    // Finished when there are no more active load or search jobs
+    // Files are searched by a bounded pool of workers, each of which repeatedly takes the next unsearched file.
+    // Results are held back as needed so that they are delivered to handler in file order.
+    // Finished when every worker has run out of files.
     
     dispatch_queue_t callbackQ = dispatch_get_main_queue();
     dispatch_queue_t workQ = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-    dispatch_queue_t progressQueue = dispatch_queue_create(NULL, NULL);
-    __block NSInteger completed = 0;
+    dispatch_queue_t orderQ = dispatch_queue_create(NULL, NULL);
     
-    NSProgress *progress = [NSProgress progressWithTotalUnitCount:_allFiles.count];
+    NSArray<GitDiffFile *> *files = _allFiles;
+    NSProgress *progress = [NSProgress progressWithTotalUnitCount:files.count];
     
     BOOL searchDiffOnly = (search.flags & GitFileSearchFlagAddedLinesOnly) != 0;
     
@@ -370,58 +705,75 @@ static NSArray<GitFileSearchResult *> *_searchDiff(NSRegularExpression *re, GitD
         dispatch_async(callbackQ, ^{
             handler(nil);
         });
+        return progress;
     }
     
+    // the added lines search works on the patch, which isn't prefiltered
+    GitTextSearchFilter *filter = searchDiffOnly ? nil : [GitTextSearchFilter filterForSearch:search];
+    
     void (^handlerProxy)(NSArray<GitFileSearchResult *> *) = ^(NSArray<GitFileSearchResult *> *result) {
         if (!progress.cancelled) {
             handler(result);
         }
     };
     
-    dispatch_block_t incrementProgress = ^{
-        dispatch_sync(progressQueue, ^{
-            progress.completedUnitCount = ++completed;
-        });
-    };
+    // state below is only accessed on orderQ
+    __block NSUInteger nextFile = 0;
+    __block NSUInteger nextDelivery = 0;
+    __block NSInteger completed = 0;
+    NSMutableDictionary<NSNumber *, NSArray *> *undelivered = [NSMutableDictionary new];
     
-    dispatch_async(workQ, ^{
-        dispatch_group_t group = dispatch_group_create(); // tracks completion
+    void (^finishFile)(NSUInteger, NSArray *) = ^(NSUInteger idx, NSArray *fileResults) {
+        progress.completedUnitCount = ++completed;
+        undelivered[@(idx)] = fileResults ?: @[];
         
-        for (GitDiffFile *file in _allFiles) {
-            if (progress.cancelled) break;
-            
-            dispatch_group_enter(group);
-            [file _loadContentsAsText:^(NSString *oldFile, NSString *newFile, NSString *patch, NSError *error) {
-                if (!progress.cancelled) {
-                    dispatch_group_async(group, workQ, ^{
-                        NSArray *fileResults;
-                        if (searchDiffOnly) {
-                            fileResults = _searchDiff(re, file, patch);
-                        } else {
-                            fileResults = _searchFile(re, file, newFile);
-                        }
-                        for (GitFileSearchResult *result in fileResults) {
-                            result.search = search;
-                        }
-                        
-                        if ([fileResults count]) {
-                            dispatch_async(callbackQ, ^{
-                                handlerProxy(fileResults);
-                            });
-                        }
-                        incrementProgress();
-                    });
-                }
-                dispatch_group_leave(group); // pair the initial load
-            } asBinary:^(NSData *oldFile, NSData *newFile, NSError *error) {
-                incrementProgress();
-                dispatch_group_leave(group); // we don't search binary files
-            } progress:nil allowLFS:NO completionQueue:workQ];
+        NSArray *ready;
+        while ((ready = undelivered[@(nextDelivery)]) != nil) {
+            [undelivered removeObjectForKey:@(nextDelivery)];
+            nextDelivery++;
+            if ([ready count]) {
+                dispatch_async(callbackQ, ^{
+                    handlerProxy(ready);
+                });
+            }
         }
-        
-        dispatch_group_notify(group, callbackQ, ^{
-            handlerProxy(nil);
+    };
+    
+    dispatch_group_t group = dispatch_group_create(); // tracks completion
+    NSUInteger workerCount = MIN([[NSProcessInfo processInfo] activeProcessorCount], files.count);
+    
+    for (NSUInteger i = 0; i < workerCount; i++) {
+        dispatch_group_async(group, workQ, ^{
+            while (!progress.cancelled) {
+                __block NSUInteger idx;
+                dispatch_sync(orderQ, ^{
+                    idx = nextFile++;
+                });
+                if (idx >= files.count) break;
+                
+                GitDiffFile *file = files[idx];
+                NSArray *fileResults;
+                @autoreleasepool {
+                    if (searchDiffOnly) {
+                        fileResults = [file _searchAddedLinesMatching:re];
+                    } else {
+                        fileResults = [file _searchNewContentsMatching:re filter:filter];
+                    }
+                    for (GitFileSearchResult *result in fileResults) {
+                        result.search = search;
+                    }
+                }
+                
+                dispatch_sync(orderQ, ^{
+                    finishFile(idx, fileResults);
+                });
+            }
         });
+    }
+    
+    // every delivery has been queued to callbackQ by the time the group is done, so this comes last
+    dispatch_group_notify(group, callbackQ, ^{
+        handlerProxy(nil);
     });
     
     return progress;
@@ -429,25 +781,170 @@ static NSArray<GitFileSearchResult *> *_searchDiff(NSRegularExpression *re, GitD
 
 @end
 
-@implementation GitFileTree
+@implementation GitFileTree {
+    NSMutableArray<GitDiffFile *> *_pendingFiles; // path sorted files beneath this tree, until children are built
+    NSMutableArray *_mutableChildren;
+}
 
-- (id)init {
+- (id)initWithPath:(NSString *)path files:(NSArray<GitDiffFile *> *)pathSortedFiles parentDiff:(GitDiff *)parentDiff {
     if (self = [super init]) {
-        self.dirname = @"";
-        self.path = @"";
-        self.mutableChildren = [NSMutableArray new];
+        self.path = path;
+        self.dirname = [path lastPathComponent];
+        self.parentDiff = parentDiff;
+        _pendingFiles = [pathSortedFiles mutableCopy];
     }
     return self;
 }
 
+static NSString *subpath(NSString *dirPath, NSString *name) {
+    return dirPath.length ? [NSString stringWithFormat:@"%@/%@", dirPath, name] : name;
+}
+
+// Splits files, all of which are beneath dirPath, into the items directly in dirPath:
+// GitDiffFiles, and NSStrings naming subdirectories, whose files are returned in subdirFiles.
+// Items are ordered by their first appearance in files.
+static NSArray *groupFiles(NSArray<GitDiffFile *> *files, NSString *dirPath, NSDictionary<NSString *, NSMutableArray<GitDiffFile *> *> *__autoreleasing *subdirFiles) {
+    NSUInteger prefix = dirPath.length ? dirPath.length + 1 : 0;
+    NSMutableArray *items = [NSMutableArray new];
+    NSMutableDictionary *subdirs = [NSMutableDictionary new];
+    
+    for (GitDiffFile *file in files) {
+        NSString *path = file.path;
+        NSRange slash = [path rangeOfString:@"/" options:NSLiteralSearch range:NSMakeRange(prefix, path.length - prefix)];
+        if (slash.location == NSNotFound) {
+            [items addObject:file];
+        } else {
+            NSString *name = [path substringWithRange:NSMakeRange(prefix, slash.location - prefix)];
+            NSMutableArray *subdir = subdirs[name];
+            if (!subdir) {
+                subdir = [NSMutableArray new];
+                subdirs[name] = subdir;
+                [items addObject:name];
+            }
+            [subdir addObject:file];
+        }
+    }
+    
+    *subdirFiles = subdirs;
+    return items;
+}
+
+static void appendInorderFiles(NSArray<GitDiffFile *> *files, NSString *dirPath, NSMutableArray *inorder) {
+    NSDictionary *subdirFiles = nil;
+    for (id item in groupFiles(files, dirPath, &subdirFiles)) {
+        if ([item isKindOfClass:[NSString class]]) {
+            appendInorderFiles(subdirFiles[item], subpath(dirPath, item), inorder);
+        } else {
+            [inorder addObject:item];
+        }
+    }
+}
+
+- (void)buildChildren {
+    if (_mutableChildren) return;
+    
+    NSDictionary *subdirFiles = nil;
+    NSArray *items = groupFiles(_pendingFiles, _path, &subdirFiles);
+    
+    _mutableChildren = [NSMutableArray arrayWithCapacity:items.count];
+    for (id item in items) {
+        if ([item isKindOfClass:[NSString class]]) {
+            GitFileTree *subtree = [[GitFileTree alloc] initWithPath:subpath(_path, item) files:subdirFiles[item] parentDiff:_parentDiff];
+            subtree.parentTree = self;
+            [_mutableChildren addObject:subtree];
+        } else {
+            [item setParentTree:self];
+            [_mutableChildren addObject:item];
+        }
+    }
+    
+    _pendingFiles = nil;
+}
+
 - (NSArray *)children {
+    [self buildChildren];
     return _mutableChildren;
 }
 
+- (NSArray<GitDiffFile *> *)inorderFiles {
+    NSMutableArray *inorder = [NSMutableArray new];
+    if (_mutableChildren) {
+        for (id item in _mutableChildren) {
+            if ([item isKindOfClass:[GitFileTree class]]) {
+                [inorder addObjectsFromArray:[item inorderFiles]];
+            } else {
+                [inorder addObject:item];
+            }
+        }
+    } else {
+        appendInorderFiles(_pendingFiles, _path, inorder);
+    }
+    return inorder;
+}
+
 - (NSString *)name {
     return _dirname;
 }
 
+// Builds children down to file, and returns the tree directly containing it.
+- (GitFileTree *)_treeContainingFile:(GitDiffFile *)file {
+    [self buildChildren];
+    
+    NSString *path = file.path;
+    for (id item in _mutableChildren) {
+        if (item == file) {
+            return self;
+        } else if ([item isKindOfClass:[GitFileTree class]]) {
+            NSString *itemPath = [item path];
+            if (path.length > itemPath.length && [path characterAtIndex:itemPath.length] == '/' && [path hasPrefix:itemPath]) {
+                return [item _treeContainingFile:file];
+            }
+        }
+    }
+    
+    return nil;
+}
+
+// Replaces file with replacement, which must have the same path, or removes file if replacement is nil.
+// Returns YES if this tree is left empty.
+- (BOOL)_replaceFile:(GitDiffFile *)file withFile:(GitDiffFile *)replacement {
+    if (!_mutableChildren) {
+        NSUInteger idx = [_pendingFiles indexOfObjectIdenticalTo:file];
+        if (idx != NSNotFound) {
+            if (replacement) {
+                _pendingFiles[idx] = replacement;
+            } else {
+                [_pendingFiles removeObjectAtIndex:idx];
+            }
+        }
+        return _pendingFiles.count == 0;
+    }
+    
+    NSString *path = file.path;
+    for (NSUInteger idx = 0; idx < _mutableChildren.count; idx++) {
+        id item = _mutableChildren[idx];
+        if (item == file) {
+            if (replacement) {
+                replacement.parentTree = self;
+                _mutableChildren[idx] = replacement;
+            } else {
+                [_mutableChildren removeObjectAtIndex:idx];
+            }
+            break;
+        } else if ([item isKindOfClass:[GitFileTree class]]) {
+            NSString *itemPath = [item path];
+            if (path.length > itemPath.length && [path characterAtIndex:itemPath.length] == '/' && [path hasPrefix:itemPath]) {
+                if ([item _replaceFile:file withFile:replacement]) {
+                    [_mutableChildren removeObjectAtIndex:idx];
+                }
+                break;
+            }
+        }
+    }
+    
+    return _mutableChildren.count == 0;
+}
+
 @end
 
 @implementation GitDiffFile
@@ -482,6 +979,15 @@ static NSArray<GitFileSearchResult *> *_searchDiff(NSRegularExpression *re, GitD
     return self.mode == DiffFileModeCommit;
 }
 
+- (GitFileTree *)parentTree {
+    GitFileTree *tree = _parentTree;
+    if (!tree) {
+        // the tree is built lazily, so build it down to here
+        tree = [(_treeDiff ?: _parentDiff).fileTree _treeContainingFile:self];
+    }
+    return tree;
+}
+
 // helper method for _loadContents...
 // must be called under read-lock
 - (BOOL)_gitAttributesHasLFSForPath:(NSString *)path {
@@ -537,8 +1043,8 @@ static NSArray<GitFileSearchResult *> *_searchDiff(NSRegularExpression *re, GitD
             } \
         } while(0);
         
-        NSString *baseRev = self.parentTree.parentDiff.baseRev;
-        NSString *headRev = self.parentTree.parentDiff.headRev;
+        NSString *baseRev = self.parentDiff.baseRev;
+        NSString *headRev = self.parentDiff.headRev;
         
         CHK(git_revparse_single(&baseObj, _repo.repo, [baseRev UTF8String]));
         CHK(git_revparse_single(&headObj, _repo.repo, [headRev UTF8String]));
@@ -596,124 +1102,155 @@ static NSArray<GitFileSearchResult *> *_searchDiff(NSRegularExpression *re, GitD
 
 - (void)_loadContentsAsText:(GitDiffFileTextCompletion)textCompletion asBinary:(GitDiffFileBinaryCompletion)binaryCompletion progress:(NSProgress *)progress allowLFS:(BOOL)allowLFS completionQueue:(dispatch_queue_t)completionQueue
 {
-    NSParameterAssert(textCompletion);
-    NSParameterAssert(binaryCompletion);
     NSParameterAssert(completionQueue);
     
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        __block git_submodule *submodule = NULL;
-        __block git_blob *newBlob = NULL;
-        __block git_blob *oldBlob = NULL;
-        __block git_patch *gitPatch = NULL;
-        __block git_buf patchBuf = {0};
+        [self _readContentsAsText:textCompletion asBinary:binaryCompletion progress:progress allowLFS:allowLFS completionQueue:completionQueue];
+    });
+}
+
+- (void)_readContentsAsText:(GitDiffFileTextCompletion)textCompletion asBinary:(GitDiffFileBinaryCompletion)binaryCompletion progress:(NSProgress *)progress allowLFS:(BOOL)allowLFS completionQueue:(dispatch_queue_t)completionQueue
+{
+    NSParameterAssert(textCompletion);
+    NSParameterAssert(binaryCompletion);
+    NSParameterAssert(completionQueue || !allowLFS);
+    
+    void (^complete)(dispatch_block_t) = ^(dispatch_block_t block) {
+        if (completionQueue) {
+            dispatch_async(completionQueue, block);
+        } else {
+            block();
+        }
+    };
+    
+    __block git_submodule *submodule = NULL;
+    __block git_blob *newBlob = NULL;
+    __block git_blob *oldBlob = NULL;
+    __block git_patch *gitPatch = NULL;
+    __block git_buf patchBuf = {0};
+    
+    NSString *newText = nil;
+    NSString *oldText = nil;
+    NSString *patchText = nil;
+    
+    NSData *newData = nil;
+    NSData *oldData = nil;
+    
+    [_repo readLock];
+    
+    dispatch_block_t cleanup = ^{
+        if (submodule) git_submodule_free(submodule);
+        if (newBlob) git_blob_free(newBlob);
+        if (oldBlob) git_blob_free(oldBlob);
+        if (gitPatch) git_patch_free(gitPatch);
+        if (patchBuf.ptr) git_buf_free(&patchBuf);
         
-        NSString *newText = nil;
-        NSString *oldText = nil;
-        NSString *patchText = nil;
+        [_repo unlock];
+    };
+    
+    #define CHK(X) \
+    do { \
+        int giterr = (X); \
+        if (giterr) { \
+            cleanup(); \
+            NSError *err = [NSError gitError]; \
+            complete(^{ textCompletion(nil, nil, nil, err); }); \
+            return; \
+        } \
+    } while(0);
+    
+    BOOL isSubmodule = self.mode == DiffFileModeCommit;
+    
+    if (isSubmodule) {
+        NSMutableString *patch = [NSMutableString new];
         
-        NSData *newData = nil;
-        NSData *oldData = nil;
+        // add
+        /*
+         diff --git a/web b/web
+         new file mode 160000
+         index 0000000..6fef966
+         --- /dev/null
+         +++ b/web
+         @@ -0,0 +1 @@
+         +6fef96688f06f620235b0e7617d6bbbe8e451d60
+         */
         
-        [_repo readLock];
+        // update
+        /*
+         diff --git a/web b/web
+         index 6fef966..5eda0b7 160000
+         --- a/web
+         +++ b/web
+         @@ -1 +1 @@
+         -Subproject commit 6fef96688f06f620235b0e7617d6bbbe8e451d60
+         +Subproject commit 5eda0b7902a0e0ac6320e57444779d154b7915a7
+         */
         
-        dispatch_block_t cleanup = ^{
-            if (submodule) git_submodule_free(submodule);
-            if (newBlob) git_blob_free(newBlob);
-            if (oldBlob) git_blob_free(oldBlob);
-            if (gitPatch) git_patch_free(gitPatch);
-            if (patchBuf.ptr) git_buf_free(&patchBuf);
-            
-            [_repo unlock];
-        };
+        // delete
+        /*
+         diff --git a/web b/web
+         deleted file mode 160000
+         index 5eda0b7..0000000
+         --- a/web
+         +++ /dev/null
+         @@ -1 +0,0 @@
+         -Subproject commit 5eda0b7902a0e0ac6320e57444779d154b7915a7
+         */
         
-        #define CHK(X) \
-        do { \
-            int giterr = (X); \
-            if (giterr) { \
-                cleanup(); \
-                NSError *err = [NSError gitError]; \
-                RunOnMain(^{ textCompletion(nil, nil, nil, err); }); \
-                return; \
-            } \
-        } while(0);
+        BOOL add = git_oid_iszero(&_oldOid);
+        BOOL delete = git_oid_iszero(&_newOid);
         
-        BOOL isSubmodule = self.mode == DiffFileModeCommit;
+        [patch appendFormat:@"diff --git a/%@ b/%@\n", self.oldPath, self.path];
+        char bufOld[8];
+        char bufNew[8];
+        [patch appendFormat:@"index %s..%s\n", git_oid_tostr(bufOld, 8, &_oldOid), git_oid_tostr(bufNew, 8, &_newOid)];
+        [patch appendFormat:@"--- %@\n", add?@"/dev/null":[@"a/" stringByAppendingString:self.oldPath]];
+        [patch appendFormat:@"+++ %@\n", delete?@"/dev/null":[@"b/" stringByAppendingString:self.path]];
+        if (add) {
+            [patch appendString:@"@@ -0,0 +1 @@\n"];
+        } else if (delete) {
+            [patch appendString:@"@@ -1 +0,0 @@\n"];
+        } else /* update */ {
+            [patch appendString:@"@@ -1 +1 @@\n"];
+        }
         
-        if (isSubmodule) {
-            NSMutableString *patch = [NSMutableString new];
-            
-            // add
-            /*
-             diff --git a/web b/web
-             new file mode 160000
-             index 0000000..6fef966
-             --- /dev/null
-             +++ b/web
-             @@ -0,0 +1 @@
-             +6fef96688f06f620235b0e7617d6bbbe8e451d60
-             */
-            
-            // update
-            /*
-             diff --git a/web b/web
-             index 6fef966..5eda0b7 160000
-             --- a/web
-             +++ b/web
-             @@ -1 +1 @@
-             -Subproject commit 6fef96688f06f620235b0e7617d6bbbe8e451d60
-             +Subproject commit 5eda0b7902a0e0ac6320e57444779d154b7915a7
-             */
-            
-            // delete
-            /*
-             diff --git a/web b/web
-             deleted file mode 160000
-             index 5eda0b7..0000000
-             --- a/web
-             +++ /dev/null
-             @@ -1 +0,0 @@
-             -Subproject commit 5eda0b7902a0e0ac6320e57444779d154b7915a7
-             */
-            
-            BOOL add = git_oid_iszero(&_oldOid);
-            BOOL delete = git_oid_iszero(&_newOid);
-            
-            [patch appendFormat:@"diff --git a/%@ b/%@\n", self.oldPath, self.path];
-            char bufOld[8];
-            char bufNew[8];
-            [patch appendFormat:@"index %s..%s\n", git_oid_tostr(bufOld, 8, &_oldOid), git_oid_tostr(bufNew, 8, &_newOid)];
-            [patch appendFormat:@"--- %@\n", add?@"/dev/null":[@"a/" stringByAppendingString:self.oldPath]];
-            [patch appendFormat:@"+++ %@\n", delete?@"/dev/null":[@"b/" stringByAppendingString:self.path]];
-            if (add) {
-                [patch appendString:@"@@ -0,0 +1 @@\n"];
-            } else if (delete) {
-                [patch appendString:@"@@ -1 +0,0 @@\n"];
-            } else /* update */ {
-                [patch appendString:@"@@ -1 +1 @@\n"];
-            }
-            
-            if (!git_oid_iszero(&_oldOid)) {
-                oldText = [NSString stringWithGitOid:&_oldOid];
-                [patch appendFormat:@"-%@\n", oldText];
-            } else {
-                oldText = @"";
-            }
-            
-            if (!git_oid_iszero(&_newOid)) {
-                newText = [NSString stringWithGitOid:&_newOid];
-                [patch appendFormat:@"+%@\n", newText];
-            } else {
-                newText = @"";
-            }
-            
-            patchText = [NSString stringWithString:patch];
-            
-            dispatch_async(completionQueue, ^{
-                textCompletion(oldText, newText, patchText, nil);
-            });
+        if (!git_oid_iszero(&_oldOid)) {
+            oldText = [NSString stringWithGitOid:&_oldOid];
+            [patch appendFormat:@"-%@\n", oldText];
+        } else {
+            oldText = @"";
+        }
+        
+        if (!git_oid_iszero(&_newOid)) {
+            newText = [NSString stringWithGitOid:&_newOid];
+            [patch appendFormat:@"+%@\n", newText];
+        } else {
+            newText = @"";
+        }
+        
+        patchText = [NSString stringWithString:patch];
+        
+        complete(^{
+            textCompletion(oldText, newText, patchText, nil);
+        });
+    } else {
+        BOOL binary = self.binary; // this is not necessarily accurate, yet, we may have to look at the contents to figure out.
+        
+        // Only text diffs are cached, so a hit also tells us neither blob is binary.
+        NSString *cacheKey = nil;
+        GitDiffCacheEntry *cached = nil;
+        if (!binary) {
+            NSString *oldOid = git_oid_iszero(&_oldOid) ? nil : [NSString stringWithGitOid:&_oldOid];
+            NSString *newOid = git_oid_iszero(&_newOid) ? nil : [NSString stringWithGitOid:&_newOid];
+            cacheKey = [GitDiffCache keyWithOldOid:oldOid newOid:newOid options:@"patch"];
+            cached = [_repo.diffCache entryForKey:cacheKey];
+        }
+        
+        if (cached) {
+            oldText = cached.oldText;
+            newText = cached.updatedText;
+            patchText = cached.patchText;
         } else {
-            BOOL binary = self.binary; // this is not necessarily accurate, yet, we may have to look at the contents to figure out.
-            
             if (!git_oid_iszero(&_oldOid)) {
                 CHK(git_blob_lookup(&oldBlob, _repo.repo, &_oldOid));
                 binary = binary || git_blob_is_binary(oldBlob);
@@ -739,213 +1276,149 @@ static NSArray<GitFileSearchResult *> *_searchDiff(NSRegularExpression *re, GitD
                     newText = [NSString stringWithGitBlob:newBlob];
                 }
             }
-            
-            BOOL usingLFS = NO;
-            
-            if (!binary) {
+        }
+        
+        BOOL usingLFS = NO;
+        
+        if (!binary) {
+            if (!cached) {
                 CHK(git_patch_from_blobs(&gitPatch, oldBlob, NULL /*oldfilename*/, newBlob, NULL /*newfilename*/, NULL /* default diff options */));
                 CHK(git_patch_to_buf(&patchBuf, gitPatch));
                 patchText = [NSString stringWithGitBuf:&patchBuf];
                 
-                // check for git-lfs
-                if (allowLFS)
+                if (cacheKey && patchText) {
+                    [_repo.diffCache setOldText:oldText newText:newText patchText:patchText forKey:cacheKey];
+                }
+            }
+            
+            // check for git-lfs
+            if (allowLFS)
+            {
+                GitLFSObject *oldLFS = nil;
+                GitLFSObject *newLFS = nil;
+                
+                [_repo.lfs isLFSAtPath:_oldPath?:_path text:oldText treeSha:_parentDiff.baseRev outObject:&oldLFS];
+                [_repo.lfs isLFSAtPath:_path?:_oldPath text:newText treeSha:_parentDiff.headRev outObject:&newLFS];
+                
+                if ((oldLFS != nil || newLFS != nil) && oldLFS.size.longLongValue < MaxLFSDownload && newLFS.size.longLongValue < MaxLFSDownload)
                 {
-                    GitLFSObject *oldLFS = nil;
-                    GitLFSObject *newLFS = nil;
+                    usingLFS = YES;
                     
-                    [_repo.lfs isLFSAtPath:_oldPath?:_path text:oldText treeSha:_parentTree.parentDiff.baseRev outObject:&oldLFS];
-                    [_repo.lfs isLFSAtPath:_path?:_oldPath text:newText treeSha:_parentTree.parentDiff.headRev outObject:&newLFS];
+                    NSArray *lfsObjs = nil;
+                    if (oldLFS && newLFS) {
+                        lfsObjs = @[oldLFS, newLFS];
+                    } else if (oldLFS) {
+                        lfsObjs = @[oldLFS];
+                    } else {
+                        lfsObjs = @[newLFS];
+                    }
                     
-                    if ((oldLFS != nil || newLFS != nil) && oldLFS.size.longLongValue < MaxLFSDownload && newLFS.size.longLongValue < MaxLFSDownload)
-                    {
-                        usingLFS = YES;
-                        
-                        NSArray *lfsObjs = nil;
-                        if (oldLFS && newLFS) {
-                            lfsObjs = @[oldLFS, newLFS];
-                        } else if (oldLFS) {
-                            lfsObjs = @[oldLFS];
+                    [_repo.lfs fetchObjects:lfsObjs withProgress:progress completion:^(NSArray<NSData *> *objs, NSError *error) {
+                        if (error) {
+                            if (![error isCancelError]) {
+                                ErrLog(@"LFS Download Error: %@", error);
+                            }
+                            // we always just fall back to showing the text interpretation of the lfs if we can't succeed
+                            textCompletion(oldText, newText, patchText, nil);
                         } else {
-                            lfsObjs = @[newLFS];
+                            GitLFSStore *store = _repo.lfs.store;
+                            binaryCompletion(oldLFS ? [objs firstObject] : nil,
+                                             newLFS ? [objs lastObject] : nil,
+                                             oldLFS ? [store pathForOid:oldLFS.oid] : nil,
+                                             newLFS ? [store pathForOid:newLFS.oid] : nil,
+                                             nil);
                         }
                         
-                        [_repo.lfs fetchObjects:lfsObjs withProgress:progress completion:^(NSArray<NSData *> *objs, NSError *error) {
-                            if (error) {
-                                if (![error isCancelError]) {
-                                    ErrLog(@"LFS Download Error: %@", error);
-                                }
-                                // we always just fall back to showing the text interpretation of the lfs if we can't succeed
-                                textCompletion(oldText, newText, patchText, nil);
-                            } else {
-                                binaryCompletion(oldLFS ? [objs firstObject] : nil,
-                                                 newLFS ? [objs lastObject] : nil,
-                                                 nil);
-                            }
-                            
-                        } completionQueue:completionQueue];
-                    }
+                    } completionQueue:completionQueue];
                 }
             }
-            
-            if (!usingLFS) {
-                dispatch_async(completionQueue, ^{
-                    if (binary) {
-                        binaryCompletion(oldData, newData, nil);
-                    } else {
-                        textCompletion(oldText, newText, patchText, nil);
-                    }
-                });
-            }
         }
         
-        cleanup();
-        
-        #undef CHK
-    });
+        if (!usingLFS) {
+            complete(^{
+                if (binary) {
+                    binaryCompletion(oldData, newData, nil, nil, nil);
+                } else {
+                    textCompletion(oldText, newText, patchText, nil);
+                }
+            });
+        }
+    }
+    
+    cleanup();
+    
+    #undef CHK
 }
 
-- (NSProgress *)loadContentsAsText:(GitDiffFileTextCompletion)textCompletion asBinary:(GitDiffFileBinaryCompletion)binaryCompletion
+- (NSArray<GitFileSearchResult *> *)_searchNewContentsMatching:(NSRegularExpression *)re filter:(GitTextSearchFilter *)filter
 {
-    NSProgress *progress = [NSProgress indeterminateProgress];
-    [self _loadContentsAsText:textCompletion asBinary:binaryCompletion progress:progress allowLFS:YES completionQueue:dispatch_get_main_queue()];
-    return progress;
-}
-
-static BOOL matchingHunkStart(NSString *a, NSString *b) {
-    NSRegularExpression *re = hunkStartRE();
+    if (self.mode == DiffFileModeCommit) {
+        // submodule, whose contents are shown as the commit sha. see _loadContentsAsText:
+        NSString *newText = git_oid_iszero(&_newOid) ? @"" : [NSString stringWithGitOid:&_newOid];
+        return _searchFile(re, self, newText);
+    }
     
-    NSTextCheckingResult *ma = [re firstMatchInString:a options:0 range:NSMakeRange(0, a.length)];
-    if (!ma) return NO;
-    NSTextCheckingResult *mb = [re firstMatchInString:b options:0 range:NSMakeRange(0, b.length)];
-    if (!mb) return NO;
+    if (git_oid_iszero(&_newOid)) {
+        return nil;
+    }
+    
+    git_blob *oldBlob = NULL;
+    git_blob *newBlob = NULL;
+    NSArray *results = nil;
+    
+    [_repo readLock];
     
-    NSRange aRange[5];
-    NSRange bRange[5];
+    // As in _loadContentsAsText:, if either side is binary, the file is treated as binary and isn't searched.
+    BOOL binary = self.binary;
     
-    for (NSInteger i = 0; i < 5; i++) {
-        aRange[i] = [ma rangeAtIndex:i];
-        bRange[i] = [mb rangeAtIndex:i];
+    if (!binary && !git_oid_iszero(&_oldOid)) {
+        binary = git_blob_lookup(&oldBlob, _repo.repo, &_oldOid) != 0 || git_blob_is_binary(oldBlob);
     }
     
-    NSInteger aLeftRun, aRightRun;
-    NSInteger bLeftRun, bRightRun;
+    if (!binary && git_blob_lookup(&newBlob, _repo.repo, &_newOid) == 0 && !git_blob_is_binary(newBlob)) {
+        results = _searchFileBytes(re, filter, self, git_blob_rawcontent(newBlob), (size_t)git_blob_rawsize(newBlob));
+    }
+    
+    if (oldBlob) git_blob_free(oldBlob);
+    if (newBlob) git_blob_free(newBlob);
     
-    aLeftRun = aRange[2].location != NSNotFound ? [[a substringWithRange:aRange[2]] integerValue] : 1;
-    bLeftRun = bRange[2].location != NSNotFound ? [[b substringWithRange:bRange[2]] integerValue] : 1;
-    aRightRun = aRange[4].location != NSNotFound ? [[a substringWithRange:aRange[4]] integerValue] : 1;
-    bRightRun = bRange[4].location != NSNotFound ? [[b substringWithRange:bRange[4]] integerValue] : 1;
+    [_repo unlock];
     
-    return aLeftRun == bLeftRun && aRightRun == bRightRun;
+    return results;
 }
 
-static BOOL matchingHunks(NSArray *aLines, NSArray *bLines, NSInteger aIdx, NSInteger bIdx, NSInteger aLineCount, NSInteger bLineCount, NSInteger *aAdvance, NSInteger *bAdvance, NSRange *aMatchRange, NSRange *bMatchRange)
+- (NSArray<GitFileSearchResult *> *)_searchAddedLinesMatching:(NSRegularExpression *)re
 {
-    *aAdvance = 1;
-    *bAdvance = 0;
-    
-    *aMatchRange = NSMakeRange(NSNotFound, 0);
-    *bMatchRange = NSMakeRange(NSNotFound, 0);
-    
-    NSInteger aSave = aIdx;
-    NSInteger bSave = bIdx;
-    
-    while (bIdx < bLineCount) {
-        aIdx = aSave;
-        if (![bLines[bIdx] hasPrefix:@"@@"]) {
-            bIdx++;
-        } else if (matchingHunkStart(aLines[aIdx], bLines[bIdx])) {
-            aMatchRange->location = aIdx;
-            bMatchRange->location = bIdx;
-            
-            aIdx++;
-            bIdx++;
-            
-            // we have a matching hunk start.
-            // now find out if the hunks match exactly.
-            while (1)
-            {
-                if ((aIdx == aLineCount || [aLines[aIdx] length] == 0 || [aLines[aIdx] hasPrefix:@"@@"])
-                    && (bIdx == bLineCount || [bLines[bIdx] length] == 0 || [bLines[bIdx] hasPrefix:@"@@"]))
-                {
-                    // we've matched the whole hunk
-                    *aAdvance = aIdx - aSave;
-                    *bAdvance = bIdx - bSave;
-                    
-                    aMatchRange->length = aIdx - aMatchRange->location;
-                    bMatchRange->length = bIdx - bMatchRange->location;
-                    
-                    return YES;
-                } else if ([aLines[aIdx] isEqualToString:bLines[bIdx]]) {
-                    // we're making progress
-                    aIdx++;
-                    bIdx++;
-                } else {
-                    // this hunk is not a match, go on to the next hunk in b
-                    bIdx++;
-                    break;
-                }
-            }
-        } else {
-            bIdx++;
-        }
-    }
+    __block NSString *patchText = nil;
     
-    return NO;
+    // Read on this thread rather than waiting on another, as a search runs many of these at once.
+    [self _readContentsAsText:^(NSString *oldFile, NSString *newFile, NSString *patch, NSError *error) {
+        patchText = patch;
+    } asBinary:^(NSData *oldFile, NSData *newFile, NSString *oldObjectPath, NSString *newObjectPath, NSError *error) {
+        // we don't search binary files
+    } progress:nil allowLFS:NO completionQueue:nil];
+    
+    return patchText ? _searchDiff(re, self, patchText) : nil;
+}
+
+- (NSProgress *)loadContentsAsText:(GitDiffFileTextCompletion)textCompletion asBinary:(GitDiffFileBinaryCompletion)binaryCompletion
+{
+    NSProgress *progress = [NSProgress indeterminateProgress];
+    [self _loadContentsAsText:textCompletion asBinary:binaryCompletion progress:progress allowLFS:YES completionQueue:dispatch_get_main_queue()];
+    return progress;
 }
 
 static NSArray *patchMapping(NSString *a, NSString *b) {
-    NSArray *aLines = [a componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]];
-    NSArray *bLines = [b componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]];
-    
-    NSInteger aLineCount = [aLines count];
-    NSInteger bLineCount = [bLines count];
-    if (!aLineCount) {
-        return @[];
-    }
-    
-    NSInteger aIdx = 0, bIdx = 0;
-    
-    NSMutableArray *map = [NSMutableArray arrayWithCapacity:[aLines count]];
+    NSData *data = GitPatchMapping(a, b);
+    const int32_t *map = data.bytes;
+    NSUInteger lineCount = data.length / sizeof(int32_t);
     
-    // initialize map with no mapping sentinel value -1 at
-    // every position.
-    for (NSUInteger i = 0; i < aLineCount; i++) {
-        [map addObject:@(-1)];
-    }
-    
-    // walk to the first hunk of the diff. assume the headers are equivalent-ish
-    while (aIdx < aLineCount && ![aLines[aIdx] hasPrefix:@"@@"]
-           && bIdx < bLineCount && ![bLines[bIdx] hasPrefix:@"@@"])
-    {
-        map[aIdx] = @(bIdx);
-        aIdx++;
-        bIdx++;
-    }
-    
-    // for each hunk in a, see if we can find it in b
-    while (aIdx < aLineCount) {
-        if ([aLines[aIdx] hasPrefix:@"@@"]) {
-            NSInteger aAdvance, bAdvance;
-            NSRange aMatchRange, bMatchRange;
-            
-            if (matchingHunks(aLines, bLines, aIdx, bIdx, aLineCount, bLineCount, &aAdvance, &bAdvance, &aMatchRange, &bMatchRange)) {
-                for (NSInteger aMap = aMatchRange.location, bMap = bMatchRange.location, m = 0; m < aMatchRange.length; aMap++, bMap++, m++)
-                {
-                    map[aMap] = @(bMap);
-                }
-                aIdx += aAdvance;
-                bIdx += bAdvance;
-            } else {
-                // there was no hunk in b that could match the hunk starting at aIdx
-                // leave bIdx where it was and bump aIdx
-                aIdx++;
-            }
-        } else {
-            aIdx++; // skip this line in a
-        }
+    NSMutableArray *mapping = [NSMutableArray arrayWithCapacity:lineCount];
+    for (NSUInteger i = 0; i < lineCount; i++) {
+        [mapping addObject:@(map[i])];
     }
     
-    return map;
+    return mapping;
 }
 
 + (void)computePatchMappingFromPatch:(NSString *)patch toPatchForFile:(GitDiffFile *)spanDiffFile completion:(void (^)(NSArray *mapping))completion
@@ -971,7 +1444,7 @@ static NSArray *patchMapping(NSString *a, NSString *b) {
                 });
                 
             });
-        } asBinary:^(NSData *oldFile, NSData *newFile, NSError *error) {
+        } asBinary:^(NSData *oldFile, NSData *newFile, NSString *oldObjectPath, NSString *newObjectPath, NSError *error) {
             NSAssert(NO, @"Should not try to compute patch mapping on binary file");
             completion(nil);
         }];
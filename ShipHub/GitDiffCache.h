@@ -0,0 +1,48 @@
+//
+//  GitDiffCache.h
+//  ShipHub
+//
+//  Created by James Howard on 3/9/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// The decoded text of both sides of a diffed file, and the rendered patch between them.
+@interface GitDiffCacheEntry : NSObject
+
+@property (readonly) NSString *oldText;
+@property (readonly) NSString *updatedText; // the new side. Not newText, which ARC would take to return an owned object.
+@property (readonly) NSString *patchText;
+
+@end
+
+/*
+ GitDiffCache is a least recently used cache of GitDiffCacheEntries, keyed by
+ (oldOid, newOid, options), and bounded by the approximate size of its entries in bytes.
+
+ If a directory is given, entries are also written there, and entries evicted from memory
+ may be read back from disk. The disk tier is bounded separately.
+
+ GitDiffCache is thread safe.
+*/
+@interface GitDiffCache : NSObject
+
+// diskDirectory may be nil to cache only in memory
+- (instancetype)initWithMemoryLimit:(NSUInteger)memoryLimit diskDirectory:(NSString *)diskDirectory diskLimit:(NSUInteger)diskLimit;
+
+// oids are hex strings, either of which may be nil for an added or deleted file.
+// options identifies how patchText was rendered.
++ (NSString *)keyWithOldOid:(NSString *)oldOid newOid:(NSString *)newOid options:(NSString *)options;
+
+- (GitDiffCacheEntry *)entryForKey:(NSString *)key;
+- (void)setOldText:(NSString *)oldText newText:(NSString *)newText patchText:(NSString *)patchText forKey:(NSString *)key;
+
+- (void)removeAllEntries;
+
+@property (readonly) NSUInteger hitCount; // includes diskHitCount
+@property (readonly) NSUInteger diskHitCount;
+@property (readonly) NSUInteger missCount;
+@property (readonly) NSUInteger memoryUsage; // approximate bytes used by entries in memory
+
+@end
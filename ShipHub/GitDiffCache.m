@@ -0,0 +1,301 @@
+//
+//  GitDiffCache.m
+//  ShipHub
+//
+//  Created by James Howard on 3/9/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "GitDiffCache.h"
+
+#import "Extras.h"
+
+#define DISK_TRIM_INTERVAL 32 // trim the disk tier after this many writes
+
+@interface GitDiffCacheEntry ()
+
+@property (readwrite) NSString *oldText;
+@property (readwrite) NSString *updatedText;
+@property (readwrite) NSString *patchText;
+
+@property NSString *key;
+@property NSUInteger cost;
+
+// LRU list. The cache's dictionary owns the entries, so prev need not be.
+@property GitDiffCacheEntry *next;
+@property (unsafe_unretained) GitDiffCacheEntry *prev;
+
+@end
+
+@implementation GitDiffCacheEntry
+
+@end
+
+@implementation GitDiffCache {
+    dispatch_queue_t _q; // protects everything below
+    NSMutableDictionary<NSString *, GitDiffCacheEntry *> *_entries;
+    GitDiffCacheEntry *_head; // most recently used
+    GitDiffCacheEntry *_tail; // least recently used
+    NSUInteger _memoryLimit;
+    NSUInteger _memoryUsage;
+    NSUInteger _hitCount;
+    NSUInteger _diskHitCount;
+    NSUInteger _missCount;
+
+    dispatch_queue_t _diskQ; // serializes disk writes and trims
+    NSString *_diskDirectory;
+    NSUInteger _diskLimit;
+    NSUInteger _diskWrites; // only accessed on _diskQ
+}
+
+- (instancetype)initWithMemoryLimit:(NSUInteger)memoryLimit diskDirectory:(NSString *)diskDirectory diskLimit:(NSUInteger)diskLimit
+{
+    if (self = [super init]) {
+        _q = dispatch_queue_create("GitDiffCache", NULL);
+        _entries = [NSMutableDictionary new];
+        _memoryLimit = memoryLimit;
+
+        if (diskDirectory) {
+            NSError *err = nil;
+            if ([[NSFileManager defaultManager] createDirectoryAtPath:diskDirectory withIntermediateDirectories:YES attributes:nil error:&err]) {
+                _diskDirectory = [diskDirectory copy];
+                _diskLimit = diskLimit;
+                _diskQ = dispatch_queue_create("GitDiffCache.disk", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+            } else {
+                ErrLog(@"Unable to create diff cache directory %@: %@", diskDirectory, err);
+            }
+        }
+    }
+    return self;
+}
+
++ (NSString *)keyWithOldOid:(NSString *)oldOid newOid:(NSString *)newOid options:(NSString *)options {
+    return [NSString stringWithFormat:@"%@-%@-%@", oldOid ?: @"0", newOid ?: @"0", options ?: @""];
+}
+
+static NSUInteger costOf(GitDiffCacheEntry *entry) {
+    // NSStrings are at worst UTF-16
+    return (entry.oldText.length + entry.updatedText.length + entry.patchText.length) * sizeof(unichar);
+}
+
+#pragma mark - LRU list (call on _q)
+
+- (void)unlink:(GitDiffCacheEntry *)entry {
+    if (entry.prev) entry.prev.next = entry.next;
+    else _head = entry.next;
+    if (entry.next) entry.next.prev = entry.prev;
+    else _tail = entry.prev;
+    entry.prev = nil;
+    entry.next = nil;
+}
+
+- (void)pushHead:(GitDiffCacheEntry *)entry {
+    entry.next = _head;
+    entry.prev = nil;
+    if (_head) _head.prev = entry;
+    _head = entry;
+    if (!_tail) _tail = entry;
+}
+
+- (void)insert:(GitDiffCacheEntry *)entry {
+    GitDiffCacheEntry *existing = _entries[entry.key];
+    if (existing) {
+        [self unlink:existing];
+        _memoryUsage -= existing.cost;
+    }
+
+    if (entry.cost > _memoryLimit) {
+        [_entries removeObjectForKey:entry.key];
+        return;
+    }
+
+    _entries[entry.key] = entry;
+    [self pushHead:entry];
+    _memoryUsage += entry.cost;
+
+    while (_memoryUsage > _memoryLimit && _tail) {
+        GitDiffCacheEntry *victim = _tail;
+        [self unlink:victim];
+        [_entries removeObjectForKey:victim.key];
+        _memoryUsage -= victim.cost;
+    }
+}
+
+#pragma mark - Disk tier
+
+- (NSString *)diskPathForKey:(NSString *)key {
+    return [_diskDirectory stringByAppendingPathComponent:key];
+}
+
+- (GitDiffCacheEntry *)readEntryFromDiskForKey:(NSString *)key {
+    NSString *path = [self diskPathForKey:key];
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL];
+    if (!data) return nil;
+
+    NSDictionary *plist = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:NULL];
+    if (![plist isKindOfClass:[NSDictionary class]] || !plist[@"patchText"]) {
+        [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+        return nil;
+    }
+
+    // bump the modification date, which is what the disk tier evicts by
+    dispatch_async(_diskQ, ^{
+        [[NSFileManager defaultManager] setAttributes:@{ NSFileModificationDate : [NSDate date] } ofItemAtPath:path error:NULL];
+    });
+
+    GitDiffCacheEntry *entry = [GitDiffCacheEntry new];
+    entry.key = key;
+    entry.oldText = plist[@"oldText"];
+    entry.updatedText = plist[@"newText"];
+    entry.patchText = plist[@"patchText"];
+    entry.cost = costOf(entry);
+    return entry;
+}
+
+- (void)writeEntryToDisk:(GitDiffCacheEntry *)entry {
+    dispatch_async(_diskQ, ^{
+        NSMutableDictionary *plist = [NSMutableDictionary new];
+        plist[@"oldText"] = entry.oldText;
+        plist[@"newText"] = entry.updatedText;
+        plist[@"patchText"] = entry.patchText;
+
+        NSError *err = nil;
+        NSData *data = [NSPropertyListSerialization dataWithPropertyList:plist format:NSPropertyListBinaryFormat_v1_0 options:0 error:&err];
+        if (!data || ![data writeToFile:[self diskPathForKey:entry.key] options:NSDataWritingAtomic error:&err]) {
+            ErrLog(@"Unable to write diff cache entry: %@", err);
+            return;
+        }
+
+        if (++_diskWrites % DISK_TRIM_INTERVAL == 0) {
+            [self trimDisk];
+        }
+    });
+}
+
+// Call on _diskQ. Removes the least recently used files until the directory is under _diskLimit.
+- (void)trimDisk {
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSArray *keys = @[NSURLFileSizeKey, NSURLContentModificationDateKey];
+    NSArray<NSURL *> *files = [fm contentsOfDirectoryAtURL:[NSURL fileURLWithPath:_diskDirectory] includingPropertiesForKeys:keys options:NSDirectoryEnumerationSkipsHiddenFiles error:NULL];
+
+    NSMutableArray *infos = [NSMutableArray arrayWithCapacity:files.count];
+    unsigned long long total = 0;
+    for (NSURL *URL in files) {
+        NSDictionary *values = [URL resourceValuesForKeys:keys error:NULL];
+        if (!values) continue;
+        total += [values[NSURLFileSizeKey] unsignedLongLongValue];
+        [infos addObject:@{ @"URL" : URL, @"size" : values[NSURLFileSizeKey] ?: @0, @"date" : values[NSURLContentModificationDateKey] ?: [NSDate distantPast] }];
+    }
+
+    if (total <= _diskLimit) return;
+
+    [infos sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"date" ascending:YES]]];
+    for (NSDictionary *info in infos) {
+        if (total <= _diskLimit) break;
+        if ([fm removeItemAtURL:info[@"URL"] error:NULL]) {
+            total -= [info[@"size"] unsignedLongLongValue];
+        }
+    }
+}
+
+#pragma mark - Public
+
+- (GitDiffCacheEntry *)entryForKey:(NSString *)key {
+    NSParameterAssert(key);
+
+    __block GitDiffCacheEntry *entry = nil;
+    dispatch_sync(_q, ^{
+        entry = _entries[key];
+        if (entry) {
+            [self unlink:entry];
+            [self pushHead:entry];
+            _hitCount++;
+        }
+    });
+
+    if (entry || !_diskDirectory) {
+        if (!entry) {
+            dispatch_sync(_q, ^{ _missCount++; });
+        }
+        return entry;
+    }
+
+    // Read from disk outside of _q, so other lookups don't wait on I/O
+    entry = [self readEntryFromDiskForKey:key];
+
+    dispatch_sync(_q, ^{
+        if (entry) {
+            _hitCount++;
+            _diskHitCount++;
+            [self insert:entry];
+        } else {
+            _missCount++;
+        }
+    });
+
+    return entry;
+}
+
+- (void)setOldText:(NSString *)oldText newText:(NSString *)newText patchText:(NSString *)patchText forKey:(NSString *)key {
+    NSParameterAssert(key);
+    NSParameterAssert(patchText);
+
+    GitDiffCacheEntry *entry = [GitDiffCacheEntry new];
+    entry.key = key;
+    entry.oldText = oldText;
+    entry.updatedText = newText;
+    entry.patchText = patchText;
+    entry.cost = costOf(entry);
+
+    dispatch_sync(_q, ^{
+        [self insert:entry];
+    });
+
+    if (_diskDirectory) {
+        [self writeEntryToDisk:entry];
+    }
+}
+
+- (void)removeAllEntries {
+    dispatch_sync(_q, ^{
+        [_entries removeAllObjects];
+        _head = nil;
+        _tail = nil;
+        _memoryUsage = 0;
+    });
+
+    if (_diskDirectory) {
+        dispatch_async(_diskQ, ^{
+            NSFileManager *fm = [NSFileManager defaultManager];
+            for (NSString *name in [fm contentsOfDirectoryAtPath:_diskDirectory error:NULL]) {
+                [fm removeItemAtPath:[_diskDirectory stringByAppendingPathComponent:name] error:NULL];
+            }
+        });
+    }
+}
+
+- (NSUInteger)hitCount {
+    __block NSUInteger count;
+    dispatch_sync(_q, ^{ count = _hitCount; });
+    return count;
+}
+
+- (NSUInteger)diskHitCount {
+    __block NSUInteger count;
+    dispatch_sync(_q, ^{ count = _diskHitCount; });
+    return count;
+}
+
+- (NSUInteger)missCount {
+    __block NSUInteger count;
+    dispatch_sync(_q, ^{ count = _missCount; });
+    return count;
+}
+
+- (NSUInteger)memoryUsage {
+    __block NSUInteger usage;
+    dispatch_sync(_q, ^{ usage = _memoryUsage; });
+    return usage;
+}
+
+@end
@@ -11,6 +11,7 @@
 #import <git2.h>
 
 @class GitRepo;
+@class GitLFSStore;
 
 @interface GitLFSObject : NSObject
 
@@ -21,6 +22,7 @@
 
 @end
 
+// objs are memory mapped from the store, in the order requested
 typedef void (^GitLFSCompletion)(NSArray<NSData *> *objs, NSError *error);
 
 @interface GitLFS : NSObject
@@ -30,9 +32,11 @@ typedef void (^GitLFSCompletion)(NSArray<NSData *> *objs, NSError *error);
 @property NSString *remotePassword;
 
 @property (readonly, weak) GitRepo *repo;
+@property (readonly) GitLFSStore *store;
 
-- (instancetype)initWithRepo:(GitRepo *)repo;
+- (instancetype)initWithRepo:(GitRepo *)repo store:(GitLFSStore *)store;
 
+// Objects already in the store are returned from there. The rest are downloaded straight into it.
 - (void)fetchObjects:(NSArray<GitLFSObject *> *)objects withProgress:(NSProgress *)progress completion:(GitLFSCompletion)completion completionQueue:(dispatch_queue_t)completionQueue;
 
 - (BOOL)isLFSAtPath:(NSString *)path text:(NSString *)text treeSha:(NSString *)treeSha outObject:(GitLFSObject *__autoreleasing *)outObject;
@@ -10,13 +10,27 @@
 
 #import "Extras.h"
 #import "Error.h"
+#import "GitLFSStore.h"
 
+static const NSInteger GitLFSMaximumConcurrentDownloads = 4;
 
+// Streams each download into the store as it arrives.
 @interface GitLFSURLSessionDelegate : NSObject <NSURLSessionDataDelegate>
 
-+ (instancetype)delegateWithProgress:(NSProgress *)progress;
++ (instancetype)delegateWithProgress:(NSProgress *)progress store:(GitLFSStore *)store;
 
-- (void)followTasks:(NSArray<NSURLSessionTask *> *)tasks completion:(void (^)(NSArray<URLSessionResult *> *))completion;
+- (void)followTasks:(NSArray<NSURLSessionTask *> *)tasks objects:(NSArray<GitLFSObject *> *)objects completion:(void (^)(NSArray<URLSessionResult *> *))completion;
+
+@end
+
+// All downloads go through one session, so that GitLFSMaximumConcurrentDownloads bounds them
+// across every fetch in progress, not just within each. The session's delegate passes each
+// task's events on to the GitLFSURLSessionDelegate of the fetch it belongs to.
+@interface GitLFSDownloadSession : NSObject <NSURLSessionDataDelegate>
+
++ (GitLFSDownloadSession *)sharedSession;
+
+- (NSURLSessionDataTask *)dataTaskWithRequest:(NSURLRequest *)request delegate:(GitLFSURLSessionDelegate *)delegate;
 
 @end
 
@@ -41,18 +55,41 @@
 @interface GitLFS ()
 
 @property (readwrite, weak) GitRepo *repo;
+@property (readwrite) GitLFSStore *store;
 
 @end
 
 @implementation GitLFS
 
-- (instancetype)initWithRepo:(GitRepo *)repo {
+- (instancetype)initWithRepo:(GitRepo *)repo store:(GitLFSStore *)store {
     if (self = [super init]) {
         self.repo = repo;
+        self.store = store;
     }
     return self;
 }
 
+// Calls completion with every one of objects, read from the store.
+- (void)completeObjects:(NSArray<GitLFSObject *> *)objects completion:(GitLFSCompletion)completion completionQueue:(dispatch_queue_t)completionQueue
+{
+    NSMutableArray<NSData *> *datas = [NSMutableArray arrayWithCapacity:objects.count];
+    for (GitLFSObject *obj in objects) {
+        NSData *data = [_store objectWithOid:obj.oid];
+        if (!data) {
+            // Only if it was evicted in the meantime, which would take a lot of other downloads.
+            ErrLog(@"LFS object %@ missing from store", obj.oid);
+            dispatch_async(completionQueue, ^{
+                completion(nil, [NSError shipErrorWithCode:ShipErrorCodeInternalInconsistencyError]);
+            });
+            return;
+        }
+        [datas addObject:data];
+    }
+    dispatch_async(completionQueue, ^{
+        completion(datas, nil);
+    });
+}
+
 - (void)fetchObjects:(NSArray<GitLFSObject *> *)objects withProgress:(NSProgress *)progress completion:(GitLFSCompletion)completion completionQueue:(dispatch_queue_t)completionQueue
 {
     if (progress.cancelled) {
@@ -62,6 +99,22 @@
         return;
     }
     
+    NSMutableArray<GitLFSObject *> *missing = [NSMutableArray new];
+    NSMutableSet<NSString *> *missingOids = [NSMutableSet new];
+    for (GitLFSObject *obj in objects) {
+        if (![missingOids containsObject:obj.oid] && ![_store hasObjectWithOid:obj.oid]) {
+            [missingOids addObject:obj.oid];
+            [missing addObject:obj];
+        }
+    }
+    
+    if (missing.count == 0) {
+        progress.totalUnitCount = [[objects valueForKeyPath:@"@sum.size"] longLongValue];
+        progress.completedUnitCount = progress.totalUnitCount;
+        [self completeObjects:objects completion:completion completionQueue:completionQueue];
+        return;
+    }
+    
     /*
      $ curl -X POST --data '{"operation":"download", "transfers":["basic"], "objects":[{"oid":"fd33a4ed04a19c6e76dc8db70a6512ff76ab47cd9851a4d3a6bbff4aeab70c68", "size":141635}]}' -H 'Accept: application/vnd.git-lfs+json' -H 'Content-Type: application/vnd.git-lfs+json' -u "$GITHUB_API_TOKEN:x-oauth-basic" https://github.com/james-howard/lfs.git/info/lfs/objects/batch
     {
@@ -81,7 +134,7 @@
     }
     */
     
-    NSArray *lfsObjs = [objects arrayByMappingObjects:^id(GitLFSObject *obj) {
+    NSArray *lfsObjs = [missing arrayByMappingObjects:^id(GitLFSObject *obj) {
         return @{ @"oid" : obj.oid, @"size" : obj.size };
     }];
     
@@ -116,7 +169,7 @@
             } else {
                 @try {
                     NSDictionary *objectsByOid = [NSDictionary lookupWithObjects:downloadInfo[@"objects"] keyPath:@"oid"];
-                    for (GitLFSObject *neededObj in objects) {
+                    for (GitLFSObject *neededObj in missing) {
                         NSDictionary *replyObj = objectsByOid[neededObj.oid];
                         if (!replyObj) {
                             error = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
@@ -139,9 +192,9 @@
             });
         } else {
             progress.completedUnitCount = 0;
-            progress.totalUnitCount = [[objects valueForKeyPath:@"@sum.size"] longLongValue];
+            progress.totalUnitCount = [[missing valueForKeyPath:@"@sum.size"] longLongValue];
             
-            NSArray *dlReqs = [objects arrayByMappingObjects:^id(GitLFSObject *obj) {
+            NSArray *dlReqs = [missing arrayByMappingObjects:^id(GitLFSObject *obj) {
                 NSMutableURLRequest *req = [NSMutableURLRequest requestWithURL:obj.downloadURL];
                 if (obj.downloadHeaders.count) {
                     req.allHTTPHeaderFields = obj.downloadHeaders;
@@ -149,34 +202,28 @@
                 return req;
             }];
             
-            GitLFSURLSessionDelegate *dlDelegate = [GitLFSURLSessionDelegate delegateWithProgress:progress];
-            
-            NSURLSession *dlSession = [NSURLSession sessionWithConfiguration:[NSURLSessionConfiguration defaultSessionConfiguration] delegate:dlDelegate delegateQueue:nil];
+            GitLFSURLSessionDelegate *dlDelegate = [GitLFSURLSessionDelegate delegateWithProgress:progress store:_store];
+            GitLFSDownloadSession *dlSession = [GitLFSDownloadSession sharedSession];
             
             NSArray *tasks = [dlReqs arrayByMappingObjects:^id(NSURLRequest *req) {
-                return [dlSession dataTaskWithRequest:req];
+                return [dlSession dataTaskWithRequest:req delegate:dlDelegate];
             }];
             
-            [tasks makeObjectsPerformSelector:@selector(resume)];
-            
-            [dlDelegate followTasks:tasks completion:^(NSArray<URLSessionResult *> *results) {
+            [dlDelegate followTasks:tasks objects:missing completion:^(NSArray<URLSessionResult *> *results) {
                 NSError *anyError = [URLSessionResult anyErrorInResults:results];
                 if (anyError) {
                     dispatch_async(completionQueue, ^{
                         completion(nil, anyError);
                     });
                 } else {
-                    NSArray<NSData *> *datas = [results arrayByMappingObjects:^id(URLSessionResult *obj) {
-                        return obj.data;
-                    }];
-                    dispatch_async(completionQueue, ^{
-                        completion(datas, nil);
-                    });
+                    [self completeObjects:objects completion:completion completionQueue:completionQueue];
                 }
             }];
             
+            [tasks makeObjectsPerformSelector:@selector(resume)];
+            
             progress.cancellationHandler = ^{
-                [dlSession invalidateAndCancel];
+                [tasks makeObjectsPerformSelector:@selector(cancel)];
             };
         }
     }];
@@ -223,9 +270,12 @@
 @interface GitLFSURLSessionDelegate ()
 
 @property NSArray *tasks;
+@property NSArray<GitLFSObject *> *objects;
 @property NSArray<URLSessionResult *> *results;
-@property NSArray<NSMutableData *> *data;
+@property NSMutableDictionary<NSNumber *, GitLFSStoreWriter *> *writers; // by task index, while downloading
+@property NSMutableDictionary<NSNumber *, NSError *> *errors; // by task index, for tasks we cancelled
 @property NSProgress *progress;
+@property GitLFSStore *store;
 @property NSUInteger tasksCompleted;
 
 @property (copy) void (^completion)(NSArray<URLSessionResult *> *);
@@ -234,12 +284,39 @@
 
 @implementation GitLFSURLSessionDelegate
 
-+ (instancetype)delegateWithProgress:(NSProgress *)progress {
++ (instancetype)delegateWithProgress:(NSProgress *)progress store:(GitLFSStore *)store {
     GitLFSURLSessionDelegate *delegate = [[self alloc] init];
     delegate.progress = progress;
+    delegate.store = store;
     return delegate;
 }
 
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveResponse:(NSURLResponse *)response completionHandler:(void (^)(NSURLSessionResponseDisposition))completionHandler
+{
+    NSUInteger idx = [_tasks indexOfObject:dataTask];
+    if (idx == NSNotFound) {
+        completionHandler(NSURLSessionResponseCancel);
+        return;
+    }
+    
+    NSError *error = nil;
+    GitLFSStoreWriter *writer = nil;
+    if (((NSHTTPURLResponse *)response).statusCode != 200) {
+        error = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+    } else {
+        GitLFSObject *obj = _objects[idx];
+        writer = [_store writerForOid:obj.oid size:obj.size.unsignedLongLongValue error:&error];
+    }
+    
+    if (writer) {
+        _writers[@(idx)] = writer;
+        completionHandler(NSURLSessionResponseAllow);
+    } else {
+        _errors[@(idx)] = error;
+        completionHandler(NSURLSessionResponseCancel);
+    }
+}
+
 - (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
     int64_t completedCount = 0;
     for (NSURLSessionDataTask *task in _tasks) {
@@ -248,16 +325,36 @@
     _progress.completedUnitCount = completedCount;
     
     NSUInteger idx = [_tasks indexOfObject:dataTask];
-    if (idx != NSNotFound) {
-        [_data[idx] appendData:data];
+    GitLFSStoreWriter *writer = idx != NSNotFound ? _writers[@(idx)] : nil;
+    
+    NSError *error = nil;
+    if (writer && ![writer appendData:data error:&error]) {
+        [_writers removeObjectForKey:@(idx)];
+        _errors[@(idx)] = error;
+        [dataTask cancel];
     }
 }
 
 - (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(nullable NSError *)error {
     NSUInteger idx = [_tasks indexOfObject:task];
+    if (idx == NSNotFound) return;
+    
+    GitLFSStoreWriter *writer = _writers[@(idx)];
+    [_writers removeObjectForKey:@(idx)];
+    
+    // Our own reason for cancelling a task takes precedence over the cancellation error it completes with.
+    error = _errors[@(idx)] ?: error;
+    if (!error && !writer) {
+        error = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+    }
+    if (error) {
+        [writer cancel];
+    } else {
+        [writer finish:&error];
+    }
+    
     _results[idx].response = task.response;
-    _results[idx].error = task.error;
-    _results[idx].data = _data[idx];
+    _results[idx].error = error;
     
     _tasksCompleted++;
     
@@ -266,16 +363,85 @@
     }
 }
 
-- (void)followTasks:(NSArray<NSURLSessionTask *> *)tasks completion:(void (^)(NSArray<URLSessionResult *> *))completion {
+- (void)followTasks:(NSArray<NSURLSessionTask *> *)tasks objects:(NSArray<GitLFSObject *> *)objects completion:(void (^)(NSArray<URLSessionResult *> *))completion {
     _tasks = tasks;
+    _objects = objects;
     _tasksCompleted = 0;
     _completion = [completion copy];
     _results = [tasks arrayByMappingObjects:^id(id obj) {
         return [URLSessionResult new];
     }];
-    _data = [tasks arrayByMappingObjects:^id(id obj) {
-        return [NSMutableData new];
-    }];
+    _writers = [NSMutableDictionary new];
+    _errors = [NSMutableDictionary new];
+}
+
+@end
+
+@implementation GitLFSDownloadSession {
+    NSURLSession *_session;
+    NSMutableDictionary<NSNumber *, GitLFSURLSessionDelegate *> *_delegates; // by task identifier
+}
+
++ (GitLFSDownloadSession *)sharedSession {
+    static dispatch_once_t onceToken;
+    static GitLFSDownloadSession *session;
+    dispatch_once(&onceToken, ^{
+        session = [GitLFSDownloadSession new];
+    });
+    return session;
+}
+
+- (id)init {
+    if (self = [super init]) {
+        _delegates = [NSMutableDictionary new];
+        
+        // Downloads go straight to the store, so don't keep another copy in the URL cache.
+        NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
+        config.HTTPMaximumConnectionsPerHost = GitLFSMaximumConcurrentDownloads;
+        config.URLCache = nil;
+        
+        // The session retains us for good, which is fine, as there is only the one.
+        _session = [NSURLSession sessionWithConfiguration:config delegate:self delegateQueue:nil];
+    }
+    return self;
+}
+
+- (NSURLSessionDataTask *)dataTaskWithRequest:(NSURLRequest *)request delegate:(GitLFSURLSessionDelegate *)delegate {
+    NSURLSessionDataTask *task = [_session dataTaskWithRequest:request];
+    @synchronized (_delegates) {
+        _delegates[@(task.taskIdentifier)] = delegate;
+    }
+    return task;
+}
+
+- (GitLFSURLSessionDelegate *)delegateForTask:(NSURLSessionTask *)task {
+    @synchronized (_delegates) {
+        return _delegates[@(task.taskIdentifier)];
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveResponse:(NSURLResponse *)response completionHandler:(void (^)(NSURLSessionResponseDisposition))completionHandler
+{
+    GitLFSURLSessionDelegate *delegate = [self delegateForTask:dataTask];
+    if (delegate) {
+        [delegate URLSession:session dataTask:dataTask didReceiveResponse:response completionHandler:completionHandler];
+    } else {
+        completionHandler(NSURLSessionResponseCancel);
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
+    [[self delegateForTask:dataTask] URLSession:session dataTask:dataTask didReceiveData:data];
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(nullable NSError *)error {
+    GitLFSURLSessionDelegate *delegate = nil;
+    @synchronized (_delegates) {
+        NSNumber *key = @(task.taskIdentifier);
+        delegate = _delegates[key];
+        [_delegates removeObjectForKey:key];
+    }
+    [delegate URLSession:session task:task didCompleteWithError:error];
 }
 
 @end
@@ -0,0 +1,61 @@
+//
+//  GitLFSStore.h
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class GitLFSStoreWriter;
+
+/*
+ GitLFSStore keeps downloaded LFS objects on disk, keyed by their SHA-256 oid, in the same
+ layout git-lfs uses (objects/ab/cd/abcd...).
+ 
+ Objects are written through a GitLFSStoreWriter as they download, hashed along the way, and
+ only moved into place once their size and hash match the oid. So anything in the store is
+ known good, and is returned memory mapped rather than read into memory.
+ 
+ The store is bounded by diskLimit, evicting the least recently read objects first.
+ 
+ GitLFSStore is thread safe.
+*/
+@interface GitLFSStore : NSObject
+
+- (instancetype)initWithDirectory:(NSString *)directory diskLimit:(unsigned long long)diskLimit;
+
+@property (readonly) NSString *directory;
+
+// Returns the object, memory mapped, or nil if it isn't in the store.
+- (NSData *)objectWithOid:(NSString *)oid;
+
+- (BOOL)hasObjectWithOid:(NSString *)oid;
+
+// Where the object is kept, whether or not it is in the store yet.
+- (NSString *)pathForOid:(NSString *)oid;
+
+// Returns a writer for an object of the given oid and size, or nil if it can't be created.
+- (GitLFSStoreWriter *)writerForOid:(NSString *)oid size:(unsigned long long)size error:(NSError *__autoreleasing *)error;
+
+- (void)removeAllObjects;
+
+@end
+
+// Streams one object into the store. Not thread safe.
+@interface GitLFSStoreWriter : NSObject
+
+@property (readonly) NSString *oid;
+@property (readonly) unsigned long long bytesWritten;
+
+// Returns NO if the data couldn't be written, after which the writer is cancelled.
+- (BOOL)appendData:(NSData *)data error:(NSError *__autoreleasing *)error;
+
+// Checks the object's size and hash, and if they match, adds it to the store.
+- (BOOL)finish:(NSError *__autoreleasing *)error;
+
+// Discards anything written so far.
+- (void)cancel;
+
+@end
@@ -0,0 +1,283 @@
+//
+//  GitLFSStore.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "GitLFSStore.h"
+
+#import "Error.h"
+#import "Extras.h"
+
+#import <CommonCrypto/CommonCrypto.h>
+
+static NSError *POSIXError(int code) {
+    return [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil];
+}
+
+// oids become paths, so only accept what a SHA-256 oid looks like.
+static BOOL IsValidOid(NSString *oid) {
+    if (oid.length != CC_SHA256_DIGEST_LENGTH * 2) return NO;
+    static NSCharacterSet *nonHex;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        nonHex = [[NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdefABCDEF"] invertedSet];
+    });
+    return [oid rangeOfCharacterFromSet:nonHex].location == NSNotFound;
+}
+
+@interface GitLFSStore ()
+
+@property (readonly) NSString *objectsDirectory;
+@property (readonly) NSString *tmpDirectory;
+
+- (void)didAddObject;
+
+@end
+
+@interface GitLFSStoreWriter ()
+
+- (instancetype)initWithStore:(GitLFSStore *)store oid:(NSString *)oid size:(unsigned long long)size tmpPath:(NSString *)tmpPath fd:(int)fd;
+
+@end
+
+@implementation GitLFSStore {
+    dispatch_queue_t _diskQ; // serializes trims and access date updates
+    unsigned long long _diskLimit;
+}
+
+- (instancetype)initWithDirectory:(NSString *)directory diskLimit:(unsigned long long)diskLimit {
+    if (self = [super init]) {
+        _directory = [directory copy];
+        _objectsDirectory = [directory stringByAppendingPathComponent:@"objects"];
+        _tmpDirectory = [directory stringByAppendingPathComponent:@"tmp"];
+        _diskLimit = diskLimit;
+        _diskQ = dispatch_queue_create("GitLFSStore.disk", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+        
+        // Anything left in tmp is from downloads that never finished.
+        NSFileManager *fm = [NSFileManager defaultManager];
+        [fm removeItemAtPath:_tmpDirectory error:NULL];
+        
+        NSError *err = nil;
+        if (![fm createDirectoryAtPath:_objectsDirectory withIntermediateDirectories:YES attributes:nil error:&err]
+            || ![fm createDirectoryAtPath:_tmpDirectory withIntermediateDirectories:YES attributes:nil error:&err])
+        {
+            ErrLog(@"Unable to create LFS store directory %@: %@", directory, err);
+        }
+    }
+    return self;
+}
+
+- (NSString *)pathForOid:(NSString *)oid {
+    oid = [oid lowercaseString];
+    return [NSString pathWithComponents:@[_objectsDirectory, [oid substringToIndex:2], [oid substringWithRange:NSMakeRange(2, 2)], oid]];
+}
+
+- (NSData *)objectWithOid:(NSString *)oid {
+    if (!IsValidOid(oid)) return nil;
+    
+    NSString *path = [self pathForOid:oid];
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:NULL];
+    if (!data) return nil;
+    
+    // bump the modification date, which is what trimming evicts by
+    dispatch_async(_diskQ, ^{
+        [[NSFileManager defaultManager] setAttributes:@{ NSFileModificationDate : [NSDate date] } ofItemAtPath:path error:NULL];
+    });
+    
+    return data;
+}
+
+- (BOOL)hasObjectWithOid:(NSString *)oid {
+    return IsValidOid(oid) && [[NSFileManager defaultManager] fileExistsAtPath:[self pathForOid:oid]];
+}
+
+- (GitLFSStoreWriter *)writerForOid:(NSString *)oid size:(unsigned long long)size error:(NSError *__autoreleasing *)error {
+    if (error) *error = nil;
+    
+    if (!IsValidOid(oid)) {
+        if (error) *error = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+        return nil;
+    }
+    
+    NSFileManager *fm = [NSFileManager defaultManager];
+    [fm createDirectoryAtPath:_tmpDirectory withIntermediateDirectories:YES attributes:nil error:NULL];
+    
+    char *template = strdup([[_tmpDirectory stringByAppendingPathComponent:@"download.XXXXXX"] fileSystemRepresentation]);
+    int fd = mkstemp(template);
+    if (fd == -1) {
+        int code = errno;
+        ErrLog(@"Unable to create LFS download file: %s", strerror(code));
+        free(template);
+        if (error) *error = POSIXError(code);
+        return nil;
+    }
+    
+    NSString *tmpPath = [fm stringWithFileSystemRepresentation:template length:strlen(template)];
+    free(template);
+    
+    return [[GitLFSStoreWriter alloc] initWithStore:self oid:[oid lowercaseString] size:size tmpPath:tmpPath fd:fd];
+}
+
+- (void)didAddObject {
+    dispatch_async(_diskQ, ^{
+        [self trimDisk];
+    });
+}
+
+// Call on _diskQ. Removes the least recently read objects until the store is under _diskLimit.
+- (void)trimDisk {
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSArray *keys = @[NSURLIsRegularFileKey, NSURLFileSizeKey, NSURLContentModificationDateKey];
+    NSDirectoryEnumerator *e = [fm enumeratorAtURL:[NSURL fileURLWithPath:_objectsDirectory] includingPropertiesForKeys:keys options:NSDirectoryEnumerationSkipsHiddenFiles errorHandler:nil];
+    
+    NSMutableArray *infos = [NSMutableArray new];
+    unsigned long long total = 0;
+    for (NSURL *URL in e) {
+        NSDictionary *values = [URL resourceValuesForKeys:keys error:NULL];
+        if (![values[NSURLIsRegularFileKey] boolValue]) continue;
+        total += [values[NSURLFileSizeKey] unsignedLongLongValue];
+        [infos addObject:@{ @"URL" : URL, @"size" : values[NSURLFileSizeKey] ?: @0, @"date" : values[NSURLContentModificationDateKey] ?: [NSDate distantPast] }];
+    }
+    
+    if (total <= _diskLimit) return;
+    
+    // Anyone still reading an evicted object keeps their mapping, as the file is only unlinked.
+    [infos sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"date" ascending:YES]]];
+    for (NSDictionary *info in infos) {
+        if (total <= _diskLimit) break;
+        if ([fm removeItemAtURL:info[@"URL"] error:NULL]) {
+            total -= [info[@"size"] unsignedLongLongValue];
+        }
+    }
+}
+
+- (void)removeAllObjects {
+    dispatch_async(_diskQ, ^{
+        NSFileManager *fm = [NSFileManager defaultManager];
+        for (NSString *name in [fm contentsOfDirectoryAtPath:_objectsDirectory error:NULL]) {
+            [fm removeItemAtPath:[_objectsDirectory stringByAppendingPathComponent:name] error:NULL];
+        }
+    });
+}
+
+@end
+
+@implementation GitLFSStoreWriter {
+    GitLFSStore *_store;
+    NSString *_tmpPath;
+    int _fd; // -1 once finished or cancelled
+    unsigned long long _size;
+    CC_SHA256_CTX _sha;
+}
+
+- (instancetype)initWithStore:(GitLFSStore *)store oid:(NSString *)oid size:(unsigned long long)size tmpPath:(NSString *)tmpPath fd:(int)fd {
+    if (self = [super init]) {
+        _store = store;
+        _oid = [oid copy];
+        _size = size;
+        _tmpPath = [tmpPath copy];
+        _fd = fd;
+        CC_SHA256_Init(&_sha);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self cancel];
+}
+
+- (BOOL)appendData:(NSData *)data error:(NSError *__autoreleasing *)error {
+    if (error) *error = nil;
+    
+    if (_fd == -1) {
+        if (error) *error = [NSError cancelError];
+        return NO;
+    }
+    
+    if (_bytesWritten + data.length > _size) {
+        // More than the oid says there is. The hash can't match, so don't bother writing it.
+        [self cancel];
+        if (error) *error = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+        return NO;
+    }
+    
+    __block int writeErr = 0;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        CC_SHA256_Update(&_sha, bytes, (CC_LONG)byteRange.length);
+        
+        const uint8_t *p = bytes;
+        size_t remaining = byteRange.length;
+        while (remaining > 0) {
+            ssize_t written = write(_fd, p, remaining);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                writeErr = errno;
+                *stop = YES;
+                return;
+            }
+            p += written;
+            remaining -= written;
+        }
+    }];
+    
+    if (writeErr) {
+        ErrLog(@"Unable to write LFS object %@: %s", _oid, strerror(writeErr));
+        [self cancel];
+        if (error) *error = POSIXError(writeErr);
+        return NO;
+    }
+    
+    _bytesWritten += data.length;
+    return YES;
+}
+
+- (BOOL)finish:(NSError *__autoreleasing *)error {
+    if (error) *error = nil;
+    
+    if (_fd == -1) {
+        if (error) *error = [NSError cancelError];
+        return NO;
+    }
+    
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &_sha);
+    NSString *hash = [NSString stringWithHexBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+    
+    if (_bytesWritten != _size || ![[hash lowercaseString] isEqualToString:_oid]) {
+        ErrLog(@"LFS object %@ failed verification (%llu of %llu bytes, hash %@)", _oid, _bytesWritten, _size, hash);
+        [self cancel];
+        if (error) *error = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+        return NO;
+    }
+    
+    close(_fd);
+    _fd = -1;
+    
+    NSString *path = [_store pathForOid:_oid];
+    [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL];
+    
+    // Objects are immutable, so if another download of the same one got here first, this just replaces it with identical contents.
+    if (rename([_tmpPath fileSystemRepresentation], [path fileSystemRepresentation]) != 0) {
+        int code = errno;
+        ErrLog(@"Unable to move LFS object %@ into place: %s", _oid, strerror(code));
+        unlink([_tmpPath fileSystemRepresentation]);
+        if (error) *error = POSIXError(code);
+        return NO;
+    }
+    
+    [_store didAddObject];
+    return YES;
+}
+
+- (void)cancel {
+    if (_fd == -1) return;
+    
+    close(_fd);
+    _fd = -1;
+    unlink([_tmpPath fileSystemRepresentation]);
+}
+
+@end
@@ -0,0 +1,19 @@
+//
+//  GitPatchMapping.h
+//  ShipHub
+//
+//  Created by James Howard on 3/8/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// Maps each line of patch a to the line in patch b where the same hunk line appears, or -1 if there is no such line.
+// Hunks map only if their run lengths and contents are identical. Lines are split as by
+// -[NSString componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]].
+//
+// Returns a buffer of one int32_t per line of a.
+extern NSData *GitPatchMapping(NSString *a, NSString *b);
+
+// As above, on UTF-8 buffers. The result is malloc'd and owned by the caller.
+extern int32_t *GitPatchMappingCompute(const uint8_t *a, size_t aLength, const uint8_t *b, size_t bLength, size_t *outLineCount);
@@ -0,0 +1,427 @@
+//
+//  GitPatchMapping.m
+//  ShipHub
+//
+//  Created by James Howard on 3/8/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "GitPatchMapping.h"
+
+/*
+ The mapping walks the hunks of a in order. For each one it looks for the first hunk in b, at or after
+ the end of the previously matched hunk, which has the same run lengths in its @@ header and exactly
+ the same lines. Lines, hunk headers and hunk bodies are each hashed once, and the hunks of b are
+ grouped by (runs, body length, body hash), so finding the matching hunk in b is a hash lookup rather
+ than a rescan of b.
+
+ This reproduces the original line by line scan exactly, including one quirk: when a hunk in b has a
+ matching header and its body is a strict prefix of the hunk in a, the scan consumed the @@ line
+ following it, and so never considered the hunk that begins there. See HunkIsSkipped().
+*/
+
+typedef NS_OPTIONS(uint8_t, LineFlags) {
+    LineFlagHunkStart = 1 << 0, // begins with @@
+    LineFlagHunkEnd = 1 << 1,   // empty or begins with @@
+};
+
+typedef struct {
+    size_t offset;
+    size_t length;
+    uint64_t hash;
+    LineFlags flags;
+} Line;
+
+typedef struct {
+    BOOL valid; // @@ line parsed as a hunk header
+    int64_t leftRun;
+    int64_t rightRun;
+    size_t start; // line index of the @@ line
+    size_t end; // line index of the first line past the hunk body (an empty line, the next @@ line, or the line count)
+    uint64_t bodyHash;
+} Hunk;
+
+typedef struct {
+    const uint8_t *bytes;
+    Line *lines;
+    size_t lineCount;
+} Patch;
+
+static uint64_t HashBytes(const uint8_t *p, size_t len) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t MixHash(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+// Splits on the same characters as [NSCharacterSet newlineCharacterSet]: U+000A-U+000D, U+0085, U+2028 and U+2029.
+static void SplitLines(Patch *patch, const uint8_t *bytes, size_t length) {
+    size_t capacity = 64;
+    Line *lines = malloc(sizeof(Line) * capacity);
+    size_t count = 0;
+    size_t start = 0;
+    size_t i = 0;
+
+    while (1) {
+        size_t sepLength = 0;
+        if (i < length) {
+            uint8_t c = bytes[i];
+            if (c >= 0x0A && c <= 0x0D) {
+                sepLength = 1;
+            } else if (c == 0xC2 && i + 1 < length && bytes[i+1] == 0x85) {
+                sepLength = 2;
+            } else if (c == 0xE2 && i + 2 < length && bytes[i+1] == 0x80 && (bytes[i+2] == 0xA8 || bytes[i+2] == 0xA9)) {
+                sepLength = 3;
+            } else {
+                i++;
+                continue;
+            }
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            lines = reallocf(lines, sizeof(Line) * capacity);
+        }
+
+        Line *line = &lines[count++];
+        line->offset = start;
+        line->length = i - start;
+        line->hash = HashBytes(bytes + start, line->length);
+        line->flags = 0;
+        if (line->length >= 2 && bytes[start] == '@' && bytes[start+1] == '@') {
+            line->flags = LineFlagHunkStart | LineFlagHunkEnd;
+        } else if (line->length == 0) {
+            line->flags = LineFlagHunkEnd;
+        }
+
+        if (i == length) break;
+        i += sepLength;
+        start = i;
+    }
+
+    patch->bytes = bytes;
+    patch->lines = lines;
+    patch->lineCount = count;
+}
+
+static inline BOOL LinesEqual(const Patch *a, size_t ai, const Patch *b, size_t bi) {
+    const Line *x = &a->lines[ai];
+    const Line *y = &b->lines[bi];
+    return x->length == y->length && x->hash == y->hash && memcmp(a->bytes + x->offset, b->bytes + y->offset, x->length) == 0;
+}
+
+static BOOL ParseRun(const uint8_t *p, size_t len, size_t *pos, int64_t *outValue) {
+    size_t i = *pos;
+    int64_t value = 0;
+    while (i < len && p[i] >= '0' && p[i] <= '9') {
+        int digit = p[i] - '0';
+        value = value > (INT64_MAX - digit) / 10 ? INT64_MAX : value * 10 + digit;
+        i++;
+    }
+    if (i == *pos) return NO;
+    *pos = i;
+    *outValue = value;
+    return YES;
+}
+
+static BOOL ParseExpected(const uint8_t *p, size_t len, size_t *pos, const char *expected) {
+    size_t n = strlen(expected);
+    if (*pos + n > len || memcmp(p + *pos, expected, n) != 0) return NO;
+    *pos += n;
+    return YES;
+}
+
+// Equivalent to matching ^@@ \-(\d+)(?:,(\d+))? \+(\d+)(?:,(\d+))? @@ and taking groups 2 and 4 (defaulting to 1).
+// Only ASCII digits are accepted, as libgit2 only writes those.
+static BOOL ParseHunkHeader(const uint8_t *p, size_t len, int64_t *leftRun, int64_t *rightRun) {
+    size_t pos = 0;
+    int64_t ignored;
+
+    if (!ParseExpected(p, len, &pos, "@@ -")) return NO;
+    if (!ParseRun(p, len, &pos, &ignored)) return NO;
+    *leftRun = 1;
+    if (pos < len && p[pos] == ',') {
+        pos++;
+        if (!ParseRun(p, len, &pos, leftRun)) return NO;
+    }
+
+    if (!ParseExpected(p, len, &pos, " +")) return NO;
+    if (!ParseRun(p, len, &pos, &ignored)) return NO;
+    *rightRun = 1;
+    if (pos < len && p[pos] == ',') {
+        pos++;
+        if (!ParseRun(p, len, &pos, rightRun)) return NO;
+    }
+
+    return ParseExpected(p, len, &pos, " @@");
+}
+
+static Hunk HunkAtLine(const Patch *patch, size_t start) {
+    Hunk h;
+    const Line *header = &patch->lines[start];
+    h.valid = ParseHunkHeader(patch->bytes + header->offset, header->length, &h.leftRun, &h.rightRun);
+    h.start = start;
+    h.end = start + 1;
+    h.bodyHash = 0;
+    while (h.end < patch->lineCount && !(patch->lines[h.end].flags & LineFlagHunkEnd)) {
+        h.bodyHash = MixHash(h.bodyHash, patch->lines[h.end].hash);
+        h.end++;
+    }
+    return h;
+}
+
+static inline size_t BodyLength(const Hunk *h) {
+    return h->end - h->start - 1;
+}
+
+static inline BOOL HeadersMatch(const Hunk *x, const Hunk *y) {
+    return x->valid && y->valid && x->leftRun == y->leftRun && x->rightRun == y->rightRun;
+}
+
+// Compares the first count body lines of the two hunks
+static BOOL BodiesEqual(const Patch *a, const Hunk *ah, const Patch *b, const Hunk *bh, size_t count) {
+    for (size_t i = 1; i <= count; i++) {
+        if (!LinesEqual(a, ah->start + i, b, bh->start + i)) return NO;
+    }
+    return YES;
+}
+
+// Hunks of b grouped into classes by (runs, body length, body hash). Members of each class are in ascending order.
+typedef struct {
+    Hunk *hunks;
+    size_t hunkCount;
+
+    size_t *classOf; // class index of each hunk
+    size_t classCount;
+    size_t *classOffsets; // members of class c are classMembers[classOffsets[c], classOffsets[c+1])
+    size_t *classMembers;
+    size_t *classCursors; // first member which may still be at or after bIdx
+
+    size_t *table; // open addressing, class index + 1, 0 is empty
+    size_t tableMask;
+} HunkIndex;
+
+static uint64_t HunkKeyHash(const Hunk *h) {
+    uint64_t k = MixHash(h->bodyHash, (uint64_t)h->leftRun);
+    k = MixHash(k, (uint64_t)h->rightRun);
+    return MixHash(k, BodyLength(h));
+}
+
+static BOOL HunkKeysEqual(const Hunk *x, const Hunk *y) {
+    return HeadersMatch(x, y) && BodyLength(x) == BodyLength(y) && x->bodyHash == y->bodyHash;
+}
+
+// Returns the class of hunks in index with the same key as h, or -1
+static ssize_t LookupClass(const HunkIndex *index, const Hunk *h, size_t *representatives) {
+    size_t slot = (size_t)HunkKeyHash(h) & index->tableMask;
+    while (index->table[slot]) {
+        size_t c = index->table[slot] - 1;
+        if (HunkKeysEqual(&index->hunks[representatives[c]], h)) {
+            return (ssize_t)c;
+        }
+        slot = (slot + 1) & index->tableMask;
+    }
+    return -1;
+}
+
+static void BuildHunkIndex(HunkIndex *index, const Patch *b, size_t **outRepresentatives) {
+    size_t capacity = 16;
+    index->hunks = malloc(sizeof(Hunk) * capacity);
+    index->hunkCount = 0;
+    for (size_t i = 0; i < b->lineCount; i++) {
+        if (b->lines[i].flags & LineFlagHunkStart) {
+            if (index->hunkCount == capacity) {
+                capacity *= 2;
+                index->hunks = reallocf(index->hunks, sizeof(Hunk) * capacity);
+            }
+            index->hunks[index->hunkCount++] = HunkAtLine(b, i);
+        }
+    }
+
+    size_t tableSize = 16;
+    while (tableSize < index->hunkCount * 2) tableSize *= 2;
+    index->table = calloc(tableSize, sizeof(size_t));
+    index->tableMask = tableSize - 1;
+
+    size_t n = MAX(index->hunkCount, 1);
+    index->classOf = malloc(sizeof(size_t) * n);
+    size_t *representatives = malloc(sizeof(size_t) * n);
+    size_t *classSizes = calloc(n + 1, sizeof(size_t));
+    index->classCount = 0;
+
+    for (size_t i = 0; i < index->hunkCount; i++) {
+        const Hunk *h = &index->hunks[i];
+        if (!h->valid) {
+            // can never match
+            index->classOf[i] = SIZE_MAX;
+            continue;
+        }
+        ssize_t c = LookupClass(index, h, representatives);
+        if (c < 0) {
+            c = (ssize_t)index->classCount++;
+            representatives[c] = i;
+            size_t slot = (size_t)HunkKeyHash(h) & index->tableMask;
+            while (index->table[slot]) slot = (slot + 1) & index->tableMask;
+            index->table[slot] = (size_t)c + 1;
+        }
+        index->classOf[i] = (size_t)c;
+        classSizes[c]++;
+    }
+
+    index->classOffsets = malloc(sizeof(size_t) * (index->classCount + 1));
+    index->classCursors = malloc(sizeof(size_t) * MAX(index->classCount, 1));
+    size_t offset = 0;
+    for (size_t c = 0; c < index->classCount; c++) {
+        index->classOffsets[c] = offset;
+        index->classCursors[c] = offset;
+        offset += classSizes[c];
+    }
+    index->classOffsets[index->classCount] = offset;
+
+    index->classMembers = malloc(sizeof(size_t) * MAX(offset, 1));
+    memset(classSizes, 0, sizeof(size_t) * (n + 1));
+    for (size_t i = 0; i < index->hunkCount; i++) {
+        size_t c = index->classOf[i];
+        if (c == SIZE_MAX) continue;
+        index->classMembers[index->classOffsets[c] + classSizes[c]++] = i;
+    }
+
+    free(classSizes);
+    *outRepresentatives = representatives;
+}
+
+static void FreeHunkIndex(HunkIndex *index) {
+    free(index->hunks);
+    free(index->classOf);
+    free(index->classOffsets);
+    free(index->classMembers);
+    free(index->classCursors);
+    free(index->table);
+}
+
+// Would the scan for ah have consumed the @@ line of hunk j while comparing against hunk j-1?
+//
+// That happens when hunk j-1 was itself scanned, has a matching header, ends at the @@ line of hunk j,
+// and has a body that is a strict prefix of ah's body. With a run of k such hunks preceding j, the
+// first of them is scanned and consumes the second, the third is scanned and consumes the fourth,
+// and so on, so j is skipped iff k is odd.
+static BOOL HunkIsSkipped(const HunkIndex *index, size_t j, const Patch *a, const Hunk *ah, const Patch *b, size_t bIdx) {
+    size_t run = 0;
+    while (j > run) {
+        const Hunk *prev = &index->hunks[j - run - 1];
+        const Hunk *next = &index->hunks[j - run];
+        if (prev->start < bIdx
+            || prev->end != next->start
+            || !HeadersMatch(prev, ah)
+            || BodyLength(prev) >= BodyLength(ah)
+            || !BodiesEqual(a, ah, b, prev, BodyLength(prev)))
+        {
+            break;
+        }
+        run++;
+    }
+    return (run & 1) == 1;
+}
+
+// Returns the index of the hunk in b which matches ah, or -1
+static ssize_t FindMatchingHunk(HunkIndex *index, size_t *representatives, const Patch *a, const Hunk *ah, const Patch *b, size_t bIdx) {
+    if (!ah->valid) return -1;
+
+    ssize_t c = LookupClass(index, ah, representatives);
+    if (c < 0) return -1;
+
+    // bIdx never decreases, so members before it can be dropped for good
+    size_t end = index->classOffsets[c + 1];
+    size_t cursor = index->classCursors[c];
+    while (cursor < end && index->hunks[index->classMembers[cursor]].start < bIdx) {
+        cursor++;
+    }
+    index->classCursors[c] = cursor;
+
+    for (size_t m = cursor; m < end; m++) {
+        size_t j = index->classMembers[m];
+        const Hunk *bh = &index->hunks[j];
+        if (BodiesEqual(a, ah, b, bh, BodyLength(ah)) && !HunkIsSkipped(index, j, a, ah, b, bIdx)) {
+            return (ssize_t)j;
+        }
+    }
+
+    return -1;
+}
+
+int32_t *GitPatchMappingCompute(const uint8_t *aBytes, size_t aLength, const uint8_t *bBytes, size_t bLength, size_t *outLineCount) {
+    Patch a, b;
+    SplitLines(&a, aBytes, aLength);
+    SplitLines(&b, bBytes, bLength);
+
+    size_t aLineCount = a.lineCount;
+    size_t bLineCount = b.lineCount;
+
+    // initialize map with no mapping sentinel value -1 at every position.
+    int32_t *map = malloc(sizeof(int32_t) * aLineCount);
+    for (size_t i = 0; i < aLineCount; i++) {
+        map[i] = -1;
+    }
+
+    size_t aIdx = 0, bIdx = 0;
+
+    // walk to the first hunk of the diff. assume the headers are equivalent-ish
+    while (aIdx < aLineCount && !(a.lines[aIdx].flags & LineFlagHunkStart)
+           && bIdx < bLineCount && !(b.lines[bIdx].flags & LineFlagHunkStart))
+    {
+        map[aIdx] = (int32_t)bIdx;
+        aIdx++;
+        bIdx++;
+    }
+
+    HunkIndex index;
+    size_t *representatives = NULL;
+    BuildHunkIndex(&index, &b, &representatives);
+
+    // for each hunk in a, see if we can find it in b
+    while (aIdx < aLineCount) {
+        if (a.lines[aIdx].flags & LineFlagHunkStart) {
+            Hunk ah = HunkAtLine(&a, aIdx);
+            ssize_t j = FindMatchingHunk(&index, representatives, &a, &ah, &b, bIdx);
+            if (j >= 0) {
+                const Hunk *bh = &index.hunks[j];
+                for (size_t m = 0; m < ah.end - ah.start; m++) {
+                    map[ah.start + m] = (int32_t)(bh->start + m);
+                }
+                aIdx = ah.end;
+                bIdx = bh->end;
+            } else {
+                // there was no hunk in b that could match the hunk starting at aIdx
+                // leave bIdx where it was and bump aIdx
+                aIdx++;
+            }
+        } else {
+            aIdx++; // skip this line in a
+        }
+    }
+
+    FreeHunkIndex(&index);
+    free(representatives);
+    free(a.lines);
+    free(b.lines);
+
+    *outLineCount = aLineCount;
+    return map;
+}
+
+NSData *GitPatchMapping(NSString *a, NSString *b) {
+    NSData *aData = [a dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+    NSData *bData = [b dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+
+    size_t lineCount = 0;
+    int32_t *map = GitPatchMappingCompute(aData.bytes, aData.length, bData.bytes, bData.length, &lineCount);
+    return [NSData dataWithBytesNoCopy:map length:lineCount * sizeof(int32_t) freeWhenDone:YES];
+}
@@ -9,12 +9,14 @@
 #import <Foundation/Foundation.h>
 
 @class GitLFS;
+@class GitDiffCache;
 
 @interface GitRepo : NSObject
 
 + (GitRepo *)repoAtPath:(NSString *)path error:(NSError *__autoreleasing *)error;
 
 @property (readonly) GitLFS *lfs;
+@property (readonly) GitDiffCache *diffCache;
 
 - (void)readLock;
 - (void)writeLock;
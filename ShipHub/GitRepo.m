@@ -9,7 +9,9 @@
 #import "GitRepoInternal.h"
 
 #import "Extras.h"
+#import "GitDiffCache.h"
 #import "GitLFS.h"
+#import "GitLFSStore.h"
 #import "NSError+Git.h"
 
 #import <pthread.h>
@@ -21,6 +23,7 @@
 
 @property git_repository *repo;
 @property (readwrite, strong) GitLFS *lfs;
+@property (readwrite, strong) GitDiffCache *diffCache;
 @property NSArray *fetchingRefs;
 
 @end
@@ -61,9 +64,11 @@ static void initGit2() {
     }
     
     GitRepo *result = [GitRepo new];
-    GitLFS *lfs = [[GitLFS alloc] initWithRepo:result];
+    GitLFSStore *lfsStore = [[GitLFSStore alloc] initWithDirectory:[path stringByAppendingPathComponent:@"lfs"] diskLimit:2ULL * 1024 * 1024 * 1024];
+    GitLFS *lfs = [[GitLFS alloc] initWithRepo:result store:lfsStore];
     result.repo = repo;
     result.lfs = lfs;
+    result.diffCache = [[GitDiffCache alloc] initWithMemoryLimit:64 * 1024 * 1024 diskDirectory:[path stringByAppendingPathComponent:@"shiphub-diffcache"] diskLimit:256 * 1024 * 1024];
     return result;
 }
 
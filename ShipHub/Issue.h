@@ -47,6 +47,7 @@
 @property (readonly) NSDictionary<NSString *, NSNumber *> *reactionSummary;
 @property (readonly) NSInteger reactionsCount; // computed from reactionSummary, not the array of reactions
 @property (readonly) BOOL unread;
+@property (readonly) NSNumber *notificationUnread; // as unread, but nil when there is no notification at all
 
 @property (readonly) BOOL pullRequest;
 @property (readonly) NSNumber *pullRequestIdentifier;
@@ -106,4 +107,5 @@ extern NSString const* IssueOptionIncludeEventsAndComments;
 extern NSString const* IssueOptionIncludeUpNextPriority;
 extern NSString const* IssueOptionIncludeNotification;
 extern NSString const* IssueOptionIncludeRequestedReviewers;
+extern NSString const* IssueOptionTableRow; // only populate what's displayed in an IssueTableController row
 
@@ -35,16 +35,41 @@
 
 #import "MetadataStore.h"
 
-@interface Issue ()
+@interface Issue () {
+    BOOL _assigneesNeedSort;
+    BOOL _labelsNeedSort;
+}
 
 @property (readwrite) NSArray<CommitStatus *> *commitStatuses;
 @property (readwrite) NSArray<CommitComment *> *commitComments;
 @property (readwrite) NSDictionary *baseBranchProtection;
+@property (readwrite) NSManagedObjectID *objectID;
 
 @end
 
 @implementation Issue
 
+@synthesize assignees = _assignees;
+@synthesize labels = _labels;
+
+static NSArray *AssigneesSort() {
+    static NSArray *assigneesSort = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        assigneesSort = @[[NSSortDescriptor sortDescriptorWithKey:@"login" ascending:YES selector:@selector(localizedStandardCompare:)]];
+    });
+    return assigneesSort;
+}
+
+static NSArray *LabelsSort() {
+    static NSArray *labelsSort = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        labelsSort = @[[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES selector:@selector(localizedStandardCompare:)]];
+    });
+    return labelsSort;
+}
+
 - (instancetype)initWithLocalIssue:(LocalIssue *)li metadataStore:(MetadataStore *)ms {
     return [self initWithLocalIssue:li metadataStore:ms options:nil];
 }
@@ -52,6 +77,9 @@
 - (instancetype)initWithLocalIssue:(LocalIssue *)li metadataStore:(MetadataStore *)ms options:(NSDictionary *)options
 {
     if (self = [super init]) {
+        BOOL tableRow = [options[IssueOptionTableRow] boolValue];
+        
+        _objectID = li.objectID;
         _number = li.number;
         _identifier = li.identifier;
         _body = li.body;
@@ -61,14 +89,8 @@
         _updatedAt = li.updatedAt;
         _closedAt = li.closedAt;
         _locked = [li.locked boolValue];
-        static NSArray *assigneesSort = nil;
-        static NSArray *labelsSort = nil;
-        static dispatch_once_t onceToken;
-        dispatch_once(&onceToken, ^{
-            assigneesSort = @[[NSSortDescriptor sortDescriptorWithKey:@"login" ascending:YES selector:@selector(localizedStandardCompare:)]];
-            labelsSort = @[[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES selector:@selector(localizedStandardCompare:)]];
-        });
         
+        // assignees and labels are sorted on first use, as most issues loaded for tables are never drawn.
         NSMutableArray *assignees = [NSMutableArray arrayWithCapacity:li.assignees.count];
         for (LocalAccount *la in li.assignees) {
             Account *a = [ms objectWithManagedObject:la];
@@ -76,8 +98,8 @@
                 [assignees addObject:a];
             }
         }
-        [assignees sortUsingDescriptors:assigneesSort];
         _assignees = assignees;
+        _assigneesNeedSort = assignees.count > 1;
         
         _originator = [ms objectWithManagedObject:li.originator];
         _closedBy = [ms objectWithManagedObject:li.closedBy];
@@ -89,8 +111,8 @@
                 [labels addObject:l];
             }
         }
-        [labels sortUsingDescriptors:labelsSort];
         _labels = labels;
+        _labelsNeedSort = labels.count > 1;
         
         _milestone = [ms objectWithManagedObject:li.milestone];
         _repository = [ms objectWithManagedObject:li.repository];
@@ -100,12 +122,20 @@
             _reactionsCount += v.integerValue;
         }
         
-        _unread = [li.notification.unread boolValue];
+        _notificationUnread = li.notification.unread;
+        _unread = [_notificationUnread boolValue];
         
         _fullIdentifier = [NSString issueIdentifierWithOwner:_repository.owner.login repo:_repository.name number:li.number];
         
         _pullRequest = [li.pullRequest boolValue];
-        if (_pullRequest) {
+        if (_pullRequest && tableRow) {
+            // Just what IssueTableController shows
+            LocalPullRequest *lpr = li.pr;
+            _pullRequestIdentifier = lpr.identifier;
+            _mergedAt = lpr.mergedAt;
+            _base = (id)(lpr.base);
+            _head = (id)(lpr.head);
+        } else if (_pullRequest) {
             LocalPullRequest *lpr = li.pr;
             _pullRequestIdentifier = lpr.identifier;
             _maintainerCanModify = lpr.maintainerCanModify;
@@ -184,7 +214,7 @@
                     [requests addObject:a];
                 }
             }
-            [requests sortUsingDescriptors:assigneesSort];
+            [requests sortUsingDescriptors:AssigneesSort()];
             _requestedReviewers = requests;
         }
     }
@@ -195,8 +225,28 @@
     return [NSString stringWithFormat:@"<%@ %p> %@ %@\nlabels:%@\ncomments:%@\nevents:%@\nunread: %d", NSStringFromClass([self class]), self, self.fullIdentifier, self.title, self.labels, self.comments, self.events, self.unread];
 }
 
+- (NSArray<Account *> *)assignees {
+    @synchronized (self) {
+        if (_assigneesNeedSort) {
+            _assignees = [_assignees sortedArrayUsingDescriptors:AssigneesSort()];
+            _assigneesNeedSort = NO;
+        }
+        return _assignees;
+    }
+}
+
+- (NSArray<Label *> *)labels {
+    @synchronized (self) {
+        if (_labelsNeedSort) {
+            _labels = [_labels sortedArrayUsingDescriptors:LabelsSort()];
+            _labelsNeedSort = NO;
+        }
+        return _labels;
+    }
+}
+
 - (Account *)assignee {
-    return [_assignees firstObject];
+    return [self.assignees firstObject];
 }
 
 - (NSString *)state {
@@ -252,7 +302,7 @@
 }
 
 - (NSComparisonResult)labelsCompare:(Issue *)other {
-    NSArray *l1 = _labels;
+    NSArray *l1 = self.labels;
     NSArray *l2 = other.labels;
     
     NSUInteger c1 = l1.count;
@@ -287,3 +337,4 @@ NSString const* IssueOptionIncludeUpNextPriority = @"IssueOptionIncludeUpNextPri
 NSString const* IssueOptionIncludeNotification = @"IssueOptionIncludeNotification";
 NSString const* IssueOptionIncludeRequestedReviewers = @"IssueOptionIncludeRequestedReviewers";
 NSString const* IssueOptionIncludeCommitStatuses = @"IssueOptionIncludeCommitStatuses";
+NSString const* IssueOptionTableRow = @"IssueOptionTableRow";
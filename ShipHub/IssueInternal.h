@@ -8,10 +8,13 @@
 
 #import "Issue.h"
 
+@class NSManagedObjectID;
+
 @interface Issue (Internal)
 
 @property (readwrite) NSArray<CommitStatus *> *commitStatuses;
 @property (readwrite) NSArray<CommitComment *> *commitComments;
 @property (readwrite) NSDictionary *baseBranchProtection;
+@property (readwrite) NSManagedObjectID *objectID; // of the LocalIssue this was read from, if any
 
 @end
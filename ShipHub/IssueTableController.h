@@ -9,6 +9,7 @@
 #import <Cocoa/Cocoa.h>
 
 @class Issue;
+@class IssueCursor;
 
 @protocol IssueTableControllerDelegate;
 
@@ -20,6 +21,12 @@
 - (void)removeSingleItem:(Issue *)removeItem;
 
 - (void)setTableItems:(NSArray *)items clearSelection:(BOOL)clearSelection; // if clearSelection is NO, controller will attempt to maintain selection via item identifiers.
+
+// For large results. When set, rows are read from the cursor a window at a time as they're displayed, rather than held in tableItems,
+// and changing the sort re-queries rather than re-sorting in memory. Setting tableItems clears it.
+@property (nonatomic, strong) IssueCursor *tableCursor;
+@property (nonatomic, readonly) NSUInteger itemCount; // the number of rows, whether from tableItems or tableCursor
+@property (nonatomic, readonly) NSArray<NSSortDescriptor *> *effectiveSortDescriptors; // the displayed sort, including its tie-breaker
 @property (weak) IBOutlet id<IssueTableControllerDelegate> delegate;
 
 @property (nonatomic, copy) NSSet /* NSString */ *defaultColumns; // Set of problem keyPaths corresponding to columns that are shown by default.
@@ -10,7 +10,9 @@
 
 #import "IssueDocumentController.h"
 
+#import "CompiledIssuePredicate.h"
 #import "DataStore.h"
+#import "DataStore+IssueCursor.h"
 #import "Extras.h"
 #import "Issue.h"
 #import "IssueIdentifier.h"
@@ -45,6 +47,14 @@ static NSString *reactionContentToEmoji(NSString *content);
 @property NSInvocation *afterTableAnimation;
 @property BOOL appearedOnce;
 
+@property NSSet *cursorSelectionIdentifiers; // to select once they're loaded from tableCursor
+
+// Every item at resolvedIndexes in resolvedCursor, for selections that include rows tableCursor hasn't loaded
+@property IssueCursor *resolvedCursor;
+@property NSIndexSet *resolvedIndexes;
+@property NSArray<Issue *> *resolvedItems;
+@property BOOL resolvingSelection;
+
 @end
 
 @implementation IssueTableController
@@ -374,23 +384,34 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
     }
 }
 
-- (NSArray *)selectedItemsForMenu {
+- (NSIndexSet *)selectedIndexesForMenu {
     NSInteger row = [_table clickedRow];
-    NSMutableIndexSet *selectedIndexes = [[_table selectedRowIndexes] mutableCopy];
+    NSIndexSet *selectedIndexes = [_table selectedRowIndexes];
     
     if ([selectedIndexes containsIndex:row]) {
-        return [_items objectsAtIndexes:selectedIndexes];
-    } else if (row != NSNotFound && row < _items.count) {
-        return @[_items[row]];
+        return selectedIndexes;
+    } else if (row >= 0 && row < self.itemCount) {
+        return [NSIndexSet indexSetWithIndex:row];
     } else {
-        return nil;
+        return [NSIndexSet indexSet];
     }
 }
 
+// With a tableCursor, only returns the items that are loaded. Actions use resolveSelectedItemsForMenu:completion: instead.
+- (NSArray *)selectedItemsForMenu {
+    NSIndexSet *indexes = [self selectedIndexesForMenu];
+    return indexes.count ? ([self availableItemsAtIndexes:indexes] ?: [self itemsAtIndexes:indexes]) : nil;
+}
+
+// Calls completion with every selected item (or clicked item, forMenu), including those tableCursor hasn't loaded.
+- (void)resolveSelectedItemsForMenu:(BOOL)forMenu completion:(void (^)(NSArray<Issue *> *selected))completion {
+    NSIndexSet *indexes = forMenu ? [self selectedIndexesForMenu] : [_table selectedRowIndexes];
+    [self resolveItemsAtIndexes:indexes completion:completion];
+}
+
 - (void)menuNeedsUpdate:(NSMenu *)menu {
     if (menu == _table.menu) {
-        NSArray *selected = [self selectedItemsForMenu];
-        BOOL any = [selected count] > 0;
+        BOOL any = [[self selectedIndexesForMenu] count] > 0;
         for (NSMenuItem *item in menu.itemArray) {
             item.hidden = !any;
         }
@@ -398,130 +419,107 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 }
 
 - (void)openFromMenu:(id)sender {
-    NSArray *selected = [self selectedItemsForMenu];
-    NSArray *identifiers = [selected arrayByMappingObjects:^id(id obj) {
-        return [obj fullIdentifier];
+    [self resolveSelectedItemsForMenu:YES completion:^(NSArray<Issue *> *selected) {
+        NSArray *identifiers = [selected arrayByMappingObjects:^id(id obj) {
+            return [obj fullIdentifier];
+        }];
+        [[IssueDocumentController sharedDocumentController] openIssuesWithIdentifiers:identifiers];
     }];
-    [[IssueDocumentController sharedDocumentController] openIssuesWithIdentifiers:identifiers];
 }
 
 - (IBAction)copyNumberFromMenu:(id)sender {
-    NSArray *selected = [self selectedItemsForMenu];
-    [self copyNumbers:selected];
+    [self resolveSelectedItemsForMenu:YES completion:^(NSArray<Issue *> *selected) {
+        [self copyNumbers:selected];
+    }];
 }
 
 - (IBAction)copyNumberAndTitleFromMenu:(id)sender {
-    NSArray *selected = [self selectedItemsForMenu];
-    [self copyNumbersAndTitles:selected];
+    [self resolveSelectedItemsForMenu:YES completion:^(NSArray<Issue *> *selected) {
+        [self copyNumbersAndTitles:selected];
+    }];
 }
 
 - (IBAction)copyGitHubURLFromMenu:(id)sender {
-    NSArray *selected = [self selectedItemsForMenu];
-    [[[selected firstObject] fullIdentifier] copyIssueGitHubURLToPasteboard:[NSPasteboard generalPasteboard]];
+    [self resolveSelectedItemsForMenu:YES completion:^(NSArray<Issue *> *selected) {
+        [[[selected firstObject] fullIdentifier] copyIssueGitHubURLToPasteboard:[NSPasteboard generalPasteboard]];
+    }];
 }
 
 - (void)markAsReadFromMenu:(id)sender {
-    NSArray *selected = [self selectedItemsForMenu];
-    for (Issue *i in selected) {
-        if (i.unread) {
-            [[DataStore activeStore] markIssueAsRead:i.fullIdentifier];
+    [self resolveSelectedItemsForMenu:YES completion:^(NSArray<Issue *> *selected) {
+        for (Issue *i in selected) {
+            if (i.unread) {
+                [[DataStore activeStore] markIssueAsRead:i.fullIdentifier];
+            }
         }
-    }
+    }];
 }
 
 - (IBAction)toggleUpNext:(id)sender {
-    NSArray *selected;
-    if ([sender menu] == _table.menu) {
-        selected = [self selectedItemsForMenu];
-    } else {
-        selected = [self selectedItems];
-    }
-    NSArray *identifiers = [selected arrayByMappingObjects:^id(id obj) {
-        return [obj fullIdentifier];
-    }];
-    if ([identifiers count]) {
-        if (_upNextMode) {
-            [[UpNextHelper sharedHelper] removeFromUpNext:identifiers window:self.view.window completion:nil];
-        } else {
-            [[UpNextHelper sharedHelper] addToUpNext:identifiers atHead:NO window:self.view.window completion:nil];
+    [self resolveSelectedItemsForMenu:[sender menu] == _table.menu completion:^(NSArray<Issue *> *selected) {
+        NSArray *identifiers = [selected arrayByMappingObjects:^id(id obj) {
+            return [obj fullIdentifier];
+        }];
+        if ([identifiers count]) {
+            if (_upNextMode) {
+                [[UpNextHelper sharedHelper] removeFromUpNext:identifiers window:self.view.window completion:nil];
+            } else {
+                [[UpNextHelper sharedHelper] addToUpNext:identifiers atHead:NO window:self.view.window completion:nil];
+            }
         }
-    }
+    }];
 }
 
 - (void)removeFromUpNext:(id)sender {
-    NSArray *selected = [self selectedItemsForMenu];
-    NSArray *identifiers = [selected arrayByMappingObjects:^id(id obj) {
-        return [obj fullIdentifier];
+    [self resolveSelectedItemsForMenu:YES completion:^(NSArray<Issue *> *selected) {
+        NSArray *identifiers = [selected arrayByMappingObjects:^id(id obj) {
+            return [obj fullIdentifier];
+        }];
+        if ([identifiers count]) {
+            [[DataStore activeStore] removeFromUpNext:identifiers completion:nil];
+        }
     }];
-    if ([identifiers count]) {
-        [[DataStore activeStore] removeFromUpNext:identifiers completion:nil];
-    }
 }
 
 - (IBAction)bulkModifyMilestone:(id)sender {
-    NSArray *selected;
-    if ([[sender menu] supermenu] == _table.menu) {
-        selected = [self selectedItemsForMenu];
-    } else {
-        selected = [self selectedItems];
-    }
-    
-    if ([selected count] > 0) {
-        [[BulkModifyHelper sharedHelper] editMilestone:selected window:self.view.window];
-    }
+    [self resolveSelectedItemsForMenu:[[sender menu] supermenu] == _table.menu completion:^(NSArray<Issue *> *selected) {
+        if ([selected count] > 0) {
+            [[BulkModifyHelper sharedHelper] editMilestone:selected window:self.view.window];
+        }
+    }];
 }
 
 - (IBAction)bulkModifyLabels:(id)sender {
-    NSArray *selected;
-    if ([[sender menu] supermenu] == _table.menu) {
-        selected = [self selectedItemsForMenu];
-    } else {
-        selected = [self selectedItems];
-    }
-    
-    if ([selected count] > 0) {
-        [[BulkModifyHelper sharedHelper] editLabels:selected window:self.view.window];
-    }
+    [self resolveSelectedItemsForMenu:[[sender menu] supermenu] == _table.menu completion:^(NSArray<Issue *> *selected) {
+        if ([selected count] > 0) {
+            [[BulkModifyHelper sharedHelper] editLabels:selected window:self.view.window];
+        }
+    }];
 }
 
 - (IBAction)bulkModifyAssignee:(id)sender {
-    NSArray *selected;
-    if ([[sender menu] supermenu] == _table.menu) {
-        selected = [self selectedItemsForMenu];
-    } else {
-        selected = [self selectedItems];
-    }
-    
-    if ([selected count] > 0) {
-        [[BulkModifyHelper sharedHelper] editAssignees:selected window:self.view.window];
-    }
+    [self resolveSelectedItemsForMenu:[[sender menu] supermenu] == _table.menu completion:^(NSArray<Issue *> *selected) {
+        if ([selected count] > 0) {
+            [[BulkModifyHelper sharedHelper] editAssignees:selected window:self.view.window];
+        }
+    }];
 }
 
 - (IBAction)bulkModifyState:(id)sender {
-    NSArray *selected;
-    if ([[sender menu] supermenu] == _table.menu) {
-        selected = [self selectedItemsForMenu];
-    } else {
-        selected = [self selectedItems];
-    }
-    
-    if ([selected count] > 0) {
-        [[BulkModifyHelper sharedHelper] editState:selected window:self.view.window];
-    }
+    [self resolveSelectedItemsForMenu:[[sender menu] supermenu] == _table.menu completion:^(NSArray<Issue *> *selected) {
+        if ([selected count] > 0) {
+            [[BulkModifyHelper sharedHelper] editState:selected window:self.view.window];
+        }
+    }];
 }
 
 - (IBAction)viewCodeChanges:(id)sender {
-    NSArray *selected;
-    if ([sender menu] == _table.menu) {
-        selected = [self selectedItemsForMenu];
-    } else {
-        selected = [self selectedItems];
-    }
-    
-    Issue *i = [selected firstObject];
-    if (i.pullRequest) {
-        [[IssueDocumentController sharedDocumentController] openDiffWithIdentifier:i.fullIdentifier canOpenExternally:NO scrollInfo:nil completion:nil];
-    }
+    [self resolveSelectedItemsForMenu:[sender menu] == _table.menu completion:^(NSArray<Issue *> *selected) {
+        Issue *i = [selected firstObject];
+        if (i.pullRequest) {
+            [[IssueDocumentController sharedDocumentController] openDiffWithIdentifier:i.fullIdentifier canOpenExternally:NO scrollInfo:nil completion:nil];
+        }
+    }];
 }
 
 - (void)_makeColumns {
@@ -599,6 +597,149 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
     return _items;
 }
 
+- (NSUInteger)itemCount {
+    return _tableCursor ? _tableCursor.count : _items.count;
+}
+
+- (Issue *)itemAtRow:(NSInteger)row {
+    if (row < 0) return nil;
+    if (_tableCursor) {
+        return [_tableCursor issueAtIndex:row];
+    }
+    return row < _items.count ? _items[row] : nil;
+}
+
+// With a tableCursor, only returns the items that are loaded. See availableItemsAtIndexes: and resolveItemsAtIndexes:completion:.
+- (NSArray<Issue *> *)itemsAtIndexes:(NSIndexSet *)indexes {
+    if (!_tableCursor) {
+        return [_items objectsAtIndexes:indexes];
+    }
+    NSMutableArray *items = [NSMutableArray arrayWithCapacity:indexes.count];
+    [indexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        Issue *i = [_tableCursor issueAtIndex:idx];
+        if (i) [items addObject:i];
+    }];
+    return items;
+}
+
+// Returns every item at indexes if they can all be had without reading from tableCursor, otherwise nil.
+- (NSArray<Issue *> *)availableItemsAtIndexes:(NSIndexSet *)indexes {
+    if (!_tableCursor || [_tableCursor isLoadedAtIndexes:indexes]) {
+        return [self itemsAtIndexes:indexes];
+    }
+    if (_resolvedCursor == _tableCursor && [_resolvedIndexes isEqualToIndexSet:indexes]) {
+        return _resolvedItems;
+    }
+    return nil;
+}
+
+// Calls completion with every item at indexes, reading any that tableCursor hasn't loaded.
+// completion isn't called if tableCursor changes before the read finishes.
+- (void)resolveItemsAtIndexes:(NSIndexSet *)indexes completion:(void (^)(NSArray<Issue *> *items))completion {
+    NSArray *available = [self availableItemsAtIndexes:indexes];
+    if (available) {
+        completion(available);
+        return;
+    }
+    
+    IssueCursor *cursor = _tableCursor;
+    indexes = [indexes copy];
+    [cursor loadIssuesAtIndexes:indexes completion:^(NSArray<Issue *> *issues, NSError *error) {
+        if (cursor != _tableCursor) return;
+        if (!issues) {
+            ErrLog(@"%@", error);
+            return;
+        }
+        
+        _resolvedCursor = cursor;
+        _resolvedIndexes = indexes;
+        _resolvedItems = issues;
+        completion(issues);
+    }];
+}
+
+// Reads the selected items ahead of time when the selection includes rows tableCursor hasn't loaded,
+// so that dragging them, which can't wait for a read, has all of them.
+- (void)resolveSelection {
+    IssueCursor *cursor = _tableCursor;
+    if (!cursor || _resolvingSelection) return;
+    
+    NSIndexSet *selected = [[_table selectedRowIndexes] copy];
+    if ([self availableItemsAtIndexes:selected]) return;
+    
+    _resolvingSelection = YES;
+    [cursor loadIssuesAtIndexes:selected completion:^(NSArray<Issue *> *issues, NSError *error) {
+        _resolvingSelection = NO;
+        if (cursor != _tableCursor) return;
+        if (!issues) {
+            ErrLog(@"%@", error);
+            return;
+        }
+        
+        _resolvedCursor = cursor;
+        _resolvedIndexes = selected;
+        _resolvedItems = issues;
+        
+        // The selection may have changed again during the read
+        [self resolveSelection];
+    }];
+}
+
+- (NSIndexSet *)indexesOfItemsPassingTest:(BOOL (^)(Issue *item))test {
+    if (!_tableCursor) {
+        return [_items indexesOfObjectsPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
+            return test(obj);
+        }];
+    }
+    NSMutableIndexSet *indexes = [NSMutableIndexSet new];
+    NSUInteger count = _tableCursor.count;
+    for (NSUInteger idx = 0; idx < count; idx++) {
+        Issue *i = [_tableCursor issueAtIndex:idx];
+        if (i && test(i)) [indexes addIndex:idx];
+    }
+    return indexes;
+}
+
+- (void)setTableCursor:(IssueCursor *)tableCursor {
+    NSSet *previouslySelectedIdentifiers = [self selectedItemIdentifiers];
+    
+    _tableCursor = tableCursor;
+    _afterTableAnimation = nil;
+    [_items removeAllObjects];
+    _cursorSelectionIdentifiers = previouslySelectedIdentifiers.count ? previouslySelectedIdentifiers : nil;
+    _resolvedCursor = nil;
+    _resolvedIndexes = nil;
+    _resolvedItems = nil;
+    
+    [_table reloadData];
+    [self updateEmptyState];
+    [self loadVisibleCursorRows];
+}
+
+// Loads the visible rows from tableCursor, plus a screenful either side of them.
+- (void)loadVisibleCursorRows {
+    IssueCursor *cursor = _tableCursor;
+    if (!cursor || cursor.count == 0) return;
+    
+    NSRange visible = [_table rowsInRect:_table.visibleRect];
+    NSUInteger prefetch = MAX(visible.length, 50);
+    NSUInteger start = visible.location > prefetch ? visible.location - prefetch : 0;
+    NSUInteger end = MIN(NSMaxRange(visible) + prefetch, cursor.count);
+    if (end <= start) return;
+    
+    [cursor loadRange:NSMakeRange(start, end - start) completion:^(NSIndexSet *loaded) {
+        if (cursor != _tableCursor || loaded.count == 0) return;
+        
+        [_table reloadDataForRowIndexes:loaded columnIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, _table.numberOfColumns)]];
+        
+        NSSet *identifiers = _cursorSelectionIdentifiers;
+        if (identifiers) {
+            _cursorSelectionIdentifiers = nil;
+            [self selectItemsByIdentifiers:identifiers];
+        }
+    }];
+}
+
 - (void)setTableItems:(NSArray *)tableItems {
     [self setTableItems:tableItems clearSelection:NO];
 }
@@ -608,6 +749,8 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 }
 
 - (void)updateSingleItem:(Issue *)updatedItem {
+    if (_tableCursor) return; // the owner refreshes the cursor instead
+    
     NSInteger idx = [_items indexOfObjectPassingTest:^BOOL(id  _Nonnull obj, NSUInteger j, BOOL * _Nonnull stop) {
         return [[obj fullIdentifier] isEqualToString:[updatedItem fullIdentifier]];
     }];
@@ -622,6 +765,8 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 }
 
 - (void)removeSingleItem:(Issue *)removeItem {
+    if (_tableCursor) return; // the owner refreshes the cursor instead
+    
     NSInteger idx = [_items indexOfObjectPassingTest:^BOOL(id  _Nonnull obj, NSUInteger j, BOOL * _Nonnull stop) {
         return [[obj fullIdentifier] isEqualToString:[removeItem fullIdentifier]];
     }];
@@ -643,7 +788,7 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
     }
 }
 
-- (void)_sortItems {
+- (NSArray<NSSortDescriptor *> *)effectiveSortDescriptors {
     NSArray *sortDescriptors = _table.sortDescriptors;
     if (_upNextMode) {
         sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"upNextPriority" ascending:YES]];
@@ -654,13 +799,20 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
     } else {
         sortDescriptors = [sortDescriptors arrayByAddingObject:stability];
     }
+    return sortDescriptors;
+}
+
+// Sorts in the same order an IssueCursor would, so results don't reorder when a search grows large enough to need one.
+- (void)_sortItems {
+    NSArray *sortDescriptors = [self effectiveSortDescriptors];
+    NSSortDescriptor *stability = [sortDescriptors lastObject];
     @try {
-        [_items sortUsingDescriptors:sortDescriptors];
+        [_items sortUsingDescriptors:[IssueCursor memorySortDescriptorsForSortDescriptors:sortDescriptors]];
     } @catch (id exc) {
         // This can happen if we had some sort descriptors saved in user defaults, but then removed those properties on the model.
         ErrLog(@"Error sorting items with descriptors %@: %@", sortDescriptors, exc);
         sortDescriptors = @[stability];
-        [_items sortUsingDescriptors:sortDescriptors];
+        [_items sortUsingDescriptors:[IssueCursor memorySortDescriptorsForSortDescriptors:sortDescriptors]];
         _table.sortDescriptors = sortDescriptors;
     }
 }
@@ -682,6 +834,11 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
     }
     
     NSSet *previouslySelectedIdentifiers = clearSelection ? nil : [self selectedItemIdentifiers];
+    _tableCursor = nil;
+    _cursorSelectionIdentifiers = nil;
+    _resolvedCursor = nil;
+    _resolvedIndexes = nil;
+    _resolvedItems = nil;
     _items = [items mutableCopy];
     
     [self _sortItems];
@@ -744,20 +901,21 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 }
 
 - (IBAction)copy:(id)sender {
-    NSArray *selected = [self selectedItems];
-    if ([selected count] == 0) {
-        return;
-    }
-
-    NSPasteboard *pb = [NSPasteboard generalPasteboard];
-    
-    NSMutableString *str = [NSMutableString new];
-    [str appendString:[self tabSeparatedHeader]];
-    for (id item in selected) {
-        [str appendString:[self tabSeparatedRowForProblem:item]];
-    }
-    [pb clearContents];
-    [pb writeObjects:@[str]];
+    [self resolveSelectedItemsForMenu:NO completion:^(NSArray<Issue *> *selected) {
+        if ([selected count] == 0) {
+            return;
+        }
+        
+        NSPasteboard *pb = [NSPasteboard generalPasteboard];
+        
+        NSMutableString *str = [NSMutableString new];
+        [str appendString:[self tabSeparatedHeader]];
+        for (id item in selected) {
+            [str appendString:[self tabSeparatedRowForProblem:item]];
+        }
+        [pb clearContents];
+        [pb writeObjects:@[str]];
+    }];
 }
 
 - (void)copyNumbers:(NSArray *)selected {
@@ -775,46 +933,53 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 }
 
 - (IBAction)copyIssueNumber:(id)sender {
-    NSArray *selected = [self selectedItems];
-    [self copyNumbers:selected];
+    [self resolveSelectedItemsForMenu:NO completion:^(NSArray<Issue *> *selected) {
+        [self copyNumbers:selected];
+    }];
 }
 
 - (IBAction)copyIssueNumberWithTitle:(id)sender {
-    NSArray *selected = [self selectedItems];
-    [self copyNumbersAndTitles:selected];
+    [self resolveSelectedItemsForMenu:NO completion:^(NSArray<Issue *> *selected) {
+        [self copyNumbersAndTitles:selected];
+    }];
 }
 
 - (IBAction)copyIssueGitHubURL:(id)sender {
-    NSArray *selected = [self selectedItems];
-    [[[selected firstObject] fullIdentifier] copyIssueGitHubURLToPasteboard:[NSPasteboard generalPasteboard]];
+    [self resolveSelectedItemsForMenu:NO completion:^(NSArray<Issue *> *selected) {
+        [[[selected firstObject] fullIdentifier] copyIssueGitHubURLToPasteboard:[NSPasteboard generalPasteboard]];
+    }];
 }
 
 - (IBAction)openDocument:(id)sender {
-    NSArray *selected = [self selectedItems];
-    NSArray *identifiers = [selected arrayByMappingObjects:^id(id obj) {
-        return [obj fullIdentifier];
+    [self resolveSelectedItemsForMenu:NO completion:^(NSArray<Issue *> *selected) {
+        NSArray *identifiers = [selected arrayByMappingObjects:^id(id obj) {
+            return [obj fullIdentifier];
+        }];
+        [[IssueDocumentController sharedDocumentController] openIssuesWithIdentifiers:identifiers];
     }];
-    [[IssueDocumentController sharedDocumentController] openIssuesWithIdentifiers:identifiers];
 }
 
 - (IBAction)openDocumentInBrowser:(id)sender {
-    NSArray *selected = [self selectedItems];
-    NSArray *URLs = [selected arrayByMappingObjects:^id(id obj) {
-        return [[obj fullIdentifier] issueGitHubURL];
+    [self resolveSelectedItemsForMenu:NO completion:^(NSArray<Issue *> *selected) {
+        NSArray *URLs = [selected arrayByMappingObjects:^id(id obj) {
+            return [[obj fullIdentifier] issueGitHubURL];
+        }];
+        NSWorkspace *workspace = [NSWorkspace sharedWorkspace];
+        NSURL *browserURL = [workspace URLForApplicationToOpenURL:[NSURL URLWithString:@"https://github.com"]];
+        [[NSWorkspace sharedWorkspace] openURLs:URLs withApplicationAtURL:browserURL options:NSWorkspaceLaunchDefault configuration:@{} error:NULL];
     }];
-    NSWorkspace *workspace = [NSWorkspace sharedWorkspace];
-    NSURL *browserURL = [workspace URLForApplicationToOpenURL:[NSURL URLWithString:@"https://github.com"]];
-    [[NSWorkspace sharedWorkspace] openURLs:URLs withApplicationAtURL:browserURL options:NSWorkspaceLaunchDefault configuration:@{} error:NULL];
 }
 
 - (BOOL)validateMenuItem:(NSMenuItem *)item {
-    NSArray *selected = nil;
+    NSIndexSet *indexes = nil;
     if ([item containedInMenu:_table.menu]) {
-        selected = [self selectedItemsForMenu];
+        indexes = [self selectedIndexesForMenu];
     } else {
-        selected = [self selectedItems];
+        indexes = [_table selectedRowIndexes];
     }
-    NSInteger selectedCount = [selected count];
+    NSInteger selectedCount = [indexes count];
+    // nil if the selection includes rows tableCursor hasn't loaded. The action reads them before acting.
+    NSArray *selected = [self availableItemsAtIndexes:indexes];
     
     if (item.action == @selector(copyIssueNumber:)
         || item.action == @selector(copyIssueNumberWithTitle:)
@@ -834,14 +999,20 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
         || item.action == @selector(bulkModifyAssignee:)
         || item.action == @selector(bulkModifyMilestone:))
     {
-        NSArray *editable = [selected filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"repository.canPush = YES"]];
+        if (!selected) {
+            return selectedCount > 0; // BulkModifyHelper reports any that can't be edited
+        }
+        NSArray *editable = [selected filteredArrayUsingPredicate:[CompiledIssuePredicate compiledPredicateWithPredicate:[NSPredicate predicateWithFormat:@"repository.canPush = YES"]]];
         return editable.count > 0;
     }
     if (item.action == @selector(viewCodeChanges:)) {
         return selectedCount == 1 && [[selected firstObject] pullRequest];
     }
     if (item.action == @selector(markAsReadFromMenu:)) {
-        return [selected containsObjectMatchingPredicate:[NSPredicate predicateWithFormat:@"unread = YES"]];
+        if (!selected) {
+            return selectedCount > 0;
+        }
+        return [selected containsObjectMatchingPredicate:[CompiledIssuePredicate compiledPredicateWithPredicate:[NSPredicate predicateWithFormat:@"unread = YES"]]];
     }
     return YES;
 }
@@ -871,7 +1042,7 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 }
 
 - (void)updateEmptyState {
-    if (_items.count == 0) {
+    if (self.itemCount == 0) {
         if (_emptyPlaceholderViewController) {
             if ([_emptyPlaceholderViewController.view superview] != _table) {
                 _emptyPlaceholderViewController.view.frame = _table.bounds;
@@ -886,7 +1057,7 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
         }
     }
     
-    _table.usesAlternatingRowBackgroundColors = [self usesAlternatingRowBackgroundColors] && (_items.count > 0 || _emptyPlaceholderViewController == nil);
+    _table.usesAlternatingRowBackgroundColors = [self usesAlternatingRowBackgroundColors] && (self.itemCount > 0 || _emptyPlaceholderViewController == nil);
 }
 
 - (BOOL)usesAlternatingRowBackgroundColors {
@@ -896,12 +1067,17 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 #pragma mark - NSTableViewDataSource & NSTableViewDelegate
 
 - (NSInteger)numberOfRowsInTableView:(NSTableView *)tableView {
-    return [_items count];
+    return self.itemCount;
 }
 
 - (id)tableView:(NSTableView *)tableView objectValueForTableColumn:(NSTableColumn *)tableColumn row:(NSInteger)row
 {
-    Issue *item = _items[row];
+    Issue *item = [self itemAtRow:row];
+    if (!item) {
+        // Not loaded from tableCursor yet
+        [self loadVisibleCursorRows];
+        return nil;
+    }
     if ([tableColumn.identifier isEqualToString:@"labels"]) {
         return item.labels; // don't ever return a @"--" for labels
     } else if ([tableColumn.identifier hasPrefix:@"reactionSummary"]) {
@@ -919,7 +1095,7 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 
 - (void)selectSomething {
     NSIndexSet *selected = [_table selectedRowIndexes];
-    if ([selected count] == 0 && _items.count != 0) {
+    if ([selected count] == 0 && self.itemCount != 0) {
         [_table selectRowIndexes:[NSIndexSet indexSetWithIndex:0] byExtendingSelection:NO];
         if ([self.delegate respondsToSelector:@selector(issueTableController:didChangeSelection:userInitiated:)]) {
             [self.delegate issueTableController:self didChangeSelection:[self selectedProblemSnapshots] userInitiated:NO];
@@ -934,8 +1110,8 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 }
 
 - (void)selectItemsByIdentifiers:(NSSet *)identifiers {
-    NSIndexSet *selected = [_items indexesOfObjectsPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
-        return [identifiers containsObject:[obj identifier]];
+    NSIndexSet *selected = [self indexesOfItemsPassingTest:^BOOL(Issue *item) {
+        return [identifiers containsObject:[item identifier]];
     }];
     [_table selectRowIndexes:selected byExtendingSelection:NO];
     if ([self.delegate respondsToSelector:@selector(issueTableController:didChangeSelection:userInitiated:)]) {
@@ -947,15 +1123,17 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
     return [self selectedItems];
 }
 
+// With a tableCursor, only returns every selected item once they've all been loaded or read by resolveSelection.
+// Until then, it's just those that are loaded.
 - (NSArray *)selectedItems {
     NSIndexSet *selected = [_table selectedRowIndexes];
-    return [_items objectsAtIndexes:selected];
+    return [self availableItemsAtIndexes:selected] ?: [self itemsAtIndexes:selected];
 }
 
 - (void)selectItems:(NSArray *)items {
     NSSet *set = [NSSet setWithArray:items];
-    NSIndexSet *selected = [_items indexesOfObjectsPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
-        return [set containsObject:obj];
+    NSIndexSet *selected = [self indexesOfItemsPassingTest:^BOOL(Issue *item) {
+        return [set containsObject:item];
     }];
     [_table selectRowIndexes:selected byExtendingSelection:NO];
     if ([self.delegate respondsToSelector:@selector(issueTableController:didChangeSelection:userInitiated:)]) {
@@ -964,6 +1142,7 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 }
 
 - (void)tableViewSelectionDidChange:(NSNotification *)notification {
+    [self resolveSelection];
     if ([self.delegate respondsToSelector:@selector(issueTableController:didChangeSelection:userInitiated:)]) {
         [self.delegate issueTableController:self didChangeSelection:[self selectedProblemSnapshots] userInitiated:YES];
     }
@@ -974,15 +1153,46 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
         return; // We cannot sort during a load
     }
     
+    if (_tableCursor) {
+        [self resortCursor];
+        return;
+    }
+    
     NSArray *selected = [self selectedItems];
     [self _sortItems];
     [_table reloadData];
     [self selectItems:selected];
 }
 
+// Re-queries tableCursor in the new order. If the database can't sort that way (e.g. by assignees),
+// falls back to loading every item and sorting in memory.
+- (void)resortCursor {
+    IssueCursor *cursor = _tableCursor;
+    [cursor cursorWithSortDescriptors:[self effectiveSortDescriptors] completion:^(IssueCursor *sorted, NSError *error) {
+        if (cursor != _tableCursor) return;
+        
+        if (sorted.sortable) {
+            self.tableCursor = sorted;
+        } else if (sorted) {
+            [cursor loadAllIssues:^(NSArray<Issue *> *issues, NSError *loadError) {
+                if (cursor == _tableCursor && issues) {
+                    self.tableItems = issues;
+                }
+            }];
+        } else {
+            ErrLog(@"%@", error);
+        }
+    }];
+}
+
 - (BOOL)tableView:(NSTableView *)tableView writeRowsWithIndexes:(NSIndexSet *)rowIndexes toPasteboard:(NSPasteboard *)pboard
 {
-    NSArray *items = [_items objectsAtIndexes:rowIndexes];
+    NSArray *items = [self availableItemsAtIndexes:rowIndexes];
+    if (!items) {
+        // Some of the rows are still being read from tableCursor, and a drag can't wait for them
+        [self resolveSelection];
+        return NO;
+    }
     [NSString copyIssueIdentifiers:[items arrayByMappingObjects:^id(id obj) {
         return [obj fullIdentifier];
     }] toPasteboard:pboard];
@@ -1134,8 +1344,8 @@ static NSDictionary *makeReactionColumnSpec(NSString *reactionContent) {
 
 - (void)tableViewDoubleClicked:(id)sender {
     NSInteger row = [_table clickedRow];
-    if (row != NSNotFound && row < [_items count]) {
-        Issue *item = _items[row];
+    Issue *item = row != NSNotFound ? [self itemAtRow:row] : nil;
+    if (item) {
         [[IssueDocumentController sharedDocumentController] openIssueWithIdentifier:item.fullIdentifier];
     }
 }
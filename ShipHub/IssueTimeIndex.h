@@ -0,0 +1,54 @@
+//
+//  IssueTimeIndex.h
+//  ShipHub
+//
+//  Created by James Howard on 3/7/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class LocalIssue;
+@class MetadataStore;
+
+/*
+ IssueTimeIndex is an immutable, columnar snapshot of a set of issues for computing time series.
+
+ createdAt and closedAt are stored as sorted arrays of NSTimeIntervals, so the number of issues
+ in any interval is found by binary search rather than by filtering every issue. Related objects
+ (repository, milestone, author, closer, assignee and labels) are dictionary encoded into integer
+ columns, so an index can be partitioned by any of them without building Issue objects.
+
+ IssueTimeIndex is thread safe once created.
+*/
+
+@interface IssueTimeIndex : NSObject
+
+// Must be called on the queue of the context that owns issues.
+- (instancetype)initWithLocalIssues:(NSArray<LocalIssue *> *)issues metadataStore:(MetadataStore *)ms;
+
+@property (readonly) NSUInteger count;
+
+// Returns the number of issues selected for the interval [start, end], with the same semantics as an interval of a TimeSeries:
+//
+// open is one of @YES, @NO, or nil:
+//  YES - issues created by end which were open at some point in the interval
+//   NO - issues created by end which, if closed, were closed by end
+//  nil - issues created by end
+- (NSUInteger)countForIntervalFromStart:(NSTimeInterval)start toEnd:(NSTimeInterval)end open:(NSNumber *)open;
+
+// Returns a new index containing only the rows passing test. closedAt is NAN for issues that have never been closed.
+- (IssueTimeIndex *)indexOfIssuesPassingTest:(BOOL (^)(NSTimeInterval createdAt, NSTimeInterval closedAt))test;
+
+// keyPath is relative to Issue and must begin with one of the indexed relationships:
+// repository, milestone, originator, closedBy, assignee or labels (e.g. @"milestone.title").
+
+// Returns the set of distinct values of keyPath in the index, with NSNull standing in for nil.
+// For labels, each label contributes its own value. Returns nil if keyPath is not indexed.
+- (NSSet *)valuesForKeyPath:(NSString *)keyPath;
+
+// Returns a new index with the issues where keyPath equals value (or is nil, if value is nil or NSNull).
+// For labels, an issue matches if any of its labels match. Returns nil if keyPath is not indexed.
+- (IssueTimeIndex *)indexOfIssuesWhereKeyPath:(NSString *)keyPath equals:(id)value;
+
+@end
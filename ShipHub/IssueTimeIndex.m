@@ -0,0 +1,424 @@
+//
+//  IssueTimeIndex.m
+//  ShipHub
+//
+//  Created by James Howard on 3/7/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "IssueTimeIndex.h"
+
+#import "Account.h"
+#import "Extras.h"
+#import "MetadataStore.h"
+
+#import "LocalAccount.h"
+#import "LocalIssue.h"
+#import "LocalLabel.h"
+
+typedef NS_ENUM(NSInteger, IssueTimeIndexColumn) {
+    IssueTimeIndexColumnRepository = 0,
+    IssueTimeIndexColumnMilestone,
+    IssueTimeIndexColumnOriginator,
+    IssueTimeIndexColumnClosedBy,
+    IssueTimeIndexColumnAssignee,
+    IssueTimeIndexColumnCount,
+
+    // labels are multi-valued and are stored separately from the other columns
+    IssueTimeIndexColumnLabels = IssueTimeIndexColumnCount
+};
+
+// Returns the number of elements of the ascending array a that are <= x
+static NSUInteger CountLessThanOrEqual(const double *a, NSUInteger n, double x) {
+    NSUInteger lo = 0, hi = n;
+    while (lo < hi) {
+        NSUInteger mid = lo + (hi - lo) / 2;
+        if (a[mid] <= x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Returns the number of elements of the ascending array a that are < x
+static NSUInteger CountLessThan(const double *a, NSUInteger n, double x) {
+    NSUInteger lo = 0, hi = n;
+    while (lo < hi) {
+        NSUInteger mid = lo + (hi - lo) / 2;
+        if (a[mid] < x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Returns the code for the metadata object corresponding to mo, adding it to values if needed. 0 is nil.
+static uint32_t EncodeObject(NSManagedObject *mo, MetadataStore *ms, NSMutableDictionary *codes, NSMutableArray *values) {
+    if (!mo) return 0;
+
+    NSManagedObjectID *objectID = mo.objectID;
+    NSNumber *code = codes[objectID];
+    if (!code) {
+        id obj = [ms objectWithManagedObject:mo];
+        if (obj) {
+            code = @(values.count);
+            [values addObject:obj];
+        } else {
+            code = @0;
+        }
+        codes[objectID] = code;
+    }
+    return [code unsignedIntValue];
+}
+
+static id ValueForCode(NSArray *values, uint32_t code, NSString *subpath) {
+    if (code == 0) return nil;
+    id obj = values[code];
+    return subpath ? [obj valueForKeyPath:subpath] : obj;
+}
+
+static BOOL ParseKeyPath(NSString *keyPath, IssueTimeIndexColumn *outColumn, NSString *__autoreleasing *outSubpath) {
+    static NSDictionary *columns;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        columns = @{ @"repository" : @(IssueTimeIndexColumnRepository),
+                     @"milestone" : @(IssueTimeIndexColumnMilestone),
+                     @"originator" : @(IssueTimeIndexColumnOriginator),
+                     @"closedBy" : @(IssueTimeIndexColumnClosedBy),
+                     @"assignee" : @(IssueTimeIndexColumnAssignee),
+                     @"labels" : @(IssueTimeIndexColumnLabels) };
+    });
+
+    NSRange dot = [keyPath rangeOfString:@"."];
+    NSString *head = dot.location == NSNotFound ? keyPath : [keyPath substringToIndex:dot.location];
+    NSNumber *column = columns[head];
+    if (!column) {
+        return NO;
+    }
+
+    *outColumn = [column integerValue];
+    *outSubpath = dot.location == NSNotFound ? nil : [keyPath substringFromIndex:NSMaxRange(dot)];
+    return YES;
+}
+
+@implementation IssueTimeIndex {
+    NSUInteger _count;
+
+    // Per issue columns. Rows are in ascending createdAt order.
+    double *_createdAt;
+    double *_closedAt; // NAN if never closed
+    uint32_t *_columns[IssueTimeIndexColumnCount];
+    uint32_t *_labelOffsets; // labels for row i are _labels[_labelOffsets[i], _labelOffsets[i+1])
+    uint32_t *_labels;
+
+    // Decoded metadata objects for each column (including labels). Index 0 is NSNull.
+    NSArray<NSArray *> *_columnValues;
+
+    // Derived from the columns above for counting intervals
+    double *_closedAtSorted; // ascending closedAt of issues closed on or after they were created
+    NSUInteger _closedCount;
+    double *_openCreatedAt; // ascending createdAt of issues that have never been closed
+    NSUInteger _openCount;
+    uint32_t *_misorderedRows; // rows of issues closed before they were created, which are counted individually
+    NSUInteger _misorderedCount;
+}
+
+- (void)allocateRows:(NSUInteger)count {
+    _count = count;
+    size_t n = MAX(count, 1);
+    _createdAt = malloc(sizeof(double) * n);
+    _closedAt = malloc(sizeof(double) * n);
+    for (NSInteger c = 0; c < IssueTimeIndexColumnCount; c++) {
+        _columns[c] = malloc(sizeof(uint32_t) * n);
+    }
+    _labelOffsets = malloc(sizeof(uint32_t) * (n + 1));
+}
+
+- (void)buildDerivedColumns {
+    size_t n = MAX(_count, 1);
+    _closedAtSorted = malloc(sizeof(double) * n);
+    _openCreatedAt = malloc(sizeof(double) * n);
+    _misorderedRows = malloc(sizeof(uint32_t) * n);
+
+    for (NSUInteger row = 0; row < _count; row++) {
+        double closedAt = _closedAt[row];
+        if (isnan(closedAt)) {
+            _openCreatedAt[_openCount++] = _createdAt[row];
+        } else if (closedAt >= _createdAt[row]) {
+            _closedAtSorted[_closedCount++] = closedAt;
+        } else {
+            _misorderedRows[_misorderedCount++] = (uint32_t)row;
+        }
+    }
+
+    qsort(_closedAtSorted, _closedCount, sizeof(double), CompareDoubles);
+}
+
+- (instancetype)initWithLocalIssues:(NSArray<LocalIssue *> *)issues metadataStore:(MetadataStore *)ms {
+    if (self = [super init]) {
+        // Issues without a createdAt are treated as created at the reference date, as in TimeSeries.
+        NSArray<LocalIssue *> *sorted = [issues sortedArrayWithOptions:NSSortStable usingComparator:^NSComparisonResult(LocalIssue *a, LocalIssue *b) {
+            NSTimeInterval ta = a.createdAt.timeIntervalSinceReferenceDate;
+            NSTimeInterval tb = b.createdAt.timeIntervalSinceReferenceDate;
+            return ta < tb ? NSOrderedAscending : (ta > tb ? NSOrderedDescending : NSOrderedSame);
+        }];
+
+        NSUInteger count = sorted.count;
+        [self allocateRows:count];
+
+        NSMutableArray<NSMutableArray *> *values = [NSMutableArray new];
+        NSMutableArray<NSMutableDictionary *> *codes = [NSMutableArray new];
+        for (NSInteger c = 0; c <= IssueTimeIndexColumnLabels; c++) {
+            [values addObject:[NSMutableArray arrayWithObject:[NSNull null]]];
+            [codes addObject:[NSMutableDictionary new]];
+        }
+
+        NSMutableArray<Account *> *assigneeValues = values[IssueTimeIndexColumnAssignee];
+
+        size_t labelsCapacity = MAX(count, 1);
+        size_t labelsLength = 0;
+        _labels = malloc(sizeof(uint32_t) * labelsCapacity);
+
+        NSUInteger row = 0;
+        for (LocalIssue *li in sorted) {
+            _createdAt[row] = li.createdAt.timeIntervalSinceReferenceDate;
+            NSDate *closedAt = li.closedAt;
+            _closedAt[row] = closedAt ? closedAt.timeIntervalSinceReferenceDate : NAN;
+
+            _columns[IssueTimeIndexColumnRepository][row] = EncodeObject(li.repository, ms, codes[IssueTimeIndexColumnRepository], values[IssueTimeIndexColumnRepository]);
+            _columns[IssueTimeIndexColumnMilestone][row] = EncodeObject(li.milestone, ms, codes[IssueTimeIndexColumnMilestone], values[IssueTimeIndexColumnMilestone]);
+            _columns[IssueTimeIndexColumnOriginator][row] = EncodeObject(li.originator, ms, codes[IssueTimeIndexColumnOriginator], values[IssueTimeIndexColumnOriginator]);
+            _columns[IssueTimeIndexColumnClosedBy][row] = EncodeObject(li.closedBy, ms, codes[IssueTimeIndexColumnClosedBy], values[IssueTimeIndexColumnClosedBy]);
+
+            // Issue.assignee is the first of the assignees ordered by login
+            uint32_t assignee = 0;
+            for (LocalAccount *la in li.assignees) {
+                uint32_t code = EncodeObject(la, ms, codes[IssueTimeIndexColumnAssignee], assigneeValues);
+                if (code != 0 && (assignee == 0 || [assigneeValues[code].login localizedStandardCompare:assigneeValues[assignee].login] == NSOrderedAscending)) {
+                    assignee = code;
+                }
+            }
+            _columns[IssueTimeIndexColumnAssignee][row] = assignee;
+
+            _labelOffsets[row] = (uint32_t)labelsLength;
+            for (LocalLabel *ll in li.labels) {
+                uint32_t code = EncodeObject(ll, ms, codes[IssueTimeIndexColumnLabels], values[IssueTimeIndexColumnLabels]);
+                if (code == 0) continue;
+                if (labelsLength == labelsCapacity) {
+                    labelsCapacity *= 2;
+                    _labels = reallocf(_labels, sizeof(uint32_t) * labelsCapacity);
+                }
+                _labels[labelsLength++] = code;
+            }
+
+            row++;
+        }
+        _labelOffsets[count] = (uint32_t)labelsLength;
+
+        _columnValues = [values arrayByMappingObjects:^id(id obj) {
+            return [obj copy];
+        }];
+
+        [self buildDerivedColumns];
+    }
+    return self;
+}
+
+// rows must be ascending
+- (instancetype)initWithIndex:(IssueTimeIndex *)index rows:(const uint32_t *)rows count:(NSUInteger)count {
+    if (self = [super init]) {
+        [self allocateRows:count];
+        _columnValues = index->_columnValues;
+
+        size_t labelsLength = 0;
+        for (NSUInteger i = 0; i < count; i++) {
+            labelsLength += index->_labelOffsets[rows[i]+1] - index->_labelOffsets[rows[i]];
+        }
+        _labels = malloc(sizeof(uint32_t) * MAX(labelsLength, 1));
+
+        labelsLength = 0;
+        for (NSUInteger i = 0; i < count; i++) {
+            uint32_t row = rows[i];
+            _createdAt[i] = index->_createdAt[row];
+            _closedAt[i] = index->_closedAt[row];
+            for (NSInteger c = 0; c < IssueTimeIndexColumnCount; c++) {
+                _columns[c][i] = index->_columns[c][row];
+            }
+
+            uint32_t lo = index->_labelOffsets[row];
+            uint32_t hi = index->_labelOffsets[row+1];
+            _labelOffsets[i] = (uint32_t)labelsLength;
+            memcpy(_labels + labelsLength, index->_labels + lo, sizeof(uint32_t) * (hi - lo));
+            labelsLength += hi - lo;
+        }
+        _labelOffsets[count] = (uint32_t)labelsLength;
+
+        [self buildDerivedColumns];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_createdAt);
+    free(_closedAt);
+    for (NSInteger c = 0; c < IssueTimeIndexColumnCount; c++) {
+        free(_columns[c]);
+    }
+    free(_labelOffsets);
+    free(_labels);
+    free(_closedAtSorted);
+    free(_openCreatedAt);
+    free(_misorderedRows);
+}
+
+- (NSUInteger)count {
+    return _count;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> count: %tu closed: %tu open: %tu", NSStringFromClass([self class]), self, _count, _closedCount, _openCount];
+}
+
+#pragma mark - Counting
+
+- (NSUInteger)countForIntervalFromStart:(NSTimeInterval)start toEnd:(NSTimeInterval)end open:(NSNumber *)open {
+    NSUInteger created = CountLessThanOrEqual(_createdAt, _count, end);
+
+    if (open == nil) {
+        return created;
+    }
+
+    if ([open boolValue]) {
+        if (start > end) {
+            // The identity below relies on start <= end
+            NSUInteger n = 0;
+            for (NSUInteger row = 0; row < _count; row++) {
+                double closedAt = _closedAt[row];
+                if (_createdAt[row] <= end && (isnan(closedAt) || closedAt >= start)) n++;
+            }
+            return n;
+        }
+
+        // Everything closed before start was also created before end, so subtract those from created.
+        NSUInteger closedBeforeStart = CountLessThan(_closedAtSorted, _closedCount, start);
+        for (NSUInteger i = 0; i < _misorderedCount; i++) {
+            uint32_t row = _misorderedRows[i];
+            if (_createdAt[row] <= end && _closedAt[row] < start) closedBeforeStart++;
+        }
+        return created - closedBeforeStart;
+    } else {
+        // Open issues created by end, plus closed issues closed (and so also created) by end.
+        NSUInteger n = CountLessThanOrEqual(_openCreatedAt, _openCount, end) + CountLessThanOrEqual(_closedAtSorted, _closedCount, end);
+        for (NSUInteger i = 0; i < _misorderedCount; i++) {
+            uint32_t row = _misorderedRows[i];
+            if (_createdAt[row] <= end && _closedAt[row] <= end) n++;
+        }
+        return n;
+    }
+}
+
+#pragma mark - Filtering
+
+- (IssueTimeIndex *)indexOfRowsPassingTest:(BOOL (^)(NSUInteger row))test {
+    uint32_t *rows = malloc(sizeof(uint32_t) * MAX(_count, 1));
+    NSUInteger count = 0;
+    for (NSUInteger row = 0; row < _count; row++) {
+        if (test(row)) {
+            rows[count++] = (uint32_t)row;
+        }
+    }
+    IssueTimeIndex *index = [[IssueTimeIndex alloc] initWithIndex:self rows:rows count:count];
+    free(rows);
+    return index;
+}
+
+- (IssueTimeIndex *)indexOfIssuesPassingTest:(BOOL (^)(NSTimeInterval createdAt, NSTimeInterval closedAt))test {
+    const double *createdAt = _createdAt;
+    const double *closedAt = _closedAt;
+    return [self indexOfRowsPassingTest:^BOOL(NSUInteger row) {
+        return test(createdAt[row], closedAt[row]);
+    }];
+}
+
+- (NSSet *)valuesForKeyPath:(NSString *)keyPath {
+    IssueTimeIndexColumn column;
+    NSString *subpath = nil;
+    if (!ParseKeyPath(keyPath, &column, &subpath)) {
+        return nil;
+    }
+
+    NSArray *values = _columnValues[column];
+    BOOL *used = calloc(values.count, sizeof(BOOL));
+
+    if (column == IssueTimeIndexColumnLabels) {
+        for (NSUInteger row = 0; row < _count; row++) {
+            uint32_t lo = _labelOffsets[row], hi = _labelOffsets[row+1];
+            if (lo == hi) used[0] = YES;
+            for (uint32_t i = lo; i < hi; i++) {
+                used[_labels[i]] = YES;
+            }
+        }
+    } else {
+        const uint32_t *codes = _columns[column];
+        for (NSUInteger row = 0; row < _count; row++) {
+            used[codes[row]] = YES;
+        }
+    }
+
+    NSMutableSet *result = [NSMutableSet new];
+    for (uint32_t code = 0; code < values.count; code++) {
+        if (used[code]) {
+            [result addObject:ValueForCode(values, code, subpath) ?: [NSNull null]];
+        }
+    }
+
+    free(used);
+    return result;
+}
+
+- (IssueTimeIndex *)indexOfIssuesWhereKeyPath:(NSString *)keyPath equals:(id)value {
+    IssueTimeIndexColumn column;
+    NSString *subpath = nil;
+    if (!ParseKeyPath(keyPath, &column, &subpath)) {
+        return nil;
+    }
+
+    if (value == [NSNull null]) {
+        value = nil;
+    }
+
+    // Decide once per distinct value rather than once per issue
+    NSArray *values = _columnValues[column];
+    BOOL *matches = calloc(values.count, sizeof(BOOL));
+    for (uint32_t code = 0; code < values.count; code++) {
+        id v = ValueForCode(values, code, subpath);
+        matches[code] = value ? [value isEqual:v] : v == nil;
+    }
+
+    IssueTimeIndex *result;
+    if (column == IssueTimeIndexColumnLabels) {
+        const uint32_t *offsets = _labelOffsets;
+        const uint32_t *labels = _labels;
+        result = [self indexOfRowsPassingTest:^BOOL(NSUInteger row) {
+            uint32_t lo = offsets[row], hi = offsets[row+1];
+            if (lo == hi) return matches[0];
+            for (uint32_t i = lo; i < hi; i++) {
+                if (matches[labels[i]]) return YES;
+            }
+            return NO;
+        }];
+    } else {
+        const uint32_t *codes = _columns[column];
+        result = [self indexOfRowsPassingTest:^BOOL(NSUInteger row) {
+            return matches[codes[row]];
+        }];
+    }
+
+    free(matches);
+    return result;
+}
+
+@end
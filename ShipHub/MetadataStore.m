@@ -6,7 +6,7 @@
 //  Copyright © 2016 Real Artists, Inc. All rights reserved.
 //
 
-#import "MetadataStore.h"
+#import "MetadataStoreInternal.h"
 
 #import "DataStoreInternal.h"
 #import "Extras.h"
@@ -20,11 +20,77 @@
 #import "LocalProject.h"
 #import "LocalBilling.h"
 
+// The parts of a snapshot read out of a single LocalRepo and its milestones, labels and projects.
+// Immutable once built, so unchanged entries are shared between successive snapshots.
+@interface MetadataRepoEntry : NSObject
+
+@property (strong) Repo *repo;
+@property (strong) Account *owner;
+@property (strong) NSArray<Account *> *assignees;
+@property (strong) NSArray<Milestone *> *milestones; // sorted by title
+@property (strong) NSArray<Label *> *labels;
+@property (strong) NSArray<Project *> *projects;
+@property (assign) BOOL listedUnderOwner;
+
+@property (strong) NSSet<NSNumber *> *accountIDs; // owner and assignees, whose Account objects this entry holds
+@property (strong) NSDictionary *managedIDToObject;
+
+@end
+
+@implementation MetadataRepoEntry
+@end
+
+// The parts of a snapshot read out of a single LocalAccount (and its projects, if it is an org).
+@interface MetadataAccountEntry : NSObject
+
+@property (strong) Account *account;
+@property (strong) NSArray<Project *> *projects; // nil if not an org
+@property (strong) id<NSCopying> managedID;
+
+@end
+
+@implementation MetadataAccountEntry
+@end
+
+@implementation MetadataChangeSet
+
+- (id)init {
+    if (self = [super init]) {
+        _repoIDs = [NSMutableSet new];
+        _accountIDs = [NSMutableSet new];
+    }
+    return self;
+}
+
+- (BOOL)isEmpty {
+    return !_rebuildAll && _repoIDs.count == 0 && _accountIDs.count == 0;
+}
+
+- (void)unionChangeSet:(MetadataChangeSet *)other {
+    [_repoIDs unionSet:other.repoIDs];
+    [_accountIDs unionSet:other.accountIDs];
+    _rebuildAll = _rebuildAll || other.rebuildAll;
+    _containsInsertions = _containsInsertions || other.containsInsertions;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> repos: %@ accounts: %@%@", NSStringFromClass([self class]), self, _repoIDs, _accountIDs, _rebuildAll ? @" (rebuild all)" : @""];
+}
+
+@end
+
 @interface MetadataStore () {
     BOOL _allAssigneesNeedsSort;
     NSMutableArray *_allAssignees;
 }
 
+@property (assign) BillingState billingState;
+@property (strong) NSNumber *currentUserIdentifier;
+
+@property (strong) NSDictionary<NSNumber *, MetadataRepoEntry *> *repoEntries;
+@property (strong) NSDictionary<NSNumber *, MetadataAccountEntry *> *accountEntries;
+@property (strong) NSDictionary<NSNumber *, NSSet<NSNumber *> *> *accountIDToRepoIDs;
+
 @property (strong) NSDictionary *accountsByID;
 
 @property (strong) NSDictionary *assigneesByRepoID;
@@ -101,6 +167,69 @@ static BOOL IsImportantUserChange(LocalAccount *lu) {
     return result;
 }
 
+// Returns the value of key on obj, or what it was before obj was deleted.
+static id RelatedObject(NSManagedObject *obj, NSString *key) {
+    id related = [obj valueForKey:key];
+    if (!related && obj.isDeleted) {
+        related = [obj committedValuesForKeys:@[key]][key];
+        if (related == [NSNull null]) related = nil;
+    }
+    return related;
+}
+
++ (MetadataChangeSet *)changeSetWithNotification:(NSNotification *)mocNote {
+    MetadataChangeSet *changes = [MetadataChangeSet new];
+    
+    [mocNote enumerateModifiedObjects:^(id obj, CoreDataModificationType modType, BOOL *stop) {
+        if (!IsMetadataObject(obj)) return;
+        
+        if (modType == CoreDataModificationTypeInserted) {
+            changes.containsInsertions = YES;
+        }
+        
+        NSNumber *repoID = nil;
+        NSNumber *accountID = nil;
+        BOOL known = YES;
+        
+        if ([obj isKindOfClass:[LocalRepo class]]) {
+            repoID = [obj identifier];
+            known = repoID != nil;
+        } else if ([obj isKindOfClass:[LocalAccount class]]) {
+            if (modType == CoreDataModificationTypeUpdated && !IsImportantUserChange(obj)) {
+                return;
+            }
+            accountID = [obj identifier];
+            known = accountID != nil;
+        } else if ([obj isKindOfClass:[LocalMilestone class]]) {
+            repoID = [RelatedObject(obj, @"repository") identifier];
+            known = repoID != nil;
+        } else if ([obj isKindOfClass:[LocalLabel class]]) {
+            repoID = [RelatedObject(obj, @"repo") identifier];
+            known = repoID != nil;
+        } else if ([obj isKindOfClass:[LocalProject class]]) {
+            repoID = [RelatedObject(obj, @"repository") identifier];
+            accountID = [RelatedObject(obj, @"organization") identifier];
+            known = repoID != nil || accountID != nil;
+        } else if ([obj isKindOfClass:[LocalHidden class]]) {
+            LocalRepo *repo = RelatedObject(obj, @"repository") ?: RelatedObject(RelatedObject(obj, @"milestone"), @"repository");
+            repoID = repo.identifier;
+            known = repoID != nil;
+        } else {
+            // Billing changes the restrictions on every repo.
+            known = NO;
+        }
+        
+        if (repoID) [changes.repoIDs addObject:repoID];
+        if (accountID) [changes.accountIDs addObject:accountID];
+        if (!known) {
+            changes.rebuildAll = YES;
+            *stop = YES;
+        }
+    }];
+    
+    return changes.empty ? nil : changes;
+}
+
 static id<NSCopying> UniqueIDForManagedObject(NSManagedObject *obj) {
     static BOOL hasPersistentStoreConnectionPool;
     static dispatch_once_t onceToken;
@@ -121,6 +250,113 @@ static id<NSCopying> UniqueIDForManagedObject(NSManagedObject *obj) {
     }
 }
 
+static NSPredicate *ReposPredicate() {
+    return [NSPredicate predicateWithFormat:@"name != nil AND owner.login != nil AND disabled = NO"];
+}
+
+static MetadataAccountEntry *AccountEntry(LocalAccount *la) {
+    MetadataAccountEntry *entry = [MetadataAccountEntry new];
+    entry.account = [[Account alloc] initWithLocalItem:la];
+    //DebugLog(@"Discover account with pk %@, uid %@, for identifier %@ for login %@", [la objectID], UniqueIDForManagedObject(la), [la identifier], [la login]);
+    entry.managedID = UniqueIDForManagedObject(la);
+    
+    if ([la.type isEqualToString:@"Organization"]) {
+        NSMutableArray *projects = [NSMutableArray new];
+        for (LocalProject *lp in la.projects) {
+            if (lp.name && lp.number) {
+                Project *p = [[Project alloc] initWithLocalItem:lp owningOrg:entry.account];
+                [projects addObject:p];
+            }
+        }
+        entry.projects = projects;
+    }
+    
+    return entry;
+}
+
+static MetadataRepoEntry *RepoEntry(LocalRepo *r, NSDictionary *accountsByID, BillingState billingState, NSNumber *currentUserIdentifier) {
+    MetadataRepoEntry *entry = [MetadataRepoEntry new];
+    
+    NSMutableDictionary *managedIDToObject = [NSMutableDictionary new];
+    void (^noteManagedObject)(NSManagedObject *, id) = ^(NSManagedObject *mObj, id obj){
+        managedIDToObject[UniqueIDForManagedObject(mObj)] = obj;
+    };
+    
+    NSMutableSet *accountIDs = [NSMutableSet new];
+    
+    BOOL currentUserAssignable = NO;
+    NSMutableArray *assignees = [NSMutableArray new];
+    for (LocalAccount *lu in r.assignees) {
+        if (lu.login) {
+            Account *u = accountsByID[lu.identifier];
+            if (u) {
+                [assignees addObject:u];
+                [accountIDs addObject:lu.identifier];
+            }
+        }
+        if (!currentUserAssignable && [lu.identifier isEqual:currentUserIdentifier]) {
+            currentUserAssignable = YES;
+        }
+    }
+    entry.assignees = assignees;
+    
+    NSMutableArray *milestones = [NSMutableArray new];
+    for (LocalMilestone *lm in r.milestones) {
+        if (lm.title) {
+            Milestone *m = [[Milestone alloc] initWithLocalItem:lm];
+            noteManagedObject(lm, m);
+            [milestones addObject:m];
+        }
+    }
+    [milestones sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"title" ascending:YES selector:@selector(localizedStandardCompare:)]]];
+    entry.milestones = milestones;
+    
+    NSMutableArray *labels = [NSMutableArray new];
+    for (LocalLabel *ll in r.labels) {
+        if (ll.name && ll.color) {
+            Label *l = [[Label alloc] initWithLocalItem:ll];
+            noteManagedObject(ll, l);
+            [labels addObject:l];
+        }
+    }
+    entry.labels = labels;
+    
+    LocalAccount *localOwner = r.owner;
+    Account *owner = accountsByID[localOwner.identifier];
+    if (owner) {
+        [accountIDs addObject:localOwner.identifier];
+    }
+    entry.owner = owner;
+    
+    Repo *repo = [[Repo alloc] initWithLocalItem:r owner:owner billingState:billingState canPush:currentUserAssignable];
+    noteManagedObject(r, repo);
+    entry.repo = repo;
+    
+    NSMutableArray *projects = [NSMutableArray new];
+    for (LocalProject *lp in r.projects) {
+        if (lp.name && lp.number) {
+            Project *p = [[Project alloc] initWithLocalItem:lp owningRepo:repo];
+            noteManagedObject(lp, p);
+            [projects addObject:p];
+        }
+    }
+    entry.projects = projects;
+    
+    entry.listedUnderOwner = !r.hidden && owner;
+    entry.accountIDs = accountIDs;
+    entry.managedIDToObject = managedIDToObject;
+    
+    return entry;
+}
+
+static NSDictionary *AccountsByID(NSDictionary<NSNumber *, MetadataAccountEntry *> *accountEntries) {
+    NSMutableDictionary *accountsByID = [NSMutableDictionary dictionaryWithCapacity:accountEntries.count];
+    [accountEntries enumerateKeysAndObjectsUsingBlock:^(NSNumber *identifier, MetadataAccountEntry *entry, BOOL *stop) {
+        accountsByID[identifier] = entry.account;
+    }];
+    return accountsByID;
+}
+
 // Read data out of ctx and store in immutable data objects accessible from any thread.
 - (instancetype)initWithMOC:(NSManagedObjectContext *)moc billingState:(BillingState)billingState currentUserIdentifier:(NSNumber *)currentUserIdentifier
 {
@@ -128,190 +364,217 @@ static id<NSCopying> UniqueIDForManagedObject(NSManagedObject *obj) {
     NSParameterAssert(currentUserIdentifier);
     
     if (self = [super init]) {
-        NSMutableDictionary *managedIDToObject = [NSMutableDictionary new];
-        void (^noteManagedObject)(NSManagedObject *, id) = ^(NSManagedObject *mObj, id obj){
-            managedIDToObject[UniqueIDForManagedObject(mObj)] = obj;
-        };
+        _billingState = billingState;
+        _currentUserIdentifier = currentUserIdentifier;
         
         NSFetchRequest *reposFetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalRepo"];
-        reposFetch.predicate = [NSPredicate predicateWithFormat:@"name != nil AND owner.login != nil AND disabled = NO"];
+        reposFetch.predicate = ReposPredicate();
         
         NSArray *localRepos = [moc executeFetchRequest:reposFetch error:NULL];
         
         NSFetchRequest *accountsFetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalAccount"];
         NSArray *localAccounts = [moc executeFetchRequest:accountsFetch error:NULL];
         
-        NSMutableArray *repos = [NSMutableArray arrayWithCapacity:localRepos.count];
-        
-        NSDictionary *accountsByID = [NSDictionary lookupWithObjects:[localAccounts arrayByMappingObjects:^id(id obj) {
-            Account *u = [[Account alloc] initWithLocalItem:obj];
-            //DebugLog(@"Discover account with pk %@, uid %@, for identifier %@ for login %@", [obj objectID], UniqueIDForManagedObject(obj), [obj identifier], [obj login]);
-            noteManagedObject(obj, u);
-            return u;
-        }] keyPath:@"identifier"];
-        
-        NSMutableDictionary *assigneesByRepoID = [NSMutableDictionary new];
-        NSMutableDictionary *milestonesByRepoID = [NSMutableDictionary new];
-        NSMutableDictionary *projectsByRepoID = [NSMutableDictionary new];
-        NSMutableDictionary *labelsByRepoID = [NSMutableDictionary new];
-        NSMutableSet *allAssignees = [NSMutableSet new];
-        
-        NSMutableSet *repoOwners = [NSMutableSet new];
-        NSMutableDictionary *reposByOwnerID = [NSMutableDictionary new];
-        
-        for (LocalRepo *r in localRepos) {
-            BOOL currentUserAssignable = NO;
-            NSMutableArray *assignees;
-            assigneesByRepoID[r.identifier] = assignees = [NSMutableArray new];
-            for (LocalAccount *lu in r.assignees) {
-                if (lu.login) {
-                    Account *u = accountsByID[lu.identifier];
-                    [assignees addObject:u];
-                    [allAssignees addObject:u];
-                }
-                if (!currentUserAssignable && [lu.identifier isEqual:currentUserIdentifier]) {
-                    currentUserAssignable = YES;
-                }
-            }
-            
-            NSMutableArray *milestones;
-            milestonesByRepoID[r.identifier] = milestones = [NSMutableArray new];
-            
-            for (LocalMilestone *lm in r.milestones) {
-                if (lm.title) {
-                    Milestone *m = [[Milestone alloc] initWithLocalItem:lm];
-                    noteManagedObject(lm, m);
-                    [milestones addObject:m];
-                }
-            }
-            
-            NSMutableArray *labels;
-            labelsByRepoID[r.identifier] = labels = [NSMutableArray new];
-            
-            for (LocalLabel *ll in r.labels) {
-                if (ll.name && ll.color) {
-                    Label *l = [[Label alloc] initWithLocalItem:ll];
-                    noteManagedObject(ll, l);
-                    [labels addObject:l];
-                }
-            }
-            
-            LocalAccount *localOwner = r.owner;
-            
-            Account *owner = accountsByID[localOwner.identifier];
-            
-            Repo *repo = [[Repo alloc] initWithLocalItem:r owner:owner billingState:billingState canPush:currentUserAssignable];
-            noteManagedObject(r, repo);
-            [repos addObject:repo];
-            
-            NSMutableArray *projects;
-            projectsByRepoID[r.identifier] = projects = [NSMutableArray new];
-            for (LocalProject *lp in r.projects) {
-                if (lp.name && lp.number) {
-                    Project *p = [[Project alloc] initWithLocalItem:lp owningRepo:repo];
-                    noteManagedObject(lp, p);
-                    [projects addObject:p];
-                }
-            }
-            
-            if (!r.hidden && owner) {
-                [repoOwners addObject:owner];
-                
-                NSMutableArray *ownersList = reposByOwnerID[localOwner.identifier];
-                if (!ownersList) {
-                    reposByOwnerID[localOwner.identifier] = ownersList = [NSMutableArray new];
-                }
-                [ownersList addObject:repo];
+        NSMutableDictionary *accountEntries = [NSMutableDictionary dictionaryWithCapacity:localAccounts.count];
+        for (LocalAccount *la in localAccounts) {
+            if (la.identifier) {
+                accountEntries[la.identifier] = AccountEntry(la);
             }
         }
+        NSDictionary *accountsByID = AccountsByID(accountEntries);
         
-        NSMutableDictionary *orgIDToProjects = [NSMutableDictionary new];
-        for (LocalAccount *lo in localAccounts) {
-            if ([lo.type isEqualToString:@"Organization"]) {
-                NSMutableArray *projects = [NSMutableArray new];
-                for (LocalProject *lp in lo.projects) {
-                    if (lp.name && lp.number) {
-                        Project *p = [[Project alloc] initWithLocalItem:lp owningOrg:accountsByID[lo.identifier]];
-                        [projects addObject:p];
-                    }
-                }
-                orgIDToProjects[lo.identifier] = projects;
+        NSMutableDictionary *repoEntries = [NSMutableDictionary dictionaryWithCapacity:localRepos.count];
+        for (LocalRepo *r in localRepos) {
+            if (r.identifier) {
+                repoEntries[r.identifier] = RepoEntry(r, accountsByID, billingState, currentUserIdentifier);
             }
         }
-        _orgIDToProjects = orgIDToProjects;
-        
-        _accountsByID = accountsByID;
         
-        _assigneesByRepoID = assigneesByRepoID;
-        
-        _repoOwners = [[repoOwners allObjects] sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"login" ascending:YES selector:@selector(localizedStandardCompare:)]]];
-        
-        _reposByOwnerID = reposByOwnerID;
-        for (id ownerID in _reposByOwnerID) {
-            NSMutableArray *r = _reposByOwnerID[ownerID];
-            [r sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES selector:@selector(localizedStandardCompare:)]]];
+        [self indexRepoEntries:repoEntries accountEntries:accountEntries accountsByID:accountsByID];
+    }
+    
+    return self;
+}
+
+- (instancetype)storeByApplyingChangeSet:(MetadataChangeSet *)changes moc:(NSManagedObjectContext *)moc billingState:(BillingState)billingState currentUserIdentifier:(NSNumber *)currentUserIdentifier
+{
+    NSParameterAssert(moc);
+    NSParameterAssert(currentUserIdentifier);
+    
+    if (changes.rebuildAll || billingState != _billingState || ![currentUserIdentifier isEqual:_currentUserIdentifier]) {
+        return [[[self class] alloc] initWithMOC:moc billingState:billingState currentUserIdentifier:currentUserIdentifier];
+    }
+    
+    MetadataStore *store = [[[self class] alloc] init];
+    store.billingState = billingState;
+    store.currentUserIdentifier = currentUserIdentifier;
+    
+    // Re-read the changed accounts. Accounts that no longer exist drop out.
+    NSMutableDictionary *accountEntries = [_accountEntries mutableCopy];
+    [accountEntries removeObjectsForKeys:[changes.accountIDs allObjects]];
+    if (changes.accountIDs.count) {
+        NSFetchRequest *accountsFetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalAccount"];
+        accountsFetch.predicate = [NSPredicate predicateWithFormat:@"identifier IN %@", changes.accountIDs];
+        accountsFetch.relationshipKeyPathsForPrefetching = @[@"projects"];
+        for (LocalAccount *la in [moc executeFetchRequest:accountsFetch error:NULL]) {
+            accountEntries[la.identifier] = AccountEntry(la);
         }
+    }
+    NSDictionary *accountsByID = AccountsByID(accountEntries);
+    
+    // Re-read the changed repos, and any that hold on to a changed account.
+    NSMutableSet *repoIDs = [changes.repoIDs mutableCopy];
+    for (NSNumber *accountID in changes.accountIDs) {
+        [repoIDs unionSet:_accountIDToRepoIDs[accountID] ?: [NSSet set]];
+    }
+    
+    NSMutableDictionary *repoEntries = [_repoEntries mutableCopy];
+    [repoEntries removeObjectsForKeys:[repoIDs allObjects]];
+    if (repoIDs.count) {
+        NSFetchRequest *reposFetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalRepo"];
+        reposFetch.predicate = [ReposPredicate() and:[NSPredicate predicateWithFormat:@"identifier IN %@", repoIDs]];
+        reposFetch.relationshipKeyPathsForPrefetching = @[@"assignees", @"milestones", @"labels", @"projects", @"owner", @"hidden"];
+        for (LocalRepo *r in [moc executeFetchRequest:reposFetch error:NULL]) {
+            repoEntries[r.identifier] = RepoEntry(r, accountsByID, billingState, currentUserIdentifier);
+        }
+    }
+    
+    DebugLog(@"Rebuilt %tu of %tu repos and %tu of %tu accounts", repoIDs.count, repoEntries.count, changes.accountIDs.count, accountEntries.count);
+    
+    [store indexRepoEntries:repoEntries accountEntries:accountEntries accountsByID:accountsByID];
+    
+    return store;
+}
+
+// Builds the lookups answered by the public interface from the per-repo and per-account entries.
+// Doesn't touch Core Data.
+- (void)indexRepoEntries:(NSDictionary<NSNumber *, MetadataRepoEntry *> *)repoEntries accountEntries:(NSDictionary<NSNumber *, MetadataAccountEntry *> *)accountEntries accountsByID:(NSDictionary *)accountsByID
+{
+    _repoEntries = [repoEntries copy];
+    _accountEntries = [accountEntries copy];
+    _accountsByID = accountsByID;
+    
+    NSMutableDictionary *managedIDToObject = [NSMutableDictionary new];
+    
+    NSMutableDictionary *orgIDToProjects = [NSMutableDictionary new];
+    [accountEntries enumerateKeysAndObjectsUsingBlock:^(NSNumber *identifier, MetadataAccountEntry *entry, BOOL *stop) {
+        managedIDToObject[entry.managedID] = entry.account;
+        if (entry.projects) {
+            orgIDToProjects[identifier] = entry.projects;
+        }
+    }];
+    _orgIDToProjects = orgIDToProjects;
+    
+    NSMutableArray *repos = [NSMutableArray arrayWithCapacity:repoEntries.count];
+    NSMutableDictionary *assigneesByRepoID = [NSMutableDictionary new];
+    NSMutableDictionary *milestonesByRepoID = [NSMutableDictionary new];
+    NSMutableDictionary *projectsByRepoID = [NSMutableDictionary new];
+    NSMutableDictionary *labelsByRepoID = [NSMutableDictionary new];
+    NSMutableSet *allAssignees = [NSMutableSet new];
+    
+    NSMutableSet *repoOwners = [NSMutableSet new];
+    NSMutableDictionary *reposByOwnerID = [NSMutableDictionary new];
+    NSMutableDictionary *accountIDToRepoIDs = [NSMutableDictionary new];
+    
+    [repoEntries enumerateKeysAndObjectsUsingBlock:^(NSNumber *repoID, MetadataRepoEntry *entry, BOOL *stop) {
+        Repo *repo = entry.repo;
+        [repos addObject:repo];
         
-        NSArray *notHiddenRepos = [repos filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"hidden = NO AND restricted = NO"]];
-        _repos = [notHiddenRepos sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"fullName" ascending:YES selector:@selector(localizedStandardCompare:)]]];
-        
-        _milestonesByRepoID = milestonesByRepoID;
-        
-        _labelsByRepoID = labelsByRepoID;
-        
-        _projectsByRepoID = projectsByRepoID;
-        
-        NSMutableDictionary *mergedLabels = [NSMutableDictionary new];
+        assigneesByRepoID[repoID] = entry.assignees;
+        milestonesByRepoID[repoID] = entry.milestones;
+        labelsByRepoID[repoID] = entry.labels;
+        projectsByRepoID[repoID] = entry.projects;
+        [allAssignees addObjectsFromArray:entry.assignees];
+        [managedIDToObject addEntriesFromDictionary:entry.managedIDToObject];
         
-        for (NSArray *la in [_labelsByRepoID allValues]) {
-            for (Label *l in la) {
-                if (!mergedLabels[l.name]) {
-                    mergedLabels[l.name] = l;
-                }
+        if (entry.listedUnderOwner) {
+            Account *owner = entry.owner;
+            [repoOwners addObject:owner];
+            
+            NSMutableArray *ownersList = reposByOwnerID[owner.identifier];
+            if (!ownersList) {
+                reposByOwnerID[owner.identifier] = ownersList = [NSMutableArray new];
             }
+            [ownersList addObject:repo];
         }
         
-        _mergedLabels = [mergedLabels allValues];
-        
-        _reposByID = [NSDictionary lookupWithObjects:repos keyPath:@"identifier"];
-        
-        NSMutableSet *mergedMilestones = [NSMutableSet new];
-        NSMutableDictionary *milestonesByID = [NSMutableDictionary new];
-        NSMutableArray *hiddenMilestones = [NSMutableArray new];
-        NSMutableDictionary *milestoneTitleToMilestones = [NSMutableDictionary new];
-        for (NSNumber *repoID in _milestonesByRepoID) {
-            NSMutableArray *ma = _milestonesByRepoID[repoID];
-            Repo *repo = _reposByID[repoID];
-            if (repo.hidden || repo.restricted) continue;
-            [ma sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"title" ascending:YES selector:@selector(localizedStandardCompare:)]]];
-            for (Milestone *m in ma) {
-                if (!m.closed && !m.hidden) {
-                    [mergedMilestones addObject:m.title];
-                    NSMutableArray *a = milestoneTitleToMilestones[m.title];
-                    if (!a) milestoneTitleToMilestones[m.title] = a = [NSMutableArray new];
-                    [a addObject:m];
-                } else if (m.hidden) {
-                    [hiddenMilestones addObject:m];
-                }
-                milestonesByID[m.identifier] = m;
+        for (NSNumber *accountID in entry.accountIDs) {
+            NSMutableSet *accountRepos = accountIDToRepoIDs[accountID];
+            if (!accountRepos) {
+                accountIDToRepoIDs[accountID] = accountRepos = [NSMutableSet new];
             }
+            [accountRepos addObject:repoID];
         }
-        
-        _milestonesByID = milestonesByID;
-        
-        _mergedMilestoneNames = [[mergedMilestones allObjects] sortedArrayUsingSelector:@selector(localizedStandardCompare:)];
-        _milestoneTitleToMilestones = milestoneTitleToMilestones;
-                
-        _allAssignees = [[allAssignees allObjects] mutableCopy];
-        _allAssigneesNeedsSort = YES;
-        
-        _hiddenRepos = [[repos filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"hidden = YES"]] sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"fullName" ascending:YES selector:@selector(localizedStandardCompare:)]]];
-        _hiddenMilestones = hiddenMilestones;
-        
-        _managedIDToObject = managedIDToObject;
+    }];
+    
+    _accountIDToRepoIDs = accountIDToRepoIDs;
+    
+    _assigneesByRepoID = assigneesByRepoID;
+    
+    _repoOwners = [[repoOwners allObjects] sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"login" ascending:YES selector:@selector(localizedStandardCompare:)]]];
+    
+    _reposByOwnerID = reposByOwnerID;
+    for (id ownerID in _reposByOwnerID) {
+        NSMutableArray *r = _reposByOwnerID[ownerID];
+        [r sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES selector:@selector(localizedStandardCompare:)]]];
     }
     
-    return self;
+    NSArray *notHiddenRepos = [repos filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"hidden = NO AND restricted = NO"]];
+    _repos = [notHiddenRepos sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"fullName" ascending:YES selector:@selector(localizedStandardCompare:)]]];
+    
+    _milestonesByRepoID = milestonesByRepoID;
+    
+    _labelsByRepoID = labelsByRepoID;
+    
+    _projectsByRepoID = projectsByRepoID;
+    
+    NSMutableDictionary *mergedLabels = [NSMutableDictionary new];
+    
+    for (NSArray *la in [_labelsByRepoID allValues]) {
+        for (Label *l in la) {
+            if (!mergedLabels[l.name]) {
+                mergedLabels[l.name] = l;
+            }
+        }
+    }
+    
+    _mergedLabels = [mergedLabels allValues];
+    
+    _reposByID = [NSDictionary lookupWithObjects:repos keyPath:@"identifier"];
+    
+    NSMutableSet *mergedMilestones = [NSMutableSet new];
+    NSMutableDictionary *milestonesByID = [NSMutableDictionary new];
+    NSMutableArray *hiddenMilestones = [NSMutableArray new];
+    NSMutableDictionary *milestoneTitleToMilestones = [NSMutableDictionary new];
+    for (NSNumber *repoID in _milestonesByRepoID) {
+        NSArray *ma = _milestonesByRepoID[repoID];
+        Repo *repo = _reposByID[repoID];
+        if (repo.hidden || repo.restricted) continue;
+        for (Milestone *m in ma) {
+            if (!m.closed && !m.hidden) {
+                [mergedMilestones addObject:m.title];
+                NSMutableArray *a = milestoneTitleToMilestones[m.title];
+                if (!a) milestoneTitleToMilestones[m.title] = a = [NSMutableArray new];
+                [a addObject:m];
+            } else if (m.hidden) {
+                [hiddenMilestones addObject:m];
+            }
+            milestonesByID[m.identifier] = m;
+        }
+    }
+    
+    _milestonesByID = milestonesByID;
+    
+    _mergedMilestoneNames = [[mergedMilestones allObjects] sortedArrayUsingSelector:@selector(localizedStandardCompare:)];
+    _milestoneTitleToMilestones = milestoneTitleToMilestones;
+    
+    _allAssignees = [[allAssignees allObjects] mutableCopy];
+    _allAssigneesNeedsSort = YES;
+    
+    _hiddenRepos = [[repos filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"hidden = YES"]] sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"fullName" ascending:YES selector:@selector(localizedStandardCompare:)]]];
+    _hiddenMilestones = hiddenMilestones;
+    
+    _managedIDToObject = managedIDToObject;
 }
 
 - (NSArray<Repo *> *)activeRepos {
@@ -12,14 +12,36 @@
 
 @class LocalAccount;
 
+// The repos and accounts touched by one or more changes to a context.
+@interface MetadataChangeSet : NSObject
+
+@property (readonly) NSMutableSet<NSNumber *> *repoIDs;
+@property (readonly) NSMutableSet<NSNumber *> *accountIDs;
+@property (assign) BOOL rebuildAll; // changes that can't be attributed to particular repos or accounts (e.g. billing)
+@property (assign) BOOL containsInsertions; // new metadata objects, which later reads may refer to
+@property (readonly, getter=isEmpty) BOOL empty;
+
+- (void)unionChangeSet:(MetadataChangeSet *)other;
+
+@end
+
 @interface MetadataStore (Internal)
 
 + (BOOL)changeNotificationContainsMetadata:(NSNotification *)mocNote;
 
+// Returns the metadata touched by mocNote, or nil if there is none.
+// Must be called on the queue of the context that posted mocNote.
++ (MetadataChangeSet *)changeSetWithNotification:(NSNotification *)mocNote;
+
 // Read data out of ctx and store in immutable data objects accessible from any thread.
 // Must be called on ctx's private queue.
 - (instancetype)initWithMOC:(NSManagedObjectContext *)ctx billingState:(BillingState)state currentUserIdentifier:(NSNumber *)currentUserIdentifier;
 
+// Returns a new store that re-reads only the repos and accounts in changes from ctx, and shares
+// everything else with the receiver. Falls back to a full read if changes can't be applied incrementally.
+// Must be called on ctx's private queue, once the changes have been saved.
+- (instancetype)storeByApplyingChangeSet:(MetadataChangeSet *)changes moc:(NSManagedObjectContext *)ctx billingState:(BillingState)state currentUserIdentifier:(NSNumber *)currentUserIdentifier;
+
 - (Account *)accountWithLocalAccount:(LocalAccount *)la;
 
 @end
@@ -30,6 +30,9 @@
 
 @end
 
+// Delegates needn't return more items than this, as no more are useful to scroll through.
+extern const NSUInteger OmniSearchMaximumItems;
+
 @protocol OmniSearchDelegate <NSObject>
 
 - (void)omniSearch:(OmniSearch *)searchController itemsForQuery:(NSString *)query completion:(void (^)(NSArray<OmniSearchItem *> *items))completion;
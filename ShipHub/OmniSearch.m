@@ -13,6 +13,8 @@
 
 #import <objc/runtime.h>
 
+const NSUInteger OmniSearchMaximumItems = 100;
+
 @protocol OmniSearchTextFieldDelegate <NSTextFieldDelegate>
 
 - (void)controlTextDidSubmit:(NSNotification *)note;
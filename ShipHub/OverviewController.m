@@ -12,6 +12,9 @@
 #import "AppDelegate.h"
 #import "AvatarManager.h"
 #import "DataStore.h"
+#import "DataStore+IssueCounts.h"
+#import "DataStore+FullTextIndex.h"
+#import "DataStore+IssuesPredicate.h"
 #import "MetadataStore.h"
 #import "Extras.h"
 #import "Milestone.h"
@@ -49,8 +52,8 @@
 #import "ProgressSheet.h"
 #import "NetworkStatusWindowController.h"
 #import "OmniSearch.h"
+#import "FuzzyMatcher.h"
 #import "Issue.h"
-#import "RateDampener.h"
 
 //#import "OutboxViewController.h"
 //#import "AttachmentProgressViewController.h"
@@ -168,10 +171,11 @@ static NSString *const SearchMenuDefaultsKey = @"SearchItemCategory";
 @property ProjectsViewController *projectsController;
 
 @property OmniSearch *omniSearch;
+@property NSArray<NSString *> *omniSearchTitles;
+@property FuzzyMatcher *omniSearchMatcher;
 
-@property NSMutableArray *pendingCounts;
-@property NSInteger activeCounts;
-@property RateDampener *countDampener;
+@property NSArray<OverviewNode *> *countedNodes; // keyed by index in the data store's counted predicates
+@property int64_t countsGeneration; // of the counted predicates for countedNodes
 
 @end
 
@@ -318,11 +322,12 @@ static NSString *const SearchMenuDefaultsKey = @"SearchItemCategory";
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(metadataChanged:) name:DataStoreDidUpdateMetadataNotification object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(dataStoreChanged:) name:DataStoreActiveDidChangeNotification object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(queriesChanged:) name:DataStoreDidUpdateQueriesNotification object:nil];
-    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(problemsChanged:) name:DataStoreDidUpdateProblemsNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(issueCountsChanged:) name:DataStoreDidUpdateIssueCountsNotification object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(initialSyncStarted:) name:DataStoreWillBeginInitialMetadataSync object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(initialSyncEnded:) name:DataStoreDidEndInitialMetadataSync object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(outboxChanged:) name:DataStoreDidUpdateOutboxNotification object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(upNextChanged:) name:DataStoreDidUpdateMyUpNextNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(fullTextIndexChanged:) name:DataStoreDidUpdateFullTextIndexNotification object:nil];
 }
 
 - (NSTouchBar *)makeTouchBar {
@@ -954,95 +959,64 @@ static NSString *const SearchMenuDefaultsKey = @"SearchItemCategory";
     }
 }
 
+- (void)_updateCounts:(IssueCounts *)counts forNode:(OverviewNode *)node {
+    if (node.showProgress) {
+        [self _updateProgress:counts.progress open:counts.open closed:counts.closed forNode:node];
+    } else {
+        [self _updateCount:node.countOpenOnly ? counts.open : counts.total forNode:node];
+    }
+}
+
 - (void)updateCount:(OverviewNode *)node {
-    if (node.predicate && node.showProgress) {
+    if (node.predicate && (node.showProgress || node.showCount)) {
         __weak __typeof(self) weakSelf = self;
-        void (^updateProgress)(double, NSInteger, NSInteger) = ^(double progress, NSInteger open, NSInteger closed) {
-            id strongSelf = weakSelf;
-            [strongSelf _updateProgress:progress open:open closed:closed forNode:node];
-            [strongSelf finishedCountForNode:node];
-        };
-        
-        [self beginCountForNode:node];
-        [[DataStore activeStore] issueProgressMatchingPredicate:node.predicate completion:^(double progress, NSInteger open, NSInteger closed, NSError *error) {
-            updateProgress(progress, open, closed);
+        [[DataStore activeStore] issueCountsMatchingPredicates:@[node.predicate] completion:^(NSArray<IssueCounts *> *counts, NSError *error) {
+            [weakSelf _updateCounts:counts.firstObject forNode:node];
         }];
-        
-    } else {
+    } else if (node == _outboxNode) {
+#if !INCOMPLETE
         __weak __typeof(self) weakSelf = self;
-        void (^updateCount)(NSUInteger) = ^(NSUInteger count) {
-            id strongSelf = weakSelf;
-            [strongSelf _updateCount:count forNode:node];
-            [strongSelf finishedCountForNode:node];
-        };
-        
-        if (node.predicate && node.showCount) {
-            NSPredicate *predicate = node.predicate;
-            if (node.countOpenOnly) {
-                predicate = [predicate and:[NSPredicate predicateWithFormat:@"closed = NO"]];
-            }
-            
-            [self beginCountForNode:node];
-            [[DataStore activeStore] countIssuesMatchingPredicate:predicate completion:^(NSUInteger count, NSError *error) {
-                updateCount(count);
-            }];
-        } else if (node == _outboxNode) {
-    #if !INCOMPLETE
-            [[DataStore activeStore] outboxWithCompletion:^(NSArray *outbox) {
-                NSUInteger count = outbox.count;
-                updateCount(count > 0 ? count : NSNotFound);
-            }];
-    #endif
-        } else {
-            node.count = NSNotFound;
-        }
+        [[DataStore activeStore] outboxWithCompletion:^(NSArray *outbox) {
+            NSUInteger count = outbox.count;
+            [weakSelf _updateCount:count > 0 ? count : NSNotFound forNode:node];
+        }];
+#endif
+    } else {
+        node.count = NSNotFound;
     }
 }
 
-- (void)_updateCounts {
-    if (!_pendingCounts) {
-        _pendingCounts = [NSMutableArray new];
-    } else {
-        [_pendingCounts removeAllObjects];
-    }
+// Hands the predicates of all of the counted nodes to the data store, which posts
+// their counts and then keeps them up to date as issues change (see issueCountsChanged:).
+- (void)updateCounts {
+    NSMutableDictionary *predicates = [NSMutableDictionary new];
+    NSMutableArray *countedNodes = [NSMutableArray new];
     
-    NSArray *elements = _outlineRoots;
-    [self walkNodes:elements expandedOnly:NO visitor:^(OverviewNode *node) {
-        [_pendingCounts addObject:node];
+    [self walkNodes:_outlineRoots expandedOnly:NO visitor:^(OverviewNode *node) {
+        if (node.predicate && (node.showProgress || node.showCount)) {
+            predicates[@(countedNodes.count)] = node.predicate;
+            [countedNodes addObject:node];
+        } else {
+            [self updateCount:node];
+        }
     }];
-    [_pendingCounts shuffle];
-    [self countNextNodes];
-}
-
-- (void)beginCountForNode:(OverviewNode *)node {
-    _activeCounts++;
-}
-
-- (void)finishedCountForNode:(OverviewNode *)node {
-    _activeCounts--;
-    NSAssert(_activeCounts >= 0, @"_activeCounts underflow");
-    [self countNextNodes];
-}
-
-- (void)countNextNodes {
-    NSInteger maxWidth = [[DataStore activeStore] readWidth] ?: 1;
-    while (_activeCounts < maxWidth && _pendingCounts.count > 0) {
-        OverviewNode *node = [_pendingCounts lastObject];
-        [_pendingCounts removeLastObject];
-        [self updateCount:node];
-    }
+    
+    _countedNodes = countedNodes;
+    _countsGeneration = [[DataStore activeStore] setCountedPredicates:predicates];
 }
 
-- (void)updateCounts {
-    if (!_countDampener) {
-        _countDampener = [RateDampener new];
-        _countDampener.windowWidth = 1.0; // seconds
-        _countDampener.windowWidth = 2;   // messages per second
-    }
-    __weak typeof(self) weakSelf = self;
-    [_countDampener addBlock:^{
-        id strongSelf = weakSelf;
-        [strongSelf _updateCounts];
+- (void)issueCountsChanged:(NSNotification *)note {
+    if (note.object != [DataStore activeStore]) return;
+    
+    // Counts for the predicates of a previous updateCounts are keyed by indexes into different nodes
+    if ([note.userInfo[DataStoreIssueCountsGenerationKey] longLongValue] != _countsGeneration) return;
+    
+    NSDictionary *counts = note.userInfo[DataStoreIssueCountsKey];
+    [counts enumerateKeysAndObjectsUsingBlock:^(NSNumber *key, IssueCounts *c, BOOL *stop) {
+        NSUInteger idx = key.unsignedIntegerValue;
+        if (idx < _countedNodes.count) {
+            [self _updateCounts:c forNode:_countedNodes[idx]];
+        }
     }];
 }
 
@@ -1059,10 +1033,6 @@ static NSString *const SearchMenuDefaultsKey = @"SearchItemCategory";
     [self buildOutline];
 }
 
-- (void)problemsChanged:(NSNotification *)note {
-    [self updateCounts];
-}
-
 - (void)outboxChanged:(NSNotification *)note {
     [self updateCount:_outboxNode];
 }
@@ -1074,6 +1044,14 @@ static NSString *const SearchMenuDefaultsKey = @"SearchItemCategory";
     }
 }
 
+- (void)fullTextIndexChanged:(NSNotification *)note {
+    // Title and description searches hold the index's matches as of when they were built
+    NSInteger searchCategory = [[NSUserDefaults standardUserDefaults] integerForKey:SearchMenuDefaultsKey fallback:SearchMenuTagTitleOnly];
+    if (searchCategory == SearchMenuTagTitleAndDescription && [[[_searchItem.searchField stringValue] trim] length]) {
+        [self updatePredicate];
+    }
+}
+
 - (void)expandDefault {
     [self walkNodes:^(OverviewNode *node) {
         if (node.children.count > 0) {
@@ -1171,9 +1149,18 @@ static NSString *const SearchMenuDefaultsKey = @"SearchItemCategory";
     if ([title length]) {
         NSInteger searchCategory = [[NSUserDefaults standardUserDefaults] integerForKey:SearchMenuDefaultsKey fallback:SearchMenuTagTitleOnly];
         switch (searchCategory) {
-            case SearchMenuTagTitleAndDescription:
-                searchPredicate = [NSPredicate predicateWithFormat:@"title CONTAINS[cd] %@ OR body CONTAINS[cd] %@", title, title];
+            case SearchMenuTagTitleAndDescription: {
+                // Titles still match substrings, as in title only searches. Bodies and comments are matched
+                // by word from the full text index, rather than scanning every body, once it's built.
+                NSArray *matches = [[DataStore activeStore] issueIdentifiersMatchingText:title];
+                if (matches) {
+                    // The matches change with every save, and are kept out of the rewrite cache so they don't fill it.
+                    searchPredicate = [NSPredicate predicateWithFormat:@"title CONTAINS[cd] %@ OR identifier IN %@", title, IssuesPredicateUncachedConstant(matches)];
+                } else {
+                    searchPredicate = [NSPredicate predicateWithFormat:@"title CONTAINS[cd] %@ OR body CONTAINS[cd] %@", title, title];
+                }
                 break;
+            }
             case SearchMenuTagTitleOnly:
             default:
                 searchPredicate = [NSPredicate predicateWithFormat:@"title CONTAINS[cd] %@", title];
@@ -2265,19 +2252,30 @@ static NSString *const SearchMenuDefaultsKey = @"SearchItemCategory";
 
 - (void)omniSearch:(OmniSearch *)searchController itemsForQuery:(NSString *)query completion:(void (^)(NSArray<OmniSearchItem *> *))completion
 {
-    NSMutableArray *items = [NSMutableArray new];
+    NSMutableArray<OverviewNode *> *nodes = [NSMutableArray new];
     [self walkNodes:^(OverviewNode *node) {
-        if (node.includeInOmniSearch && [node.title localizedCaseInsensitiveContainsString:query]) {
-            
-            OmniSearchItem *item = [OmniSearchItem new];
-            item.image = node.omniSearchIcon ?: node.icon;
-            item.title = node.title;
-            item.representedObject = node;
-            [items addObject:item];
+        if (node.includeInOmniSearch && node.title) {
+            [nodes addObject:node];
         }
     }];
     
-    completion(items);
+    NSArray *titles = [nodes arrayByMappingObjects:^id(OverviewNode *node) {
+        return node.title;
+    }];
+    if (![titles isEqualToArray:_omniSearchTitles]) {
+        _omniSearchTitles = titles;
+        _omniSearchMatcher = [[FuzzyMatcher alloc] initWithCandidates:titles];
+    }
+    
+    NSArray *matches = [_omniSearchMatcher indexesMatchingQuery:query limit:OmniSearchMaximumItems];
+    completion([matches arrayByMappingObjects:^id(NSNumber *idx) {
+        OverviewNode *node = nodes[idx.unsignedIntegerValue];
+        OmniSearchItem *item = [OmniSearchItem new];
+        item.image = node.omniSearchIcon ?: node.icon;
+        item.title = node.title;
+        item.representedObject = node;
+        return item;
+    }]);
 }
 
 - (void)omniSearch:(OmniSearch *)searchController didSelectItem:(OmniSearchItem *)item {
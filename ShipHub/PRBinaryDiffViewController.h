@@ -12,7 +12,8 @@
 
 @interface PRBinaryDiffViewController : NSViewController
 
-- (void)setFile:(GitDiffFile *)file oldData:(NSData *)oldData newData:(NSData *)newData;
+// If the data is already in a file, such as an LFS object in the store, pass its path to preview it from there.
+- (void)setFile:(GitDiffFile *)file oldData:(NSData *)oldData newData:(NSData *)newData oldObjectPath:(NSString *)oldObjectPath newObjectPath:(NSString *)newObjectPath;
 
 @property (nonatomic, readonly) GitDiffFile *file;
 
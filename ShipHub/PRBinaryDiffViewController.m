@@ -15,7 +15,7 @@
 
 @interface GitPreviewItem : NSObject <QLPreviewItem>
 
-+ (GitPreviewItem *)itemWithData:(NSData *)data name:(NSString *)name;
++ (GitPreviewItem *)itemWithData:(NSData *)data objectPath:(NSString *)objectPath name:(NSString *)name;
 
 @end
 
@@ -48,7 +48,7 @@
     return (NSSplitView *)(self.view);
 }
 
-- (void)setFile:(GitDiffFile *)file oldData:(NSData *)oldData newData:(NSData *)newData {
+- (void)setFile:(GitDiffFile *)file oldData:(NSData *)oldData newData:(NSData *)newData oldObjectPath:(NSString *)oldObjectPath newObjectPath:(NSString *)newObjectPath {
     _file = file;
     
     _leftView.previewItem = nil;
@@ -57,8 +57,8 @@
     NSInteger loadCount = ++_loadCount;
     
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        GitPreviewItem *left = [GitPreviewItem itemWithData:oldData name:[file.oldPath lastPathComponent]];
-        GitPreviewItem *right = [GitPreviewItem itemWithData:newData name:[file.path lastPathComponent]];
+        GitPreviewItem *left = [GitPreviewItem itemWithData:oldData objectPath:oldObjectPath name:[file.oldPath lastPathComponent]];
+        GitPreviewItem *right = [GitPreviewItem itemWithData:newData objectPath:newObjectPath name:[file.path lastPathComponent]];
         
         RunOnMain(^{
             if (loadCount == _loadCount) {
@@ -86,10 +86,11 @@
 
 @interface GitPreviewItem ()
 
-- (id)initWithFileURL:(NSURL *)URL name:(NSString *)name;
+- (id)initWithFileURL:(NSURL *)URL temporaryURL:(NSURL *)temporaryURL name:(NSString *)name;
 
 @property (readwrite) NSURL *previewItemURL;
 @property (readwrite) NSString *previewItemTitle;
+@property NSURL *temporaryURL; // removed on dealloc
 
 @end
 
@@ -98,10 +99,42 @@
 @synthesize previewItemURL;
 @synthesize previewItemTitle;
 
-+ (GitPreviewItem *)itemWithData:(NSData *)data name:(NSString *)name {
+// QuickLook goes by the file extension, so objects from the store, which have none, are linked
+// under their name in a temporary directory rather than copied.
++ (GitPreviewItem *)itemWithObjectPath:(NSString *)objectPath name:(NSString *)name {
+    char *buf = strdup([[NSTemporaryDirectory() stringByAppendingPathComponent:@"preview.XXXXXX"] fileSystemRepresentation]);
+    if (!mkdtemp(buf)) {
+        ErrLog(@"Unable to create temporary directory: %s", strerror(errno));
+        free(buf);
+        return nil;
+    }
+    
+    NSString *dir = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:buf length:strlen(buf)];
+    free(buf);
+    
+    NSString *path = [dir stringByAppendingPathComponent:name];
+    
+    // A hard link keeps the object around even if the store evicts it while it's being previewed.
+    if (-1 == link([objectPath fileSystemRepresentation], [path fileSystemRepresentation])
+        && -1 == symlink([objectPath fileSystemRepresentation], [path fileSystemRepresentation]))
+    {
+        ErrLog(@"Unable to link %@ for preview: %s", objectPath, strerror(errno));
+        [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+        return nil;
+    }
+    
+    return [[GitPreviewItem alloc] initWithFileURL:[NSURL fileURLWithPath:path] temporaryURL:[NSURL fileURLWithPath:dir] name:name];
+}
+
++ (GitPreviewItem *)itemWithData:(NSData *)data objectPath:(NSString *)objectPath name:(NSString *)name {
     if (!data) return nil;
     if (!name) return nil;
     
+    if (objectPath) {
+        GitPreviewItem *item = [self itemWithObjectPath:objectPath name:name];
+        if (item) return item;
+    }
+    
     NSString *ext = [name pathExtension];
     NSString *withoutExt = [name stringByDeletingPathExtension];
     
@@ -121,7 +154,8 @@
         
         [data writeToFile:path atomically:NO];
         
-        return [[GitPreviewItem alloc] initWithFileURL:[NSURL fileURLWithPath:path] name:name];
+        NSURL *URL = [NSURL fileURLWithPath:path];
+        return [[GitPreviewItem alloc] initWithFileURL:URL temporaryURL:URL name:name];
     } else {
         ErrLog(@"Unable to create temporary file: %s", strerror(errno));
         free(buf);
@@ -129,17 +163,18 @@
     }
 }
 
-- (id)initWithFileURL:(NSURL *)URL name:(NSString *)name {
+- (id)initWithFileURL:(NSURL *)URL temporaryURL:(NSURL *)temporaryURL name:(NSString *)name {
     if (self = [super init]) {
         self.previewItemURL = URL;
         self.previewItemTitle = name;
+        self.temporaryURL = temporaryURL;
     }
     return self;
 }
 
 - (void)dealloc {
-    if (self.previewItemURL) {
-        NSURL *URL = self.previewItemURL;
+    if (self.temporaryURL) {
+        NSURL *URL = self.temporaryURL;
         dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
             [[NSFileManager defaultManager] removeItemAtURL:URL error:NULL];
         });
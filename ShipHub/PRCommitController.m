@@ -51,10 +51,23 @@
     _table.rowHeight = 10000;
     
     _table.allowsMultipleSelection = NO; // showing multiple commits at once is very doable, but punting on it for the moment
+    
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(diffDidDetectRenames:) name:GitDiffDidDetectRenamesNotification object:nil];
 }
 
 - (void)viewDidAppear {
     [super viewDidAppear];
+    [self reloadData];
+}
+
+- (void)diffDidDetectRenames:(NSNotification *)note {
+    // the span rows show how many files changed, which renames reduce
+    if (note.object == _pr.spanDiffSinceMyLastReview || note.object == _pr.spanDiffSinceMyLastView) {
+        [self reloadData];
+    }
+}
+
+- (void)reloadData {
     NSIndexSet *selected = _table.selectedRowIndexes;
     [_table reloadData];
     if (selected.count > 0) {
@@ -58,6 +58,18 @@
     [self.view addSubview:_fileBarController.view];
     
     [self.web setValue:@YES forKey:@"drawsTransparentBackground"];
+    
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(diffDidDetectRenames:) name:GitDiffDidDetectRenamesNotification object:nil];
+}
+
+- (void)diffDidDetectRenames:(NSNotification *)note {
+    // Comments are mapped through the span diff file at _diffFile's path, which may have just become part of a rename
+    if (note.object != _pr.spanDiff || _diff == _pr.spanDiff || !_diffFile) return;
+    
+    NSArray *changed = [note.userInfo[GitDiffRenamedFilesKey] arrayByAddingObjectsFromArray:note.userInfo[GitDiffReplacedFilesKey]];
+    if ([changed containsObjectMatchingPredicate:[NSPredicate predicateWithFormat:@"path = %@ OR oldPath = %@", _diffFile.path, _diffFile.path]]) {
+        [self reconfigureForReload];
+    }
 }
 
 - (CGRect)webContentRect {
@@ -287,12 +299,12 @@ static BOOL differentiateWithoutColor() {
             complete(nil);
         }
         
-    } asBinary:^(NSData *oldFile, NSData *newFile, NSError *error) {
+    } asBinary:^(NSData *oldFile, NSData *newFile, NSString *oldObjectPath, NSString *newObjectPath, NSError *error) {
         if (_loadCount != count) return;
         
         [self showBinaryDiff];
         
-        [_binaryController setFile:diffFile oldData:oldFile newData:newFile];
+        [_binaryController setFile:diffFile oldData:oldFile newData:newFile oldObjectPath:oldObjectPath newObjectPath:newObjectPath];
     }];
     
     _progressController.progress = _progress;
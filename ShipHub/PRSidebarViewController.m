@@ -20,6 +20,7 @@
 #import "PRCommitController.h"
 #import "NSImage+Icons.h"
 #import "OmniSearch.h"
+#import "FuzzyMatcher.h"
 
 @interface PRSidebarCellView : NSTableCellView
 
@@ -83,6 +84,9 @@ typedef NS_ENUM(NSInteger, FindMenuTags) {
 @property NSSet *commentedPaths;
 
 @property OmniSearch *omniSearch;
+@property NSArray *omniSearchDiffFiles; // the allFiles of the diff omniSearchFiles came from
+@property NSArray<GitDiffFile *> *omniSearchFiles;
+@property FuzzyMatcher *omniSearchMatcher;
 
 @end
 
@@ -103,6 +107,7 @@ typedef NS_ENUM(NSInteger, FindMenuTags) {
     
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(themeDidChange:) name:CThemeDidChangeNotification object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(frameDidChange:) name:NSViewFrameDidChangeNotification object:self.view];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(diffDidDetectRenames:) name:GitDiffDidDetectRenamesNotification object:nil];
 }
 
 - (void)updateTheme {
@@ -135,9 +140,20 @@ typedef NS_ENUM(NSInteger, FindMenuTags) {
 }
 
 - (void)reloadData {
-    GitDiffFile *file = [_outline selectedItem];
-    [_outline reloadData];
-    [self selectFile:file];
+    if (_inFindMode) {
+        // find results are both groups and matches, so restore whichever was selected
+        id item = [_outline selectedItem];
+        [_outline reloadData];
+        [_outline expandItem:nil expandChildren:YES];
+        NSInteger row = item ? [_outline rowForItem:item] : -1;
+        if (row != -1) {
+            [_outline selectRowIndexes:[NSIndexSet indexSetWithIndex:row] byExtendingSelection:NO];
+        }
+    } else {
+        GitDiffFile *file = [_outline selectedItem];
+        [_outline reloadData];
+        [self selectFile:file];
+    }
 }
 
 - (void)setPr:(PullRequest *)pr {
@@ -230,27 +246,81 @@ typedef NS_ENUM(NSInteger, FindMenuTags) {
     [_commitPopover close];
 }
 
-static void traverseFiles(GitFileTree *tree, NSMutableArray *files, NSPredicate *filter) {
-    if (!tree) return;
-    
-    for (id item in tree.children) {
-        if ([item isKindOfClass:[GitDiffFile class]]) {
-            if (!filter || [filter evaluateWithObject:item]) {
-                [files addObject:item];
-            }
-        } else {
-            traverseFiles(item, files, filter);
-        }
-    }
-}
-
 - (void)buildInorderFiles {
     // create inorderFiles, a traversal of
     // the tree that's the same order as the fully
     // expanded outline view
-    NSMutableArray *files = [NSMutableArray new];
-    traverseFiles(_filteredDiff.fileTree, files, nil);
-    _inorderFiles = files;
+    _inorderFiles = _filteredDiff.fileTree.inorderFiles ?: @[];
+}
+
+- (void)diffDidDetectRenames:(NSNotification *)note {
+    if (note.object != _activeDiff) return;
+    
+    GitDiffFile *selected = _selectedFile;
+    NSArray *replaced = note.userInfo[GitDiffReplacedFilesKey];
+    NSArray *renamed = note.userInfo[GitDiffRenamedFilesKey];
+    BOOL selectionReplaced = selected && [replaced indexOfObjectIdenticalTo:selected] != NSNotFound;
+    GitDiffFile *replacement = nil;
+    if (selectionReplaced) {
+        replacement = [renamed firstObjectMatchingPredicate:[NSPredicate predicateWithFormat:@"path = %@ OR oldPath = %@", selected.path, selected.path]];
+    }
+    
+    if (_inFindMode) {
+        [self remapFindResultsWithRenamedFiles:renamed replacedFiles:replaced];
+    }
+    
+    if (_filteredDiff != _activeDiff) {
+        [self updateFilteredDiff];
+    } else {
+        [self buildInorderFiles];
+        [self reloadData];
+    }
+    
+    if (!replacement) {
+        return;
+    }
+    
+    if (_inFindMode) {
+        // the find results now point at replacement, but the outline's selection hasn't changed, so show it directly
+        _selectedFile = replacement;
+        id item = [_outline selectedItem];
+        [_delegate prSidebar:self didSelectGitDiffFile:replacement highlightingSearchResult:[item isKindOfClass:[GitFileSearchResult class]] ? item : nil];
+    } else {
+        [self selectFile:replacement];
+    }
+}
+
+// Points find results at the renamed files that replaced the files they were found in.
+// Results in deleted files that are now part of a rename are dropped.
+- (void)remapFindResultsWithRenamedFiles:(NSArray<GitDiffFile *> *)renamed replacedFiles:(NSArray<GitDiffFile *> *)replaced {
+    NSMapTable *replacements = [NSMapTable strongToStrongObjectsMapTable];
+    for (GitDiffFile *file in replaced) {
+        if (file.operation == DiffFileOperationAdded) {
+            GitDiffFile *replacement = [renamed firstObjectMatchingPredicate:[NSPredicate predicateWithFormat:@"path = %@", file.path]];
+            if (replacement) {
+                [replacements setObject:replacement forKey:file];
+            }
+        }
+    }
+    
+    NSMutableIndexSet *dropped = [NSMutableIndexSet new];
+    [_findResults enumerateObjectsUsingBlock:^(NSArray<GitFileSearchResult *> *group, NSUInteger idx, BOOL *stop) {
+        GitDiffFile *file = [[group firstObject] file];
+        if ([replaced indexOfObjectIdenticalTo:file] == NSNotFound) {
+            return;
+        }
+        GitDiffFile *replacement = [replacements objectForKey:file];
+        if (replacement) {
+            for (GitFileSearchResult *result in group) {
+                result.file = replacement;
+            }
+        } else {
+            [dropped addIndex:idx];
+        }
+    }];
+    [_findResults removeObjectsAtIndexes:dropped];
+    
+    [self updateFilteredFindResults];
 }
 
 - (void)setActiveDiff:(GitDiff *)diff {
@@ -654,9 +724,22 @@ static void traverseFiles(GitFileTree *tree, NSMutableArray *files, NSPredicate
 
 - (void)omniSearch:(OmniSearch *)searchController itemsForQuery:(NSString *)query completion:(void (^)(NSArray<OmniSearchItem *> *))completion
 {
-    NSMutableArray *files = [NSMutableArray new];
-    traverseFiles(_activeDiff.fileTree, files, [NSPredicate predicateWithFormat:@"name CONTAINS[cd] %@", query]);
-    completion([files arrayByMappingObjects:^id(GitDiffFile *obj) {
+    // allFiles is replaced whenever the diff's files change (say, once renames are detected), so
+    // the matcher is only built again then, and otherwise refined as the query is typed.
+    NSArray *diffFiles = _activeDiff.allFiles;
+    if (diffFiles != _omniSearchDiffFiles) {
+        _omniSearchDiffFiles = diffFiles;
+        _omniSearchFiles = _activeDiff.fileTree.inorderFiles;
+        _omniSearchMatcher = [[FuzzyMatcher alloc] initWithCandidates:[_omniSearchFiles arrayByMappingObjects:^id(GitDiffFile *obj) {
+            return obj.path ?: obj.oldPath ?: @"";
+        }]];
+    }
+    
+    NSArray<GitDiffFile *> *files = _omniSearchFiles;
+    
+    NSArray *matches = [_omniSearchMatcher indexesMatchingQuery:query limit:OmniSearchMaximumItems];
+    completion([matches arrayByMappingObjects:^id(NSNumber *idx) {
+        GitDiffFile *obj = files[idx.unsignedIntegerValue];
         OmniSearchItem *item = [OmniSearchItem new];
         item.image = [self iconForDiffFile:obj];
         item.title = obj.path ?: obj.oldPath;
@@ -0,0 +1,68 @@
+//
+//  ReadContextPool.h
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+@interface ReadContextPoolStats : NSObject
+
+@property (readonly) NSUInteger reads;
+
+// Wait is from when the read was requested until it had a context. Execution is the read itself.
+@property (readonly) NSTimeInterval totalWaitTime;
+@property (readonly) NSTimeInterval maxWaitTime;
+@property (readonly) NSTimeInterval averageWaitTime;
+@property (readonly) NSTimeInterval totalExecutionTime;
+@property (readonly) NSTimeInterval maxExecutionTime;
+@property (readonly) NSTimeInterval averageExecutionTime;
+
+@property (readonly) NSUInteger merges; // saves merged into a context before a read
+@property (readonly) NSUInteger resets; // contexts reset before a read, because they were too far behind to merge
+
+@property (readonly) NSUInteger size; // contexts in the pool now
+@property (readonly) NSUInteger peakSize;
+@property (readonly) NSUInteger queueDepth; // reads requested and not yet finished
+@property (readonly) NSUInteger peakQueueDepth;
+
+@end
+
+/*
+ ReadContextPool hands out read only contexts, one read at a time.
+
+ It starts with minimumSize contexts and makes more, up to maximumSize, when reads are waiting
+ for one. Contexts left idle for a while are released again, down to minimumSize.
+
+ Rather than resetting each context after every write, the pool keeps the object IDs changed by
+ recent saves of the write context and merges them into a context before its next read, so
+ objects the context already has stay registered. Contexts that have missed too many saves, or
+ any save that invalidated everything, are reset instead.
+
+ ReadContextPool is thread safe.
+*/
+
+@interface ReadContextPool : NSObject
+
+// mergesSaves should be NO if the contexts made by factory don't share a coordinator with the write context.
+- (instancetype)initWithMinimumSize:(NSUInteger)minimumSize maximumSize:(NSUInteger)maximumSize mergesSaves:(BOOL)mergesSaves factory:(NSManagedObjectContext *(^)(void))factory;
+
+@property (readonly) NSUInteger minimumSize;
+@property (readonly) NSUInteger maximumSize;
+
+// Call when a read is queued, so that queueDepth includes reads not yet started.
+// Returns the time requested, to pass to performRead:requestedAt:.
+- (double)readRequested;
+
+// Waits for a context, brings it up to date with the write context's saves and runs block on its queue.
+- (void)performRead:(void (^)(NSManagedObjectContext *moc))block requestedAt:(double)requestTime;
+
+// Call with the write context's NSManagedObjectContextDidSaveNotification, on its queue.
+- (void)writeContextDidSave:(NSNotification *)note;
+
+- (ReadContextPoolStats *)stats;
+
+@end
@@ -0,0 +1,268 @@
+//
+//  ReadContextPool.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "ReadContextPool.h"
+
+#import "Extras.h"
+
+static const NSUInteger ReadContextPoolMaxPendingSaves = 32;
+static const NSTimeInterval ReadContextPoolIdleTimeout = 30.0;
+
+@interface ReadContextPoolStats ()
+
+@property (readwrite) NSUInteger reads;
+@property (readwrite) NSTimeInterval totalWaitTime;
+@property (readwrite) NSTimeInterval maxWaitTime;
+@property (readwrite) NSTimeInterval totalExecutionTime;
+@property (readwrite) NSTimeInterval maxExecutionTime;
+@property (readwrite) NSUInteger merges;
+@property (readwrite) NSUInteger resets;
+@property (readwrite) NSUInteger size;
+@property (readwrite) NSUInteger peakSize;
+@property (readwrite) NSUInteger queueDepth;
+@property (readwrite) NSUInteger peakQueueDepth;
+
+@end
+
+@implementation ReadContextPoolStats
+
+- (NSTimeInterval)averageWaitTime {
+    return _reads ? _totalWaitTime / _reads : 0.0;
+}
+
+- (NSTimeInterval)averageExecutionTime {
+    return _reads ? _totalExecutionTime / _reads : 0.0;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    ReadContextPoolStats *copy = [ReadContextPoolStats new];
+    copy.reads = _reads;
+    copy.totalWaitTime = _totalWaitTime;
+    copy.maxWaitTime = _maxWaitTime;
+    copy.totalExecutionTime = _totalExecutionTime;
+    copy.maxExecutionTime = _maxExecutionTime;
+    copy.merges = _merges;
+    copy.resets = _resets;
+    copy.size = _size;
+    copy.peakSize = _peakSize;
+    copy.queueDepth = _queueDepth;
+    copy.peakQueueDepth = _peakQueueDepth;
+    return copy;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> reads: %tu wait: %.1fms avg, %.1fms max execution: %.1fms avg, %.1fms max merges: %tu resets: %tu size: %tu (peak %tu) queueDepth: %tu (peak %tu)", NSStringFromClass([self class]), self, _reads, self.averageWaitTime * 1000.0, _maxWaitTime * 1000.0, self.averageExecutionTime * 1000.0, _maxExecutionTime * 1000.0, _merges, _resets, _size, _peakSize, _queueDepth, _peakQueueDepth];
+}
+
+@end
+
+@interface PooledReadContext : NSObject
+
+@property NSManagedObjectContext *moc;
+@property NSUInteger savesMerged; // the pool's saveCount when this context was last brought up to date
+@property double idleSince;
+
+@end
+
+@implementation PooledReadContext
+
+@end
+
+@interface ReadContextPool () {
+    NSCondition *_lock;
+    NSManagedObjectContext *(^_factory)(void);
+    BOOL _mergesSaves;
+    
+    NSMutableArray<PooledReadContext *> *_idle; // most recently used last
+    NSUInteger _size;
+    
+    NSMutableArray<NSDictionary *> *_saves; // object IDs changed by the most recent saves, oldest first
+    NSUInteger _saveCount; // saves seen, so _saves[0] is save number _saveCount - _saves.count
+    
+    BOOL _trimScheduled;
+    
+    ReadContextPoolStats *_stats;
+}
+
+@end
+
+@implementation ReadContextPool
+
+- (instancetype)initWithMinimumSize:(NSUInteger)minimumSize maximumSize:(NSUInteger)maximumSize mergesSaves:(BOOL)mergesSaves factory:(NSManagedObjectContext *(^)(void))factory
+{
+    NSParameterAssert(factory);
+    NSParameterAssert(minimumSize > 0 && minimumSize <= maximumSize);
+    
+    if (self = [super init]) {
+        _minimumSize = minimumSize;
+        _maximumSize = maximumSize;
+        _mergesSaves = mergesSaves;
+        _factory = [factory copy];
+        _lock = [NSCondition new];
+        _idle = [NSMutableArray new];
+        _saves = [NSMutableArray new];
+        _stats = [ReadContextPoolStats new];
+        
+        for (NSUInteger i = 0; i < minimumSize; i++) {
+            [_idle addObject:[self makeContext]];
+        }
+    }
+    return self;
+}
+
+// Call with _lock held
+- (PooledReadContext *)makeContext {
+    PooledReadContext *ctx = [PooledReadContext new];
+    ctx.moc = _factory();
+    ctx.savesMerged = _saveCount; // a new context has nothing to catch up on
+    _size++;
+    _stats.size = _size;
+    _stats.peakSize = MAX(_stats.peakSize, _size);
+    return ctx;
+}
+
+- (double)readRequested {
+    [_lock lock];
+    _stats.queueDepth++;
+    _stats.peakQueueDepth = MAX(_stats.peakQueueDepth, _stats.queueDepth);
+    [_lock unlock];
+    return [NSDate extras_monotonicTime];
+}
+
+- (void)performRead:(void (^)(NSManagedObjectContext *moc))block requestedAt:(double)requestTime {
+    PooledReadContext *ctx = nil;
+    NSArray *changes = nil;
+    
+    [_lock lock];
+    while (_idle.count == 0 && _size >= _maximumSize) {
+        [_lock wait];
+    }
+    if (_idle.count > 0) {
+        ctx = [_idle lastObject];
+        [_idle removeLastObject];
+    } else {
+        ctx = [self makeContext];
+    }
+    
+    // Work out what the context has missed. nil means it must be reset.
+    NSUInteger oldestRetained = _saveCount - _saves.count;
+    if (ctx.savesMerged == _saveCount) {
+        changes = @[];
+    } else if (_mergesSaves && ctx.savesMerged >= oldestRetained) {
+        changes = [_saves subarrayWithRange:NSMakeRange(ctx.savesMerged - oldestRetained, _saveCount - ctx.savesMerged)];
+    }
+    ctx.savesMerged = _saveCount;
+    [_lock unlock];
+    
+    double start = [NSDate extras_monotonicTime];
+    NSManagedObjectContext *moc = ctx.moc;
+    
+    for (NSDictionary *save in changes) {
+        [NSManagedObjectContext mergeChangesFromRemoteContextSave:save intoContexts:@[moc]];
+    }
+    
+    [moc performBlockAndWait:^{
+        if (!changes) {
+            [moc reset];
+        }
+        block(moc);
+    }];
+    
+    double end = [NSDate extras_monotonicTime];
+    
+    [_lock lock];
+    ctx.idleSince = end;
+    [_idle addObject:ctx];
+    
+    _stats.reads++;
+    _stats.queueDepth--;
+    NSTimeInterval wait = start - requestTime;
+    NSTimeInterval execution = end - start;
+    _stats.totalWaitTime += wait;
+    _stats.maxWaitTime = MAX(_stats.maxWaitTime, wait);
+    _stats.totalExecutionTime += execution;
+    _stats.maxExecutionTime = MAX(_stats.maxExecutionTime, execution);
+    if (changes) {
+        _stats.merges += changes.count;
+    } else {
+        _stats.resets++;
+    }
+    
+    [self scheduleTrimIfNeeded];
+    [_lock signal];
+    [_lock unlock];
+}
+
+// Call with _lock held
+- (void)scheduleTrimIfNeeded {
+    if (_trimScheduled || _size <= _minimumSize) return;
+    
+    _trimScheduled = YES;
+    __weak __typeof(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(ReadContextPoolIdleTimeout * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        [weakSelf trimIdleContexts];
+    });
+}
+
+- (void)trimIdleContexts {
+    [_lock lock];
+    _trimScheduled = NO;
+    
+    double now = [NSDate extras_monotonicTime];
+    // _idle is in order of last use, so the longest idle are first
+    while (_size > _minimumSize && _idle.count > 0 && now - _idle[0].idleSince >= ReadContextPoolIdleTimeout) {
+        [_idle removeObjectAtIndex:0];
+        _size--;
+    }
+    _stats.size = _size;
+    
+    [self scheduleTrimIfNeeded];
+    [_lock unlock];
+}
+
+static NSArray *ObjectIDs(NSSet<NSManagedObject *> *objects) {
+    NSMutableArray *ids = [NSMutableArray arrayWithCapacity:objects.count];
+    for (NSManagedObject *obj in objects) {
+        [ids addObject:obj.objectID];
+    }
+    return ids;
+}
+
+- (void)writeContextDidSave:(NSNotification *)note {
+    NSDictionary *userInfo = note.userInfo;
+    BOOL invalidatesAll = userInfo[NSInvalidatedAllObjectsKey] != nil;
+    
+    NSDictionary *save = nil;
+    if (!invalidatesAll && _mergesSaves) {
+        save = @{ NSInsertedObjectsKey : ObjectIDs(userInfo[NSInsertedObjectsKey]),
+                  NSUpdatedObjectsKey : ObjectIDs(userInfo[NSUpdatedObjectsKey]),
+                  NSDeletedObjectsKey : ObjectIDs(userInfo[NSDeletedObjectsKey]) };
+    }
+    
+    [_lock lock];
+    _saveCount++;
+    if (save) {
+        [_saves addObject:save];
+        if (_saves.count > ReadContextPoolMaxPendingSaves) {
+            [_saves removeObjectAtIndex:0];
+        }
+    } else {
+        // Nothing before this save can be merged past it.
+        [_saves removeAllObjects];
+    }
+    [_lock unlock];
+}
+
+- (ReadContextPoolStats *)stats {
+    [_lock lock];
+    ReadContextPoolStats *stats = [_stats copy];
+    [_lock unlock];
+    return stats;
+}
+
+@end
@@ -17,6 +17,7 @@
 - (id)initWithAuth:(Auth *)auth queue:(dispatch_queue_t)queue; // callbacks will be on queue
 
 @property NSInteger pageLimit; // default = 100
+@property NSInteger maxConcurrentPages; // default = 4. Requests in flight, plus pages waiting to be delivered, per paged fetch.
 
 @property NSURLRequestCachePolicy cachePolicy; // default NSURLRequestUseProtocolCachePolicy
 
@@ -37,4 +38,10 @@
 // Return pages as soon as they are available (and not necessarily in order)
 - (void)streamPages:(NSURLRequest *)rootRequest pageHandler:(void (^)(NSArray *data))pageHandler completion:(void (^)(NSError *))completion;
 
+// Deliver pages in order, one at a time, with at most maxConcurrentPages fetched ahead of the consumer.
+// The next page isn't delivered until pageHandler calls next (from any queue), so a slow consumer slows the fetch.
+// When GitHub reports the rate limit is exhausted, no new pages are requested until it resets.
+// completion is called once, after the last page's next, or with the first error. Cancel via the returned progress.
+- (NSProgress *)streamPagesInOrder:(NSURLRequest *)rootRequest pageHandler:(void (^)(NSArray *data, NSHTTPURLResponse *response, dispatch_block_t next))pageHandler completion:(void (^)(NSError *err))completion;
+
 @end
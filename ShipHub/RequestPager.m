@@ -15,6 +15,19 @@
 @property Auth *auth;
 @property dispatch_queue_t q;
 
+- (NSArray *)_pageRequestsWithRootRequest:(NSURLRequest *)rootRequest response:(NSHTTPURLResponse *)response;
+
+@end
+
+// The state of one -[RequestPager streamPagesInOrder:pageHandler:completion:]. Only accessed on the pager's queue.
+@interface PageStream : NSObject
+
+- (id)initWithPager:(RequestPager *)pager rootRequest:(NSURLRequest *)rootRequest pageHandler:(void (^)(NSArray *data, NSHTTPURLResponse *response, dispatch_block_t next))pageHandler completion:(void (^)(NSError *err))completion;
+
+@property (readonly) NSProgress *progress;
+
+- (void)start;
+
 @end
 
 @implementation RequestPager
@@ -31,6 +44,7 @@
         self.auth = auth;
         self.q = queue;
         self.pageLimit = 100;
+        self.maxConcurrentPages = 4;
     }
     return self;
 }
@@ -244,44 +258,27 @@ function pagedFetch(url) /* => Promise */ {
 - (void)fetchPaged:(NSURLRequest *)rootRequest headersCompletion:(void (^)(NSArray *data, NSDictionary *headers, NSError *err))completion {
     NSParameterAssert(rootRequest);
     NSParameterAssert(completion);
-    // Must first fetch the rootRequest and then can fetch each page
     DebugLog(@"%@", rootRequest);
-    [self jsonTask:rootRequest completion:^(id first, NSHTTPURLResponse *response, NSError *err) {
-        if (!err && ![first isKindOfClass:[NSArray class]]) {
-            err = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+    
+    NSMutableArray *all = [NSMutableArray new];
+    __block NSDictionary *headers = nil;
+    __block NSInteger pageCount = 0;
+    
+    [self streamPagesInOrder:rootRequest pageHandler:^(NSArray *data, NSHTTPURLResponse *response, dispatch_block_t next) {
+        if (!headers) {
+            headers = [response allHeaderFields];
         }
-        
+        [all addObjectsFromArray:data];
+        pageCount++;
+        next();
+    } completion:^(NSError *err) {
         if (err) {
-            completion(nil, nil, err);
-            return;
-        }
-        
-        NSDictionary *headers = [response allHeaderFields];
-        NSArray *pageRequests = [self _pageRequestsWithRootRequest:rootRequest response:response];
-        
-        if (pageRequests.count) {
-            [self jsonTasks:pageRequests completion:^(NSArray *rest, NSError *restErr) {
-                if (restErr) {
-                    ErrLog(@"%@", restErr);
-                    completion(nil, headers, restErr);
-                } else {
-                    NSMutableArray *all = [first mutableCopy];
-                    for (NSArray *page in rest) {
-                        if (![page isKindOfClass:[NSArray class]]) {
-                            restErr = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
-                            break;
-                        }
-                        [all addObjectsFromArray:page];
-                    }
-                    DebugLog(@"%@ finished with %td pages: %tu items", rootRequest, 1+rest.count, all.count);
-                    completion(all, headers, restErr);
-                }
-            }];
+            if (headers) ErrLog(@"%@", err);
+            completion(nil, headers, err);
         } else {
-            DebugLog(@"%@ finished with 1 page: %tu items", rootRequest, ((NSArray *)first).count);
-            completion(first, headers, nil);
+            DebugLog(@"%@ finished with %td pages: %tu items", rootRequest, pageCount, all.count);
+            completion(all, headers, nil);
         }
-        
     }];
 }
 
@@ -291,46 +288,212 @@ function pagedFetch(url) /* => Promise */ {
     NSParameterAssert(pageHandler);
     NSParameterAssert(completion);
     
-    [self jsonTask:rootRequest completion:^(id first, NSHTTPURLResponse *response, NSError *err) {
-        if (!err && ![first isKindOfClass:[NSArray class]]) {
-            err = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
-        }
-        
-        if (err) {
-            completion(err);
-            return;
-        }
-        
-        pageHandler(first);
+    [self streamPagesInOrder:rootRequest pageHandler:^(NSArray *data, NSHTTPURLResponse *response, dispatch_block_t next) {
+        pageHandler(data);
+        next();
+    } completion:completion];
+}
+
+- (NSProgress *)streamPagesInOrder:(NSURLRequest *)rootRequest pageHandler:(void (^)(NSArray *data, NSHTTPURLResponse *response, dispatch_block_t next))pageHandler completion:(void (^)(NSError *err))completion
+{
+    NSParameterAssert(rootRequest);
+    NSParameterAssert(pageHandler);
+    NSParameterAssert(completion);
+    
+    PageStream *stream = [[PageStream alloc] initWithPager:self rootRequest:rootRequest pageHandler:pageHandler completion:completion];
+    [stream start];
+    return stream.progress;
+}
+
+@end
+
+// Returns how long GitHub has asked us to wait before making more requests, or 0.
+static NSTimeInterval RateLimitDelay(NSHTTPURLResponse *response) {
+    NSDictionary *headers = [response allHeaderFields];
+    
+    NSString *retryAfter = headers[@"Retry-After"];
+    if (retryAfter && (response.statusCode == 403 || response.statusCode == 429)) {
+        return MAX(1.0, [retryAfter doubleValue]);
+    }
+    
+    NSString *remaining = headers[@"X-RateLimit-Remaining"];
+    NSString *reset = headers[@"X-RateLimit-Reset"]; // seconds since 1970
+    if (remaining && reset && [remaining integerValue] <= 0) {
+        return MAX(1.0, [reset doubleValue] - [[NSDate date] timeIntervalSince1970] + 1.0);
+    }
+    
+    return 0.0;
+}
+
+@implementation PageStream {
+    RequestPager *_pager;
+    dispatch_queue_t _q;
+    void (^_pageHandler)(NSArray *, NSHTTPURLResponse *, dispatch_block_t);
+    void (^_completion)(NSError *);
+    
+    NSMutableArray<NSURLRequest *> *_requests; // page i is fetched by _requests[i]. Only the root is known until it arrives.
+    BOOL _rootArrived;
+    
+    NSMutableIndexSet *_unrequested; // pages not yet requested, or to be retried
+    NSMutableDictionary<NSNumber *, NSURLSessionDataTask *> *_tasks; // pages in flight
+    NSMutableDictionary<NSNumber *, NSArray *> *_pages; // pages arrived, but not yet delivered
+    NSMutableDictionary<NSNumber *, NSHTTPURLResponse *> *_responses;
+    
+    NSInteger _nextDelivery;
+    BOOL _consumerBusy; // waiting for the consumer to call next
+    BOOL _rateLimited; // waiting for the rate limit to reset
+    BOOL _finished;
+}
+
+- (id)initWithPager:(RequestPager *)pager rootRequest:(NSURLRequest *)rootRequest pageHandler:(void (^)(NSArray *data, NSHTTPURLResponse *response, dispatch_block_t next))pageHandler completion:(void (^)(NSError *err))completion
+{
+    if (self = [super init]) {
+        _pager = pager;
+        _q = pager.q;
+        _pageHandler = [pageHandler copy];
+        _completion = [completion copy];
         
-        NSArray *pageRequests = [self _pageRequestsWithRootRequest:rootRequest response:response];
+        _requests = [NSMutableArray arrayWithObject:rootRequest];
+        _unrequested = [NSMutableIndexSet indexSetWithIndex:0];
+        _tasks = [NSMutableDictionary new];
+        _pages = [NSMutableDictionary new];
+        _responses = [NSMutableDictionary new];
         
+        _progress = [NSProgress progressWithTotalUnitCount:-1];
+        __weak __typeof(self) weakSelf = self;
+        _progress.cancellationHandler = ^{
+            dispatch_async(pager.q, ^{
+                [weakSelf finishWithError:[NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil]];
+            });
+        };
+    }
+    return self;
+}
+
+- (void)start {
+    dispatch_async(_q, ^{
+        [self pump];
+    });
+}
+
+- (void)pump {
+    dispatch_assert_current_queue(_q);
+    
+    if (_finished) return;
+    
+    // deliver the next page, if it's here and the consumer is ready for it
+    NSNumber *key = @(_nextDelivery);
+    NSArray *page = _pages[key];
+    if (page && !_consumerBusy) {
+        NSHTTPURLResponse *response = _responses[key];
+        [_pages removeObjectForKey:key];
+        [_responses removeObjectForKey:key];
+        _nextDelivery++;
+        _consumerBusy = YES;
+        _progress.completedUnitCount = _nextDelivery;
         
-        if (pageRequests.count) {
-            __block NSUInteger pagesFinished = 0;
-            __block NSError *pageErr = nil;
-            NSUInteger totalPages = pageRequests.count;
-            for (NSURLRequest *pageRequest in pageRequests) {
-                [self jsonTask:pageRequest completion:^(id page, NSHTTPURLResponse *response2, NSError *err2) {
-                    if (err2 && !pageErr) {
-                        pageErr = err2;
-                    }
-                    
-                    if (page && !err2) {
-                        pageHandler(page);
-                    }
-                    
-                    pagesFinished++;
-                    
-                    if (pagesFinished == totalPages) {
-                        completion(pageErr);
-                    }
-                }];
-            }
-        } else {
-            completion(nil);
-        }
+        _pageHandler(page, response, ^{
+            dispatch_async(_q, ^{
+                _consumerBusy = NO;
+                [self pump];
+            });
+        });
+    }
+    
+    if (_rootArrived && !_consumerBusy && _nextDelivery == _requests.count) {
+        [self finishWithError:nil];
+        return;
+    }
+    
+    // request more pages, staying no more than maxConcurrentPages ahead of the consumer
+    NSInteger window = MAX(1, _pager.maxConcurrentPages);
+    while (!_rateLimited && _unrequested.count && (NSInteger)_tasks.count < window) {
+        NSUInteger idx = _unrequested.firstIndex;
+        if ((NSInteger)idx - _nextDelivery >= window) break;
+        [_unrequested removeIndex:idx];
+        [self request:idx];
+    }
+}
+
+- (void)request:(NSUInteger)idx {
+    _tasks[@(idx)] = [_pager jsonTask:_requests[idx] completion:^(id json, NSHTTPURLResponse *response, NSError *err) {
+        [self didReceivePage:idx json:json response:response error:err];
     }];
 }
 
+- (void)didReceivePage:(NSUInteger)idx json:(id)json response:(NSHTTPURLResponse *)response error:(NSError *)err {
+    dispatch_assert_current_queue(_q);
+    
+    [_tasks removeObjectForKey:@(idx)];
+    if (_finished) return;
+    
+    NSTimeInterval delay = RateLimitDelay(response);
+    
+    if (delay > 0.0 && (response.statusCode == 403 || response.statusCode == 429)) {
+        // rejected for exceeding the rate limit. try again once it resets.
+        [_unrequested addIndex:idx];
+        [self pauseForRateLimit:delay];
+        return;
+    }
+    
+    if (!err && ![json isKindOfClass:[NSArray class]]) {
+        err = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+    }
+    
+    if (err) {
+        [self finishWithError:err];
+        return;
+    }
+    
+    if (idx == 0) {
+        NSArray *pageRequests = [_pager _pageRequestsWithRootRequest:_requests[0] response:response];
+        [_unrequested addIndexesInRange:NSMakeRange(1, pageRequests.count)];
+        [_requests addObjectsFromArray:pageRequests];
+        _rootArrived = YES;
+        _progress.totalUnitCount = _requests.count;
+    }
+    
+    _pages[@(idx)] = json;
+    _responses[@(idx)] = response;
+    
+    if (delay > 0.0) {
+        // this was the last request we're allowed for now
+        [self pauseForRateLimit:delay];
+    }
+    
+    [self pump];
+}
+
+- (void)pauseForRateLimit:(NSTimeInterval)delay {
+    if (_rateLimited) return;
+    
+    DebugLog(@"Rate limited. Pausing %@ for %.0fs", _requests[0].URL, delay);
+    
+    _rateLimited = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _q, ^{
+        _rateLimited = NO;
+        [self pump];
+    });
+}
+
+- (void)finishWithError:(NSError *)err {
+    dispatch_assert_current_queue(_q);
+    
+    if (_finished) return;
+    _finished = YES;
+    
+    for (NSURLSessionDataTask *task in _tasks.allValues) {
+        [task cancel];
+    }
+    [_tasks removeAllObjects];
+    [_pages removeAllObjects];
+    [_responses removeAllObjects];
+    
+    void (^completion)(NSError *) = _completion;
+    _completion = nil;
+    _pageHandler = nil;
+    
+    completion(err);
+}
+
 @end
@@ -11,6 +11,7 @@
 #import "IssueTableController.h"
 #import "IssueTableControllerPrivate.h"
 #import "DataStore.h"
+#import "DataStore+IssueCursor.h"
 #import "Issue.h"
 #import "EmptyUpNextViewController.h"
 #import "UpNextHelper.h"
@@ -30,6 +31,9 @@
 
 @end
 
+static const NSUInteger SearchResultsFirstPageSize = 200;
+static const NSUInteger SearchResultsCursorThreshold = 5000; // fewer than this are loaded in full
+
 @implementation SearchResultsController
 
 @dynamic delegate;
@@ -88,16 +92,54 @@
     NSInteger generation = _searchGeneration;
     self.searching = YES;
     
-    NSArray *sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"number" ascending:YES]];
     NSDictionary *options = nil;
     
     if (self.upNextMode) {
         options = @{ IssueOptionIncludeUpNextPriority : @YES };
     }
     
-    [[DataStore activeStore] issuesMatchingPredicate:predicate sortDescriptors:sortDescriptors options:options completion:^(NSArray<Issue *> *issues, NSError *error) {
+    // Most searches are under the threshold, so load them in full, and only count and set up a cursor when they turn out not to be.
+    BOOL mayUseCursor = !self.upNextMode && [self usesTableCursor];
+    [self loadItemsWithPredicate:predicate options:options limit:mayUseCursor ? SearchResultsCursorThreshold - 1 : NSUIntegerMax generation:generation];
+}
+
+- (void)loadCursorWithPredicate:(NSPredicate *)predicate options:(NSDictionary *)options generation:(NSInteger)generation {
+    [[DataStore activeStore] issueCursorWithPredicate:predicate sortDescriptors:_table.effectiveSortDescriptors options:options completion:^(IssueCursor *cursor, NSError *error) {
+        if (generation != _searchGeneration) return;
+        
+        if (cursor.sortable) {
+            _table.tableCursor = cursor;
+            [self didUpdateItems];
+            self.searching = NO;
+        } else if (cursor) {
+            [self loadItemsWithPredicate:predicate options:options limit:NSUIntegerMax generation:generation];
+        } else {
+            [self presentError:error modalForWindow:self.view.window delegate:nil didPresentSelector:nil contextInfo:NULL];
+            self.searching = NO;
+        }
+    }];
+}
+
+- (void)loadItemsWithPredicate:(NSPredicate *)predicate options:(NSDictionary *)options limit:(NSUInteger)limit generation:(NSInteger)generation {
+    NSArray *sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"number" ascending:YES]];
+    
+    [[DataStore activeStore] issueRowsMatchingPredicate:predicate sortDescriptors:sortDescriptors options:options pageSize:SearchResultsFirstPageSize limit:limit completion:^(NSArray<Issue *> *issues, BOOL complete, NSError *error) {
         if (generation != _searchGeneration) return;
         
+        if (complete && !issues && !error) {
+            // over limit
+            [self loadCursorWithPredicate:predicate options:options generation:generation];
+            return;
+        }
+        
+        if (!complete) {
+            // Only worth showing a partial result in place of nothing. Otherwise keep showing the last results until these are complete.
+            if (_table.itemCount == 0) {
+                _table.tableItems = issues;
+            }
+            return;
+        }
+        
         if (issues) {
             issues = [self willUpdateItems:issues];
             _table.tableItems = issues;
@@ -109,6 +151,10 @@
     }];
 }
 
+- (BOOL)usesTableCursor {
+    return YES;
+}
+
 - (NSArray *)willUpdateItems:(NSArray *)proposedItems {
     return proposedItems;
 }
@@ -149,9 +195,9 @@
     } else {
         [self.titleTimer invalidate];
         self.titleTimer = nil;
-        NSUInteger count = _table.tableItems.count;
+        NSUInteger count = _table.itemCount;
         if (count != 1) {
-            self.title = [NSString localizedStringWithFormat:NSLocalizedString(@"%td items", nil), _table.tableItems.count];
+            self.title = [NSString localizedStringWithFormat:NSLocalizedString(@"%td items", nil), count];
         } else {
             self.title = NSLocalizedString(@"1 item", nil);
         }
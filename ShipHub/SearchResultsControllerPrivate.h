@@ -21,6 +21,10 @@
 
 - (void)refreshWithPredicate:(NSPredicate *)predicate;
 
+// Whether large results are shown through an IssueCursor rather than loaded in full.
+// Subclasses that need every item in hand (see willUpdateItems:) should return NO.
+- (BOOL)usesTableCursor;
+
 - (void)updateTitle;
 
 @end
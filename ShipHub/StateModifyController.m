@@ -8,6 +8,7 @@
 
 #import "StateModifyController.h"
 
+#import "CompiledIssuePredicate.h"
 #import "Extras.h"
 #import "Error.h"
 #import "DataStore.h"
@@ -30,8 +31,8 @@
 
 - (id)initWithIssues:(NSArray<Issue *> *)issues {
     if (self = [super initWithIssues:issues]) {
-        _openIssues = [issues filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"closed = NO"]];
-        _closedIssues = [issues filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"closed = YES"]];
+        _openIssues = [issues filteredArrayUsingPredicate:[CompiledIssuePredicate compiledPredicateWithPredicate:[NSPredicate predicateWithFormat:@"closed = NO"]]];
+        _closedIssues = [issues filteredArrayUsingPredicate:[CompiledIssuePredicate compiledPredicateWithPredicate:[NSPredicate predicateWithFormat:@"closed = YES"]]];
     }
     return self;
 }
@@ -0,0 +1,93 @@
+//
+//  SyncBinaryCodec.h
+//  ShipHub
+//
+//  Created by James Howard on 3/10/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SyncMessageDecoder.h"
+
+/*
+ The binary sync encoding (MessageHeaderBinary) is a compact stand-in for the JSON
+ sync message body. It encodes the same tree of values:
+
+ The body is a version byte (SyncBinaryFormatVersion) followed by a single value,
+ the message, which must be a map. Each value is a tag byte followed by its payload:
+
+   SyncBinaryTagNull, SyncBinaryTagFalse, SyncBinaryTagTrue  no payload
+   SyncBinaryTagUInt      varint n                 n
+   SyncBinaryTagNegInt    varint n                 -1 - n
+   SyncBinaryTagDouble    8 bytes                  IEEE 754, little endian
+   SyncBinaryTagString    varint length, UTF-8     a string
+   SyncBinaryTagDefine    varint length, UTF-8     a string, which is also appended to the string table
+   SyncBinaryTagRef       varint index             the string at index in the string table
+   SyncBinaryTagArray     varint count, values
+   SyncBinaryTagMap       varint count, (key, value) pairs. keys are String, Define or Ref values.
+
+ Varints are unsigned LEB128: 7 bits per byte, least significant group first, high bit set on all but the last byte.
+
+ The string table starts with a fixed shared dictionary of common field names and values, and grows
+ with each Define for the life of the connection, so repeated keys cost one or two bytes after the first use.
+ Both ends must keep their tables in step: a connection that fails to decode a message must reconnect.
+*/
+
+extern NSString *const SyncBinaryEncodingName; // advertised in hello
+
+#define SyncBinaryFormatVersion 1
+
+typedef NS_ENUM(uint8_t, SyncBinaryTag) {
+    SyncBinaryTagNull = 0,
+    SyncBinaryTagFalse = 1,
+    SyncBinaryTagTrue = 2,
+    SyncBinaryTagUInt = 3,
+    SyncBinaryTagNegInt = 4,
+    SyncBinaryTagDouble = 5,
+    SyncBinaryTagString = 6,
+    SyncBinaryTagDefine = 7,
+    SyncBinaryTagRef = 8,
+    SyncBinaryTagArray = 9,
+    SyncBinaryTagMap = 10,
+};
+
+// The per-connection string table. Each end of the connection has its own.
+// Not thread safe.
+@interface SyncBinaryStringTable : NSObject
+
+@property (readonly) NSUInteger count; // includes the shared dictionary
+@property (readonly) NSUInteger sharedCount; // the size of the shared dictionary
+
+- (NSString *)stringAtIndex:(NSUInteger)idx; // nil if out of range
+- (NSUInteger)indexOfString:(NSString *)str; // NSNotFound if absent
+
+// Returns NO if the table is full
+- (BOOL)addString:(NSString *)str;
+
+// Discards strings added after count
+- (void)truncateToCount:(NSUInteger)count;
+
+@end
+
+// Reference encoder, as used by the server. Not thread safe.
+@interface SyncBinaryEncoder : NSObject
+
+- (instancetype)initWithStringTable:(SyncBinaryStringTable *)table;
+
+// Returns the message body (not including the MessageHeader byte), or nil if message contains values
+// that aren't representable in JSON.
+- (NSData *)encodeMessage:(NSDictionary *)message;
+
+@end
+
+/*
+ SyncBinaryDecoder incrementally decodes a single binary sync message, as
+ SyncMessageDecoder does for JSON messages, adding strings defined by the message
+ to table.
+*/
+@interface SyncBinaryDecoder : NSObject <SyncMessageDecoding>
+
+- (instancetype)initWithStringTable:(SyncBinaryStringTable *)table streamedArrayKey:(NSString *)key batchSize:(NSUInteger)batchSize batchHandler:(SyncMessageDecoderBatchHandler)handler;
+
+@end
@@ -0,0 +1,571 @@
+//
+//  SyncBinaryCodec.m
+//  ShipHub
+//
+//  Created by James Howard on 3/10/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "SyncBinaryCodec.h"
+
+#import "Error.h"
+#import "Extras.h"
+#import "SyncConnection.h"
+
+NSString *const SyncBinaryEncodingName = @"binary1";
+
+#define MAX_DEPTH 64
+#define MAX_TABLE_COUNT (1 << 16)
+#define MAX_INTERNED_VALUE_LENGTH 16 // string values longer than this (e.g. dates, bodies) aren't worth interning
+
+// Never reorder or remove entries from this list: both ends of the connection must agree on it.
+// New entries may only be added along with a new SyncBinaryFormatVersion.
+static NSArray<NSString *> *SharedDictionary() {
+    static NSArray *dict;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        dict = @[
+            // message fields
+            @"msg", @"hello", @"sync", @"purge", @"subscription", @"ratelimit",
+            @"versions", @"logs", @"remaining", @"spiderProgress", @"progress",
+            @"purgeIdentifier", @"upgrade", @"version", @"until",
+            // log entries
+            @"action", @"set", @"delete", @"entity", @"data",
+            // entities
+            @"account", @"user", @"org", @"repo", @"issue", @"comment", @"event", @"milestone",
+            @"label", @"reaction", @"project", @"pullrequest", @"prcomment", @"prreview", @"query",
+            // common fields
+            @"identifier", @"id", @"login", @"name", @"type", @"User", @"Organization",
+            @"number", @"title", @"body", @"state", @"open", @"closed", @"locked",
+            @"createdAt", @"updatedAt", @"closedAt", @"dueOn", @"description",
+            @"repository", @"assignees", @"labels", @"color", @"fullName", @"owner", @"private",
+            @"comments", @"closedBy", @"avatarUrl", @"content", @"commitId", @"sha", @"url",
+        ];
+    });
+    return dict;
+}
+
+@implementation SyncBinaryStringTable {
+    NSMutableArray<NSString *> *_strings;
+    NSMutableDictionary<NSString *, NSNumber *> *_indexes;
+    NSUInteger _sharedCount;
+}
+
+- (id)init {
+    if (self = [super init]) {
+        NSArray *shared = SharedDictionary();
+        _sharedCount = shared.count;
+        _strings = [shared mutableCopy];
+        _indexes = [NSMutableDictionary dictionaryWithCapacity:shared.count];
+        [shared enumerateObjectsUsingBlock:^(NSString *str, NSUInteger idx, BOOL *stop) {
+            _indexes[str] = @(idx);
+        }];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return _strings.count;
+}
+
+- (NSUInteger)sharedCount {
+    return _sharedCount;
+}
+
+- (NSString *)stringAtIndex:(NSUInteger)idx {
+    return idx < _strings.count ? _strings[idx] : nil;
+}
+
+- (NSUInteger)indexOfString:(NSString *)str {
+    NSNumber *idx = _indexes[str];
+    return idx ? [idx unsignedIntegerValue] : NSNotFound;
+}
+
+- (BOOL)addString:(NSString *)str {
+    if (_strings.count >= MAX_TABLE_COUNT) return NO;
+    if (!_indexes[str]) {
+        _indexes[str] = @(_strings.count);
+    }
+    [_strings addObject:str];
+    return YES;
+}
+
+- (void)truncateToCount:(NSUInteger)count {
+    while (_strings.count > MAX(count, _sharedCount)) {
+        NSString *str = [_strings lastObject];
+        if ([_indexes[str] unsignedIntegerValue] == _strings.count - 1) {
+            [_indexes removeObjectForKey:str];
+        }
+        [_strings removeLastObject];
+    }
+}
+
+@end
+
+#pragma mark - Encoding
+
+@implementation SyncBinaryEncoder {
+    SyncBinaryStringTable *_table;
+    NSMutableData *_out;
+}
+
+- (instancetype)initWithStringTable:(SyncBinaryStringTable *)table {
+    NSParameterAssert(table);
+    if (self = [super init]) {
+        _table = table;
+    }
+    return self;
+}
+
+static void WriteVarint(NSMutableData *out, uint64_t v) {
+    uint8_t buf[10];
+    size_t n = 0;
+    do {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        buf[n++] = v ? (b | 0x80) : b;
+    } while (v);
+    [out appendBytes:buf length:n];
+}
+
+static void WriteTag(NSMutableData *out, SyncBinaryTag tag) {
+    [out appendBytes:&tag length:1];
+}
+
+- (void)writeString:(NSString *)str intern:(BOOL)intern {
+    NSUInteger idx = [_table indexOfString:str];
+    if (idx != NSNotFound) {
+        WriteTag(_out, SyncBinaryTagRef);
+        WriteVarint(_out, idx);
+        return;
+    }
+
+    const char *utf8 = [str UTF8String];
+    size_t length = strlen(utf8);
+    if (intern && length <= MAX_INTERNED_VALUE_LENGTH && [_table addString:str]) {
+        WriteTag(_out, SyncBinaryTagDefine);
+    } else {
+        WriteTag(_out, SyncBinaryTagString);
+    }
+    WriteVarint(_out, length);
+    [_out appendBytes:utf8 length:length];
+}
+
+- (BOOL)writeValue:(id)value depth:(NSInteger)depth {
+    if (depth > MAX_DEPTH) return NO;
+
+    if (value == nil || value == [NSNull null]) {
+        WriteTag(_out, SyncBinaryTagNull);
+    } else if ([value isKindOfClass:[NSString class]]) {
+        [self writeString:value intern:YES];
+    } else if ([value isKindOfClass:[NSNumber class]]) {
+        NSNumber *num = value;
+        if (CFGetTypeID((__bridge CFTypeRef)num) == CFBooleanGetTypeID()) {
+            WriteTag(_out, [num boolValue] ? SyncBinaryTagTrue : SyncBinaryTagFalse);
+        } else if (CFNumberIsFloatType((__bridge CFNumberRef)num)) {
+            double d = [num doubleValue];
+            if (!isfinite(d)) return NO;
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            bits = CFSwapInt64HostToLittle(bits);
+            WriteTag(_out, SyncBinaryTagDouble);
+            [_out appendBytes:&bits length:sizeof(bits)];
+        } else if (strcmp([num objCType], @encode(unsigned long long)) == 0 || strcmp([num objCType], @encode(unsigned long)) == 0) {
+            WriteTag(_out, SyncBinaryTagUInt);
+            WriteVarint(_out, [num unsignedLongLongValue]);
+        } else {
+            int64_t i = [num longLongValue];
+            if (i >= 0) {
+                WriteTag(_out, SyncBinaryTagUInt);
+                WriteVarint(_out, (uint64_t)i);
+            } else {
+                WriteTag(_out, SyncBinaryTagNegInt);
+                WriteVarint(_out, (uint64_t)(-(i + 1)));
+            }
+        }
+    } else if ([value isKindOfClass:[NSArray class]]) {
+        NSArray *array = value;
+        WriteTag(_out, SyncBinaryTagArray);
+        WriteVarint(_out, array.count);
+        for (id elem in array) {
+            if (![self writeValue:elem depth:depth+1]) return NO;
+        }
+    } else if ([value isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dict = value;
+        WriteTag(_out, SyncBinaryTagMap);
+        WriteVarint(_out, dict.count);
+        for (id key in dict) {
+            if (![key isKindOfClass:[NSString class]]) return NO;
+            [self writeString:key intern:YES];
+            if (![self writeValue:dict[key] depth:depth+1]) return NO;
+        }
+    } else {
+        return NO;
+    }
+
+    return YES;
+}
+
+- (NSData *)encodeMessage:(NSDictionary *)message {
+    NSParameterAssert([message isKindOfClass:[NSDictionary class]]);
+
+    NSUInteger tableCount = _table.count;
+
+    _out = [NSMutableData new];
+    uint8_t version = SyncBinaryFormatVersion;
+    [_out appendBytes:&version length:1];
+
+    BOOL ok = [self writeValue:message depth:0];
+    NSData *result = ok ? _out : nil;
+    _out = nil;
+
+    if (!ok) {
+        // the message won't be sent, so neither are its definitions
+        [_table truncateToCount:tableCount];
+    }
+
+    return result;
+}
+
+@end
+
+#pragma mark - Decoding
+
+typedef NS_ENUM(NSInteger, ReadStatus) {
+    ReadOK,
+    ReadNeedMore,
+    ReadError
+};
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+} Reader;
+
+static ReadStatus ReadVarint(Reader *r, uint64_t *out) {
+    uint64_t v = 0;
+    for (NSUInteger shift = 0; shift < 64; shift += 7) {
+        if (r->p == r->end) return ReadNeedMore;
+        uint8_t b = *r->p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return ReadOK;
+        }
+    }
+    return ReadError; // longer than 10 bytes
+}
+
+static ReadStatus ReadValue(Reader *r, SyncBinaryStringTable *table, NSInteger depth, id *out);
+
+static ReadStatus ReadString(Reader *r, SyncBinaryStringTable *table, SyncBinaryTag tag, NSString **out) {
+    ReadStatus s;
+    uint64_t n;
+    if ((s = ReadVarint(r, &n)) != ReadOK) return s;
+
+    if (tag == SyncBinaryTagRef) {
+        NSString *str = [table stringAtIndex:n];
+        if (!str) return ReadError;
+        *out = str;
+        return ReadOK;
+    }
+
+    if (n > (uint64_t)(r->end - r->p)) return ReadNeedMore;
+    NSString *str = [[NSString alloc] initWithBytes:r->p length:n encoding:NSUTF8StringEncoding];
+    if (!str) return ReadError;
+    r->p += n;
+
+    if (tag == SyncBinaryTagDefine && ![table addString:str]) {
+        return ReadError;
+    }
+
+    *out = str;
+    return ReadOK;
+}
+
+static ReadStatus ReadValue(Reader *r, SyncBinaryStringTable *table, NSInteger depth, id *out) {
+    if (depth > MAX_DEPTH) return ReadError;
+    if (r->p == r->end) return ReadNeedMore;
+
+    SyncBinaryTag tag = *r->p++;
+    ReadStatus s;
+    uint64_t n;
+
+    switch (tag) {
+        case SyncBinaryTagNull:
+            *out = [NSNull null];
+            return ReadOK;
+        case SyncBinaryTagFalse:
+            *out = @NO;
+            return ReadOK;
+        case SyncBinaryTagTrue:
+            *out = @YES;
+            return ReadOK;
+        case SyncBinaryTagUInt:
+            if ((s = ReadVarint(r, &n)) != ReadOK) return s;
+            *out = @(n);
+            return ReadOK;
+        case SyncBinaryTagNegInt:
+            if ((s = ReadVarint(r, &n)) != ReadOK) return s;
+            if (n > INT64_MAX) return ReadError;
+            *out = @(-1 - (int64_t)n);
+            return ReadOK;
+        case SyncBinaryTagDouble: {
+            if (r->end - r->p < 8) return ReadNeedMore;
+            uint64_t bits;
+            memcpy(&bits, r->p, sizeof(bits));
+            r->p += 8;
+            bits = CFSwapInt64LittleToHost(bits);
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            *out = @(d);
+            return ReadOK;
+        }
+        case SyncBinaryTagString:
+        case SyncBinaryTagDefine:
+        case SyncBinaryTagRef: {
+            NSString *str = nil;
+            if ((s = ReadString(r, table, tag, &str)) != ReadOK) return s;
+            *out = str;
+            return ReadOK;
+        }
+        case SyncBinaryTagArray: {
+            if ((s = ReadVarint(r, &n)) != ReadOK) return s;
+            // every element is at least 1 byte, so don't trust a count larger than what could possibly be there
+            NSMutableArray *array = [NSMutableArray arrayWithCapacity:MIN(n, (uint64_t)(r->end - r->p))];
+            for (uint64_t i = 0; i < n; i++) {
+                id elem = nil;
+                if ((s = ReadValue(r, table, depth+1, &elem)) != ReadOK) return s;
+                [array addObject:elem];
+            }
+            *out = array;
+            return ReadOK;
+        }
+        case SyncBinaryTagMap: {
+            if ((s = ReadVarint(r, &n)) != ReadOK) return s;
+            NSMutableDictionary *dict = [NSMutableDictionary dictionaryWithCapacity:MIN(n, (uint64_t)(r->end - r->p) / 2)];
+            for (uint64_t i = 0; i < n; i++) {
+                if (r->p == r->end) return ReadNeedMore;
+                SyncBinaryTag keyTag = *r->p++;
+                if (keyTag != SyncBinaryTagString && keyTag != SyncBinaryTagDefine && keyTag != SyncBinaryTagRef) return ReadError;
+                NSString *key = nil;
+                if ((s = ReadString(r, table, keyTag, &key)) != ReadOK) return s;
+                id val = nil;
+                if ((s = ReadValue(r, table, depth+1, &val)) != ReadOK) return s;
+                dict[key] = val;
+            }
+            *out = dict;
+            return ReadOK;
+        }
+        default:
+            return ReadError;
+    }
+}
+
+typedef NS_ENUM(NSInteger, BinaryDecoderState) {
+    BinaryDecoderStateVersion,      // expecting the format version
+    BinaryDecoderStateMessage,      // expecting the message map header
+    BinaryDecoderStateField,        // expecting a top level key and value, or the end of the message
+    BinaryDecoderStateArrayElement, // inside the streamed array
+    BinaryDecoderStateDone,
+    BinaryDecoderStateError
+};
+
+@implementation SyncBinaryDecoder {
+    SyncBinaryStringTable *_table;
+    NSString *_streamedKey;
+    NSUInteger _batchSize;
+    SyncMessageDecoderBatchHandler _handler;
+
+    // Unconsumed bytes live in _buf[_start, _len)
+    uint8_t *_buf;
+    size_t _cap;
+    size_t _len;
+    size_t _start;
+
+    BinaryDecoderState _state;
+    uint64_t _fieldsRemaining;
+    uint64_t _elementsRemaining;
+
+    NSMutableDictionary *_fields;
+    NSMutableArray<SyncEntry *> *_batch;
+    NSUInteger _entryCount;
+}
+
+- (instancetype)initWithStringTable:(SyncBinaryStringTable *)table streamedArrayKey:(NSString *)key batchSize:(NSUInteger)batchSize batchHandler:(SyncMessageDecoderBatchHandler)handler
+{
+    NSParameterAssert(table);
+    NSParameterAssert(key);
+    NSParameterAssert(handler);
+
+    if (self = [super init]) {
+        _table = table;
+        _streamedKey = [key copy];
+        _batchSize = MAX(batchSize, 1);
+        _handler = [handler copy];
+        _fields = [NSMutableDictionary new];
+        _batch = [NSMutableArray new];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_buf);
+}
+
+- (NSDictionary *)fields {
+    return _fields;
+}
+
+- (NSUInteger)entryCount {
+    return _entryCount;
+}
+
+- (BOOL)appendBytes:(const void *)bytes length:(NSUInteger)length {
+    if (_state == BinaryDecoderStateError) return NO;
+    if (length == 0) return YES;
+
+    if (_start > 0) {
+        memmove(_buf, _buf + _start, _len - _start);
+        _len -= _start;
+        _start = 0;
+    }
+    if (_len + length > _cap) {
+        size_t cap = MAX(_cap * 2, (size_t)4096);
+        while (cap < _len + length) cap *= 2;
+        _buf = reallocf(_buf, cap);
+        _cap = cap;
+    }
+    memcpy(_buf + _len, bytes, length);
+    _len += length;
+
+    [self decode];
+
+    return _state != BinaryDecoderStateError;
+}
+
+// Decodes as much as possible from the buffered bytes. Anything that's incomplete is
+// left in the buffer, along with any strings it defined, to be decoded again when more arrives.
+- (void)decode {
+    while (_state != BinaryDecoderStateDone && _state != BinaryDecoderStateError) {
+        Reader r = { _buf + _start, _buf + _len };
+        NSUInteger tableCount = _table.count;
+        ReadStatus s = ReadOK;
+        uint64_t n;
+
+        switch (_state) {
+            case BinaryDecoderStateVersion:
+                if (r.p == r.end) {
+                    s = ReadNeedMore;
+                } else if (*r.p++ != SyncBinaryFormatVersion) {
+                    s = ReadError;
+                } else {
+                    _state = BinaryDecoderStateMessage;
+                }
+                break;
+            case BinaryDecoderStateMessage:
+                if (r.p == r.end) {
+                    s = ReadNeedMore;
+                } else if (*r.p++ != SyncBinaryTagMap) {
+                    s = ReadError;
+                } else if ((s = ReadVarint(&r, &n)) == ReadOK) {
+                    _fieldsRemaining = n;
+                    _state = BinaryDecoderStateField;
+                }
+                break;
+            case BinaryDecoderStateField: {
+                if (_fieldsRemaining == 0) {
+                    _state = BinaryDecoderStateDone;
+                    break;
+                }
+                if (r.p == r.end) {
+                    s = ReadNeedMore;
+                    break;
+                }
+                SyncBinaryTag keyTag = *r.p++;
+                if (keyTag != SyncBinaryTagString && keyTag != SyncBinaryTagDefine && keyTag != SyncBinaryTagRef) {
+                    s = ReadError;
+                    break;
+                }
+                NSString *key = nil;
+                if ((s = ReadString(&r, _table, keyTag, &key)) != ReadOK) break;
+
+                if ([key isEqualToString:_streamedKey] && r.p != r.end && *r.p == SyncBinaryTagArray) {
+                    r.p++;
+                    if ((s = ReadVarint(&r, &n)) == ReadOK) {
+                        _fieldsRemaining--;
+                        _elementsRemaining = n;
+                        _state = BinaryDecoderStateArrayElement;
+                    }
+                } else if (r.p == r.end) {
+                    s = ReadNeedMore;
+                } else {
+                    id val = nil;
+                    if ((s = ReadValue(&r, _table, 1, &val)) == ReadOK) {
+                        _fields[key] = val;
+                        _fieldsRemaining--;
+                    }
+                }
+                break;
+            }
+            case BinaryDecoderStateArrayElement: {
+                if (_elementsRemaining == 0) {
+                    _state = BinaryDecoderStateField;
+                    break;
+                }
+                id elem = nil;
+                if ((s = ReadValue(&r, _table, 2, &elem)) == ReadOK) {
+                    if (![elem isKindOfClass:[NSDictionary class]]) {
+                        s = ReadError;
+                        break;
+                    }
+                    _elementsRemaining--;
+                    [self addEntry:[SyncEntry entryWithDictionary:elem]];
+                }
+                break;
+            }
+            case BinaryDecoderStateDone:
+            case BinaryDecoderStateError:
+                break;
+        }
+
+        if (s == ReadOK) {
+            _start = r.p - _buf;
+        } else {
+            [_table truncateToCount:tableCount];
+            if (s == ReadError) {
+                _state = BinaryDecoderStateError;
+            }
+            return;
+        }
+    }
+
+    if (_state == BinaryDecoderStateDone && _start != _len) {
+        // trailing garbage
+        _state = BinaryDecoderStateError;
+    }
+}
+
+- (void)addEntry:(SyncEntry *)entry {
+    [_batch addObject:entry];
+    _entryCount++;
+    if (_batch.count == _batchSize) {
+        NSArray *batch = _batch;
+        _batch = [NSMutableArray new];
+        _handler(batch);
+    }
+}
+
+- (NSArray<SyncEntry *> *)finish:(NSError *__autoreleasing *)error {
+    if (_state != BinaryDecoderStateDone) {
+        _state = BinaryDecoderStateError;
+        if (error) *error = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+        return nil;
+    }
+
+    NSArray *remaining = _batch;
+    _batch = [NSMutableArray new];
+    return remaining;
+}
+
+@end
@@ -62,4 +62,7 @@ typedef NS_ENUM(NSInteger, SyncEntryAction) {
 
 + (instancetype)entryWithDictionary:(NSDictionary *)dict;
 
+// The inverse of entryWithDictionary:, as the server would send it
+- (NSDictionary *)dictionaryRepresentation;
+
 @end
@@ -57,6 +57,12 @@
     return e;
 }
 
+- (NSDictionary *)dictionaryRepresentation {
+    return @{ @"action" : _action == SyncEntryActionSet ? @"set" : @"delete",
+              @"entity" : _entityName ?: @"",
+              @"data" : _data ?: [NSNull null] };
+}
+
 - (NSString *)description {
     return [NSString stringWithFormat:@"{%s %@} : %@", _action == SyncEntryActionSet ? "set" : "del", _entityName, _data];
 }
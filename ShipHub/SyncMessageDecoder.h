@@ -0,0 +1,60 @@
+//
+//  SyncMessageDecoder.h
+//  ShipHub
+//
+//  Created by James Howard on 3/1/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class SyncEntry;
+
+/*
+ SyncMessageDecoder incrementally decodes a single sync socket message.
+
+ Bytes are fed in as they become available (optionally deflated), and the
+ decoder inflates and scans them in a single pass. Elements of the streamed
+ array field (e.g. "logs") are turned into SyncEntry objects as soon as each
+ element is complete and handed off in batches of at most batchSize entries,
+ so the full message never needs to be materialized as one NSDictionary.
+ The last partial batch is not given to the batchHandler, but is instead
+ returned from -finish:, once the rest of the message is known.
+
+ All other top level fields of the message are collected into fields.
+
+ SyncMessageDecoder is not thread safe. Use it from a single queue.
+*/
+
+typedef void (^SyncMessageDecoderBatchHandler)(NSArray<SyncEntry *> *entries);
+
+// The batchSize WSSyncConnection decodes with: the most log entries handed to its delegate at once
+// while a sync message is still being decoded.
+extern const NSUInteger SyncEntryBatchSize;
+
+// The first byte of each sync socket message, identifying how the rest is encoded.
+typedef NS_ENUM(uint8_t, MessageHeader) {
+    MessageHeaderPlainText = 0,
+    MessageHeaderDeflate = 1,
+    MessageHeaderBinary = 2, // see SyncBinaryCodec.h
+};
+
+@protocol SyncMessageDecoding <NSObject>
+
+// Returns NO if the data is malformed. Once NO has been returned, further calls are ignored.
+- (BOOL)appendBytes:(const void *)bytes length:(NSUInteger)length;
+
+// Returns the final, possibly empty, partial batch of entries that were not yet delivered to the batchHandler.
+// Returns nil if the message is incomplete or malformed.
+- (NSArray<SyncEntry *> *)finish:(NSError *__autoreleasing *)error;
+
+@property (readonly) NSDictionary *fields; // top level fields, excluding the streamed array
+@property (readonly) NSUInteger entryCount; // total number of entries decoded so far
+
+@end
+
+@interface SyncMessageDecoder : NSObject <SyncMessageDecoding>
+
+- (instancetype)initWithStreamedArrayKey:(NSString *)key compressed:(BOOL)compressed batchSize:(NSUInteger)batchSize batchHandler:(SyncMessageDecoderBatchHandler)handler;
+
+@end
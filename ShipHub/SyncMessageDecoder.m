@@ -0,0 +1,389 @@
+//
+//  SyncMessageDecoder.m
+//  ShipHub
+//
+//  Created by James Howard on 3/1/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "SyncMessageDecoder.h"
+
+#import "Error.h"
+#import "Extras.h"
+#import "SyncConnection.h"
+
+#import <zlib.h>
+
+#define INFLATE_CHUNK (64 * 1024)
+
+const NSUInteger SyncEntryBatchSize = 1000;
+
+typedef NS_ENUM(NSInteger, DecoderState) {
+    DecoderStateBegin,             // expecting '{'
+    DecoderStateKeyOrEnd,          // expecting '"' or '}'
+    DecoderStateKey,               // scanning a key string
+    DecoderStateColon,             // expecting ':'
+    DecoderStateValue,             // expecting the start of a value
+    DecoderStateScalarValue,       // scanning a top level value (not the streamed array)
+    DecoderStateArrayElementOrEnd, // inside the streamed array, expecting an element or ']'
+    DecoderStateArrayElement,      // scanning an element of the streamed array
+    DecoderStateArrayCommaOrEnd,   // inside the streamed array, expecting ',' or ']'
+    DecoderStateCommaOrEnd,        // expecting ',' or '}'
+    DecoderStateDone,
+    DecoderStateError
+};
+
+static inline BOOL IsJSONWhitespace(uint8_t c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline BOOL IsJSONDelimiter(uint8_t c) {
+    return c == ',' || c == '}' || c == ']' || IsJSONWhitespace(c);
+}
+
+@implementation SyncMessageDecoder {
+    NSString *_streamedKey;
+    NSUInteger _batchSize;
+    SyncMessageDecoderBatchHandler _handler;
+
+    BOOL _compressed;
+    BOOL _inflateDone;
+    z_stream _strm;
+
+    // Unconsumed bytes live in _buf[_start, _len). _pos is the scan position.
+    uint8_t *_buf;
+    size_t _cap;
+    size_t _len;
+    size_t _start;
+    size_t _pos;
+
+    DecoderState _state;
+
+    // Value scanner state. Persists across calls to -appendBytes:length: so no byte is scanned twice.
+    size_t _valueStart;
+    NSInteger _depth;
+    BOOL _inString;
+    BOOL _escape;
+    BOOL _scalar;
+
+    NSString *_currentKey;
+    NSMutableDictionary *_fields;
+    NSMutableArray<SyncEntry *> *_batch;
+    NSUInteger _entryCount;
+}
+
+- (instancetype)initWithStreamedArrayKey:(NSString *)key compressed:(BOOL)compressed batchSize:(NSUInteger)batchSize batchHandler:(SyncMessageDecoderBatchHandler)handler
+{
+    NSParameterAssert(key);
+    NSParameterAssert(handler);
+
+    if (self = [super init]) {
+        _streamedKey = [key copy];
+        _batchSize = MAX(batchSize, 1);
+        _handler = [handler copy];
+        _fields = [NSMutableDictionary new];
+        _batch = [NSMutableArray new];
+
+        _compressed = compressed;
+        if (_compressed) {
+            memset(&_strm, 0, sizeof(_strm));
+            if (inflateInit2(&_strm, MAX_WBITS|32) != Z_OK) {
+                _compressed = NO;
+                _state = DecoderStateError;
+            }
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_compressed) {
+        inflateEnd(&_strm);
+    }
+    free(_buf);
+}
+
+- (NSDictionary *)fields {
+    return _fields;
+}
+
+- (NSUInteger)entryCount {
+    return _entryCount;
+}
+
+#pragma mark - Input
+
+- (void)reserve:(size_t)additional {
+    if (_start > 0 && (_start >= _len / 2 || _len + additional > _cap)) {
+        // Compact. Everything before _start has been consumed.
+        size_t live = _len - _start;
+        memmove(_buf, _buf + _start, live);
+        _len = live;
+        _pos -= _start;
+        _valueStart = _valueStart >= _start ? _valueStart - _start : 0;
+        _start = 0;
+    }
+    if (_len + additional > _cap) {
+        size_t cap = MAX(_cap * 2, (size_t)INFLATE_CHUNK);
+        while (cap < _len + additional) cap *= 2;
+        _buf = reallocf(_buf, cap);
+        _cap = cap;
+    }
+}
+
+- (void)appendPlainBytes:(const uint8_t *)bytes length:(size_t)length {
+    [self reserve:length];
+    memcpy(_buf + _len, bytes, length);
+    _len += length;
+    [self scan];
+}
+
+- (BOOL)appendBytes:(const void *)bytes length:(NSUInteger)length {
+    if (_state == DecoderStateError) return NO;
+    if (length == 0) return YES;
+
+    if (!_compressed) {
+        [self appendPlainBytes:bytes length:length];
+        return _state != DecoderStateError;
+    }
+
+    if (_inflateDone) {
+        // trailing garbage after the end of the deflate stream
+        _state = DecoderStateError;
+        return NO;
+    }
+
+    _strm.next_in = (Bytef *)bytes;
+    _strm.avail_in = (uInt)length;
+
+    do {
+        // Inflate directly into the tail of the scan buffer
+        [self reserve:INFLATE_CHUNK];
+        _strm.next_out = _buf + _len;
+        _strm.avail_out = INFLATE_CHUNK;
+
+        int ret = inflate(&_strm, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            ErrLog(@"inflate failed: %d", ret);
+            _state = DecoderStateError;
+            return NO;
+        }
+
+        _len += INFLATE_CHUNK - _strm.avail_out;
+        [self scan];
+
+        if (ret == Z_STREAM_END) {
+            _inflateDone = YES;
+            break;
+        }
+        if (ret == Z_BUF_ERROR && _strm.avail_in == 0) {
+            break;
+        }
+    } while (_state != DecoderStateError && (_strm.avail_in > 0 || _strm.avail_out == 0));
+
+    return _state != DecoderStateError;
+}
+
+- (NSArray<SyncEntry *> *)finish:(NSError *__autoreleasing *)error {
+    if (_state != DecoderStateDone || (_compressed && !_inflateDone)) {
+        _state = DecoderStateError;
+        if (error) *error = [NSError shipErrorWithCode:ShipErrorCodeUnexpectedServerResponse];
+        return nil;
+    }
+
+    NSArray *remaining = _batch;
+    _batch = [NSMutableArray new];
+    return remaining;
+}
+
+#pragma mark - Scanning
+
+- (void)beginValueAt:(size_t)pos {
+    _valueStart = pos;
+    _depth = 0;
+    _inString = NO;
+    _escape = NO;
+    uint8_t c = _buf[pos];
+    _scalar = !(c == '{' || c == '[' || c == '"');
+}
+
+// Advances _pos through the current value. Returns YES once the value is complete, leaving _pos just past its end.
+- (BOOL)scanValue {
+    const uint8_t *buf = _buf;
+    size_t pos = _pos, len = _len;
+
+    if (_scalar) {
+        while (pos < len && !IsJSONDelimiter(buf[pos])) pos++;
+        _pos = pos;
+        return pos < len;
+    }
+
+    while (pos < len) {
+        uint8_t c = buf[pos++];
+        if (_inString) {
+            if (_escape) {
+                _escape = NO;
+            } else if (c == '\\') {
+                _escape = YES;
+            } else if (c == '"') {
+                _inString = NO;
+                if (_depth == 0) {
+                    _pos = pos;
+                    return YES;
+                }
+            }
+        } else if (c == '"') {
+            _inString = YES;
+        } else if (c == '{' || c == '[') {
+            _depth++;
+        } else if (c == '}' || c == ']') {
+            if (--_depth == 0) {
+                _pos = pos;
+                return YES;
+            }
+        }
+    }
+
+    _pos = pos;
+    return NO;
+}
+
+- (id)parseValueInRange:(size_t)start end:(size_t)end {
+    NSData *data = [NSData dataWithBytesNoCopy:_buf + start length:end - start freeWhenDone:NO];
+    NSError *err = nil;
+    id val = [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingAllowFragments error:&err];
+    if (err) {
+        ErrLog(@"%@", err);
+    }
+    return val;
+}
+
+- (void)flushBatch {
+    if (_batch.count == 0) return;
+    NSArray *batch = _batch;
+    _batch = [NSMutableArray arrayWithCapacity:_batchSize];
+    _handler(batch);
+}
+
+- (void)scan {
+    @autoreleasepool {
+        while (_state != DecoderStateError && _state != DecoderStateDone) {
+            if (_state != DecoderStateKey && _state != DecoderStateScalarValue && _state != DecoderStateArrayElement) {
+                while (_pos < _len && IsJSONWhitespace(_buf[_pos])) _pos++;
+                _start = _pos;
+            }
+            if (_pos >= _len) break;
+
+            uint8_t c = _buf[_pos];
+
+            switch (_state) {
+                case DecoderStateBegin:
+                    if (c != '{') { _state = DecoderStateError; break; }
+                    _pos++;
+                    _state = DecoderStateKeyOrEnd;
+                    break;
+
+                case DecoderStateKeyOrEnd:
+                    if (c == '}') {
+                        _pos++;
+                        _state = DecoderStateDone;
+                    } else if (c == '"') {
+                        [self beginValueAt:_pos];
+                        _state = DecoderStateKey;
+                    } else {
+                        _state = DecoderStateError;
+                    }
+                    break;
+
+                case DecoderStateKey:
+                    if ([self scanValue]) {
+                        _currentKey = [self parseValueInRange:_valueStart end:_pos];
+                        _state = [_currentKey isKindOfClass:[NSString class]] ? DecoderStateColon : DecoderStateError;
+                    }
+                    break;
+
+                case DecoderStateColon:
+                    if (c != ':') { _state = DecoderStateError; break; }
+                    _pos++;
+                    _state = DecoderStateValue;
+                    break;
+
+                case DecoderStateValue:
+                    if ([_currentKey isEqualToString:_streamedKey] && c == '[') {
+                        _pos++;
+                        _state = DecoderStateArrayElementOrEnd;
+                    } else {
+                        [self beginValueAt:_pos];
+                        _state = DecoderStateScalarValue;
+                    }
+                    break;
+
+                case DecoderStateScalarValue:
+                    if ([self scanValue]) {
+                        id val = [self parseValueInRange:_valueStart end:_pos];
+                        if (!val) { _state = DecoderStateError; break; }
+                        _fields[_currentKey] = val;
+                        _state = DecoderStateCommaOrEnd;
+                    }
+                    break;
+
+                case DecoderStateArrayElementOrEnd:
+                    if (c == ']') {
+                        _pos++;
+                        _state = DecoderStateCommaOrEnd;
+                    } else {
+                        [self beginValueAt:_pos];
+                        _state = DecoderStateArrayElement;
+                    }
+                    break;
+
+                case DecoderStateArrayElement:
+                    if ([self scanValue]) {
+                        id val = [self parseValueInRange:_valueStart end:_pos];
+                        if (![val isKindOfClass:[NSDictionary class]]) { _state = DecoderStateError; break; }
+                        [_batch addObject:[SyncEntry entryWithDictionary:val]];
+                        _entryCount++;
+                        if (_batch.count >= _batchSize) {
+                            [self flushBatch];
+                        }
+                        _state = DecoderStateArrayCommaOrEnd;
+                    }
+                    break;
+
+                case DecoderStateArrayCommaOrEnd:
+                    if (c == ',') {
+                        _pos++;
+                        _state = DecoderStateArrayElementOrEnd;
+                    } else if (c == ']') {
+                        _pos++;
+                        _state = DecoderStateCommaOrEnd;
+                    } else {
+                        _state = DecoderStateError;
+                    }
+                    break;
+
+                case DecoderStateCommaOrEnd:
+                    if (c == ',') {
+                        _pos++;
+                        _state = DecoderStateKeyOrEnd;
+                    } else if (c == '}') {
+                        _pos++;
+                        _state = DecoderStateDone;
+                    } else {
+                        _state = DecoderStateError;
+                    }
+                    break;
+
+                case DecoderStateDone:
+                case DecoderStateError:
+                    break;
+            }
+
+            if (_state == DecoderStateKey || _state == DecoderStateScalarValue || _state == DecoderStateArrayElement) {
+                if (_pos >= _len) break; // need more data to complete the value
+            }
+        }
+    }
+}
+
+@end
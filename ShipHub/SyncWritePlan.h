@@ -0,0 +1,47 @@
+//
+//  SyncWritePlan.h
+//  ShipHub
+//
+//  Created by James Howard on 3/5/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+@class SyncEntry;
+@class EntityCacheKey;
+
+/*
+ SyncWritePlan writes a batch of SyncEntries into a managed object context.
+
+ Writing happens in three phases:
+ 1. Planning (-addEntries:) walks every entry, including all nested objects,
+    and records every identifier referenced for each entity. This does not
+    touch Core Data and may be done on any queue.
+ 2. Resolution issues a single identifier IN fetch per entity referenced by
+    the plan, prefetching any to-many relationships that will be diffed.
+ 3. Application merges attributes and relationships from the entries in a
+    flat loop, without any further per-object fetches.
+*/
+
+@interface SyncWritePlan : NSObject
+
+// Returns a mapping of sync entity names (e.g. "issue") to managed object model entity names (e.g. "LocalIssue").
++ (NSDictionary<NSString *, NSString *> *)syncEntityNamesForModel:(NSManagedObjectModel *)mom;
+
+- (instancetype)initWithModel:(NSManagedObjectModel *)mom syncEntityNames:(NSDictionary<NSString *, NSString *> *)syncEntityNames;
+
+- (void)addEntries:(NSArray<SyncEntry *> *)entries;
+
+// Must be called on moc's queue. Does not call save:.
+// moc may already have unsaved changes, e.g. from other writes coalesced into the same save.
+- (void)executeInContext:(NSManagedObjectContext *)moc;
+
+// Every object fetched or inserted by the plan. Valid after -executeInContext:.
+@property (readonly) NSDictionary<EntityCacheKey *, NSManagedObject *> *objectCache;
+
+@property (readonly) NSUInteger entryCount;
+@property (readonly) NSUInteger fetchCount; // number of fetch requests issued by -executeInContext:
+
+@end
@@ -0,0 +1,448 @@
+//
+//  SyncWritePlan.m
+//  ShipHub
+//
+//  Created by James Howard on 3/5/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "SyncWritePlan.h"
+
+#import "DataStoreInternal.h"
+#import "Extras.h"
+#import "SyncConnection.h"
+
+@interface SyncWriteItem : NSObject
+
+@property NSManagedObject *obj;
+@property NSDictionary *syncDict;
+
+@end
+
+@implementation SyncWriteItem
+
++ (instancetype)itemWithObject:(NSManagedObject *)obj syncDict:(NSDictionary *)syncDict {
+    SyncWriteItem *item = [SyncWriteItem new];
+    item.obj = obj;
+    item.syncDict = syncDict;
+    return item;
+}
+
+@end
+
+@implementation SyncWritePlan {
+    NSManagedObjectModel *_mom;
+    NSDictionary<NSString *, NSString *> *_syncEntityNames;
+
+    NSMutableArray<SyncEntry *> *_entries;
+    NSMutableArray<NSString *> *_entryEntityNames;
+    NSMutableArray<NSNumber *> *_entryIdentifiers;
+
+    NSMutableDictionary<NSString *, NSMutableSet<NSNumber *> *> *_identifiers; // entity name => every identifier referenced in the plan
+    NSMutableDictionary<NSString *, NSMutableSet<NSString *> *> *_prefetch; // entity name => to-many relationships that will be diffed
+
+    NSManagedObjectContext *_moc;
+    BOOL _includesPendingChanges; // _moc had unsaved changes before the plan, so not everything pending is in _objects
+    NSMutableDictionary<EntityCacheKey *, NSManagedObject *> *_objects;
+}
+
++ (NSDictionary<NSString *, NSString *> *)syncEntityNamesForModel:(NSManagedObjectModel *)mom {
+    NSMutableDictionary *syncEntityToMomEntity = [NSMutableDictionary new];
+    for (NSEntityDescription *entityDesc in mom.entities) {
+        NSString *entityName = entityDesc.name;
+        if ([entityName hasPrefix:@"Local"]) {
+            NSString *syncName = [[entityName substringFromIndex:5] lowercaseString];
+            syncEntityToMomEntity[syncName] = entityName;
+        }
+    }
+    return syncEntityToMomEntity;
+}
+
+- (instancetype)initWithModel:(NSManagedObjectModel *)mom syncEntityNames:(NSDictionary<NSString *, NSString *> *)syncEntityNames {
+    NSParameterAssert(mom);
+    NSParameterAssert(syncEntityNames);
+
+    if (self = [super init]) {
+        _mom = mom;
+        _syncEntityNames = syncEntityNames;
+        _entries = [NSMutableArray new];
+        _entryEntityNames = [NSMutableArray new];
+        _entryIdentifiers = [NSMutableArray new];
+        _identifiers = [NSMutableDictionary new];
+        _prefetch = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (NSUInteger)entryCount {
+    return _entries.count;
+}
+
+- (NSDictionary<EntityCacheKey *, NSManagedObject *> *)objectCache {
+    return _objects;
+}
+
+#pragma mark - Planning
+
+- (void)noteIdentifier:(id)identifier entityName:(NSString *)entityName {
+    if (![identifier isKindOfClass:[NSNumber class]]) return;
+
+    NSMutableSet *s = _identifiers[entityName];
+    if (!s) {
+        _identifiers[entityName] = s = [NSMutableSet new];
+    }
+    [s addObject:identifier];
+}
+
+- (void)notePrefetchRelationship:(NSString *)relationshipName entityName:(NSString *)entityName {
+    NSMutableSet *s = _prefetch[entityName];
+    if (!s) {
+        _prefetch[entityName] = s = [NSMutableSet new];
+    }
+    [s addObject:relationshipName];
+}
+
+// Resolves the concrete entity for a reference to a (possibly abstract) destination entity.
+- (NSEntityDescription *)concreteEntity:(NSEntityDescription *)entity forSyncDict:(NSDictionary *)syncDict {
+    if (!entity.abstract) return entity;
+
+    NSString *type = [syncDict isKindOfClass:[NSDictionary class]] ? syncDict[@"type"] : nil;
+    if (!type) {
+        DebugLog(@"Cannot resolve concrete entity for abstract entity %@", entity.name);
+        return nil;
+    }
+
+    NSString *name = _syncEntityNames[type];
+    if (!name) {
+        for (NSEntityDescription *sub in entity.subentities) {
+            NSString *jsonType = sub.userInfo[@"jsonType"];
+            if ([jsonType isEqualToString:type]) {
+                name = sub.name;
+                break;
+            }
+        }
+    }
+
+#if DEBUG
+    if (!name) {
+        DebugLog(@"Cannot resolve concrete entity for abstract entity %@ (%@)", entity.name, syncDict);
+    }
+#endif
+
+    return name ? _mom.entitiesByName[name] : nil;
+}
+
+- (void)addEntries:(NSArray<SyncEntry *> *)entries {
+    NSMutableArray<SyncWriteItem *> *work = [NSMutableArray new];
+    NSMutableArray<NSEntityDescription *> *workEntities = [NSMutableArray new];
+
+    for (SyncEntry *e in entries) {
+        NSString *entityName = _syncEntityNames[e.entityName];
+        if (!entityName) {
+            DebugLog(@"Received unknown sync type: %@", e.entityName);
+            continue;
+        }
+
+        id data = e.data;
+        NSNumber *identifier = [data isKindOfClass:[NSNumber class]] ? data : data[@"identifier"];
+        NSAssert(identifier != nil, @"identifier cannot be nil.");
+        if (!identifier) continue;
+
+        [_entries addObject:e];
+        [_entryEntityNames addObject:entityName];
+        [_entryIdentifiers addObject:identifier];
+        [self noteIdentifier:identifier entityName:entityName];
+
+        if (e.action == SyncEntryActionSet && [data isKindOfClass:[NSDictionary class]]) {
+            [work addObject:[SyncWriteItem itemWithObject:nil syncDict:data]];
+            [workEntities addObject:_mom.entitiesByName[entityName]];
+        }
+    }
+
+    // Walk every nested object referenced by the entries, without recursion.
+    while (work.count) {
+        NSDictionary *syncDict = [[work lastObject] syncDict];
+        NSEntityDescription *entity = [workEntities lastObject];
+        [work removeLastObject];
+        [workEntities removeLastObject];
+
+        NSDictionary *relationships = entity.relationshipsByName;
+        for (NSString *key in relationships) {
+            NSRelationshipDescription *rel = relationships[key];
+            NSString *syncDictKey = rel.userInfo[@"jsonKey"] ?: key;
+            id related = syncDict[syncDictKey];
+            if (!related || related == [NSNull null]) continue;
+
+            NSEntityDescription *dest = rel.destinationEntity;
+
+            if (rel.toMany) {
+                if (![related isKindOfClass:[NSArray class]]) continue;
+
+                for (id x in related) {
+                    if ([x isKindOfClass:[NSDictionary class]]) {
+                        [self noteIdentifier:x[@"identifier"] entityName:dest.name];
+                        [work addObject:[SyncWriteItem itemWithObject:nil syncDict:x]];
+                        [workEntities addObject:dest];
+                    } else {
+                        [self noteIdentifier:x entityName:dest.name];
+                    }
+                }
+
+                if (rel.deleteRule == NSCascadeDeleteRule) {
+                    [self notePrefetchRelationship:key entityName:entity.name];
+                }
+            } else if ([related isKindOfClass:[NSDictionary class]]) {
+                [self noteIdentifier:related[@"identifier"] entityName:dest.name];
+                NSEntityDescription *concrete = [self concreteEntity:dest forSyncDict:related];
+                if (concrete) {
+                    [work addObject:[SyncWriteItem itemWithObject:nil syncDict:related]];
+                    [workEntities addObject:concrete];
+                }
+            } else {
+                [self noteIdentifier:related entityName:dest.name];
+            }
+        }
+    }
+}
+
+#pragma mark - Resolution
+
+- (void)resolve {
+    for (NSString *entityName in _identifiers) {
+        NSSet *idNums = _identifiers[entityName];
+
+        NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:entityName];
+        fetch.predicate = [NSPredicate predicateWithFormat:@"identifier IN %@", idNums];
+        fetch.includesPendingChanges = _includesPendingChanges; // otherwise anything pending would be in our cache
+        fetch.returnsObjectsAsFaults = NO; // we're about to merge into nearly all of these
+        NSArray *prefetch = [_prefetch[entityName] allObjects];
+        if (prefetch.count) {
+            fetch.relationshipKeyPathsForPrefetching = prefetch;
+        }
+
+        NSError *err = nil;
+        NSArray *existing = [_moc executeFetchRequest:fetch error:&err];
+        _fetchCount++;
+        if (err) {
+            ErrLog(@"%@", err);
+            continue;
+        }
+
+        for (NSManagedObject *obj in existing) {
+            _objects[[EntityCacheKey keyWithManagedObject:obj]] = obj;
+        }
+    }
+}
+
+- (NSManagedObject *)cachedObjectWithIdentifier:(NSNumber *)identifier entity:(NSEntityDescription *)entity {
+    if (entity.abstract) {
+        for (NSEntityDescription *child in entity.subentities) {
+            NSManagedObject *obj = [self cachedObjectWithIdentifier:identifier entity:child];
+            if (obj) return obj;
+        }
+        return nil;
+    } else {
+        return _objects[[EntityCacheKey keyWithEntity:entity.name identifier:identifier]];
+    }
+}
+
+- (BOOL)isPlannedIdentifier:(NSNumber *)identifier entity:(NSEntityDescription *)entity {
+    for (NSEntityDescription *e = entity; e != nil; e = e.superentity) {
+        if ([_identifiers[e.name] containsObject:identifier]) return YES;
+    }
+    return NO;
+}
+
+- (NSManagedObject *)objectWithIdentifier:(NSNumber *)identifier entityName:(NSString *)entityName {
+    NSEntityDescription *entity = _mom.entitiesByName[entityName];
+    NSManagedObject *obj = [self cachedObjectWithIdentifier:identifier entity:entity];
+    if (obj || [self isPlannedIdentifier:identifier entity:entity]) {
+        // If it was planned and it's not in the cache, it doesn't exist yet.
+        return obj;
+    }
+
+    // Shouldn't happen, as every identifier is noted when planning, but fall back to a fetch rather than risk a dupe.
+    NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:entityName];
+    fetch.predicate = [NSPredicate predicateWithFormat:@"identifier = %@", identifier];
+    fetch.includesPendingChanges = _includesPendingChanges;
+    fetch.fetchLimit = 1;
+    obj = [[_moc executeFetchRequest:fetch error:NULL] firstObject];
+    _fetchCount++;
+    if (obj) {
+        _objects[[EntityCacheKey keyWithManagedObject:obj]] = obj;
+    }
+    return obj;
+}
+
+- (NSManagedObject *)insertObjectWithIdentifier:(NSNumber *)identifier entityName:(NSString *)entityName {
+    NSManagedObject *obj = [NSEntityDescription insertNewObjectForEntityForName:entityName inManagedObjectContext:_moc];
+    [obj setValue:identifier forKey:@"identifier"];
+    _objects[[EntityCacheKey keyWithManagedObject:obj]] = obj;
+    return obj;
+}
+
+#pragma mark - Application
+
+// Merges item.syncDict into item.obj and sets its relationships.
+// Nested objects that also need merging are appended to children, in document order.
+- (void)applyItem:(SyncWriteItem *)item children:(NSMutableArray<SyncWriteItem *> *)children {
+    NSManagedObject *obj = item.obj;
+    NSDictionary *syncDict = item.syncDict;
+
+    [obj mergeAttributesFromDictionary:syncDict];
+
+    NSDictionary *relationships = obj.entity.relationshipsByName;
+    for (NSString *key in relationships) {
+        NSRelationshipDescription *rel = relationships[key];
+        BOOL noPopulate = [rel.userInfo[@"noPopulate"] boolValue];
+        NSString *syncDictKey = rel.userInfo[@"jsonKey"] ?: key;
+        id related = syncDict[syncDictKey];
+        if (!related) continue;
+
+        NSEntityDescription *dest = rel.destinationEntity;
+
+        if (rel.toMany) {
+            // Anything that cascades is considered a "strong" relationship, which
+            // implies the ability to delete and create referenced objects as needed.
+            BOOL cascade = rel.deleteRule == NSCascadeDeleteRule;
+
+            // to many relationships refer by identifiers or by actual populated objects that have identifiers
+            NSArray *relatedIDs = nil;
+            NSDictionary *relatedLookup = nil;
+            if ([[related firstObject] isKindOfClass:[NSDictionary class]]) {
+                relatedIDs = [related arrayByMappingObjects:^id(NSDictionary *x) {
+                    return x[@"identifier"];
+                }];
+                relatedLookup = [NSDictionary lookupWithObjects:related keyPath:@"identifier"];
+            } else {
+                relatedIDs = related;
+            }
+            if (!relatedIDs) relatedIDs = @[];
+
+            if (cascade) {
+                // delete anything that's no longer being referenced
+                NSSet *relatedIDSet = [NSSet setWithArray:relatedIDs];
+                for (NSManagedObject *relObj in [obj valueForKey:key]) {
+                    id identifier = [relObj valueForKey:@"identifier"];
+                    if (![relatedIDSet containsObject:identifier]) {
+                        DebugLog(@"Will delete relationship %@ to %@ (%@)", rel, relObj, identifier);
+                        [_moc deleteObject:relObj];
+                    }
+                }
+            }
+
+            id relatedObjs = rel.ordered ? [NSMutableOrderedSet new] : [NSMutableSet new];
+            for (NSNumber *relatedID in relatedIDs) {
+                NSManagedObject *relObj = [self objectWithIdentifier:relatedID entityName:dest.name];
+                BOOL populate = !noPopulate;
+                if (!relObj) {
+                    relObj = [self insertObjectWithIdentifier:relatedID entityName:dest.name];
+                    populate = YES;
+                }
+                NSDictionary *updates = relatedLookup[relatedID];
+                if (updates && populate) {
+                    [children addObject:[SyncWriteItem itemWithObject:relObj syncDict:updates]];
+                }
+                [relatedObjs addObject:relObj];
+            }
+
+            [obj setValue:relatedObjs forKey:key onlyIfChanged:YES];
+        } else /* rel.toOne */ {
+            NSDictionary *populate = nil;
+            id relatedID = related;
+            if ([related isKindOfClass:[NSDictionary class]]) {
+                populate = related;
+                relatedID = populate[@"identifier"];
+            } else if (related == [NSNull null]) {
+                [obj setValue:nil forKey:key onlyIfChanged:YES];
+                relatedID = nil;
+            }
+
+            if (relatedID == nil) continue;
+
+            NSManagedObject *relObj = [self objectWithIdentifier:relatedID entityName:dest.name];
+            if (relObj) {
+                [obj setValue:relObj forKey:key onlyIfChanged:YES];
+                if (populate && !noPopulate) {
+                    [children addObject:[SyncWriteItem itemWithObject:relObj syncDict:populate]];
+                }
+            } else {
+                NSEntityDescription *concrete = [self concreteEntity:dest forSyncDict:populate];
+                if (concrete) {
+                    DebugLog(@"Creating %@ of id %@", concrete.name, relatedID);
+                    relObj = [self insertObjectWithIdentifier:relatedID entityName:concrete.name];
+                    if (populate) {
+                        [children addObject:[SyncWriteItem itemWithObject:relObj syncDict:populate]];
+                    }
+                    [obj setValue:relObj forKey:key];
+                }
+            }
+        }
+    }
+}
+
+- (void)applyEntryObject:(NSManagedObject *)obj syncDict:(NSDictionary *)syncDict {
+    // Process nested objects depth first, in document order, as a recursive walk would.
+    NSMutableArray<SyncWriteItem *> *stack = [NSMutableArray arrayWithObject:[SyncWriteItem itemWithObject:obj syncDict:syncDict]];
+    NSMutableArray<SyncWriteItem *> *children = [NSMutableArray new];
+    while (stack.count) {
+        SyncWriteItem *item = [stack lastObject];
+        [stack removeLastObject];
+
+        [self applyItem:item children:children];
+
+        for (SyncWriteItem *child in [children reverseObjectEnumerator]) {
+            [stack addObject:child];
+        }
+        [children removeAllObjects];
+    }
+}
+
+- (void)executeInContext:(NSManagedObjectContext *)moc {
+    NSParameterAssert(moc);
+
+    _moc = moc;
+    _includesPendingChanges = moc.hasChanges;
+    _objects = [NSMutableDictionary new];
+    _fetchCount = 0;
+
+    [self resolve];
+
+    NSUInteger count = _entries.count;
+    for (NSUInteger i = 0; i < count; i++) {
+        SyncEntry *e = _entries[i];
+        NSString *entityName = _entryEntityNames[i];
+        NSNumber *identifier = _entryIdentifiers[i];
+        id data = e.data;
+
+        NSManagedObject *mObj = [self objectWithIdentifier:identifier entityName:entityName];
+
+        if (e.action == SyncEntryActionSet) {
+            if (!mObj) {
+                mObj = [self insertObjectWithIdentifier:identifier entityName:entityName];
+            }
+
+            if ([data isKindOfClass:[NSDictionary class]]) {
+                NSDate *dbDate = nil;
+                NSDate *newDate = nil;
+
+                if (mObj.entity.attributesByName[@"updatedAt"] != nil) {
+                    dbDate = [mObj valueForKey:@"updatedAt"];
+                    newDate = [NSDate dateWithJSONString:data[@"updatedAt"]];
+                }
+
+                if (dbDate == nil || newDate == nil || [dbDate compare:newDate] != NSOrderedDescending) {
+                    [self applyEntryObject:mObj syncDict:data];
+                }
+            }
+        } else /*e.action == SyncEntryActionDelete*/ {
+            if (mObj) {
+                [_moc deleteObject:mObj];
+            }
+        }
+    }
+
+    _moc = nil;
+}
+
+@end
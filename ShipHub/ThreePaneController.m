@@ -157,6 +157,11 @@
     return s;
 }
 
+- (BOOL)usesTableCursor {
+    // Issue3PaneTableController works from the full list of items
+    return NO;
+}
+
 - (NSArray *)willUpdateItems:(NSArray *)items {
     if (!self.upNextMode && self.displayedIssue && [self.displayedPredicate isEqual:self.predicate]) {
         Issue *i = self.displayedIssue;
@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 
 @class Issue;
+@class IssueTimeIndex;
 
 @interface TimeSeries : NSObject
 
@@ -21,9 +22,19 @@
 
 @property NSArray<Issue *> *records;
 
+// An alternative to records. When set, intervals are counted from the index instead of selecting records.
+@property IssueTimeIndex *index;
+
+// The number of records (or issues in index) in the series
+@property (readonly) NSUInteger count;
+
 @property (readonly) NSArray<TimeSeries *> *intervals;
 
 - (void)selectRecordsFrom:(NSArray<Issue *> *)records;
+
+// Like selectRecordsFrom:, but only the date range (and state) of predicate is applied, so index must already be restricted to match the rest of predicate.
+- (void)selectRecordsFromIndex:(IssueTimeIndex *)index;
+
 - (void)generateIntervalsWithCalendarUnit:(NSCalendarUnit)unit;
 
 // Returns an edited version of queryPredicate that searches for open, closed, or existing issues within the date range given. The existing queryPredicate is examined to see if it is for all issues, open issues, or closed issues, and it is rewritten to drop that clause and then is ANDed with the appropriate range predicate given by the predicateFromStartDate:untilEndDate:open: method.
@@ -8,8 +8,10 @@
 
 #import "TimeSeries.h"
 
+#import "CompiledIssuePredicate.h"
 #import "Extras.h"
 #import "Issue.h"
+#import "IssueTimeIndex.h"
 #import "NSPredicate+Extras.h"
 
 @interface TimeSeries ()
@@ -23,6 +25,8 @@
 
 @property (readwrite, strong) NSArray<TimeSeries *> *intervals;
 
+@property (assign) NSUInteger intervalCount; // count of an interval generated from an index
+
 @end
 
 @implementation TimeSeries
@@ -199,6 +203,16 @@ static BOOL isStatePredicate(NSPredicate *predicate, BOOL *isOpenValue) {
     return [self timeSeriesPredicateWithPredicate:queryPredicate startDate:startDate endDate:endDate open:NULL];
 }
 
+- (NSUInteger)count {
+    if (self.index) {
+        return self.index.count;
+    } else if (self.records) {
+        return self.records.count;
+    } else {
+        return self.intervalCount;
+    }
+}
+
 - (void)_fastSelectRecordsFrom:(NSArray<Issue *> *)records {
     NSPredicate *p = [TimeSeries _fastPredicateFromStartDate:self.startDate untilEndDate:self.endDate open:_open];
     
@@ -206,11 +220,34 @@ static BOOL isStatePredicate(NSPredicate *predicate, BOOL *isOpenValue) {
 }
 
 - (void)selectRecordsFrom:(NSArray<Issue *> *)records {
-    NSPredicate *p = [TimeSeries timeSeriesPredicateWithPredicate:self.predicate startDate:self.startDate endDate:self.endDate];
+    NSPredicate *p = [CompiledIssuePredicate compiledPredicateWithPredicate:[TimeSeries timeSeriesPredicateWithPredicate:self.predicate startDate:self.startDate endDate:self.endDate]];
     
     self.records = [records filteredArrayUsingPredicate:p];
 }
 
+- (void)selectRecordsFromIndex:(IssueTimeIndex *)index {
+    NSTimeInterval start = self.startDate.timeIntervalSinceReferenceDate;
+    NSTimeInterval end = self.endDate.timeIntervalSinceReferenceDate;
+    
+    // Equivalent to predicateFromStartDate:untilEndDate:open:
+    BOOL (^test)(NSTimeInterval createdAt, NSTimeInterval closedAt);
+    if (_open == nil) {
+        test = ^BOOL(NSTimeInterval createdAt, NSTimeInterval closedAt) {
+            return createdAt <= end;
+        };
+    } else if ([_open boolValue] == YES) {
+        test = ^BOOL(NSTimeInterval createdAt, NSTimeInterval closedAt) {
+            return createdAt <= end && (isnan(closedAt) || closedAt >= start);
+        };
+    } else /* [_open boolValue] == NO */ {
+        test = ^BOOL(NSTimeInterval createdAt, NSTimeInterval closedAt) {
+            return createdAt <= end && !isnan(closedAt) && closedAt <= end;
+        };
+    }
+    
+    self.index = [index indexOfIssuesPassingTest:test];
+}
+
 - (void)generateIntervalsWithCalendarUnit:(NSCalendarUnit)unit {
     NSMutableArray *intervals = [NSMutableArray new];
     TimeSeries *current = [TimeSeries new];
@@ -231,10 +268,18 @@ static BOOL isStatePredicate(NSPredicate *predicate, BOOL *isOpenValue) {
         current = next;
     } while ([current.startDate compare:self.endDate] != NSOrderedDescending);
     
-    // in parallel, make each interval select its records
-    dispatch_apply(intervals.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
-        [intervals[i] _fastSelectRecordsFrom:self.records];
-    });
+    IssueTimeIndex *index = self.index;
+    if (index) {
+        // each interval is just a pair of binary searches, so there's no need to go parallel
+        for (TimeSeries *interval in intervals) {
+            interval.intervalCount = [index countForIntervalFromStart:interval.startDate.timeIntervalSinceReferenceDate toEnd:interval.endDate.timeIntervalSinceReferenceDate open:interval.open];
+        }
+    } else {
+        // in parallel, make each interval select its records
+        dispatch_apply(intervals.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            [intervals[i] _fastSelectRecordsFrom:self.records];
+        });
+    }
     
     self.intervals = intervals;
 }
@@ -14,6 +14,8 @@
 #import "IssueIdentifier.h"
 #import "JSON.h"
 #import "Reachability.h"
+#import "SyncBinaryCodec.h"
+#import "SyncMessageDecoder.h"
 
 #import <SocketRocket/SRWebSocket.h>
 
@@ -41,6 +43,7 @@ static NSString *const MessageFieldSpiderProgress = @"spiderProgress";
 
 // Hello Message fields
 static NSString *const MessageFieldClient = @"client";
+static NSString *const MessageFieldEncodings = @"encodings";
 
 // Sync Message fields
 static NSString *const MessageFieldLogs = @"logs";
@@ -68,13 +71,47 @@ static NSString *const MessageFieldRateLimitedUntil = @"until";
 // Spider Progress fields
 static NSString *const MessageFieldProgress = @"progress";
 
-typedef NS_ENUM(uint8_t, MessageHeader) {
-    MessageHeaderPlainText = 0,
-    MessageHeaderDeflate = 1,
-};
-
 static uint64_t ServerHelloMinimumVersion = 2;
 
+#if DEBUG
+// If SHIP_SYNC_RECORD names a file, each sync message received is appended to it as a line of JSON,
+// in the form TestSyncLog replays.
+static NSFileHandle *SyncRecordingHandle() {
+    static NSFileHandle *handle;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSString *path = [[[NSProcessInfo processInfo] environment][@"SHIP_SYNC_RECORD"] stringByExpandingTildeInPath];
+        if (!path) return;
+        
+        if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            [[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:nil];
+        }
+        handle = [NSFileHandle fileHandleForWritingAtPath:path];
+        [handle seekToEndOfFile];
+        if (!handle) {
+            ErrLog(@"Unable to record sync messages to %@", path);
+        }
+    });
+    return handle;
+}
+
+static void RecordSyncMessage(NSDictionary *fields, NSArray<SyncEntry *> *entries) {
+    NSMutableDictionary *msg = [fields mutableCopy];
+    msg[MessageFieldLogs] = [entries arrayByMappingObjects:^id(SyncEntry *e) {
+        return [e dictionaryRepresentation];
+    }];
+    
+    NSError *err = nil;
+    NSMutableData *line = [[NSJSONSerialization dataWithJSONObject:msg options:0 error:&err] mutableCopy];
+    if (!line) {
+        ErrLog(@"Unable to record sync message: %@", err);
+        return;
+    }
+    [line appendBytes:"\n" length:1];
+    [SyncRecordingHandle() writeData:line];
+}
+#endif
+
 const double MaxConnectWaitTime = 3 * 60; // don't wait longer than this to establish a connection. retry if we can't get it in this time.
 const double MaxReceiveWaitTime = 3 * 60; // don't wait longer than this to receive any data. retry if we don't get anything in this time.
 
@@ -90,6 +127,11 @@ const double MaxReceiveWaitTime = 3 * 60; // don't wait longer than this to rece
     
     double _connectTime; // the moment we tried to open the connection
     double _lastReceiveTime; // the last time we've received any data
+    
+    double _lastLogProgress; // progress reported with the last complete sync message
+    double _lastSpiderProgress;
+    
+    SyncBinaryStringTable *_binaryStrings; // interned strings from MessageHeaderBinary messages on this socket
 }
 
 @property SRWebSocket *socket;
@@ -168,6 +210,8 @@ const double MaxReceiveWaitTime = 3 * 60; // don't wait longer than this to rece
         });
         
         self.logEntryTotalRemaining = -1;
+        _lastLogProgress = 0.0;
+        _lastSpiderProgress = 1.0;
         _connectTime = [NSDate extras_monotonicTime];
         NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:_syncURL];
         [self.auth addAuthHeadersToRequest:request];
@@ -267,48 +311,79 @@ const double MaxReceiveWaitTime = 3 * 60; // don't wait longer than this to rece
     
     NSDictionary *hello = @{ MessageFieldType : MessageHello,
                              MessageFieldClient : [self clientVersion],
+                             MessageFieldEncodings : @[SyncBinaryEncodingName],
                              MessageFieldVersions : _syncVersions };
     
     [self sendMessage:hello];
 }
 
-- (void)webSocket:(SRWebSocket *)webSocket didReceiveMessage:(id)rawMessage {
+- (BOOL)webSocketShouldConvertTextFrameToString:(SRWebSocket *)webSocket {
+    // Text messages are decoded from their UTF-8 bytes, same as binary ones.
+    return NO;
+}
+
+- (void)webSocket:(SRWebSocket *)webSocket didReceiveMessageWithDispatchData:(dispatch_data_t)data {
     _lastReceiveTime = [NSDate extras_monotonicTime];
     
-    NSData *data = nil;
-    if ([rawMessage isKindOfClass:[NSData class]]) {
-        data = rawMessage;
-    } else if ([rawMessage isKindOfClass:[NSString class]]) {
-        data = [rawMessage dataUsingEncoding:NSUTF8StringEncoding];
-    } else {
-        ErrLog(@"Received unexpected message: %@", rawMessage);
+    size_t length = dispatch_data_get_size(data);
+    if (length < 1) {
+        ErrLog(@"Received short message");
         return;
     }
     
-    if ([data length] < 1) {
-        ErrLog(@"Received short message: %@", data);
+    __block MessageHeader header = 0;
+    dispatch_data_apply(data, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+        header = ((const uint8_t *)buffer)[0];
+        return false;
+    });
+    if (header != MessageHeaderPlainText && header != MessageHeaderDeflate && header != MessageHeaderBinary) {
+        ErrLog(@"Received message with unknown header: %d", header);
         return;
     }
     
-    MessageHeader header = ((uint8_t *)[data bytes])[0];
-    NSData *bodyData = [data subdataWithRange:NSMakeRange(1, data.length-1)];
-    if (header == MessageHeaderDeflate) {
-        bodyData = [bodyData inflate];
-        if (!bodyData) {
-            ErrLog(@"Unable to inflate message");
-            return;
-        }
+    // Log entries are handed to the delegate in batches as they're decoded.
+    // The new versions are held back until the whole message is written, so if
+    // we're interrupted partway through, the server will just resend the message.
+#if DEBUG
+    NSMutableArray *recordedEntries = SyncRecordingHandle() ? [NSMutableArray new] : nil;
+#endif
+    SyncMessageDecoderBatchHandler batchHandler = ^(NSArray<SyncEntry *> *entries) {
+#if DEBUG
+        [recordedEntries addObjectsFromArray:entries];
+#endif
+        [self.delegate syncConnection:self receivedEntries:entries versions:_syncVersions logProgress:_lastLogProgress spiderProgress:_lastSpiderProgress];
+    };
+    
+    id<SyncMessageDecoding> decoder = nil;
+    if (header == MessageHeaderBinary) {
+        if (!_binaryStrings) _binaryStrings = [SyncBinaryStringTable new];
+        decoder = [[SyncBinaryDecoder alloc] initWithStringTable:_binaryStrings streamedArrayKey:MessageFieldLogs batchSize:SyncEntryBatchSize batchHandler:batchHandler];
+    } else {
+        decoder = [[SyncMessageDecoder alloc] initWithStreamedArrayKey:MessageFieldLogs compressed:header == MessageHeaderDeflate batchSize:SyncEntryBatchSize batchHandler:batchHandler];
     }
     
+    // The message arrives in the pieces it was read from the socket in. Decode those in place,
+    // rather than first copying them together.
+    dispatch_data_t payload = dispatch_data_create_subrange(data, 1, length - 1);
+    dispatch_data_apply(payload, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+        return [decoder appendBytes:buffer length:size];
+    });
+    
     NSError *err = nil;
-    NSDictionary *msg = [NSJSONSerialization JSONObjectWithData:bodyData options:0 error:&err];
-    if (err) {
-        ErrLog(@"%@", err);
+    NSArray *finalEntries = [decoder finish:&err];
+    if (!finalEntries) {
+        ErrLog(@"Unable to decode message: %@", err);
+        if (header == MessageHeaderBinary) {
+            // Our string table may no longer match the server's. Start over with a new connection.
+            [self refresh];
+        }
         return;
     }
     
+    NSDictionary *msg = decoder.fields;
+    
 #if DEBUG
-    fprintf(stderr, "%s WSSyncConnection received message: %s\n", [[[NSDate date] description] UTF8String], [[msg description] UTF8String]);
+    fprintf(stderr, "%s WSSyncConnection received message (%tu log entries): %s\n", [[[NSDate date] description] UTF8String], decoder.entryCount, [[msg description] UTF8String]);
 #endif
     
     
@@ -344,14 +419,17 @@ const double MaxReceiveWaitTime = 3 * 60; // don't wait longer than this to rece
             return;
         }
     } else if ([type isEqualToString:MessageSync]) {
-        _syncVersions = msg[MessageFieldVersions];
+#if DEBUG
+        if (recordedEntries) {
+            RecordSyncMessage(msg, [recordedEntries arrayByAddingObjectsFromArray:finalEntries]);
+        }
+#endif
         
-        NSArray *entries = [msg[MessageFieldLogs] arrayByMappingObjects:^id(id obj) {
-            return [SyncEntry entryWithDictionary:obj];
-        }];
+        _syncVersions = msg[MessageFieldVersions];
         
+        NSInteger entryCount = decoder.entryCount;
         NSInteger remaining = [msg[MessageFieldRemaining] integerValue];
-        NSInteger totalRemaining = remaining + [entries count];
+        NSInteger totalRemaining = remaining + entryCount;
         if (_logEntryTotalRemaining < 0 || totalRemaining > _logEntriesRemaining) {
             _logEntryTotalRemaining = totalRemaining;
         }
@@ -369,8 +447,10 @@ const double MaxReceiveWaitTime = 3 * 60; // don't wait longer than this to rece
         id spiderProgressNumber = ([spiderProgress isKindOfClass:[NSDictionary class]] ? spiderProgress[MessageFieldProgress] : nil) ?: @(1.0);
         
         self.logEntriesRemaining = remaining;
-                
-        [self.delegate syncConnection:self receivedEntries:entries versions:_syncVersions logProgress:progress spiderProgress:[spiderProgressNumber doubleValue]];
+        _lastLogProgress = progress;
+        _lastSpiderProgress = [spiderProgressNumber doubleValue];
+        
+        [self.delegate syncConnection:self receivedEntries:finalEntries versions:_syncVersions logProgress:progress spiderProgress:_lastSpiderProgress];
     } else if ([type isEqualToString:MessageBilling]) {
         [self.delegate syncConnection:self didReceiveBillingUpdate:msg];
     } else if ([type isEqualToString:MessageRateLimit]) {
@@ -383,6 +463,7 @@ const double MaxReceiveWaitTime = 3 * 60; // don't wait longer than this to rece
 - (void)webSocketDidOpen:(SRWebSocket *)webSocket {
     Trace();
     _socketOpen = YES;
+    _binaryStrings = [SyncBinaryStringTable new];
     [self sendHello];
     
     if (_lastViewedIssueIdentifier) {
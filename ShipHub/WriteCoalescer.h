@@ -0,0 +1,68 @@
+//
+//  WriteCoalescer.h
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+@interface WriteCoalescerStats : NSObject
+
+@property (readonly) NSUInteger writes;
+@property (readonly) NSUInteger batches; // saves
+@property (readonly) NSUInteger maxBatchSize;
+@property (readonly) double averageBatchSize;
+@property (readonly) NSUInteger retriedBatches; // batches that failed to save and were written again one at a time
+
+// Latency is from queueing a write until its batch was saved.
+@property (readonly) NSTimeInterval maxLatency;
+@property (readonly) NSTimeInterval averageLatency;
+
+@end
+
+/*
+ WriteCoalescer implements group commit for a write context.
+
+ Writes queued within window of the first write of a batch are run back to back and saved
+ together, so a fast stream of small writes costs one save:, and one reset of the read
+ contexts, rather than one each. A batch is written early once it reaches maximumBatchSize,
+ so no write waits more than window before it is scheduled.
+
+ Write blocks must not call save: themselves. They share the context with the other writes in
+ their batch, so they must not rely on fetches which ignore pending changes (dictionary results,
+ batch updates and deletes). If the batch fails to save, it is rolled back and each write is run
+ and saved again on its own, so that one bad write can't fail the others.
+
+ Completions are called with the result of the save, in the order the writes were queued, on the
+ write context's queue.
+
+ WriteCoalescer is thread safe.
+*/
+
+@interface WriteCoalescer : NSObject
+
+// schedule is called, on any queue, when a batch is ready. It must arrange for commitInContext:
+// to be called on the write context's queue, ordered with any other writes.
+- (instancetype)initWithWindow:(NSTimeInterval)window maximumBatchSize:(NSUInteger)maximumBatchSize schedule:(dispatch_block_t)schedule;
+
+@property (readonly) NSTimeInterval window;
+@property (readonly) NSUInteger maximumBatchSize;
+
+// Called on moc's queue each time a failed save is rolled back, so that anything tracking
+// moc's unsaved changes can forget the ones that were discarded.
+@property (copy) void (^didRollback)(NSManagedObjectContext *moc);
+
+- (void)addWrite:(void (^)(NSManagedObjectContext *moc))block completion:(void (^)(NSError *error))completion;
+
+// Schedules any pending writes now, so that anything scheduled after this call is ordered after them.
+- (void)flush;
+
+// Runs, saves and completes the pending batch. Call on moc's queue. Resets moc afterwards.
+- (void)commitInContext:(NSManagedObjectContext *)moc;
+
+- (WriteCoalescerStats *)stats;
+
+@end
@@ -0,0 +1,229 @@
+//
+//  WriteCoalescer.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "WriteCoalescer.h"
+
+#import "Extras.h"
+
+@interface WriteCoalescerStats ()
+
+@property (readwrite) NSUInteger writes;
+@property (readwrite) NSUInteger batches;
+@property (readwrite) NSUInteger maxBatchSize;
+@property (readwrite) NSUInteger retriedBatches;
+@property (readwrite) NSTimeInterval totalLatency;
+@property (readwrite) NSTimeInterval maxLatency;
+
+@end
+
+@implementation WriteCoalescerStats
+
+- (double)averageBatchSize {
+    return _batches ? (double)_writes / (double)_batches : 0.0;
+}
+
+- (NSTimeInterval)averageLatency {
+    return _writes ? _totalLatency / _writes : 0.0;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    WriteCoalescerStats *copy = [WriteCoalescerStats new];
+    copy.writes = _writes;
+    copy.batches = _batches;
+    copy.maxBatchSize = _maxBatchSize;
+    copy.retriedBatches = _retriedBatches;
+    copy.totalLatency = _totalLatency;
+    copy.maxLatency = _maxLatency;
+    return copy;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ %p> writes: %tu batches: %tu size: %.1f avg, %tu max retried: %tu latency: %.1fms avg, %.1fms max", NSStringFromClass([self class]), self, _writes, _batches, self.averageBatchSize, _maxBatchSize, _retriedBatches, self.averageLatency * 1000.0, _maxLatency * 1000.0];
+}
+
+@end
+
+@interface CoalescedWrite : NSObject
+
+@property (copy) void (^block)(NSManagedObjectContext *moc);
+@property (copy) void (^completion)(NSError *error);
+@property double queuedAt;
+@property NSError *error;
+
+@end
+
+@implementation CoalescedWrite
+
+@end
+
+@interface WriteCoalescer () {
+    NSLock *_lock;
+    dispatch_block_t _schedule;
+    
+    NSMutableArray<CoalescedWrite *> *_pending;
+    NSUInteger _batchNumber; // incremented each time a batch is taken, so stale timers can tell
+    BOOL _scheduled; // a commit is on its way for the pending writes
+    
+    WriteCoalescerStats *_stats;
+}
+
+@end
+
+@implementation WriteCoalescer
+
+- (instancetype)initWithWindow:(NSTimeInterval)window maximumBatchSize:(NSUInteger)maximumBatchSize schedule:(dispatch_block_t)schedule
+{
+    NSParameterAssert(schedule);
+    NSParameterAssert(maximumBatchSize > 0);
+    
+    if (self = [super init]) {
+        _window = window;
+        _maximumBatchSize = maximumBatchSize;
+        _schedule = [schedule copy];
+        _lock = [NSLock new];
+        _pending = [NSMutableArray new];
+        _stats = [WriteCoalescerStats new];
+    }
+    return self;
+}
+
+- (void)addWrite:(void (^)(NSManagedObjectContext *moc))block completion:(void (^)(NSError *error))completion
+{
+    NSParameterAssert(block);
+    
+    CoalescedWrite *write = [CoalescedWrite new];
+    write.block = block;
+    write.completion = completion;
+    write.queuedAt = [NSDate extras_monotonicTime];
+    
+    BOOL startTimer = NO;
+    NSUInteger batchNumber = 0;
+    
+    [_lock lock];
+    [_pending addObject:write];
+    if (!_scheduled) {
+        if (_window <= 0.0 || _pending.count >= _maximumBatchSize) {
+            [self scheduleLocked];
+        } else if (_pending.count == 1) {
+            startTimer = YES;
+            batchNumber = _batchNumber;
+        }
+    }
+    [_lock unlock];
+    
+    if (startTimer) {
+        __weak __typeof(self) weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_window * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [weakSelf windowElapsedForBatch:batchNumber];
+        });
+    }
+}
+
+// Call with _lock held. _schedule only enqueues, and calling it under the lock means that once
+// _scheduled is seen to be set, the commit is already ahead of anything scheduled afterwards.
+- (void)scheduleLocked {
+    _scheduled = YES;
+    _schedule();
+}
+
+- (void)windowElapsedForBatch:(NSUInteger)batchNumber {
+    [_lock lock];
+    if (batchNumber == _batchNumber && !_scheduled && _pending.count > 0) {
+        [self scheduleLocked];
+    }
+    [_lock unlock];
+}
+
+- (void)flush {
+    [_lock lock];
+    if (!_scheduled && _pending.count > 0) {
+        [self scheduleLocked];
+    }
+    [_lock unlock];
+}
+
+- (void)commitInContext:(NSManagedObjectContext *)moc {
+    [_lock lock];
+    NSUInteger count = MIN(_pending.count, _maximumBatchSize);
+    NSArray<CoalescedWrite *> *batch = [_pending subarrayWithRange:NSMakeRange(0, count)];
+    [_pending removeObjectsInRange:NSMakeRange(0, count)];
+    _batchNumber++;
+    _scheduled = NO;
+    if (_pending.count > 0) {
+        // Whatever arrived after the batch filled up goes straight out in the next one.
+        [self scheduleLocked];
+    }
+    [_lock unlock];
+    
+    if (batch.count == 0) {
+        return;
+    }
+    
+    for (CoalescedWrite *write in batch) {
+        write.block(moc);
+    }
+    
+    NSError *error = nil;
+    BOOL retried = NO;
+    if (moc.hasChanges && ![moc save:&error]) {
+        [self rollbackContext:moc];
+        if (batch.count > 1) {
+            ErrLog(@"Batch of %tu writes failed to save, writing them one at a time: %@", batch.count, error);
+            retried = YES;
+            for (CoalescedWrite *write in batch) {
+                write.block(moc);
+                NSError *writeError = nil;
+                if (moc.hasChanges && ![moc save:&writeError]) {
+                    [self rollbackContext:moc];
+                }
+                write.error = writeError;
+            }
+        } else {
+            batch[0].error = error;
+        }
+    }
+    
+    double saved = [NSDate extras_monotonicTime];
+    
+    [_lock lock];
+    _stats.batches++;
+    _stats.writes += batch.count;
+    _stats.maxBatchSize = MAX(_stats.maxBatchSize, batch.count);
+    if (retried) _stats.retriedBatches++;
+    for (CoalescedWrite *write in batch) {
+        NSTimeInterval latency = saved - write.queuedAt;
+        _stats.totalLatency += latency;
+        _stats.maxLatency = MAX(_stats.maxLatency, latency);
+    }
+    [_lock unlock];
+    
+    for (CoalescedWrite *write in batch) {
+        if (write.completion) {
+            write.completion(write.error);
+        }
+    }
+    
+    [moc reset];
+}
+
+- (void)rollbackContext:(NSManagedObjectContext *)moc {
+    [moc rollback];
+    void (^didRollback)(NSManagedObjectContext *) = self.didRollback;
+    if (didRollback) {
+        didRollback(moc);
+    }
+}
+
+- (WriteCoalescerStats *)stats {
+    [_lock lock];
+    WriteCoalescerStats *stats = [_stats copy];
+    [_lock unlock];
+    return stats;
+}
+
+@end
@@ -0,0 +1,151 @@
+//
+//  CompiledIssuePredicateTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "CompiledIssuePredicate.h"
+#import "Extras.h"
+#import "Issue.h"
+#import "TestDataStore.h"
+#import "TestSyncLog.h"
+#import "TimeSeries.h"
+
+/*
+ Checks that CompiledIssuePredicate agrees with NSPredicate on the kinds of predicates built by
+ search and burndown, and compares their filtering throughput.
+ 
+ Environment:
+   SHIP_PREDICATE_ISSUES  synthetic issue count to filter (default 20000)
+*/
+
+@interface DataStore (CompiledPredicateTestInternals)
+
+- (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+
+@end
+
+@interface CompiledIssuePredicateTests : XCTestCase
+
+@property TestDataStore *store;
+@property NSArray<Issue *> *issues;
+
+@end
+
+@implementation CompiledIssuePredicateTests
+
+- (void)setUp {
+    [super setUp];
+    
+    NSString *size = [[NSProcessInfo processInfo] environment][@"SHIP_PREDICATE_ISSUES"];
+    NSUInteger issueCount = size.integerValue > 0 ? size.integerValue : 20000;
+    
+    _store = [TestDataStore testStore];
+    XCTAssertNotNil(_store);
+    [_store activate];
+    
+    @autoreleasepool {
+        [_store.testSyncConnection replayEntries:[TestSyncLog syntheticEntriesWithIssueCount:issueCount] batchSize:1000];
+        [_store performWriteAndWait:^(NSManagedObjectContext *moc) { }];
+    }
+    
+    XCTestExpectation *loaded = [self expectationWithDescription:@"issues"];
+    [_store issuesMatchingPredicate:[NSPredicate predicateWithValue:YES] completion:^(NSArray<Issue *> *issues, NSError *error) {
+        XCTAssertNil(error);
+        _issues = issues;
+        [loaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:600.0 handler:nil];
+    XCTAssertTrue(_issues.count > 0);
+}
+
+- (void)tearDown {
+    NSString *dir = [_store.testDBPath stringByDeletingLastPathComponent];
+    [_store deactivate];
+    _store = nil;
+    _issues = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+    
+    [super tearDown];
+}
+
+- (NSArray<NSPredicate *> *)searchPredicates {
+    NSDate *date = [NSDate dateWithTimeIntervalSinceReferenceDate:60.0 * _issues.count / 2];
+    return @[[NSPredicate predicateWithFormat:@"closed = NO"],
+             [NSPredicate predicateWithFormat:@"state = 'closed'"],
+             [NSPredicate predicateWithFormat:@"milestone = nil AND closed = NO"],
+             [NSPredicate predicateWithFormat:@"milestone.title = %@", @"v3.0"],
+             [NSPredicate predicateWithFormat:@"milestone.title IN %@", @[@"v1.0", @"v2.0"]],
+             [NSPredicate predicateWithFormat:@"repository.fullName = %@", @"user1/repo1"],
+             [NSPredicate predicateWithFormat:@"repository.owner.login = %@", @"user1"],
+             [NSPredicate predicateWithFormat:@"ANY labels.name = %@", @"label 4"],
+             [NSPredicate predicateWithFormat:@"ANY labels.name IN %@", @[@"label 4", @"label 5"]],
+             [NSPredicate predicateWithFormat:@"ANY assignees.login = %@", @"user3"],
+             [NSPredicate predicateWithFormat:@"count(assignees) = 0"],
+             [NSPredicate predicateWithFormat:@"assignees.@count > 0"],
+             [NSPredicate predicateWithFormat:@"originator.login = %@ OR closedBy = nil", @"user2"],
+             [NSPredicate predicateWithFormat:@"title CONTAINS[cd] %@", @"issue 1"],
+             [NSPredicate predicateWithFormat:@"title BEGINSWITH %@ AND NOT (number < 100)", @"Issue 2"],
+             [NSPredicate predicateWithFormat:@"createdAt > %@ AND updatedAt <= %@", date, [date dateByAddingTimeInterval:86400.0]],
+             [NSPredicate predicateWithFormat:@"createdAt > FUNCTION(now(), '_ship_dateByAddingDays:', -7)"],
+             [NSPredicate predicateWithFormat:@"closedAt != nil OR %@ < createdAt", date],
+             [NSPredicate predicateWithFormat:@"repository.canPush = YES"],
+             [NSPredicate predicateWithFormat:@"count(subquery(assignees, $x, $x.login IN %@)) = 0 AND closed = NO", @[@"user3"]]];
+}
+
+- (NSArray<NSPredicate *> *)burndownPredicates {
+    NSDate *start = [NSDate dateWithTimeIntervalSinceReferenceDate:60.0 * _issues.count / 4];
+    NSDate *end = [start dateByAddingTimeInterval:30 * 86400.0];
+    return @[[TimeSeries timeSeriesPredicateWithPredicate:[NSPredicate predicateWithFormat:@"closed = NO AND milestone.title = %@", @"v2.0"] startDate:start endDate:end],
+             [TimeSeries timeSeriesPredicateWithPredicate:[NSPredicate predicateWithFormat:@"closed = YES"] startDate:start endDate:end],
+             [TimeSeries timeSeriesPredicateWithPredicate:[NSPredicate predicateWithFormat:@"ANY labels.name = %@", @"label 1"] startDate:start endDate:end]];
+}
+
+- (void)testMatchesNSPredicate {
+    for (NSPredicate *predicate in [[self searchPredicates] arrayByAddingObjectsFromArray:[self burndownPredicates]]) {
+        CompiledIssuePredicate *compiled = [CompiledIssuePredicate compiledPredicateWithPredicate:predicate];
+        NSArray *expected = [_issues filteredArrayUsingPredicate:predicate];
+        NSArray *actual = [_issues filteredArrayUsingPredicate:compiled];
+        XCTAssertEqualObjects(actual, expected, @"%@", predicate);
+    }
+}
+
+- (void)testFallsBackOutsideSubset {
+    NSPredicate *subquery = [NSPredicate predicateWithFormat:@"count(subquery(assignees, $x, $x.login = 'user3')) = 0"];
+    XCTAssertFalse([CompiledIssuePredicate compiledPredicateWithPredicate:subquery].fullyCompiled);
+    XCTAssertTrue([CompiledIssuePredicate compiledPredicateWithPredicate:[NSPredicate predicateWithFormat:@"closed = NO AND ANY labels.name = 'label 1'"]].fullyCompiled);
+    
+    // Objects other than Issues are left to NSPredicate
+    CompiledIssuePredicate *compiled = [CompiledIssuePredicate compiledPredicateWithPredicate:[NSPredicate predicateWithFormat:@"closed = NO"]];
+    XCTAssertTrue([compiled evaluateWithObject:@{ @"closed" : @NO }]);
+}
+
+- (double)secondsToFilter:(NSArray<NSPredicate *> *)predicates compiled:(BOOL)compiled {
+    double start = [NSDate extras_monotonicTime];
+    for (NSPredicate *predicate in predicates) {
+        NSPredicate *p = compiled ? [CompiledIssuePredicate compiledPredicateWithPredicate:predicate] : predicate;
+        @autoreleasepool {
+            for (NSUInteger i = 0; i < 5; i++) {
+                [_issues filteredArrayUsingPredicate:p];
+            }
+        }
+    }
+    return [NSDate extras_monotonicTime] - start;
+}
+
+- (void)testFilteringThroughput {
+    NSDictionary *sets = @{ @"search" : [self searchPredicates], @"burndown" : [self burndownPredicates] };
+    for (NSString *name in sets) {
+        NSArray *predicates = sets[name];
+        double interpreted = [self secondsToFilter:predicates compiled:NO];
+        double compiled = [self secondsToFilter:predicates compiled:YES];
+        NSUInteger evaluations = _issues.count * predicates.count * 5;
+        NSLog(@"%@: NSPredicate %.0f issues/s, compiled %.0f issues/s (%.1fx)", name, evaluations / interpreted, evaluations / compiled, interpreted / compiled);
+    }
+}
+
+@end
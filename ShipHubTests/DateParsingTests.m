@@ -0,0 +1,149 @@
+//
+//  DateParsingTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Extras.h"
+
+/*
+ Checks +[NSDate extras_8601Fast:] against the ISO 8601 date formatters it stands in front of,
+ and compares their throughput.
+ 
+ Environment:
+   SHIP_DATE_FUZZ_ITERATIONS  random strings to check (default 200000)
+*/
+
+@interface DateParsingTests : XCTestCase
+
+@end
+
+@implementation DateParsingTests
+
+static NSDate *FormatterDate(NSString *str) {
+    return [[NSDateFormatter ISO8601Formatter] dateFromString:str] ?: [[NSDateFormatter ISO8601FormatterNoFractionalSeconds] dateFromString:str];
+}
+
+// Returns a sync style timestamp for a random time between 1970 and 2106, with 0, 3, 6 or 7 fractional digits.
+static NSString *RandomTimestamp(double *outTime) {
+    time_t t = (time_t)arc4random_uniform(UINT32_MAX);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    
+    NSUInteger fractionDigits = (NSUInteger[]){ 0, 3, 6, 7 }[arc4random_uniform(4)];
+    uint32_t fraction = 0;
+    uint32_t scale = 1;
+    for (NSUInteger i = 0; i < fractionDigits; i++) scale *= 10;
+    if (fractionDigits) fraction = arc4random_uniform(scale);
+    
+    NSMutableString *str = [NSMutableString stringWithFormat:@"%04d-%02d-%02dT%02d:%02d:%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec];
+    if (fractionDigits) {
+        [str appendFormat:@".%0*u", (int)fractionDigits, fraction];
+    }
+    [str appendString:arc4random_uniform(2) ? @"Z" : @"+00:00"];
+    
+    if (outTime) *outTime = (double)t + (fractionDigits ? (double)fraction / scale : 0.0);
+    return str;
+}
+
+- (void)testKnownDates {
+    NSDictionary *expected = @{ @"1970-01-01T00:00:00Z" : @0.0,
+                                @"2016-03-11T17:04:05Z" : @1457715845.0,
+                                @"2016-03-11T17:04:05+00:00" : @1457715845.0,
+                                @"2016-02-29T23:59:59.5Z" : @1456790399.5,
+                                @"2000-12-31T12:00:00.1234567Z" : @978264000.1234567,
+                                @"2100-03-01T00:00:00.000000001Z" : @4107542400.000000001 };
+    for (NSString *str in expected) {
+        NSDate *date = [NSDate extras_8601Fast:str];
+        XCTAssertNotNil(date, @"%@", str);
+        XCTAssertEqualWithAccuracy(date.timeIntervalSince1970, [expected[str] doubleValue], 1e-6, @"%@", str);
+    }
+    
+    // Anything else is left to the formatters
+    for (NSString *str in @[@"", @"2016-03-11", @"2016-03-11T17:04:05", @"2016-03-11 17:04:05Z", @"2016-03-11T17:04:05.Z",
+                            @"2016-03-11T17:04:05.1234567890Z", @"2016-03-11T17:04:05-07:00", @"2016-13-11T17:04:05Z",
+                            @"2016-03-11T25:04:05Z", @"2016-03-11T17:04:05z", @"２０１６-03-11T17:04:05Z"]) {
+        XCTAssertNil([NSDate extras_8601Fast:str], @"%@", str);
+    }
+}
+
+- (void)testFuzzAgainstFormatter {
+    NSString *iterationsStr = [[NSProcessInfo processInfo] environment][@"SHIP_DATE_FUZZ_ITERATIONS"];
+    NSUInteger iterations = iterationsStr.integerValue > 0 ? iterationsStr.integerValue : 200000;
+    
+    for (NSUInteger i = 0; i < iterations; i++) {
+        @autoreleasepool {
+            double t = 0.0;
+            NSString *str = RandomTimestamp(&t);
+            
+            NSDate *fast = [NSDate extras_8601Fast:str];
+            XCTAssertNotNil(fast, @"%@", str);
+            XCTAssertEqualWithAccuracy(fast.timeIntervalSince1970, t, 1e-6, @"%@", str);
+            
+            // The formatters only keep milliseconds
+            NSDate *formatted = FormatterDate(str);
+            if (formatted) {
+                XCTAssertEqualWithAccuracy(fast.timeIntervalSince1970, formatted.timeIntervalSince1970, 1e-3, @"%@", str);
+            }
+            
+            // Damage the string. The fast path must either reject it or agree with the formatters.
+            NSMutableString *mutated = [str mutableCopy];
+            NSUInteger at = arc4random_uniform((uint32_t)mutated.length);
+            switch (arc4random_uniform(3)) {
+                case 0: [mutated replaceCharactersInRange:NSMakeRange(at, 1) withString:[NSString stringWithFormat:@"%C", (unichar)arc4random_uniform(128)]]; break;
+                case 1: [mutated deleteCharactersInRange:NSMakeRange(at, 1)]; break;
+                case 2: [mutated insertString:[NSString stringWithFormat:@"%C", (unichar)arc4random_uniform(128)] atIndex:at]; break;
+            }
+            
+            // Before the 1582 cutover, the formatters' calendar is Julian, while the fast path is proleptic Gregorian,
+            // so they disagree by days. Only years after that have to agree.
+            fast = [NSDate extras_8601Fast:mutated];
+            formatted = FormatterDate(mutated);
+            if (fast && formatted && [[mutated substringToIndex:4] integerValue] >= 1583) {
+                XCTAssertEqualWithAccuracy(fast.timeIntervalSince1970, formatted.timeIntervalSince1970, 1e-3, @"%@", mutated);
+            }
+            
+            NSDate *json = [NSDate dateWithJSONString:mutated];
+            XCTAssertEqualObjects(json, fast ?: formatted, @"%@", mutated);
+        }
+    }
+}
+
+- (void)testParseThroughput {
+    NSMutableArray *strings = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 100000; i++) {
+        [strings addObject:RandomTimestamp(NULL)];
+    }
+    
+    double start = [NSDate extras_monotonicTime];
+    @autoreleasepool {
+        for (NSString *str in strings) {
+            [NSDate extras_8601Fast:str];
+        }
+    }
+    double fast = [NSDate extras_monotonicTime] - start;
+    
+    start = [NSDate extras_monotonicTime];
+    @autoreleasepool {
+        for (NSString *str in strings) {
+            FormatterDate(str);
+        }
+    }
+    double formatter = [NSDate extras_monotonicTime] - start;
+    
+    NSLog(@"Parsed %tu dates: fast path %.0f/s, formatter %.0f/s (%.1fx)", strings.count, strings.count / fast, strings.count / formatter, formatter / fast);
+    
+    [self measureBlock:^{
+        @autoreleasepool {
+            for (NSString *str in strings) {
+                [NSDate extras_8601Fast:str];
+            }
+        }
+    }];
+}
+
+@end
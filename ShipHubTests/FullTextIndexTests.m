@@ -0,0 +1,188 @@
+//
+//  FullTextIndexTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Extras.h"
+#import "FullTextIndex.h"
+
+/*
+ Checks FullTextIndex matching, and times queries over a synthetic set of issues.
+ 
+ Environment:
+   SHIP_FULLTEXT_ISSUES  issues to index for the query benchmark (default 200000)
+*/
+
+@interface FullTextIndexTests : XCTestCase
+
+@end
+
+@implementation FullTextIndexTests
+
+- (void)testWordsAreFolded {
+    FullTextIndex *index = [FullTextIndex new];
+    [index setTitle:@"Crash in Café menu" body:nil forIssue:@1];
+    
+    for (NSString *query in @[@"cafe", @"CAFÉ", @"ｃａｆｅ", @"crash cafe", @"menu, crash!"]) {
+        XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:query], @[@1], @"%@", query);
+    }
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@""], @[]);
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"  ?! "], @[]);
+}
+
+- (void)testEveryWordMustMatch {
+    FullTextIndex *index = [FullTextIndex new];
+    [index setTitle:@"Login crash" body:@"Happens on launch" forIssue:@1];
+    [index setTitle:@"Login works" body:nil forIssue:@2];
+    
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"login crash"], @[@1]);
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"login launch"], @[@1]);
+    XCTAssertEqualObjects([[index issueIdentifiersMatchingQuery:@"login"] sortedArrayUsingSelector:@selector(compare:)], (@[@1, @2]));
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"login missing"], @[]);
+}
+
+- (void)testLastWordMatchesPrefix {
+    FullTextIndex *index = [FullTextIndex new];
+    [index setTitle:@"Crashes when saving" body:nil forIssue:@1];
+    
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"cras"], @[@1]);
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"saving cras"], @[@1]);
+    
+    // Too short to prefix match, or not the last word
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"cr"], @[]);
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"cras saving"], @[]);
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"cras "], @[]);
+}
+
+- (void)testCommentsCountTowardsTheirIssue {
+    FullTextIndex *index = [FullTextIndex new];
+    [index setTitle:@"Hangs" body:nil forIssue:@1];
+    [index setTitle:@"Hangs too" body:nil forIssue:@2];
+    [index setBody:@"Backtrace shows a deadlock" forComment:@10 issue:@1];
+    
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"hangs deadlock"], @[@1]);
+    
+    [index setBody:@"Backtrace shows a deadlock" forComment:@10 issue:@2];
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"deadlock"], @[@2]);
+    
+    [index removeIssue:@2];
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"deadlock"], @[]);
+    
+    [index setTitle:@"Hangs too" body:nil forIssue:@2];
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"deadlock"], @[@2]);
+    
+    [index removeComment:@10];
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"deadlock"], @[]);
+    
+    // Comments can arrive before their issue
+    [index setBody:@"First!" forComment:@11 issue:@3];
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"first"], @[]);
+    [index setTitle:@"Late" body:nil forIssue:@3];
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"first"], @[@3]);
+    XCTAssertEqual(index.issueCount, 3);
+}
+
+- (void)testUpdatesReplaceText {
+    FullTextIndex *index = [FullTextIndex new];
+    [index setTitle:@"Typo in prefrences" body:nil forIssue:@1];
+    [index setTitle:@"Typo in preferences" body:nil forIssue:@1];
+    
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"prefrences"], @[]);
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"preferences"], @[@1]);
+    XCTAssertEqual(index.issueCount, 1);
+    
+    [index removeIssue:@1];
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"typo"], @[]);
+    XCTAssertEqual(index.issueCount, 0);
+}
+
+- (void)testRanking {
+    FullTextIndex *index = [FullTextIndex new];
+    [index setTitle:@"Something else" body:@"The parser is slow" forIssue:@1];
+    [index setTitle:@"Parser is slow" body:nil forIssue:@2];
+    [index setTitle:@"Slow" body:@"parser parser parser parser parser parser" forIssue:@3];
+    
+    // Title words count more than body words, and repeats add up
+    XCTAssertEqualObjects([index issueIdentifiersMatchingQuery:@"parser"], (@[@3, @2, @1]));
+}
+
+static NSArray<NSString *> *Vocabulary(NSUInteger count) {
+    NSArray *syllables = @[@"ka", @"lo", @"mi", @"ne", @"ru", @"sa", @"ti", @"vo", @"zu", @"pe", @"qua", @"dri", @"ful", @"gon", @"xen", @"bri"];
+    NSMutableArray *words = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        NSMutableString *word = [NSMutableString new];
+        NSUInteger n = i;
+        do {
+            [word appendString:syllables[n % syllables.count]];
+            n /= syllables.count;
+        } while (n > 0);
+        [words addObject:word];
+    }
+    return words;
+}
+
+// Picks words skewed towards the start of the vocabulary, like real text.
+static NSString *RandomText(NSArray<NSString *> *vocabulary, NSUInteger wordCount) {
+    NSMutableString *text = [NSMutableString new];
+    for (NSUInteger i = 0; i < wordCount; i++) {
+        double r = (double)arc4random() / UINT32_MAX;
+        NSUInteger idx = MIN((NSUInteger)(r * r * r * vocabulary.count), vocabulary.count - 1);
+        if (i) [text appendString:@" "];
+        [text appendString:vocabulary[idx]];
+    }
+    return text;
+}
+
+- (void)testQueryThroughput {
+    NSString *issuesStr = [[NSProcessInfo processInfo] environment][@"SHIP_FULLTEXT_ISSUES"];
+    NSUInteger issueCount = issuesStr.integerValue > 0 ? issuesStr.integerValue : 200000;
+    
+    NSArray *vocabulary = Vocabulary(20000);
+    FullTextIndex *index = [FullTextIndex new];
+    
+    double start = [NSDate extras_monotonicTime];
+    for (NSUInteger i = 0; i < issueCount; i++) {
+        @autoreleasepool {
+            [index setTitle:RandomText(vocabulary, 6) body:RandomText(vocabulary, 40) forIssue:@(i + 1)];
+            if (i % 2 == 0) {
+                [index setBody:RandomText(vocabulary, 20) forComment:@(i + 1) issue:@(i + 1)];
+            }
+        }
+    }
+    [index compact];
+    double built = [NSDate extras_monotonicTime] - start;
+    
+    NSMutableArray *queries = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 200; i++) {
+        NSString *query = RandomText(vocabulary, 1 + i % 3);
+        if (i % 4 == 0 && query.length > FullTextIndexMinimumPrefixLength + 2) {
+            // Still typing the last word
+            query = [query substringToIndex:query.length - 2];
+        }
+        [queries addObject:query];
+    }
+    
+    NSUInteger matched = 0;
+    double slowest = 0.0;
+    start = [NSDate extras_monotonicTime];
+    for (NSString *query in queries) {
+        @autoreleasepool {
+            double queryStart = [NSDate extras_monotonicTime];
+            matched += [index issueIdentifiersMatchingQuery:query].count;
+            slowest = MAX(slowest, [NSDate extras_monotonicTime] - queryStart);
+        }
+    }
+    double average = ([NSDate extras_monotonicTime] - start) / queries.count;
+    
+    NSLog(@"Indexed %tu issues (%tu terms) in %.1fs. %tu queries matched %.0f issues on average, in %.2fms avg, %.2fms max", issueCount, index.termCount, built, queries.count, (double)matched / queries.count, average * 1000.0, slowest * 1000.0);
+    
+    XCTAssertEqual(index.issueCount, issueCount);
+    XCTAssertLessThan(average, 0.05);
+}
+
+@end
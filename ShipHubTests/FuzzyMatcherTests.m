@@ -0,0 +1,159 @@
+//
+//  FuzzyMatcherTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Extras.h"
+#import "FuzzyMatcher.h"
+
+/*
+ Checks FuzzyMatcher ranking, and times typing a query against a large diff's worth of paths.
+ 
+ Environment:
+   SHIP_FUZZY_PATHS  paths to match against in the throughput test (default 50000)
+*/
+
+@interface FuzzyMatcherTests : XCTestCase
+
+@end
+
+@implementation FuzzyMatcherTests
+
+static NSArray<NSString *> *Matches(FuzzyMatcher *matcher, NSArray<NSString *> *candidates, NSString *query) {
+    return [[matcher indexesMatchingQuery:query limit:100] arrayByMappingObjects:^id(NSNumber *idx) {
+        return candidates[idx.unsignedIntegerValue];
+    }];
+}
+
+- (void)testSubsequenceMatching {
+    NSArray *candidates = @[@"ShipHub/DataStore.m", @"ShipHub/Issue.m", @"ext/SocketRocket/SRWebSocket.m"];
+    FuzzyMatcher *matcher = [[FuzzyMatcher alloc] initWithCandidates:candidates];
+    
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"dstore"), @[@"ShipHub/DataStore.m"]);
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"SRWEB"), @[@"ext/SocketRocket/SRWebSocket.m"]);
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"sr web"), @[@"ext/SocketRocket/SRWebSocket.m"]);
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"erotsd"), @[]);
+    XCTAssertEqualObjects(Matches(matcher, candidates, @""), @[]);
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"   "), @[]);
+}
+
+- (void)testFoldsCaseAndDiacritics {
+    NSArray *candidates = @[@"Café Repository", @"Other"];
+    FuzzyMatcher *matcher = [[FuzzyMatcher alloc] initWithCandidates:candidates];
+    
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"cafe"), @[@"Café Repository"]);
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"CAFÉ"), @[@"Café Repository"]);
+}
+
+- (void)testRanking {
+    NSArray *candidates = @[@"ShipHub/Mardown/Sources/issue.c",
+                            @"docs/pr/sidebar/view/controller.txt",
+                            @"ShipHub/PRSidebarViewController.m",
+                            @"ShipHub/PRSidebarViewController.h",
+                            @"ShipHub/Issue.m",
+                            @"ShipHub/IssueViewController.m",
+                            @"ShipHubTests/IssueTests.m"];
+    FuzzyMatcher *matcher = [[FuzzyMatcher alloc] initWithCandidates:candidates];
+    
+    // Camel case humps count as word starts, and the file name matters most
+    NSArray *results = Matches(matcher, candidates, @"prsvc");
+    XCTAssertEqual(results.count, 3);
+    XCTAssertEqualObjects([NSSet setWithArray:[results subarrayWithRange:NSMakeRange(0, 2)]], ([NSSet setWithObjects:@"ShipHub/PRSidebarViewController.m", @"ShipHub/PRSidebarViewController.h", nil]));
+    XCTAssertEqualObjects(results[2], @"docs/pr/sidebar/view/controller.txt");
+    
+    // Ties go to the shortest
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"issue").firstObject, @"ShipHub/Issue.m");
+    
+    // Word starts close together beat ones spread across the path
+    XCTAssertEqualObjects(Matches(matcher, candidates, @"ivc").firstObject, @"ShipHub/IssueViewController.m");
+}
+
+- (void)testLimit {
+    NSMutableArray *candidates = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [candidates addObject:[NSString stringWithFormat:@"dir%tu/file%tu.m", i % 10, i]];
+    }
+    FuzzyMatcher *matcher = [[FuzzyMatcher alloc] initWithCandidates:candidates];
+    
+    NSArray *limited = [matcher indexesMatchingQuery:@"file" limit:10];
+    NSArray *all = [matcher indexesMatchingQuery:@"file" limit:candidates.count];
+    XCTAssertEqual(limited.count, 10);
+    XCTAssertEqual(all.count, candidates.count);
+    XCTAssertEqualObjects(limited, [all subarrayWithRange:NSMakeRange(0, 10)]);
+}
+
+static NSArray<NSString *> *SyntheticPaths(NSUInteger count) {
+    NSArray *dirs = @[@"ShipHub", @"ShipHubTests", @"ext", @"SocketRocket", @"Sources", @"Resources", @"Views", @"Models", @"Controllers", @"lib"];
+    NSArray *words = @[@"Data", @"Store", @"Issue", @"View", @"Controller", @"Sync", @"Web", @"Socket", @"Avatar", @"Manager", @"Diff", @"File", @"Tree", @"Search", @"Omni", @"Cell", @"Row", @"Table", @"Git", @"Repo"];
+    NSArray *exts = @[@".m", @".h", @".swift", @".js", @".png", @".json"];
+    
+    NSMutableArray *paths = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        NSMutableString *path = [NSMutableString new];
+        NSUInteger depth = 1 + arc4random_uniform(4);
+        for (NSUInteger d = 0; d < depth; d++) {
+            [path appendFormat:@"%@/", dirs[arc4random_uniform((uint32_t)dirs.count)]];
+        }
+        NSUInteger parts = 1 + arc4random_uniform(3);
+        for (NSUInteger p = 0; p < parts; p++) {
+            [path appendString:words[arc4random_uniform((uint32_t)words.count)]];
+        }
+        [path appendFormat:@"%tu%@", i, exts[arc4random_uniform((uint32_t)exts.count)]];
+        [paths addObject:path];
+    }
+    return paths;
+}
+
+- (void)testRefiningMatchesStartingOver {
+    NSArray *candidates = SyntheticPaths(5000);
+    FuzzyMatcher *typing = [[FuzzyMatcher alloc] initWithCandidates:candidates];
+    
+    NSString *query = @"shipsyncview";
+    for (NSUInteger i = 1; i <= query.length; i++) {
+        NSString *prefix = [query substringToIndex:i];
+        FuzzyMatcher *fresh = [[FuzzyMatcher alloc] initWithCandidates:candidates];
+        XCTAssertEqualObjects([typing indexesMatchingQuery:prefix limit:50], [fresh indexesMatchingQuery:prefix limit:50], @"%@", prefix);
+    }
+    
+    // Deleting characters starts over
+    XCTAssertEqualObjects([typing indexesMatchingQuery:@"ship" limit:50], [[[FuzzyMatcher alloc] initWithCandidates:candidates] indexesMatchingQuery:@"ship" limit:50]);
+}
+
+- (void)testTypingThroughput {
+    NSString *pathsStr = [[NSProcessInfo processInfo] environment][@"SHIP_FUZZY_PATHS"];
+    NSUInteger pathCount = pathsStr.integerValue > 0 ? pathsStr.integerValue : 50000;
+    NSArray *candidates = SyntheticPaths(pathCount);
+    
+    double start = [NSDate extras_monotonicTime];
+    FuzzyMatcher *matcher = [[FuzzyMatcher alloc] initWithCandidates:candidates];
+    double built = [NSDate extras_monotonicTime] - start;
+    
+    NSString *query = @"shipdatastorecontroller";
+    double slowest = 0.0;
+    double total = 0.0;
+    for (NSUInteger i = 1; i <= query.length; i++) {
+        @autoreleasepool {
+            start = [NSDate extras_monotonicTime];
+            [matcher indexesMatchingQuery:[query substringToIndex:i] limit:100];
+            double elapsed = [NSDate extras_monotonicTime] - start;
+            slowest = MAX(slowest, elapsed);
+            total += elapsed;
+        }
+    }
+    
+    // For comparison, what each keystroke cost before
+    start = [NSDate extras_monotonicTime];
+    [candidates filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF CONTAINS[cd] %@", @"s"]];
+    double contains = [NSDate extras_monotonicTime] - start;
+    
+    NSLog(@"Matched %tu paths (built in %.1fms): %.2fms per keystroke avg, %.2fms max. CONTAINS[cd] took %.2fms", pathCount, built * 1000.0, total / query.length * 1000.0, slowest * 1000.0, contains * 1000.0);
+    
+    XCTAssertLessThan(slowest, 1.0 / 60.0);
+}
+
+@end
@@ -0,0 +1,210 @@
+//
+//  GitDiffCacheTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/9/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "GitDiffCache.h"
+
+@interface GitDiffCacheTests : XCTestCase
+
+@property NSString *directory;
+
+@end
+
+@implementation GitDiffCacheTests
+
+- (void)setUp {
+    [super setUp];
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:_directory error:NULL];
+    [super tearDown];
+}
+
+static NSString *Text(NSUInteger length, NSUInteger seed) {
+    NSMutableString *str = [NSMutableString stringWithCapacity:length];
+    while (str.length < length) {
+        [str appendFormat:@"%tu ", seed++];
+    }
+    return [str substringToIndex:length];
+}
+
+static NSString *Key(NSUInteger i) {
+    return [GitDiffCache keyWithOldOid:[NSString stringWithFormat:@"%040tx", i] newOid:[NSString stringWithFormat:@"%040tx", i + 1] options:@"patch"];
+}
+
+// Disk writes happen in the background, so wait for them to land.
+static BOOL WaitFor(BOOL (^condition)(void)) {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (!condition() && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.05];
+    }
+    return condition();
+}
+
+- (unsigned long long)directorySize {
+    unsigned long long total = 0;
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_directory error:NULL]) {
+        total += [[[NSFileManager defaultManager] attributesOfItemAtPath:[_directory stringByAppendingPathComponent:name] error:NULL] fileSize];
+    }
+    return total;
+}
+
+- (void)testKeys {
+    XCTAssertEqualObjects([GitDiffCache keyWithOldOid:@"abc" newOid:@"def" options:@"patch"], [GitDiffCache keyWithOldOid:@"abc" newOid:@"def" options:@"patch"]);
+    XCTAssertNotEqualObjects([GitDiffCache keyWithOldOid:@"abc" newOid:@"def" options:@"patch"], [GitDiffCache keyWithOldOid:@"def" newOid:@"abc" options:@"patch"]);
+    XCTAssertNotEqualObjects([GitDiffCache keyWithOldOid:@"abc" newOid:@"def" options:@"patch"], [GitDiffCache keyWithOldOid:@"abc" newOid:@"def" options:@"other"]);
+    XCTAssertNotEqualObjects([GitDiffCache keyWithOldOid:nil newOid:@"def" options:@"patch"], [GitDiffCache keyWithOldOid:@"def" newOid:nil options:@"patch"]);
+}
+
+- (void)testMemoryTier {
+    GitDiffCache *cache = [[GitDiffCache alloc] initWithMemoryLimit:1024 * 1024 diskDirectory:nil diskLimit:0];
+    
+    XCTAssertNil([cache entryForKey:Key(0)]);
+    XCTAssertEqual(cache.missCount, 1);
+    
+    [cache setOldText:@"a\n" newText:@"b\n" patchText:@"@@ -1 +1 @@\n-a\n+b\n" forKey:Key(0)];
+    GitDiffCacheEntry *entry = [cache entryForKey:Key(0)];
+    XCTAssertEqualObjects(entry.oldText, @"a\n");
+    XCTAssertEqualObjects(entry.updatedText, @"b\n");
+    XCTAssertEqualObjects(entry.patchText, @"@@ -1 +1 @@\n-a\n+b\n");
+    XCTAssertEqual(cache.hitCount, 1);
+    XCTAssertEqual(cache.diskHitCount, 0);
+    XCTAssertGreaterThan(cache.memoryUsage, 0);
+    
+    // Replacing an entry doesn't count it twice
+    NSUInteger usage = cache.memoryUsage;
+    [cache setOldText:@"a\n" newText:@"b\n" patchText:@"@@ -1 +1 @@\n-a\n+b\n" forKey:Key(0)];
+    XCTAssertEqual(cache.memoryUsage, usage);
+    
+    [cache removeAllEntries];
+    XCTAssertNil([cache entryForKey:Key(0)]);
+    XCTAssertEqual(cache.memoryUsage, 0);
+}
+
+- (void)testEvictsLeastRecentlyUsed {
+    // Each entry costs 200 bytes (100 UTF-16 characters), so five fit
+    GitDiffCache *cache = [[GitDiffCache alloc] initWithMemoryLimit:1000 diskDirectory:nil diskLimit:0];
+    for (NSUInteger i = 0; i < 5; i++) {
+        [cache setOldText:nil newText:nil patchText:Text(100, i) forKey:Key(i)];
+    }
+    XCTAssertEqual(cache.memoryUsage, 1000);
+    
+    // Using 0 makes 1 the least recently used
+    XCTAssertNotNil([cache entryForKey:Key(0)]);
+    [cache setOldText:nil newText:nil patchText:Text(100, 5) forKey:Key(5)];
+    
+    XCTAssertNotNil([cache entryForKey:Key(0)]);
+    XCTAssertNil([cache entryForKey:Key(1)]);
+    for (NSUInteger i = 2; i <= 5; i++) {
+        XCTAssertEqualObjects([cache entryForKey:Key(i)].patchText, Text(100, i));
+    }
+    XCTAssertLessThanOrEqual(cache.memoryUsage, 1000);
+    
+    // An entry larger than the whole cache isn't kept, and replaces any older one for its key
+    [cache setOldText:nil newText:nil patchText:Text(1000, 0) forKey:Key(2)];
+    XCTAssertNil([cache entryForKey:Key(2)]);
+    XCTAssertEqual(cache.memoryUsage, 800);
+}
+
+- (void)testDiskTierRoundTrip {
+    NSString *oldText = @"café \U0001F600\nline 2\n";
+    NSString *newText = @"café \U0001F601\nline 2\n";
+    NSString *patchText = @"@@ -1 +1 @@\n-café \U0001F600\n+café \U0001F601\n";
+    
+    GitDiffCache *cache = [[GitDiffCache alloc] initWithMemoryLimit:1024 * 1024 diskDirectory:_directory diskLimit:1024 * 1024];
+    [cache setOldText:oldText newText:newText patchText:patchText forKey:Key(0)];
+    [cache setOldText:nil newText:newText patchText:patchText forKey:Key(1)]; // an added file
+    
+    NSFileManager *fm = [NSFileManager defaultManager];
+    XCTAssertTrue(WaitFor(^{
+        return (BOOL)([fm fileExistsAtPath:[_directory stringByAppendingPathComponent:Key(0)]]
+                      && [fm fileExistsAtPath:[_directory stringByAppendingPathComponent:Key(1)]]);
+    }));
+    
+    // A new cache over the same directory starts with nothing in memory, so these come from disk
+    GitDiffCache *reopened = [[GitDiffCache alloc] initWithMemoryLimit:1024 * 1024 diskDirectory:_directory diskLimit:1024 * 1024];
+    GitDiffCacheEntry *entry = [reopened entryForKey:Key(0)];
+    XCTAssertEqualObjects(entry.oldText, oldText);
+    XCTAssertEqualObjects(entry.updatedText, newText);
+    XCTAssertEqualObjects(entry.patchText, patchText);
+    XCTAssertEqual(reopened.diskHitCount, 1);
+    
+    entry = [reopened entryForKey:Key(1)];
+    XCTAssertNil(entry.oldText);
+    XCTAssertEqualObjects(entry.updatedText, newText);
+    XCTAssertEqual(reopened.diskHitCount, 2);
+    
+    // Now it's in memory
+    XCTAssertNotNil([reopened entryForKey:Key(0)]);
+    XCTAssertEqual(reopened.diskHitCount, 2);
+    XCTAssertEqual(reopened.hitCount, 3);
+    
+    XCTAssertNil([reopened entryForKey:Key(2)]);
+    XCTAssertEqual(reopened.missCount, 1);
+}
+
+- (void)testDiskTierIgnoresCorruptEntries {
+    GitDiffCache *cache = [[GitDiffCache alloc] initWithMemoryLimit:1024 * 1024 diskDirectory:_directory diskLimit:1024 * 1024];
+    NSString *path = [_directory stringByAppendingPathComponent:Key(0)];
+    [[@"not a plist" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:path atomically:YES];
+    
+    XCTAssertNil([cache entryForKey:Key(0)]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+}
+
+- (void)testDiskTierEvictsEntriesFromMemory {
+    // Too small to keep more than one entry in memory, so the rest must come back from disk
+    GitDiffCache *cache = [[GitDiffCache alloc] initWithMemoryLimit:300 diskDirectory:_directory diskLimit:1024 * 1024];
+    for (NSUInteger i = 0; i < 4; i++) {
+        [cache setOldText:nil newText:nil patchText:Text(100, i) forKey:Key(i)];
+    }
+    XCTAssertTrue(WaitFor(^{
+        return (BOOL)([[[NSFileManager defaultManager] contentsOfDirectoryAtPath:_directory error:NULL] count] == 4);
+    }));
+    
+    // 3 was set last, so it's the one in memory
+    XCTAssertEqualObjects([cache entryForKey:Key(3)].patchText, Text(100, 3));
+    XCTAssertEqual(cache.diskHitCount, 0);
+    for (NSUInteger i = 0; i < 3; i++) {
+        XCTAssertEqualObjects([cache entryForKey:Key(i)].patchText, Text(100, i));
+    }
+    XCTAssertEqual(cache.diskHitCount, 3);
+    XCTAssertLessThanOrEqual(cache.memoryUsage, 300);
+}
+
+- (void)testTrimsDisk {
+    // The disk tier is trimmed every 32 writes. Each entry is a little over 1000 bytes on disk.
+    const NSUInteger diskLimit = 20000;
+    GitDiffCache *cache = [[GitDiffCache alloc] initWithMemoryLimit:1024 * 1024 diskDirectory:_directory diskLimit:diskLimit];
+    for (NSUInteger i = 0; i < 31; i++) {
+        [cache setOldText:nil newText:nil patchText:Text(1000, i) forKey:Key(i)];
+    }
+    XCTAssertTrue(WaitFor(^{
+        return (BOOL)([[[NSFileManager defaultManager] contentsOfDirectoryAtPath:_directory error:NULL] count] == 31);
+    }));
+    XCTAssertGreaterThan([self directorySize], diskLimit);
+    
+    [cache setOldText:nil newText:nil patchText:Text(1000, 31) forKey:Key(31)];
+    XCTAssertTrue(WaitFor(^{
+        return (BOOL)([self directorySize] <= diskLimit);
+    }), @"%llu", [self directorySize]);
+    
+    NSUInteger count = [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:_directory error:NULL] count];
+    XCTAssertGreaterThan(count, 0);
+    XCTAssertLessThan(count, 32);
+    
+    // Everything is still in memory regardless
+    for (NSUInteger i = 0; i < 32; i++) {
+        XCTAssertNotNil([cache entryForKey:Key(i)]);
+    }
+}
+
+@end
@@ -0,0 +1,137 @@
+//
+//  GitLFSStoreTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Extras.h"
+#import "GitLFSStore.h"
+
+#import <CommonCrypto/CommonCrypto.h>
+
+@interface GitLFSStoreTests : XCTestCase
+
+@property NSString *directory;
+
+@end
+
+@implementation GitLFSStoreTests
+
+- (void)setUp {
+    [super setUp];
+    _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:_directory error:NULL];
+    [super tearDown];
+}
+
+static NSData *RandomData(NSUInteger length) {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    arc4random_buf(data.mutableBytes, length);
+    return data;
+}
+
+static NSString *OidOf(NSData *data) {
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(data.bytes, (CC_LONG)data.length, digest);
+    return [NSString stringWithHexBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+}
+
+// Writes data through a writer in chunks, as it would arrive from the network.
+static BOOL Write(GitLFSStore *store, NSString *oid, unsigned long long size, NSData *data, NSError *__autoreleasing *error) {
+    GitLFSStoreWriter *writer = [store writerForOid:oid size:size error:error];
+    if (!writer) return NO;
+    for (NSUInteger offset = 0; offset < data.length; offset += 1000) {
+        NSData *chunk = [data subdataWithRange:NSMakeRange(offset, MIN(1000, data.length - offset))];
+        if (![writer appendData:chunk error:error]) return NO;
+    }
+    return [writer finish:error];
+}
+
+- (void)testWriteAndRead {
+    GitLFSStore *store = [[GitLFSStore alloc] initWithDirectory:_directory diskLimit:UINT64_MAX];
+    NSData *data = RandomData(100000);
+    NSString *oid = OidOf(data);
+    
+    XCTAssertFalse([store hasObjectWithOid:oid]);
+    XCTAssertNil([store objectWithOid:oid]);
+    
+    NSError *error = nil;
+    XCTAssertTrue(Write(store, oid, data.length, data, &error), @"%@", error);
+    XCTAssertTrue([store hasObjectWithOid:oid]);
+    XCTAssertEqualObjects([store objectWithOid:oid], data);
+    XCTAssertEqualObjects([store objectWithOid:[oid uppercaseString]], data);
+    
+    // Laid out the way git-lfs does it
+    NSString *path = [NSString pathWithComponents:@[_directory, @"objects", [oid substringToIndex:2], [oid substringWithRange:NSMakeRange(2, 2)], oid]];
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:path]);
+    
+    // A second store over the same directory sees it
+    GitLFSStore *reopened = [[GitLFSStore alloc] initWithDirectory:_directory diskLimit:UINT64_MAX];
+    XCTAssertEqualObjects([reopened objectWithOid:oid], data);
+}
+
+- (void)testRejectsBadObjects {
+    GitLFSStore *store = [[GitLFSStore alloc] initWithDirectory:_directory diskLimit:UINT64_MAX];
+    NSData *data = RandomData(10000);
+    NSString *oid = OidOf(data);
+    NSError *error = nil;
+    
+    // Wrong contents
+    NSData *other = RandomData(10000);
+    XCTAssertFalse(Write(store, oid, other.length, other, &error));
+    XCTAssertNotNil(error);
+    XCTAssertFalse([store hasObjectWithOid:oid]);
+    
+    // Truncated
+    XCTAssertFalse(Write(store, oid, data.length, [data subdataWithRange:NSMakeRange(0, 5000)], &error));
+    XCTAssertFalse([store hasObjectWithOid:oid]);
+    
+    // Longer than promised
+    XCTAssertFalse(Write(store, oid, 5000, data, &error));
+    XCTAssertFalse([store hasObjectWithOid:oid]);
+    
+    // Not an oid
+    XCTAssertNil([store writerForOid:@"../../etc/passwd" size:10 error:&error]);
+    XCTAssertNotNil(error);
+    
+    // Nothing left behind
+    NSArray *tmp = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:[_directory stringByAppendingPathComponent:@"tmp"] error:NULL];
+    XCTAssertEqual(tmp.count, 0);
+}
+
+- (void)testEvictsLeastRecentlyRead {
+    GitLFSStore *store = [[GitLFSStore alloc] initWithDirectory:_directory diskLimit:250000];
+    
+    NSMutableArray *oids = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 2; i++) {
+        NSData *data = RandomData(100000);
+        [oids addObject:OidOf(data)];
+        XCTAssertTrue(Write(store, oids[i], data.length, data, NULL));
+        [NSThread sleepForTimeInterval:1.1]; // modification dates have a resolution of a second on some file systems
+    }
+    XCTAssertNotNil([store objectWithOid:oids[0]]);
+    [NSThread sleepForTimeInterval:1.1];
+    
+    NSData *data = RandomData(100000);
+    [oids addObject:OidOf(data)];
+    XCTAssertTrue(Write(store, oids[2], data.length, data, NULL));
+    
+    // Trimming happens in the background
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while ([store hasObjectWithOid:oids[1]] && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.05];
+    }
+    
+    XCTAssertTrue([store hasObjectWithOid:oids[0]]);
+    XCTAssertFalse([store hasObjectWithOid:oids[1]]);
+    XCTAssertTrue([store hasObjectWithOid:oids[2]]);
+}
+
+@end
@@ -0,0 +1,100 @@
+//
+//  InflateTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Extras.h"
+
+/*
+ Checks -[NSData inflateWithSizeHint:] against data split across many regions, as sync messages are
+ when they come off the socket, and times inflating a large one.
+ 
+ Environment:
+   SHIP_INFLATE_MB  size in megabytes of the message in the throughput test (default 20)
+*/
+
+@interface InflateTests : XCTestCase
+
+@end
+
+@implementation InflateTests
+
+static NSData *SyntheticMessage(NSUInteger length) {
+    NSMutableData *data = [NSMutableData dataWithCapacity:length];
+    NSUInteger i = 0;
+    while (data.length < length) {
+        NSString *entry = [NSString stringWithFormat:@"{\"entity\":\"issue\",\"action\":\"set\",\"data\":{\"identifier\":%tu,\"title\":\"Issue %tu\",\"state\":\"open\"}},", i, i * 7919 % 100003];
+        [data appendData:[entry dataUsingEncoding:NSUTF8StringEncoding]];
+        i++;
+    }
+    data.length = length;
+    return data;
+}
+
+// Returns data as a dispatch_data_t made of regions of at most regionSize bytes.
+// The regions are joined pairwise, as concatenating them one at a time is quadratic in their number.
+static dispatch_data_t Regions(NSData *data, NSUInteger regionSize) {
+    NSMutableArray<dispatch_data_t> *level = [NSMutableArray new];
+    for (NSUInteger offset = 0; offset < data.length; offset += regionSize) {
+        NSUInteger length = MIN(regionSize, data.length - offset);
+        [level addObject:dispatch_data_create(((const uint8_t *)data.bytes) + offset, length, NULL, DISPATCH_DATA_DESTRUCTOR_DEFAULT)];
+    }
+    while (level.count > 1) {
+        NSMutableArray<dispatch_data_t> *next = [NSMutableArray arrayWithCapacity:(level.count + 1) / 2];
+        for (NSUInteger i = 0; i < level.count; i += 2) {
+            [next addObject:i + 1 < level.count ? dispatch_data_create_concat(level[i], level[i + 1]) : level[i]];
+        }
+        level = next;
+    }
+    return level.firstObject ?: dispatch_data_empty;
+}
+
+- (void)testInflateAcrossRegions {
+    NSData *message = SyntheticMessage(1024 * 1024);
+    NSData *deflated = [message deflate];
+    
+    for (NSNumber *regionSize in @[@1, @7, @4096, @65536, @(deflated.length)]) {
+        NSData *regions = (NSData *)Regions(deflated, regionSize.unsignedIntegerValue);
+        XCTAssertEqualObjects([regions inflate], message, @"%@", regionSize);
+        XCTAssertEqualObjects([regions inflateWithSizeHint:message.length], message, @"%@", regionSize);
+        XCTAssertEqualObjects([regions inflateWithSizeHint:16], message, @"%@", regionSize);
+    }
+}
+
+- (void)testInflateRejectsTruncatedData {
+    NSData *deflated = [SyntheticMessage(100000) deflate];
+    XCTAssertNil([[deflated subdataWithRange:NSMakeRange(0, deflated.length - 1)] inflate]);
+    XCTAssertNil([[NSData data] inflate]);
+}
+
+- (void)testInflateThroughput {
+    NSString *mbStr = [[NSProcessInfo processInfo] environment][@"SHIP_INFLATE_MB"];
+    NSUInteger length = (mbStr.integerValue > 0 ? mbStr.integerValue : 20) * 1024 * 1024;
+    
+    NSData *message = SyntheticMessage(length);
+    NSData *regions = (NSData *)Regions([message deflate], 64 * 1024);
+    __block NSUInteger regionCount = 0;
+    dispatch_data_apply((dispatch_data_t)regions, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+        regionCount++;
+        return true;
+    });
+    
+    double start = [NSDate extras_monotonicTime];
+    NSData *inflated = [regions inflate];
+    double elapsed = [NSDate extras_monotonicTime] - start;
+    
+    start = [NSDate extras_monotonicTime];
+    [regions inflateWithSizeHint:length];
+    double hinted = [NSDate extras_monotonicTime] - start;
+    
+    NSLog(@"Inflated %.1fMB from %tu regions in %.1fms (%.1fms with a size hint)", length / (1024.0 * 1024.0), regionCount, elapsed * 1000.0, hinted * 1000.0);
+    
+    XCTAssertEqual(inflated.length, length);
+}
+
+@end
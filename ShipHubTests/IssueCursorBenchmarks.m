@@ -0,0 +1,133 @@
+//
+//  IssueCursorBenchmarks.m
+//  ShipHub
+//
+//  Created by James Howard on 3/12/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <sys/resource.h>
+
+#import "DataStore+IssueCursor.h"
+#import "Extras.h"
+#import "Issue.h"
+#import "TestDataStore.h"
+#import "TestSyncLog.h"
+
+/*
+ Compares what it takes to show the last row of a large search result: reading and sorting every
+ matching issue, as IssueTableController does for ordinary tables, against counting them and reading
+ the last page with an IssueCursor.
+ 
+ Environment:
+   SHIP_CURSOR_ISSUES     synthetic issue count to search (default 250000)
+*/
+
+@interface DataStore (CursorBenchmarkInternals)
+
+- (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+
+@end
+
+@interface IssueCursorBenchmarks : XCTestCase
+
+@property TestDataStore *store;
+@property NSUInteger issueCount;
+
+@end
+
+@implementation IssueCursorBenchmarks
+
+static uint64_t PeakRSS() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (uint64_t)usage.ru_maxrss; // bytes on macOS
+}
+
+- (void)setUp {
+    [super setUp];
+    
+    NSString *size = [[NSProcessInfo processInfo] environment][@"SHIP_CURSOR_ISSUES"];
+    _issueCount = size.integerValue > 0 ? size.integerValue : 250000;
+    
+    _store = [TestDataStore testStore];
+    XCTAssertNotNil(_store);
+    [_store activate];
+    
+    @autoreleasepool {
+        [_store.testSyncConnection replayEntries:[TestSyncLog syntheticEntriesWithIssueCount:_issueCount] batchSize:1000];
+        [_store performWriteAndWait:^(NSManagedObjectContext *moc) { }];
+    }
+}
+
+- (void)tearDown {
+    NSString *dir = [_store.testDBPath stringByDeletingLastPathComponent];
+    [_store deactivate];
+    _store = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+    
+    [super tearDown];
+}
+
+- (NSArray<NSSortDescriptor *> *)sortDescriptors {
+    return @[[NSSortDescriptor sortDescriptorWithKey:@"updatedAt" ascending:NO]];
+}
+
+- (void)testScrollToEndInMemory {
+    NSPredicate *predicate = [NSPredicate predicateWithValue:YES];
+    NSArray *sortDescriptors = [self sortDescriptors];
+    
+    double start = [NSDate extras_monotonicTime];
+    __block double fetched = 0.0;
+    __block Issue *last = nil;
+    __block NSUInteger count = 0;
+    XCTestExpectation *done = [self expectationWithDescription:@"issues"];
+    [_store issuesMatchingPredicate:predicate completion:^(NSArray<Issue *> *issues, NSError *error) {
+        XCTAssertNil(error);
+        fetched = [NSDate extras_monotonicTime];
+        NSArray *sorted = [issues sortedArrayUsingDescriptors:sortDescriptors];
+        count = sorted.count;
+        last = [sorted lastObject];
+        [done fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:600.0 handler:nil];
+    double end = [NSDate extras_monotonicTime];
+    
+    XCTAssertNotNil(last);
+    NSLog(@"In memory: %tu issues, last row after %.3fs (read %.3fs, sort %.3fs), peak RSS %llu", count, end - start, fetched - start, end - fetched, PeakRSS());
+}
+
+- (void)testScrollToEndWithCursor {
+    NSPredicate *predicate = [NSPredicate predicateWithValue:YES];
+    
+    double start = [NSDate extras_monotonicTime];
+    __block IssueCursor *cursor = nil;
+    XCTestExpectation *counted = [self expectationWithDescription:@"count"];
+    [_store issueCursorWithPredicate:predicate sortDescriptors:[self sortDescriptors] options:nil completion:^(IssueCursor *c, NSError *error) {
+        XCTAssertNil(error);
+        cursor = c;
+        [counted fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:600.0 handler:nil];
+    double countTime = [NSDate extras_monotonicTime];
+    
+    XCTAssertTrue(cursor.sortable);
+    XCTAssertTrue(cursor.count > 0);
+    
+    // A screenful of rows at the end, as loadVisibleCursorRows would ask for.
+    NSUInteger length = MIN(cursor.count, (NSUInteger)50);
+    NSRange range = NSMakeRange(cursor.count - length, length);
+    XCTestExpectation *loaded = [self expectationWithDescription:@"last page"];
+    [cursor loadRange:range completion:^(NSIndexSet *indexes) {
+        XCTAssertTrue([indexes containsIndexesInRange:range]);
+        [loaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:600.0 handler:nil];
+    double end = [NSDate extras_monotonicTime];
+    
+    XCTAssertNotNil([cursor issueAtIndex:cursor.count - 1]);
+    NSLog(@"Cursor: %tu issues, last row after %.3fs (count %.3fs, last page %.3fs), peak RSS %llu", cursor.count, end - start, countTime - start, end - countTime, PeakRSS());
+}
+
+@end
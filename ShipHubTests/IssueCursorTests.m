@@ -0,0 +1,340 @@
+//
+//  IssueCursorTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/12/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <CoreData/CoreData.h>
+
+#import "DataStore+IssueCursor.h"
+#import "Extras.h"
+#import "Issue.h"
+#import "LocalIssue.h"
+#import "LocalNotification.h"
+#import "LocalPullRequest.h"
+#import "SyncConnection.h"
+#import "TestDataStore.h"
+
+/*
+ Pages an IssueCursor through a small store in every sortable order and checks it against reading
+ every issue and sorting in memory with memorySortDescriptorsForSortDescriptors:.
+
+ The store is made to have ties, NULLs (directly and through nil to-one relationships), empty strings,
+ and strings whose byte order differs from their case and diacritic insensitive order. The page size
+ is small enough that there are more pages than the cursor keeps, so pages are re-read by key.
+*/
+
+@interface DataStore (IssueCursorTestInternals)
+
+- (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+
+@end
+
+@interface IssueCursor (IssueCursorTestInternals)
+
+- (void)setPageSize:(NSUInteger)pageSize;
+
+@end
+
+@interface IssueCursorTests : XCTestCase
+
+@property TestDataStore *store;
+@property NSArray<Issue *> *issues; // unsorted
+
+@end
+
+@implementation IssueCursorTests
+
+static const NSUInteger IssueCount = 157; // prime, so that number below is a permutation
+static const NSUInteger PageSize = 4; // 40 pages, the last one short
+
+static SyncEntry *SetEntry(NSString *type, NSDictionary *data) {
+    return [SyncEntry entryWithDictionary:@{ @"action" : @"set", @"entity" : type, @"data" : data }];
+}
+
+static NSArray<SyncEntry *> *Entries() {
+    NSMutableArray *entries = [NSMutableArray new];
+    NSDate *epoch = [NSDate dateWithTimeIntervalSinceReferenceDate:0];
+
+    NSArray *logins = @[@"user1", @"alice", @"Bob", @"bob", @"Émile", @"zoë"];
+    [logins enumerateObjectsUsingBlock:^(NSString *login, NSUInteger i, BOOL *stop) {
+        [entries addObject:SetEntry(@"account", @{ @"identifier" : @(i + 1), @"login" : login, @"type" : @"User" })];
+    }];
+
+    NSArray *repoNames = @[@"alpha", @"Beta", @"ålpha"];
+    [repoNames enumerateObjectsUsingBlock:^(NSString *name, NSUInteger i, BOOL *stop) {
+        NSUInteger r = i + 1;
+        [entries addObject:SetEntry(@"repo", @{ @"identifier" : @(r),
+                                                @"name" : name,
+                                                @"fullName" : [@"user1/" stringByAppendingString:name],
+                                                @"owner" : @1,
+                                                @"private" : @NO })];
+        [entries addObject:SetEntry(@"milestone", @{ @"identifier" : @(r * 10 + 1),
+                                                     @"number" : @1,
+                                                     @"title" : @"v1.0",
+                                                     @"state" : @"open",
+                                                     @"repository" : @(r) })];
+        [entries addObject:SetEntry(@"milestone", @{ @"identifier" : @(r * 10 + 2),
+                                                     @"number" : @2,
+                                                     @"title" : r == 2 ? @"V1.0" : @"v1.0 beta",
+                                                     @"state" : @"open",
+                                                     @"repository" : @(r) })];
+    }];
+
+    NSArray *titles = @[@"Crash on launch", @"crash on launch", @"Çrash on launch", @"", @"Zoom", @"zoom", @"émoji \U0001F600", @"emoji", @"Crash"];
+
+    for (NSUInteger i = 1; i <= IssueCount; i++) {
+        NSUInteger r = 1 + (i * 7) % 3;
+        BOOL closed = (i * 7) % 5 < 2;
+        NSDate *createdAt = [epoch dateByAddingTimeInterval:((i * 17) % 40) * 3600.0];
+
+        NSMutableDictionary *issue = [@{ @"identifier" : @(i),
+                                         @"number" : @((i * 53) % IssueCount + 1),
+                                         @"state" : closed ? @"closed" : @"open",
+                                         @"closed" : @(closed),
+                                         @"pullRequest" : @(i % 4 == 1),
+                                         @"createdAt" : [createdAt JSONString],
+                                         @"updatedAt" : [[createdAt dateByAddingTimeInterval:(i % 7) * 600.0] JSONString],
+                                         @"repository" : @(r) } mutableCopy];
+        NSUInteger t = (i * 13) % (titles.count + 1);
+        if (t < titles.count) {
+            issue[@"title"] = titles[t];
+        }
+        if (i % 5 != 0) {
+            issue[@"milestone"] = @(r * 10 + 1 + i % 2);
+        }
+        if (i % 11 != 0) {
+            issue[@"user"] = @(1 + (i * 3) % logins.count);
+        }
+        if (closed) {
+            issue[@"closedAt"] = [[epoch dateByAddingTimeInterval:((i * 3) % 10) * 86400.0] JSONString];
+            if (i % 3 != 0) {
+                issue[@"closedBy"] = @(2 + i % 5);
+            }
+        }
+        [entries addObject:SetEntry(@"issue", issue)];
+    }
+
+    return entries;
+}
+
+- (void)setUp {
+    [super setUp];
+
+    _store = [TestDataStore testStore];
+    XCTAssertNotNil(_store);
+    [_store activate];
+
+    [_store.testSyncConnection replayEntries:Entries() batchSize:50];
+
+    // Notifications (read, unread, unknown and none) and pull requests (merged and not) are written
+    // directly, since only their issue's sort keys matter here.
+    [_store performWriteAndWait:^(NSManagedObjectContext *moc) {
+        NSDate *epoch = [NSDate dateWithTimeIntervalSinceReferenceDate:0];
+        NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+        for (LocalIssue *li in [moc executeFetchRequest:fetch error:NULL]) {
+            NSUInteger i = li.identifier.unsignedIntegerValue;
+            if (i % 3 != 0) {
+                LocalNotification *ln = [NSEntityDescription insertNewObjectForEntityForName:@"LocalNotification" inManagedObjectContext:moc];
+                [ln setValue:@(20000 + i) forKey:@"identifier"];
+                [ln setValue:i % 9 == 1 ? nil : @(i % 5 < 2) forKey:@"unread"];
+                [ln setValue:li forKey:@"issue"];
+            }
+            if ([li.pullRequest boolValue]) {
+                LocalPullRequest *lpr = [NSEntityDescription insertNewObjectForEntityForName:@"LocalPullRequest" inManagedObjectContext:moc];
+                lpr.identifier = @(10000 + i);
+                lpr.mergedAt = i % 3 == 0 ? nil : [epoch dateByAddingTimeInterval:(i % 6) * 86400.0];
+                lpr.issue = li;
+            }
+        }
+        NSError *error = nil;
+        [moc save:&error];
+        XCTAssertNil(error);
+    }];
+
+    XCTestExpectation *read = [self expectationWithDescription:@"issues"];
+    [_store issuesMatchingPredicate:[NSPredicate predicateWithValue:YES] completion:^(NSArray<Issue *> *issues, NSError *error) {
+        XCTAssertNil(error);
+        _issues = issues;
+        [read fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    XCTAssertEqual(_issues.count, IssueCount);
+}
+
+- (void)tearDown {
+    NSString *dir = [_store.testDBPath stringByDeletingLastPathComponent];
+    [_store deactivate];
+    _store = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+
+    [super tearDown];
+}
+
+// Every order IssueTableController can ask a cursor for, one column at a time, plus a few combinations.
+- (NSArray<NSArray<NSSortDescriptor *> *> *)sortOrders {
+    NSArray *keys = @[@"number", @"title", @"fullIdentifier", @"repository.fullName", @"milestone.title",
+                      @"originator.login", @"closedBy.login", @"state", @"updatedAt", @"createdAt",
+                      @"closedAt", @"unread", @"pullRequest", @"mergedAt"];
+    NSMutableArray *orders = [NSMutableArray new];
+    for (NSString *key in keys) {
+        XCTAssertTrue([IssueCursor canSortWithDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:key ascending:YES]]]);
+        [orders addObject:@[[NSSortDescriptor sortDescriptorWithKey:key ascending:YES]]];
+        [orders addObject:@[[NSSortDescriptor sortDescriptorWithKey:key ascending:NO]]];
+    }
+    [orders addObject:@[[NSSortDescriptor sortDescriptorWithKey:@"state" ascending:YES],
+                        [NSSortDescriptor sortDescriptorWithKey:@"milestone.title" ascending:NO]]];
+    [orders addObject:@[[NSSortDescriptor sortDescriptorWithKey:@"unread" ascending:NO],
+                        [NSSortDescriptor sortDescriptorWithKey:@"closedBy.login" ascending:YES]]];
+    [orders addObject:@[[NSSortDescriptor sortDescriptorWithKey:@"milestone.title" ascending:YES],
+                        [NSSortDescriptor sortDescriptorWithKey:@"fullIdentifier" ascending:NO]]];
+    return orders;
+}
+
+// The identifiers of every issue, in the order sortDescriptors give in memory. The cursor breaks ties by identifier.
+- (NSArray<NSNumber *> *)expectedIdentifiersWithSortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors {
+    NSArray *memorySort = [[IssueCursor memorySortDescriptorsForSortDescriptors:sortDescriptors] arrayByAddingObject:[NSSortDescriptor sortDescriptorWithKey:@"identifier" ascending:YES]];
+    return [[_issues sortedArrayUsingDescriptors:memorySort] valueForKey:@"identifier"];
+}
+
+- (IssueCursor *)cursorWithSortDescriptors:(NSArray<NSSortDescriptor *> *)sortDescriptors {
+    __block IssueCursor *cursor = nil;
+    XCTestExpectation *counted = [self expectationWithDescription:@"count"];
+    [_store issueCursorWithPredicate:[NSPredicate predicateWithValue:YES] sortDescriptors:sortDescriptors options:nil completion:^(IssueCursor *c, NSError *error) {
+        XCTAssertNil(error);
+        cursor = c;
+        [counted fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+
+    XCTAssertTrue(cursor.sortable);
+    XCTAssertEqual(cursor.count, IssueCount);
+    [cursor setPageSize:PageSize];
+    return cursor;
+}
+
+// Loads range and records the identifier at each index in it into seen, checking that every index
+// in range is loaded (no gaps) and that an index read again has the same issue as before.
+- (void)loadRange:(NSRange)range cursor:(IssueCursor *)cursor seen:(NSMutableArray *)seen order:(NSArray *)sortDescriptors {
+    XCTestExpectation *loaded = [self expectationWithDescription:@"load"];
+    [cursor loadRange:range completion:^(NSIndexSet *indexes) {
+        [loaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+
+    range.length = MIN(NSMaxRange(range), cursor.count) - range.location;
+    XCTAssertTrue([cursor isLoadedAtIndexes:[NSIndexSet indexSetWithIndexesInRange:range]], @"%@ %@", sortDescriptors, NSStringFromRange(range));
+
+    for (NSUInteger idx = range.location; idx < NSMaxRange(range); idx++) {
+        Issue *issue = [cursor issueAtIndex:idx];
+        XCTAssertNotNil(issue, @"%@ at %tu", sortDescriptors, idx);
+        if (!issue) continue;
+        if (seen[idx] != [NSNull null]) {
+            XCTAssertEqualObjects(seen[idx], issue.identifier, @"%@ at %tu, read again", sortDescriptors, idx);
+        }
+        seen[idx] = issue.identifier;
+    }
+}
+
+- (void)checkSeen:(NSArray *)seen order:(NSArray *)sortDescriptors mode:(NSString *)mode {
+    NSArray *expected = [self expectedIdentifiersWithSortDescriptors:sortDescriptors];
+    XCTAssertEqualObjects(seen, expected, @"%@ %@", mode, sortDescriptors);
+    XCTAssertEqual([[NSSet setWithArray:seen] count], IssueCount, @"%@ %@ has duplicates", mode, sortDescriptors);
+}
+
+static NSMutableArray *EmptySeen() {
+    NSMutableArray *seen = [NSMutableArray arrayWithCapacity:IssueCount];
+    for (NSUInteger i = 0; i < IssueCount; i++) {
+        [seen addObject:[NSNull null]];
+    }
+    return seen;
+}
+
+// From the first page to the last, each found by key from the one before it. Then back to the first,
+// which re-reads the pages evicted on the way, each found by key from the one after it.
+- (void)testPagesForwards {
+    NSUInteger pageCount = (IssueCount + PageSize - 1) / PageSize;
+    for (NSArray *order in [self sortOrders]) {
+        IssueCursor *cursor = [self cursorWithSortDescriptors:order];
+        NSMutableArray *seen = EmptySeen();
+        for (NSUInteger page = 0; page < pageCount; page++) {
+            [self loadRange:NSMakeRange(page * PageSize, PageSize) cursor:cursor seen:seen order:order];
+        }
+        [self checkSeen:seen order:order mode:@"forwards"];
+
+        NSMutableArray *reread = EmptySeen();
+        for (NSUInteger page = pageCount; page > 0; page--) {
+            [self loadRange:NSMakeRange((page - 1) * PageSize, PageSize) cursor:cursor seen:reread order:order];
+        }
+        [self checkSeen:reread order:order mode:@"forwards, then back"];
+    }
+}
+
+// The last page first, as the reverse order's first page, then each page before it by key from the one after.
+- (void)testPagesBackwards {
+    NSUInteger pageCount = (IssueCount + PageSize - 1) / PageSize;
+    for (NSArray *order in [self sortOrders]) {
+        IssueCursor *cursor = [self cursorWithSortDescriptors:order];
+        NSMutableArray *seen = EmptySeen();
+        for (NSUInteger page = pageCount; page > 0; page--) {
+            [self loadRange:NSMakeRange((page - 1) * PageSize, PageSize) cursor:cursor seen:seen order:order];
+        }
+        [self checkSeen:seen order:order mode:@"backwards"];
+    }
+}
+
+// Ranges of one to three pages anywhere, so that pages are read by offset when nothing near them is known,
+// by key in either direction when something is, and several at once.
+- (void)testPagesByJumping {
+    NSUInteger pageCount = (IssueCount + PageSize - 1) / PageSize;
+    NSArray *orders = [self sortOrders];
+    [orders enumerateObjectsUsingBlock:^(NSArray *order, NSUInteger o, BOOL *stop) {
+        srandom((unsigned)o + 1);
+        IssueCursor *cursor = [self cursorWithSortDescriptors:order];
+        NSMutableArray *seen = EmptySeen();
+
+        // A middle page with no neighbors known, then the one just before it
+        [self loadRange:NSMakeRange((pageCount / 2) * PageSize, PageSize) cursor:cursor seen:seen order:order];
+        [self loadRange:NSMakeRange((pageCount / 2 - 1) * PageSize, PageSize) cursor:cursor seen:seen order:order];
+
+        for (NSUInteger jump = 0; jump < 4 * pageCount && [seen containsObject:[NSNull null]]; jump++) {
+            NSUInteger page = random() % pageCount;
+            NSUInteger pages = 1 + random() % 3;
+            [self loadRange:NSMakeRange(page * PageSize, pages * PageSize) cursor:cursor seen:seen order:order];
+        }
+        for (NSUInteger page = 0; page < pageCount; page++) {
+            if ([seen[page * PageSize] isKindOfClass:[NSNull class]]) {
+                [self loadRange:NSMakeRange(page * PageSize, PageSize) cursor:cursor seen:seen order:order];
+            }
+        }
+        [self checkSeen:seen order:order mode:@"jumping"];
+    }];
+}
+
+// loadIssuesAtIndexes: reads by offset rather than by key, and must agree.
+- (void)testLoadIssuesAtIndexes {
+    for (NSArray *order in [self sortOrders]) {
+        IssueCursor *cursor = [self cursorWithSortDescriptors:order];
+        NSMutableIndexSet *indexes = [NSMutableIndexSet new];
+        [indexes addIndexesInRange:NSMakeRange(3, 10)];
+        [indexes addIndex:IssueCount / 2];
+        [indexes addIndexesInRange:NSMakeRange(IssueCount - 6, 6)];
+
+        __block NSArray *identifiers = nil;
+        XCTestExpectation *loaded = [self expectationWithDescription:@"issues"];
+        [cursor loadIssuesAtIndexes:indexes completion:^(NSArray<Issue *> *issues, NSError *error) {
+            XCTAssertNil(error);
+            identifiers = [issues valueForKey:@"identifier"];
+            [loaded fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:60.0 handler:nil];
+
+        NSArray *expected = [[self expectedIdentifiersWithSortDescriptors:order] objectsAtIndexes:indexes];
+        XCTAssertEqualObjects(identifiers, expected, @"%@", order);
+    }
+}
+
+@end
@@ -0,0 +1,197 @@
+//
+//  IssueTimeIndexTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/7/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Extras.h"
+#import "Issue.h"
+#import "IssueTimeIndex.h"
+#import "LocalIssue.h"
+#import "TestDataStore.h"
+#import "TestSyncLog.h"
+#import "TimeSeries.h"
+
+/*
+ Checks that time series counted from an IssueTimeIndex match the ones counted by filtering
+ Issue records, over a fixture with closed, reopened, undated, and closed-before-created issues.
+*/
+
+@interface DataStore (IssueTimeIndexTestInternals)
+
+- (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+
+@end
+
+@interface IssueTimeIndexTests : XCTestCase
+
+@property TestDataStore *store;
+@property NSDate *startDate;
+@property NSDate *endDate;
+
+@end
+
+@implementation IssueTimeIndexTests
+
+- (void)setUp {
+    [super setUp];
+    
+    _store = [TestDataStore testStore];
+    XCTAssertNotNil(_store);
+    [_store activate];
+    
+    // Synthetic issues are created a minute apart from the reference date
+    _startDate = [NSDate dateWithTimeIntervalSinceReferenceDate:-2 * 3600.0];
+    _endDate = [NSDate dateWithTimeIntervalSinceReferenceDate:14 * 3600.0];
+    
+    @autoreleasepool {
+        [_store.testSyncConnection replayEntries:[TestSyncLog syntheticEntriesWithIssueCount:600] batchSize:200];
+        [_store performWriteAndWait:^(NSManagedObjectContext *moc) {
+            NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+            for (LocalIssue *li in [moc executeFetchRequest:fetch error:NULL]) {
+                NSUInteger n = li.number.unsignedIntegerValue;
+                NSDate *createdAt = li.createdAt;
+                if (n % 17 == 0) {
+                    // undated
+                    li.createdAt = nil;
+                }
+                if (n % 15 == 0) {
+                    // closed before it was created
+                    li.closedAt = [createdAt dateByAddingTimeInterval:-3600.0];
+                } else if (n % 21 == 0) {
+                    // closed, but without a date
+                    li.closedAt = nil;
+                } else if (n % 3 == 0) {
+                    li.closedAt = [createdAt dateByAddingTimeInterval:(n % 11) * 1800.0];
+                    li.closedBy = li.originator;
+                } else if (n % 10 == 1) {
+                    // reopened, which keeps the date it was last closed
+                    li.closedAt = [createdAt dateByAddingTimeInterval:2 * 3600.0];
+                    li.closedBy = li.originator;
+                }
+            }
+            NSError *error = nil;
+            [moc save:&error];
+            XCTAssertNil(error);
+        }];
+    }
+}
+
+- (void)tearDown {
+    NSString *dir = [_store.testDBPath stringByDeletingLastPathComponent];
+    [_store deactivate];
+    _store = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+    
+    [super tearDown];
+}
+
+static NSArray<NSNumber *> *IntervalCounts(TimeSeries *series) {
+    return [series.intervals arrayByMappingObjects:^id(TimeSeries *interval) {
+        return @(interval.count);
+    }];
+}
+
+static NSSet *UniqueValues(NSArray<Issue *> *records, NSString *keyPath) {
+    NSMutableSet *s = [NSMutableSet new];
+    for (Issue *i in records) {
+        [s addObject:[i valueForKeyPath:keyPath] ?: [NSNull null]];
+    }
+    return s;
+}
+
+// The series counted by filtering records, as timeSeriesMatchingPredicate: used to build it
+- (TimeSeries *)recordsSeriesWithPredicate:(NSPredicate *)predicate {
+    __block NSArray<Issue *> *records = nil;
+    XCTestExpectation *loaded = [self expectationWithDescription:@"records"];
+    [_store issuesMatchingPredicate:[TimeSeries timeSeriesPredicateWithPredicate:predicate startDate:_startDate endDate:_endDate] completion:^(NSArray<Issue *> *issues, NSError *error) {
+        XCTAssertNil(error);
+        records = issues;
+        [loaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    
+    TimeSeries *series = [[TimeSeries alloc] initWithPredicate:predicate startDate:_startDate endDate:_endDate];
+    series.records = records;
+    return series;
+}
+
+- (TimeSeries *)indexSeriesWithPredicate:(NSPredicate *)predicate {
+    __block TimeSeries *result = nil;
+    XCTestExpectation *loaded = [self expectationWithDescription:@"index"];
+    [_store timeSeriesMatchingPredicate:predicate startDate:_startDate endDate:_endDate completion:^(TimeSeries *series, NSError *error) {
+        XCTAssertNil(error);
+        result = series;
+        [loaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    XCTAssertNotNil(result.index);
+    return result;
+}
+
+- (void)testMatchesRecords {
+    NSArray *predicates = @[[NSPredicate predicateWithValue:YES],
+                            [NSPredicate predicateWithFormat:@"closed = NO"],
+                            [NSPredicate predicateWithFormat:@"closed = YES"],
+                            [NSPredicate predicateWithFormat:@"state = 'open' AND milestone.title = %@", @"v2.0"]];
+    
+    for (NSPredicate *predicate in predicates) {
+        TimeSeries *expected = [self recordsSeriesWithPredicate:predicate];
+        TimeSeries *actual = [self indexSeriesWithPredicate:predicate];
+        XCTAssertTrue(expected.count > 0, @"%@", predicate);
+        XCTAssertEqual(actual.count, expected.count, @"%@", predicate);
+        
+        [expected generateIntervalsWithCalendarUnit:NSCalendarUnitHour];
+        [actual generateIntervalsWithCalendarUnit:NSCalendarUnitHour];
+        XCTAssertEqualObjects(IntervalCounts(actual), IntervalCounts(expected), @"%@", predicate);
+    }
+}
+
+- (void)testPartitionsMatchRecords {
+    NSPredicate *predicate = [NSPredicate predicateWithValue:YES];
+    TimeSeries *expected = [self recordsSeriesWithPredicate:predicate];
+    TimeSeries *actual = [self indexSeriesWithPredicate:predicate];
+    
+    for (NSString *keyPath in @[@"repository.fullName", @"milestone.title", @"originator.login", @"closedBy.login", @"assignee.login"]) {
+        NSSet *values = UniqueValues(expected.records, keyPath);
+        XCTAssertEqualObjects([actual.index valuesForKeyPath:keyPath], values, @"%@", keyPath);
+        
+        for (id value in values) {
+            id val = value == [NSNull null] ? nil : value;
+            NSPredicate *partitionPredicate = [NSPredicate predicateWithFormat:@"%K = %@", keyPath, val];
+            
+            TimeSeries *e = [[TimeSeries alloc] initWithPredicate:partitionPredicate startDate:_startDate endDate:_endDate];
+            [e selectRecordsFrom:expected.records];
+            [e generateIntervalsWithCalendarUnit:NSCalendarUnitHour];
+            
+            TimeSeries *a = [[TimeSeries alloc] initWithPredicate:partitionPredicate startDate:_startDate endDate:_endDate];
+            [a selectRecordsFromIndex:[actual.index indexOfIssuesWhereKeyPath:keyPath equals:val]];
+            [a generateIntervalsWithCalendarUnit:NSCalendarUnitHour];
+            
+            XCTAssertEqual(a.count, e.count, @"%@", partitionPredicate);
+            XCTAssertEqualObjects(IntervalCounts(a), IntervalCounts(e), @"%@", partitionPredicate);
+        }
+    }
+    
+    // State partitions select from the whole index
+    for (NSString *state in @[@"open", @"closed"]) {
+        NSPredicate *partitionPredicate = [NSPredicate predicateWithFormat:@"state = %@", state];
+        
+        TimeSeries *e = [[TimeSeries alloc] initWithPredicate:partitionPredicate startDate:_startDate endDate:_endDate];
+        [e selectRecordsFrom:expected.records];
+        [e generateIntervalsWithCalendarUnit:NSCalendarUnitHour];
+        
+        TimeSeries *a = [[TimeSeries alloc] initWithPredicate:partitionPredicate startDate:_startDate endDate:_endDate];
+        [a selectRecordsFromIndex:actual.index];
+        [a generateIntervalsWithCalendarUnit:NSCalendarUnitHour];
+        
+        XCTAssertEqual(a.count, e.count, @"%@", partitionPredicate);
+        XCTAssertEqualObjects(IntervalCounts(a), IntervalCounts(e), @"%@", partitionPredicate);
+    }
+}
+
+@end
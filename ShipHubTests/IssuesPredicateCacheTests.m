@@ -0,0 +1,137 @@
+//
+//  IssuesPredicateCacheTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "DataStore+IssuesPredicate.h"
+#import "Issue.h"
+#import "TestDataStore.h"
+#import "TestSyncLog.h"
+
+/*
+ Checks that cached issues predicate rewrites are invalidated by saves to the entities they read,
+ including saves of a subentity when the rewrite read its abstract parent.
+*/
+
+@interface DataStore (IssuesPredicateCacheTestInternals)
+
+- (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+
+@end
+
+@interface IssuesPredicateCacheTests : XCTestCase
+
+@property TestDataStore *store;
+@property NSPredicate *predicate;
+
+@end
+
+@implementation IssuesPredicateCacheTests
+
+- (void)setUp {
+    [super setUp];
+    
+    _store = [TestDataStore testStore];
+    XCTAssertNotNil(_store);
+    [_store activate];
+    
+    @autoreleasepool {
+        [_store.testSyncConnection replayEntries:[TestSyncLog syntheticEntriesWithIssueCount:250] batchSize:250];
+        [_store performWriteAndWait:^(NSManagedObjectContext *moc) { }];
+    }
+    
+    // A complex subquery, which is expanded by reading the assignees' entity
+    _predicate = [NSPredicate predicateWithFormat:@"count(subquery(assignees, $x, $x.login BEGINSWITH %@)) > 0", @"user2"];
+}
+
+- (void)tearDown {
+    NSString *dir = [_store.testDBPath stringByDeletingLastPathComponent];
+    [_store deactivate];
+    _store = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+    
+    [super tearDown];
+}
+
+- (NSArray<Issue *> *)issuesMatchingPredicate:(NSPredicate *)predicate {
+    __block NSArray<Issue *> *result = nil;
+    XCTestExpectation *loaded = [self expectationWithDescription:@"issues"];
+    [_store issuesMatchingPredicate:predicate completion:^(NSArray<Issue *> *issues, NSError *error) {
+        XCTAssertNil(error);
+        result = issues;
+        [loaded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    return result;
+}
+
+- (void)testAccountSaveInvalidatesPlan {
+    XCTAssertTrue([self issuesMatchingPredicate:_predicate].count > 0);
+    
+    IssuesPredicateCacheStats *before = [_store issuesPredicateCacheStats];
+    
+    [_store performWriteAndWait:^(NSManagedObjectContext *moc) {
+        NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalAccount"];
+        fetch.predicate = [NSPredicate predicateWithFormat:@"login BEGINSWITH %@", @"user2"];
+        for (NSManagedObject *account in [moc executeFetchRequest:fetch error:NULL]) {
+            [account setValue:[@"renamed" stringByAppendingString:[account valueForKey:@"login"]] forKey:@"login"];
+        }
+        NSError *error = nil;
+        [moc save:&error];
+        XCTAssertNil(error);
+    }];
+    
+    XCTAssertEqual([self issuesMatchingPredicate:_predicate].count, 0);
+    
+    IssuesPredicateCacheStats *after = [_store issuesPredicateCacheStats];
+    XCTAssertEqual(after.stale, before.stale + 1);
+    XCTAssertEqual(after.hits, before.hits);
+}
+
+- (void)testSubentitySaveInvalidatesAbstractParent {
+    [self issuesMatchingPredicate:_predicate];
+    [self issuesMatchingPredicate:_predicate];
+    
+    IssuesPredicateCacheStats *before = [_store issuesPredicateCacheStats];
+    XCTAssertTrue(before.hits > 0);
+    
+    // A model where accounts are split into concrete subentities, as relationships to LocalAccount may resolve to
+    NSEntityDescription *account = [NSEntityDescription new];
+    account.name = @"LocalAccount";
+    account.abstract = YES;
+    NSEntityDescription *user = [NSEntityDescription new];
+    user.name = @"LocalUser";
+    account.subentities = @[user];
+    NSManagedObjectModel *mom = [NSManagedObjectModel new];
+    mom.entities = @[account, user];
+    
+    NSManagedObject *obj = [[NSManagedObject alloc] initWithEntity:user insertIntoManagedObjectContext:nil];
+    NSNotification *note = [NSNotification notificationWithName:NSManagedObjectContextDidSaveNotification object:nil userInfo:@{ NSUpdatedObjectsKey : [NSSet setWithObject:obj] }];
+    [_store invalidateIssuesPredicatesWithSave:note];
+    
+    [self issuesMatchingPredicate:_predicate];
+    
+    IssuesPredicateCacheStats *after = [_store issuesPredicateCacheStats];
+    XCTAssertEqual(after.stale, before.stale + 1);
+    XCTAssertEqual(after.hits, before.hits);
+}
+
+- (void)testUncachedConstantIsNotCached {
+    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"identifier IN %@", IssuesPredicateUncachedConstant(@[@1, @2, @3])];
+    
+    IssuesPredicateCacheStats *before = [_store issuesPredicateCacheStats];
+    [self issuesMatchingPredicate:predicate];
+    [self issuesMatchingPredicate:predicate];
+    
+    IssuesPredicateCacheStats *after = [_store issuesPredicateCacheStats];
+    XCTAssertEqual(after.uncacheable, before.uncacheable + 2);
+    XCTAssertEqual(after.hits, before.hits);
+    XCTAssertEqual(after.count, before.count);
+}
+
+@end
@@ -0,0 +1,99 @@
+//
+//  MetadataUpdateTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Extras.h"
+#import "Issue.h"
+#import "LocalIssue.h"
+#import "LocalMilestone.h"
+#import "MetadataStore.h"
+#import "Milestone.h"
+#import "TestDataStore.h"
+#import "TestSyncLog.h"
+
+/*
+ Checks that reads queued behind a write see the metadata that write inserted.
+*/
+
+@interface DataStore (MetadataUpdateTestInternals)
+
+- (void)performWrite:(void (^)(NSManagedObjectContext *moc))block;
+- (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+
+@end
+
+@interface MetadataUpdateTests : XCTestCase
+
+@property TestDataStore *store;
+
+@end
+
+@implementation MetadataUpdateTests
+
+- (void)setUp {
+    [super setUp];
+    
+    _store = [TestDataStore testStore];
+    XCTAssertNotNil(_store);
+    [_store activate];
+    
+    @autoreleasepool {
+        [_store.testSyncConnection replayEntries:[TestSyncLog syntheticEntriesWithIssueCount:100] batchSize:100];
+        [_store performWriteAndWait:^(NSManagedObjectContext *moc) { }];
+    }
+}
+
+- (void)tearDown {
+    NSString *dir = [_store.testDBPath stringByDeletingLastPathComponent];
+    [_store deactivate];
+    _store = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+    
+    [super tearDown];
+}
+
+- (void)testReadAfterSaveSeesInsertedMilestone {
+    for (NSUInteger i = 0; i < 20; i++) {
+        NSNumber *number = @(i + 1);
+        NSNumber *milestoneID = @(100000 + i);
+        
+        [_store performWrite:^(NSManagedObjectContext *moc) {
+            NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+            fetch.predicate = [NSPredicate predicateWithFormat:@"number = %@", number];
+            LocalIssue *li = [[moc executeFetchRequest:fetch error:NULL] firstObject];
+            XCTAssertNotNil(li);
+            
+            LocalMilestone *lm = [NSEntityDescription insertNewObjectForEntityForName:@"LocalMilestone" inManagedObjectContext:moc];
+            lm.identifier = milestoneID;
+            lm.number = @(100 + i);
+            lm.title = [NSString stringWithFormat:@"Inserted %tu", i];
+            lm.state = @"open";
+            lm.repository = li.repository;
+            li.milestone = lm;
+            
+            NSError *error = nil;
+            [moc save:&error];
+            XCTAssertNil(error);
+        }];
+        
+        // Queued behind the write, so it must see the milestone, and the metadata store must know it
+        XCTestExpectation *read = [self expectationWithDescription:[NSString stringWithFormat:@"read %tu", i]];
+        [_store issuesMatchingPredicate:[NSPredicate predicateWithFormat:@"number = %@", number] completion:^(NSArray<Issue *> *issues, NSError *error) {
+            XCTAssertNil(error);
+            XCTAssertEqual(issues.count, 1);
+            XCTAssertEqualObjects([[issues firstObject] milestone].identifier, milestoneID);
+            XCTAssertNotNil([_store.metadataStore milestoneWithIdentifier:milestoneID]);
+            [read fulfill];
+        }];
+    }
+    
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+}
+
+@end
@@ -0,0 +1,228 @@
+//
+//  SyncIngestBenchmarks.m
+//  ShipHub
+//
+//  Created by James Howard on 3/11/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <CoreData/CoreData.h>
+#import <sys/resource.h>
+
+#import "Extras.h"
+#import "SyncConnection.h"
+#import "TestDataStore.h"
+#import "TestSyncLog.h"
+
+/*
+ Replays sync logs through -[DataStore syncConnection:receivedEntries:...] into a throwaway store
+ and measures ingest throughput end to end: planning, writing, saving, and the change processing
+ that follows each save.
+
+ Environment:
+   SHIP_INGEST_SIZES      comma separated synthetic issue counts to replay (default 10000), e.g. 10000,100000,1000000
+   SHIP_SYNC_LOG          a recorded sync log to replay as well (see TestSyncLog)
+   SHIP_INGEST_RESULTS    where to write the results as JSON (default $TMPDIR/SyncIngestBenchmarks.json)
+   SHIP_INGEST_BASELINE   results from an earlier run to compare against
+   SHIP_BENCHMARK_LABEL   recorded in the results, e.g. the commit being measured
+*/
+
+@interface DataStore (IngestInternals)
+
+- (void)mocDidChange:(NSNotification *)note;
+- (NSArray *)changedIssueIdentifiers:(NSNotification *)note;
+- (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+
+@end
+
+// Times the work the DataStore does on its write context. Only touched on the write context's queue.
+@interface IngestDataStore : TestDataStore {
+@public
+    double _saveTime;
+    NSUInteger _saveCount;
+    double _mocDidChangeTime;
+    double _changedIssueIdentifiersTime;
+
+    double _saveStart;
+    double _mocDidChangeTimeInSave;
+}
+
+@end
+
+@implementation IngestDataStore
+
+- (void)startObservingSaves {
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(benchmarkWillSave:) name:NSManagedObjectContextWillSaveNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(benchmarkDidSave:) name:NSManagedObjectContextDidSaveNotification object:nil];
+}
+
+- (BOOL)isOwnContext:(NSManagedObjectContext *)moc {
+    return [moc.persistentStoreCoordinator persistentStoreForURL:[NSURL fileURLWithPath:self.testDBPath]] != nil;
+}
+
+- (void)benchmarkWillSave:(NSNotification *)note {
+    if (![self isOwnContext:note.object]) return;
+    _saveStart = [NSDate extras_monotonicTime];
+    _mocDidChangeTimeInSave = 0.0;
+}
+
+- (void)benchmarkDidSave:(NSNotification *)note {
+    if (![self isOwnContext:note.object] || _saveStart == 0.0) return;
+    // Pending changes are processed as part of the save, so don't count mocDidChange: twice.
+    _saveTime += ([NSDate extras_monotonicTime] - _saveStart) - _mocDidChangeTimeInSave;
+    _saveCount++;
+    _saveStart = 0.0;
+}
+
+- (void)mocDidChange:(NSNotification *)note {
+    double start = [NSDate extras_monotonicTime];
+    [super mocDidChange:note];
+    double elapsed = [NSDate extras_monotonicTime] - start;
+
+    _mocDidChangeTime += elapsed;
+    if (_saveStart != 0.0) {
+        _mocDidChangeTimeInSave += elapsed;
+    }
+}
+
+- (NSArray *)changedIssueIdentifiers:(NSNotification *)note {
+    double start = [NSDate extras_monotonicTime];
+    NSArray *result = [super changedIssueIdentifiers:note];
+    _changedIssueIdentifiersTime += [NSDate extras_monotonicTime] - start;
+    return result;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+@end
+
+@interface SyncIngestBenchmarks : XCTestCase
+
+@end
+
+@implementation SyncIngestBenchmarks
+
+static NSString *EnvironmentValue(NSString *key) {
+    NSString *value = [[NSProcessInfo processInfo] environment][key];
+    return value.length ? value : nil;
+}
+
+static uint64_t PeakRSS() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (uint64_t)usage.ru_maxrss; // bytes on macOS
+}
+
+- (NSArray<NSNumber *> *)syntheticSizes {
+    NSString *sizes = EnvironmentValue(@"SHIP_INGEST_SIZES") ?: @"10000";
+    NSMutableArray *result = [NSMutableArray new];
+    for (NSString *size in [sizes componentsSeparatedByString:@","]) {
+        NSInteger count = [[size trim] integerValue];
+        if (count > 0) [result addObject:@(count)];
+    }
+    // Smallest first, so the peak RSS recorded for each run is its own.
+    return [result sortedArrayUsingSelector:@selector(compare:)];
+}
+
+- (NSDictionary *)replayEntries:(NSArray<SyncEntry *> *)entries name:(NSString *)name {
+    IngestDataStore *store = (IngestDataStore *)[IngestDataStore testStore];
+    XCTAssertNotNil(store);
+
+    // Let the store finish opening before timing anything.
+    [store performWriteAndWait:^(NSManagedObjectContext *moc) { }];
+    [store performWriteAndWait:^(NSManagedObjectContext *moc) {
+        store->_saveTime = 0.0;
+        store->_saveCount = 0;
+        store->_mocDidChangeTime = 0.0;
+        store->_changedIssueIdentifiersTime = 0.0;
+    }];
+    [store startObservingSaves];
+
+    double start = [NSDate extras_monotonicTime];
+    @autoreleasepool {
+        [store.testSyncConnection replayEntries:entries batchSize:1000];
+        [store performWriteAndWait:^(NSManagedObjectContext *moc) { }];
+    }
+    double elapsed = [NSDate extras_monotonicTime] - start;
+
+    __block NSUInteger issueCount = 0;
+    __block NSDictionary *result = nil;
+    [store performWriteAndWait:^(NSManagedObjectContext *moc) {
+        issueCount = [moc countForFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"] error:NULL];
+        result = @{ @"name" : name,
+                    @"entries" : @(entries.count),
+                    @"issues" : @(issueCount),
+                    @"seconds" : @(elapsed),
+                    @"entriesPerSecond" : @(entries.count / elapsed),
+                    @"saveSeconds" : @(store->_saveTime),
+                    @"saveCount" : @(store->_saveCount),
+                    @"mocDidChangeSeconds" : @(store->_mocDidChangeTime),
+                    @"changedIssueIdentifiersSeconds" : @(store->_changedIssueIdentifiersTime),
+                    @"peakRSS" : @(PeakRSS()) };
+    }];
+
+    XCTAssertTrue(issueCount > 0);
+    NSLog(@"%@", result);
+
+    NSString *dir = [store.testDBPath stringByDeletingLastPathComponent];
+    store = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+
+    return result;
+}
+
+- (void)compareRuns:(NSArray<NSDictionary *> *)runs withBaseline:(NSString *)path {
+    NSData *data = [NSData dataWithContentsOfFile:[path stringByExpandingTildeInPath]];
+    NSDictionary *baseline = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL] : nil;
+    if (![baseline isKindOfClass:[NSDictionary class]]) {
+        NSLog(@"Unable to read baseline %@", path);
+        return;
+    }
+
+    NSDictionary *baselineRuns = [NSDictionary lookupWithObjects:baseline[@"runs"] keyPath:@"name"];
+    for (NSDictionary *run in runs) {
+        NSDictionary *before = baselineRuns[run[@"name"]];
+        if (!before) continue;
+        double ratio = [run[@"entriesPerSecond"] doubleValue] / [before[@"entriesPerSecond"] doubleValue];
+        NSLog(@"%@: %.0f entries/s, %.2fx %@ (%@)", run[@"name"], [run[@"entriesPerSecond"] doubleValue], ratio, baseline[@"label"] ?: @"baseline", path);
+    }
+}
+
+- (void)testIngest {
+    NSMutableArray *runs = [NSMutableArray new];
+
+    for (NSNumber *size in [self syntheticSizes]) {
+        NSArray *entries = [TestSyncLog syntheticEntriesWithIssueCount:size.unsignedIntegerValue];
+        [runs addObject:[self replayEntries:entries name:[NSString stringWithFormat:@"synthetic-%@", size]]];
+    }
+
+    NSString *recording = [TestSyncLog recordedLogPath];
+    if (recording) {
+        NSArray *entries = [TestSyncLog entriesWithContentsOfFile:recording];
+        XCTAssertTrue(entries.count > 0);
+        [runs addObject:[self replayEntries:entries name:[recording lastPathComponent]]];
+    }
+
+    NSProcessInfo *info = [NSProcessInfo processInfo];
+    NSDictionary *results = @{ @"label" : EnvironmentValue(@"SHIP_BENCHMARK_LABEL") ?: @"",
+                               @"date" : [[NSDate date] JSONString],
+                               @"host" : @{ @"os" : info.operatingSystemVersionString,
+                                            @"processors" : @(info.activeProcessorCount),
+                                            @"memory" : @(info.physicalMemory) },
+                               @"runs" : runs };
+
+    NSString *path = [EnvironmentValue(@"SHIP_INGEST_RESULTS") stringByExpandingTildeInPath] ?: [NSTemporaryDirectory() stringByAppendingPathComponent:@"SyncIngestBenchmarks.json"];
+    NSData *json = [NSJSONSerialization dataWithJSONObject:results options:NSJSONWritingPrettyPrinted error:NULL];
+    XCTAssertTrue([json writeToFile:path atomically:YES]);
+    NSLog(@"Wrote ingest results to %@", path);
+
+    NSString *baseline = EnvironmentValue(@"SHIP_INGEST_BASELINE");
+    if (baseline) {
+        [self compareRuns:runs withBaseline:baseline];
+    }
+}
+
+@end
@@ -0,0 +1,28 @@
+//
+//  SyncTestServer.h
+//  ShipHub
+//
+//  Created by James Howard on 3/10/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SyncMessageDecoder.h"
+
+@class SyncEntry;
+
+// A local stand-in for the server end of a sync socket.
+// Each instance is one connection, with its own binary string table.
+@interface SyncTestServer : NSObject
+
+// Converts entries back into the log dictionaries the server sends.
++ (NSArray<NSDictionary *> *)logsWithEntries:(NSArray<SyncEntry *> *)entries;
+
+// Returns a complete socket message, including the MessageHeader byte.
+- (NSData *)messageWithFields:(NSDictionary *)fields header:(MessageHeader)header;
+// As above, but with body as the JSON text of the message, sent as is or deflated. header must not be MessageHeaderBinary.
+- (NSData *)messageWithJSON:(NSData *)body header:(MessageHeader)header;
+- (NSData *)syncMessageWithLogs:(NSArray<NSDictionary *> *)logs versions:(NSDictionary *)versions remaining:(NSInteger)remaining header:(MessageHeader)header;
+
+@end
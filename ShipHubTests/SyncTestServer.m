@@ -0,0 +1,87 @@
+//
+//  SyncTestServer.m
+//  ShipHub
+//
+//  Created by James Howard on 3/10/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "SyncTestServer.h"
+
+#import "SyncBinaryCodec.h"
+#import "SyncConnection.h"
+
+#import <zlib.h>
+
+@implementation SyncTestServer {
+    SyncBinaryEncoder *_encoder;
+}
+
+- (id)init {
+    if (self = [super init]) {
+        _encoder = [[SyncBinaryEncoder alloc] initWithStringTable:[SyncBinaryStringTable new]];
+    }
+    return self;
+}
+
++ (NSArray<NSDictionary *> *)logsWithEntries:(NSArray<SyncEntry *> *)entries {
+    NSMutableArray *logs = [NSMutableArray arrayWithCapacity:entries.count];
+    for (SyncEntry *e in entries) {
+        [logs addObject:@{ @"action" : e.action == SyncEntryActionSet ? @"set" : @"delete",
+                           @"entity" : e.entityName,
+                           @"data" : e.data ?: [NSNull null] }];
+    }
+    return logs;
+}
+
+static NSData *Deflate(NSData *data) {
+    uLongf length = compressBound(data.length);
+    NSMutableData *deflated = [NSMutableData dataWithLength:length];
+    if (compress2(deflated.mutableBytes, &length, data.bytes, data.length, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return nil;
+    }
+    deflated.length = length;
+    return deflated;
+}
+
+- (NSData *)messageWithFields:(NSDictionary *)fields header:(MessageHeader)header {
+    NSData *body = nil;
+    switch (header) {
+        case MessageHeaderPlainText:
+            body = [NSJSONSerialization dataWithJSONObject:fields options:0 error:NULL];
+            break;
+        case MessageHeaderDeflate:
+            body = Deflate([NSJSONSerialization dataWithJSONObject:fields options:0 error:NULL]);
+            break;
+        case MessageHeaderBinary:
+            body = [_encoder encodeMessage:fields];
+            break;
+    }
+    if (!body) return nil;
+    
+    NSMutableData *message = [NSMutableData dataWithBytes:&header length:1];
+    [message appendData:body];
+    return message;
+}
+
+- (NSData *)messageWithJSON:(NSData *)body header:(MessageHeader)header {
+    NSParameterAssert(header != MessageHeaderBinary);
+    if (header == MessageHeaderDeflate) {
+        body = Deflate(body);
+    }
+    if (!body) return nil;
+    
+    NSMutableData *message = [NSMutableData dataWithBytes:&header length:1];
+    [message appendData:body];
+    return message;
+}
+
+- (NSData *)syncMessageWithLogs:(NSArray<NSDictionary *> *)logs versions:(NSDictionary *)versions remaining:(NSInteger)remaining header:(MessageHeader)header {
+    return [self messageWithFields:@{ @"msg" : @"sync",
+                                      @"logs" : logs,
+                                      @"versions" : versions ?: @{},
+                                      @"remaining" : @(remaining) }
+                            header:header];
+}
+
+@end
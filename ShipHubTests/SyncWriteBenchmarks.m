@@ -0,0 +1,114 @@
+//
+//  SyncWriteBenchmarks.m
+//  ShipHub
+//
+//  Created by James Howard on 3/5/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <CoreData/CoreData.h>
+
+#import "DataStore.h"
+#import "SyncConnection.h"
+#import "SyncWritePlan.h"
+#import "TestSyncLog.h"
+
+@interface SyncWriteBenchmarks : XCTestCase
+
+@property NSManagedObjectModel *mom;
+@property NSArray<SyncEntry *> *entries;
+
+@end
+
+@implementation SyncWriteBenchmarks
+
+- (void)setUp {
+    [super setUp];
+    
+    NSURL *momURL = [[NSBundle bundleForClass:[DataStore class]] URLForResource:@"LocalModel" withExtension:@"momd"];
+    _mom = [[NSManagedObjectModel alloc] initWithContentsOfURL:momURL];
+    XCTAssertNotNil(_mom);
+    
+    // Replay a recorded log if one is given, else generate one.
+    NSString *recording = [TestSyncLog recordedLogPath];
+    _entries = recording ? [TestSyncLog entriesWithContentsOfFile:recording] : [TestSyncLog syntheticEntriesWithIssueCount:20000];
+    XCTAssertTrue(_entries.count > 0);
+}
+
+- (NSManagedObjectContext *)inMemoryContext {
+    NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:_mom];
+    NSError *err = nil;
+    [coordinator addPersistentStoreWithType:NSInMemoryStoreType configuration:nil URL:nil options:nil error:&err];
+    XCTAssertNil(err);
+    
+    NSManagedObjectContext *moc = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    moc.persistentStoreCoordinator = coordinator;
+    moc.undoManager = nil;
+    return moc;
+}
+
+- (void)replayIntoContext:(NSManagedObjectContext *)moc batchSize:(NSUInteger)batchSize fetchCount:(NSUInteger *)outFetchCount {
+    NSDictionary *syncEntityNames = [SyncWritePlan syncEntityNamesForModel:_mom];
+    __block NSUInteger fetchCount = 0;
+    
+    for (NSUInteger i = 0; i < _entries.count; i += batchSize) {
+        NSArray *batch = [_entries subarrayWithRange:NSMakeRange(i, MIN(batchSize, _entries.count - i))];
+        SyncWritePlan *plan = [[SyncWritePlan alloc] initWithModel:_mom syncEntityNames:syncEntityNames];
+        [plan addEntries:batch];
+        
+        [moc performBlockAndWait:^{
+            [plan executeInContext:moc];
+            fetchCount += plan.fetchCount;
+            
+            NSError *err = nil;
+            [moc save:&err];
+            XCTAssertNil(err);
+            [moc reset];
+        }];
+    }
+    
+    if (outFetchCount) *outFetchCount = fetchCount;
+}
+
+- (void)testReplayIsIdempotent {
+    NSManagedObjectContext *moc = [self inMemoryContext];
+    [self replayIntoContext:moc batchSize:1000 fetchCount:NULL];
+    
+    __block NSUInteger issues = 0;
+    [moc performBlockAndWait:^{
+        issues = [moc countForFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"] error:NULL];
+    }];
+    
+    // Replaying the same log again must update in place, not insert dupes.
+    [self replayIntoContext:moc batchSize:1000 fetchCount:NULL];
+    
+    __block NSUInteger issuesAfter = 0;
+    [moc performBlockAndWait:^{
+        issuesAfter = [moc countForFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"] error:NULL];
+    }];
+    
+    XCTAssertTrue(issues > 0);
+    XCTAssertEqual(issues, issuesAfter);
+}
+
+- (void)testReplayFetchesOncePerEntity {
+    NSManagedObjectContext *moc = [self inMemoryContext];
+    
+    NSUInteger fetchCount = 0;
+    [self replayIntoContext:moc batchSize:_entries.count fetchCount:&fetchCount];
+    
+    // One IN fetch per entity referenced by the log, no per-object fetches.
+    XCTAssertTrue(fetchCount <= _mom.entities.count, @"Issued %tu fetches", fetchCount);
+}
+
+- (void)testReplayPerformance {
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        NSManagedObjectContext *moc = [self inMemoryContext];
+        [self startMeasuring];
+        [self replayIntoContext:moc batchSize:1000 fetchCount:NULL];
+        [self stopMeasuring];
+    }];
+}
+
+@end
@@ -17,4 +17,6 @@
 @property (nonatomic, readonly) TestServerConnection *testServerConnection;
 @property (nonatomic, readonly) TestSyncConnection *testSyncConnection;
 
+@property (nonatomic, readonly) NSString *testDBPath; // in a directory of its own under NSTemporaryDirectory()
+
 @end
@@ -11,8 +11,8 @@
 
 @interface DataStore (Internals)
 
-- (void)openDB;
-- (void)openDBForceRecreate:(BOOL)force;
+- (BOOL)openDB;
+- (BOOL)openDBForceRecreate:(BOOL)force;
 
 - (SyncConnection *)syncConnection;
 - (ServerConnection *)serverConnection;
@@ -21,6 +21,7 @@
 
 @interface TestDataStore () {
     BOOL _offline;
+    NSString *_testDBPath;
 }
 
 @end
@@ -41,13 +42,23 @@
     return [self storeWithAuth:auth];
 }
 
-- (NSString *)dbPath {
-    return [NSTemporaryDirectory() stringByAppendingPathComponent:@"ShipTests.db"];
+- (NSString *)_dbPath {
+    return self.testDBPath;
 }
 
-- (void)openDB {
+- (NSString *)testDBPath {
+    // A throwaway DB per instance, so stores don't share state
+    if (!_testDBPath) {
+        NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"ShipTests-%@", [[NSUUID UUID] UUIDString]]];
+        [[NSFileManager defaultManager] createDirectoryAtPath:dir withIntermediateDirectories:YES attributes:nil error:NULL];
+        _testDBPath = [dir stringByAppendingPathComponent:@"ShipTests.db"];
+    }
+    return _testDBPath;
+}
+
+- (BOOL)openDB {
     // Want a fresh DB for every instance
-    [super openDBForceRecreate:YES];
+    return [super openDBForceRecreate:YES];
 }
 
 + (Class)serverConnectionClass {
@@ -0,0 +1,322 @@
+//
+//  TestPatchMapping.m
+//  ShipHub
+//
+//  Created by James Howard on 3/8/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "GitPatchMapping.h"
+
+@interface TestPatchMapping : XCTestCase
+
+@end
+
+#pragma mark - Reference
+
+/*
+ The mapping as GitDiff computed it before GitPatchMapping, on NSArrays of NSStrings with a regex per
+ @@ line. GitPatchMapping must give exactly the same result, which testMatchesReference checks.
+
+ Where one patch ends in the middle of a hunk that still matches the other, without a trailing newline,
+ this indexes past the end of a line array and throws. There is no old result to compare with there.
+*/
+
+static NSRegularExpression *ReferenceHunkStartRE(void) {
+    static dispatch_once_t onceToken;
+    static NSRegularExpression *re;
+    dispatch_once(&onceToken, ^{
+        re = [NSRegularExpression regularExpressionWithPattern:@"^@@ \\-(\\d+)(?:,(\\d+))? \\+(\\d+)(?:,(\\d+))? @@" options:0 error:NULL];
+    });
+    return re;
+}
+
+static BOOL ReferenceMatchingHunkStart(NSString *a, NSString *b) {
+    NSRegularExpression *re = ReferenceHunkStartRE();
+    
+    NSTextCheckingResult *ma = [re firstMatchInString:a options:0 range:NSMakeRange(0, a.length)];
+    if (!ma) return NO;
+    NSTextCheckingResult *mb = [re firstMatchInString:b options:0 range:NSMakeRange(0, b.length)];
+    if (!mb) return NO;
+    
+    NSRange aRange[5];
+    NSRange bRange[5];
+    
+    for (NSInteger i = 0; i < 5; i++) {
+        aRange[i] = [ma rangeAtIndex:i];
+        bRange[i] = [mb rangeAtIndex:i];
+    }
+    
+    NSInteger aLeftRun, aRightRun;
+    NSInteger bLeftRun, bRightRun;
+    
+    aLeftRun = aRange[2].location != NSNotFound ? [[a substringWithRange:aRange[2]] integerValue] : 1;
+    bLeftRun = bRange[2].location != NSNotFound ? [[b substringWithRange:bRange[2]] integerValue] : 1;
+    aRightRun = aRange[4].location != NSNotFound ? [[a substringWithRange:aRange[4]] integerValue] : 1;
+    bRightRun = bRange[4].location != NSNotFound ? [[b substringWithRange:bRange[4]] integerValue] : 1;
+    
+    return aLeftRun == bLeftRun && aRightRun == bRightRun;
+}
+
+static BOOL ReferenceMatchingHunks(NSArray *aLines, NSArray *bLines, NSInteger aIdx, NSInteger bIdx, NSInteger aLineCount, NSInteger bLineCount, NSInteger *aAdvance, NSInteger *bAdvance, NSRange *aMatchRange, NSRange *bMatchRange)
+{
+    *aAdvance = 1;
+    *bAdvance = 0;
+    
+    *aMatchRange = NSMakeRange(NSNotFound, 0);
+    *bMatchRange = NSMakeRange(NSNotFound, 0);
+    
+    NSInteger aSave = aIdx;
+    NSInteger bSave = bIdx;
+    
+    while (bIdx < bLineCount) {
+        aIdx = aSave;
+        if (![bLines[bIdx] hasPrefix:@"@@"]) {
+            bIdx++;
+        } else if (ReferenceMatchingHunkStart(aLines[aIdx], bLines[bIdx])) {
+            aMatchRange->location = aIdx;
+            bMatchRange->location = bIdx;
+            
+            aIdx++;
+            bIdx++;
+            
+            while (1)
+            {
+                if ((aIdx == aLineCount || [aLines[aIdx] length] == 0 || [aLines[aIdx] hasPrefix:@"@@"])
+                    && (bIdx == bLineCount || [bLines[bIdx] length] == 0 || [bLines[bIdx] hasPrefix:@"@@"]))
+                {
+                    *aAdvance = aIdx - aSave;
+                    *bAdvance = bIdx - bSave;
+                    
+                    aMatchRange->length = aIdx - aMatchRange->location;
+                    bMatchRange->length = bIdx - bMatchRange->location;
+                    
+                    return YES;
+                } else if ([aLines[aIdx] isEqualToString:bLines[bIdx]]) {
+                    aIdx++;
+                    bIdx++;
+                } else {
+                    bIdx++;
+                    break;
+                }
+            }
+        } else {
+            bIdx++;
+        }
+    }
+    
+    return NO;
+}
+
+static NSArray *ReferencePatchMapping(NSString *a, NSString *b) {
+    NSArray *aLines = [a componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]];
+    NSArray *bLines = [b componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]];
+    
+    NSInteger aLineCount = [aLines count];
+    NSInteger bLineCount = [bLines count];
+    if (!aLineCount) {
+        return @[];
+    }
+    
+    NSInteger aIdx = 0, bIdx = 0;
+    
+    NSMutableArray *map = [NSMutableArray arrayWithCapacity:[aLines count]];
+    for (NSUInteger i = 0; i < aLineCount; i++) {
+        [map addObject:@(-1)];
+    }
+    
+    while (aIdx < aLineCount && ![aLines[aIdx] hasPrefix:@"@@"]
+           && bIdx < bLineCount && ![bLines[bIdx] hasPrefix:@"@@"])
+    {
+        map[aIdx] = @(bIdx);
+        aIdx++;
+        bIdx++;
+    }
+    
+    while (aIdx < aLineCount) {
+        if ([aLines[aIdx] hasPrefix:@"@@"]) {
+            NSInteger aAdvance, bAdvance;
+            NSRange aMatchRange, bMatchRange;
+            
+            if (ReferenceMatchingHunks(aLines, bLines, aIdx, bIdx, aLineCount, bLineCount, &aAdvance, &bAdvance, &aMatchRange, &bMatchRange)) {
+                for (NSInteger aMap = aMatchRange.location, bMap = bMatchRange.location, m = 0; m < aMatchRange.length; aMap++, bMap++, m++)
+                {
+                    map[aMap] = @(bMap);
+                }
+                aIdx += aAdvance;
+                bIdx += bAdvance;
+            } else {
+                aIdx++;
+            }
+        } else {
+            aIdx++;
+        }
+    }
+    
+    return map;
+}
+
+#pragma mark - Random patches
+
+// Hunk headers that match, differ only in their runs, omit runs, or only look like headers
+static NSArray<NSString *> *HeaderPool() {
+    return @[@"@@ -1,2 +1,2 @@", @"@@ -1,2 +1,2 @@ func()", @"@@ -10,2 +12,2 @@", @"@@ -1,2 +1,3 @@",
+             @"@@ -1 +1 @@", @"@@ -1,1 +1 @@", @"@@ -001,02 +1,2 @@", @"@@ -1,99999999999999999999 +1,2 @@",
+             @"@@ -1,2 +1,2@@", @"@@ -1,2 +1, @@", @"@@@ -1,2 +1,2 @@", @"@@"];
+}
+
+static NSArray<NSString *> *BodyPool() {
+    return @[@" a", @" a", @"+b", @"-c", @" é", @" e\u0301", @"+\U0001F600", @"-\u00e9", @" x y", @"@ not a header", @"+@@ -1,2 +1,2 @@", @""];
+}
+
+static NSString *RandomElement(NSArray<NSString *> *pool) {
+    return pool[random() % pool.count];
+}
+
+static NSArray<NSString *> *RandomHunk() {
+    NSMutableArray *hunk = [NSMutableArray arrayWithObject:RandomElement(HeaderPool())];
+    NSUInteger bodyLength = random() % 5;
+    for (NSUInteger i = 0; i < bodyLength; i++) {
+        NSString *line = RandomElement(BodyPool());
+        if (line.length == 0 && random() % 3) continue; // an empty line ends the hunk early, so keep them rare
+        [hunk addObject:line];
+    }
+    return hunk;
+}
+
+// Hunks taken from pool, some cut short so that they are a prefix of another, and some new.
+static NSArray<NSString *> *RandomPatchLines(NSArray<NSArray<NSString *> *> *pool) {
+    NSMutableArray *lines = [NSMutableArray new];
+    NSUInteger headerLines = random() % 3;
+    for (NSUInteger i = 0; i < headerLines; i++) {
+        [lines addObject:i == 0 ? @"diff --git a/f b/f" : @"index 1234567..89abcde 100644"];
+    }
+    NSUInteger hunkCount = random() % 7;
+    for (NSUInteger i = 0; i < hunkCount; i++) {
+        NSArray *hunk = random() % 5 ? pool[random() % pool.count] : RandomHunk();
+        if (hunk.count > 1 && random() % 4 == 0) {
+            hunk = [hunk subarrayWithRange:NSMakeRange(0, 1 + random() % (hunk.count - 1))];
+        }
+        [lines addObjectsFromArray:hunk];
+    }
+    return lines;
+}
+
+static NSString *JoinLines(NSArray<NSString *> *lines) {
+    NSString *nextLine = [NSString stringWithFormat:@"%C", (unichar)0x85]; // U+0085, which is below U+00A0 and so can't be a \u escape
+    NSArray *separators = @[@"\n", @"\n", @"\n", @"\n", @"\r\n", @"\r", @"\u2028", nextLine];
+    NSString *separator = RandomElement(separators);
+    NSString *text = [lines componentsJoinedByString:separator];
+    if (random() % 5) {
+        text = [text stringByAppendingString:separator];
+    }
+    return text;
+}
+
+@implementation TestPatchMapping
+
+- (NSArray<NSNumber *> *)mappingFrom:(NSString *)a to:(NSString *)b {
+    NSData *data = GitPatchMapping(a, b);
+    const int32_t *map = data.bytes;
+    NSMutableArray *result = [NSMutableArray new];
+    for (NSUInteger i = 0; i < data.length / sizeof(int32_t); i++) {
+        [result addObject:@(map[i])];
+    }
+    return result;
+}
+
+- (void)testIdentical {
+    NSString *p = @"diff --git a/x b/x\n@@ -1,2 +1,2 @@\n-a\n+b\n";
+    XCTAssertEqualObjects([self mappingFrom:p to:p], (@[@0, @1, @2, @3, @-1]));
+}
+
+- (void)testHunkMovedDown {
+    NSString *a = @"hdr\n@@ -10,1 +10,1 @@\n-x\n+y\n";
+    NSString *b = @"hdr\n@@ -1,1 +1,1 @@\n-q\n+r\n@@ -12,1 +12,1 @@\n-x\n+y\n";
+    XCTAssertEqualObjects([self mappingFrom:a to:b], (@[@0, @4, @5, @6, @-1]));
+}
+
+- (void)testRunLengthsMustMatch {
+    NSString *a = @"@@ -1,2 +1,3 @@\n a\n+b\n";
+    NSString *b = @"@@ -1,2 +1,4 @@\n a\n+b\n";
+    XCTAssertEqualObjects([self mappingFrom:a to:b], (@[@-1, @-1, @-1, @-1]));
+}
+
+- (void)testCRLF {
+    // \r and \n each end a line, so the empty line between them ends the hunk
+    NSString *a = @"@@ -1 +1 @@\r\n+a\r\n";
+    XCTAssertEqualObjects([self mappingFrom:a to:a], (@[@0, @-1, @-1, @-1, @-1]));
+}
+
+- (void)testPrefixHunkConsumesFollowingHeader {
+    // The first hunk of b is a prefix of the hunk in a, so the hunk immediately following it is
+    // never considered, and the hunk in a maps to the third hunk of b.
+    NSString *a = @"@@ -1,2 +1,2 @@\n x\n y\n";
+    NSString *b = @"@@ -1,2 +1,2 @@\n x\n@@ -1,2 +1,2 @@\n x\n y\n@@ -1,2 +1,2 @@\n x\n y\n";
+    XCTAssertEqualObjects([self mappingFrom:a to:b], (@[@5, @6, @7, @-1]));
+}
+
+- (void)testMatchesReference {
+    srandom(4);
+    NSUInteger compared = 0;
+    for (NSUInteger iteration = 0; iteration < 20000; iteration++) {
+        @autoreleasepool {
+            NSMutableArray *pool = [NSMutableArray new];
+            NSUInteger poolSize = 1 + random() % 6;
+            for (NSUInteger i = 0; i < poolSize; i++) {
+                [pool addObject:RandomHunk()];
+            }
+            NSString *a = JoinLines(RandomPatchLines(pool));
+            NSString *b = JoinLines(RandomPatchLines(pool));
+            
+            NSArray *expected = nil;
+            @try {
+                expected = ReferencePatchMapping(a, b);
+            } @catch (NSException *exc) {
+                continue;
+            }
+            compared++;
+            XCTAssertEqualObjects([self mappingFrom:a to:b], expected, @"a:\n%@\nb:\n%@", a, b);
+        }
+    }
+    // Most patches end in a newline, so only a few inputs make the reference throw
+    XCTAssertTrue(compared > 10000, @"%tu", compared);
+}
+
+- (void)testMatchesReferenceOnLargePatch {
+    srandom(8);
+    NSMutableArray *pool = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 40; i++) {
+        [pool addObject:RandomHunk()];
+    }
+    NSMutableArray *aLines = [NSMutableArray arrayWithObject:@"diff --git a/gen b/gen"];
+    NSMutableArray *bLines = [NSMutableArray arrayWithObject:@"diff --git a/gen b/gen"];
+    for (NSUInteger i = 0; i < 300; i++) {
+        NSArray *hunk = pool[random() % pool.count];
+        [aLines addObjectsFromArray:hunk];
+        if (random() % 3) [bLines addObjectsFromArray:hunk];
+        if (random() % 4 == 0) [bLines addObjectsFromArray:pool[random() % pool.count]];
+    }
+    NSString *a = [[aLines componentsJoinedByString:@"\n"] stringByAppendingString:@"\n"];
+    NSString *b = [[bLines componentsJoinedByString:@"\n"] stringByAppendingString:@"\n"];
+    XCTAssertEqualObjects([self mappingFrom:a to:b], ReferencePatchMapping(a, b));
+}
+
+- (void)testManyHunksPerformance {
+    NSMutableString *a = [NSMutableString stringWithString:@"diff --git a/gen b/gen\n"];
+    NSMutableString *b = [NSMutableString stringWithString:@"diff --git a/gen b/gen\n"];
+    for (NSInteger i = 0; i < 5000; i++) {
+        NSString *hunk = [NSString stringWithFormat:@"@@ -%td,3 +%td,3 @@\n context\n-old %td\n+new %td\n context\n", i * 10, i * 10, i, i];
+        [a appendString:hunk];
+        if (i % 2 == 0) [b appendString:hunk];
+    }
+
+    [self measureBlock:^{
+        NSData *mapping = GitPatchMapping(a, b);
+        XCTAssertTrue(mapping.length > 0);
+    }];
+}
+
+@end
@@ -0,0 +1,316 @@
+//
+//  TestSyncBinary.m
+//  ShipHub
+//
+//  Created by James Howard on 3/10/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Extras.h"
+#import "SyncBinaryCodec.h"
+#import "SyncConnection.h"
+#import "SyncMessageDecoder.h"
+#import "SyncTestServer.h"
+#import "TestSyncLog.h"
+
+@interface TestSyncBinary : XCTestCase
+
+@property NSArray<NSDictionary *> *logs;
+
+@end
+
+@implementation TestSyncBinary
+
+- (void)setUp {
+    [super setUp];
+    _logs = [SyncTestServer logsWithEntries:[TestSyncLog syntheticEntriesWithIssueCount:2000]];
+}
+
+// Decodes message as WSSyncConnection does, feeding it chunkSize bytes at a time.
+- (NSArray<SyncEntry *> *)decodeMessage:(NSData *)message strings:(SyncBinaryStringTable *)strings chunkSize:(NSUInteger)chunkSize fields:(NSDictionary **)outFields {
+    NSMutableArray *entries = [NSMutableArray new];
+    SyncMessageDecoderBatchHandler handler = ^(NSArray<SyncEntry *> *batch) {
+        [entries addObjectsFromArray:batch];
+    };
+
+    MessageHeader header = ((const uint8_t *)message.bytes)[0];
+    id<SyncMessageDecoding> decoder = nil;
+    if (header == MessageHeaderBinary) {
+        decoder = [[SyncBinaryDecoder alloc] initWithStringTable:strings streamedArrayKey:@"logs" batchSize:100 batchHandler:handler];
+    } else {
+        decoder = [[SyncMessageDecoder alloc] initWithStreamedArrayKey:@"logs" compressed:header == MessageHeaderDeflate batchSize:100 batchHandler:handler];
+    }
+
+    const uint8_t *bytes = message.bytes;
+    for (NSUInteger i = 1; i < message.length; ) {
+        NSUInteger length = MIN(chunkSize, message.length - i);
+        if (![decoder appendBytes:bytes + i length:length]) {
+            return nil;
+        }
+        i += length;
+    }
+
+    NSArray *final = [decoder finish:NULL];
+    if (!final) return nil;
+    [entries addObjectsFromArray:final];
+
+    if (outFields) *outFields = decoder.fields;
+    return entries;
+}
+
+- (void)assertEntries:(NSArray<SyncEntry *> *)a equalEntries:(NSArray<SyncEntry *> *)b {
+    XCTAssertEqual(a.count, b.count);
+    for (NSUInteger i = 0; i < MIN(a.count, b.count); i++) {
+        XCTAssertEqual(a[i].action, b[i].action);
+        XCTAssertEqualObjects(a[i].entityName, b[i].entityName);
+        XCTAssertEqualObjects(a[i].data, b[i].data);
+    }
+}
+
+// A sync message body written by hand rather than by NSJSONSerialization, so that it has string escapes
+// (\u surrogate pairs among them), strings full of brackets, numbers in every form, nested arrays and
+// objects, and whitespace between tokens, both in the log entries and in the other fields.
+static NSData *HandWrittenJSONBody(NSUInteger entryCount) {
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"msg\":\"sync\", \"versions\" : {\"repo\":{\"1\":12345},\"issue\":{}}, \"note\":\"a\\\"b\\\\\\u00e9\\ud83d\\ude00\",\"logs\": ["];
+    for (NSUInteger i = 0; i < entryCount; i++) {
+        if (i > 0) {
+            [json appendString:i % 2 ? @" ,\n\t" : @","];
+        }
+        if (i % 3 == 2) {
+            [json appendFormat:@"{\"action\":\"delete\",\"entity\":\"comment\",\"data\" : { \"identifier\" : %tu } }", i + 1];
+        } else {
+            [json appendFormat:@"{ \"action\" : \"set\", \"entity\":\"issue\" ,\"data\":{\"identifier\":%tu,\"title\":\"q\\\"b\\\\s\\/t\\tn\\nu\\u00e9 p\\ud83d\\ude00 c\\u0001 {[}]\",\"body\":\"\\\\\\\"\",\"tail\":\"\\\\\",\"raw\":\"é😀\",\"numbers\":[0,-12,3.25,1e10,-0.5E-3,12345678901234567],\"nested\":{\"a\":[[],{}],\"b\":[{\"c\":[1,{\"d\":\"}\"}]}],\"e\":true,\"f\":null}}}", i + 1];
+        }
+    }
+    [json appendString:TAIL];
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// The sizes of the batches a decoder gives out for count entries: full ones to the batchHandler, then the rest from -finish:.
+static NSArray<NSNumber *> *ExpectedBatches(NSUInteger count, NSUInteger batchSize) {
+    NSMutableArray *batches = [NSMutableArray new];
+    for (NSUInteger i = 0; i < count / batchSize; i++) {
+        [batches addObject:@(batchSize)];
+    }
+    [batches addObject:@(count % batchSize)];
+    return batches;
+}
+
+// The log entries (as dictionaryRepresentations) and other fields of body, read with NSJSONSerialization all at once.
+- (NSArray<NSDictionary *> *)expectedLogsForJSON:(NSData *)body fields:(NSDictionary **)outFields {
+    NSDictionary *msg = [NSJSONSerialization JSONObjectWithData:body options:0 error:NULL];
+    XCTAssertNotNil(msg);
+    NSMutableDictionary *fields = [msg mutableCopy];
+    [fields removeObjectForKey:@"logs"];
+    *outFields = fields;
+    return [msg[@"logs"] arrayByMappingObjects:^id(NSDictionary *log) {
+        return [[SyncEntry entryWithDictionary:log] dictionaryRepresentation];
+    }];
+}
+
+// Decodes a plain or deflated JSON message given to the decoder in pieces, split at each of offsets into the body.
+// batches collects the size of each batch the decoder gives out.
+- (NSArray<NSDictionary *> *)decodeJSONMessage:(NSData *)message splitAt:(NSArray<NSNumber *> *)offsets batchSize:(NSUInteger)batchSize batches:(NSMutableArray<NSNumber *> *)batches fields:(NSDictionary **)outFields
+{
+    NSMutableArray<SyncEntry *> *entries = [NSMutableArray new];
+    MessageHeader header = ((const uint8_t *)message.bytes)[0];
+    SyncMessageDecoder *decoder = [[SyncMessageDecoder alloc] initWithStreamedArrayKey:@"logs" compressed:header == MessageHeaderDeflate batchSize:batchSize batchHandler:^(NSArray<SyncEntry *> *batch) {
+        [batches addObject:@(batch.count)];
+        [entries addObjectsFromArray:batch];
+    }];
+
+    const uint8_t *body = (const uint8_t *)message.bytes + 1;
+    NSUInteger start = 0;
+    for (NSNumber *offset in [offsets arrayByAddingObject:@(message.length - 1)]) {
+        NSUInteger end = offset.unsignedIntegerValue;
+        if (![decoder appendBytes:body + start length:end - start]) {
+            return nil;
+        }
+        start = end;
+    }
+
+    NSArray *final = [decoder finish:NULL];
+    if (!final) return nil;
+    [batches addObject:@(final.count)];
+    [entries addObjectsFromArray:final];
+
+    *outFields = decoder.fields;
+    return [entries arrayByMappingObjects:^id(SyncEntry *e) {
+        return [e dictionaryRepresentation];
+    }];
+}
+
+- (void)testMatchesJSON {
+    SyncTestServer *server = [SyncTestServer new];
+    NSDictionary *versions = @{ @"repo" : @{ @"1" : @(12345) } };
+
+    NSData *json = [server syncMessageWithLogs:_logs versions:versions remaining:7 header:MessageHeaderDeflate];
+    NSData *binary = [server syncMessageWithLogs:_logs versions:versions remaining:7 header:MessageHeaderBinary];
+
+    NSDictionary *jsonFields = nil, *binaryFields = nil;
+    NSArray *jsonEntries = [self decodeMessage:json strings:nil chunkSize:NSUIntegerMax fields:&jsonFields];
+    NSArray *binaryEntries = [self decodeMessage:binary strings:[SyncBinaryStringTable new] chunkSize:NSUIntegerMax fields:&binaryFields];
+
+    XCTAssertNotNil(binaryEntries);
+    XCTAssertEqual(binaryEntries.count, _logs.count);
+    [self assertEntries:binaryEntries equalEntries:jsonEntries];
+    XCTAssertEqualObjects(binaryFields, jsonFields);
+}
+
+- (void)testSmallerThanJSON {
+    SyncTestServer *server = [SyncTestServer new];
+    NSData *plain = [server syncMessageWithLogs:_logs versions:@{} remaining:0 header:MessageHeaderPlainText];
+    NSData *binary = [server syncMessageWithLogs:_logs versions:@{} remaining:0 header:MessageHeaderBinary];
+
+    NSLog(@"%tu log entries: JSON %tu bytes, binary %tu bytes", _logs.count, plain.length, binary.length);
+    XCTAssertLessThan(binary.length, plain.length);
+}
+
+- (void)testStringsInternedAcrossMessages {
+    SyncTestServer *server = [SyncTestServer new];
+    SyncBinaryStringTable *strings = [SyncBinaryStringTable new];
+
+    NSArray *first = [_logs subarrayWithRange:NSMakeRange(0, 100)];
+    NSArray *second = [_logs subarrayWithRange:NSMakeRange(100, 100)];
+
+    NSData *m1 = [server syncMessageWithLogs:first versions:@{} remaining:100 header:MessageHeaderBinary];
+    NSData *m2 = [server syncMessageWithLogs:second versions:@{} remaining:0 header:MessageHeaderBinary];
+
+    NSArray *e1 = [self decodeMessage:m1 strings:strings chunkSize:NSUIntegerMax fields:NULL];
+    NSUInteger definedByFirst = strings.count;
+    NSArray *e2 = [self decodeMessage:m2 strings:strings chunkSize:NSUIntegerMax fields:NULL];
+
+    XCTAssertEqual(e1.count, first.count);
+    XCTAssertEqual(e2.count, second.count);
+    XCTAssertGreaterThan(definedByFirst, strings.sharedCount);
+
+    // decoding the second message alone fails, as it refers to strings defined by the first
+    XCTAssertNil([self decodeMessage:m2 strings:[SyncBinaryStringTable new] chunkSize:NSUIntegerMax fields:NULL]);
+}
+
+- (void)testByteAtATime {
+    SyncTestServer *server = [SyncTestServer new];
+    NSArray *logs = [_logs subarrayWithRange:NSMakeRange(0, 200)];
+    NSData *binary = [server syncMessageWithLogs:logs versions:@{} remaining:0 header:MessageHeaderBinary];
+
+    SyncBinaryStringTable *whole = [SyncBinaryStringTable new];
+    SyncBinaryStringTable *bytewise = [SyncBinaryStringTable new];
+    NSArray *a = [self decodeMessage:binary strings:whole chunkSize:NSUIntegerMax fields:NULL];
+    NSArray *b = [self decodeMessage:binary strings:bytewise chunkSize:1 fields:NULL];
+
+    XCTAssertNotNil(b);
+    [self assertEntries:b equalEntries:a];
+    XCTAssertEqual(whole.count, bytewise.count);
+}
+
+- (void)testScalars {
+    SyncTestServer *server = [SyncTestServer new];
+    NSDictionary *fields = @{ @"msg" : @"hello",
+                              @"values" : @[ [NSNull null], @YES, @NO, @0, @127, @128, @(-1), @(INT64_MIN), @(UINT64_MAX), @(0.5), @"", @"héllo" ] };
+    NSData *binary = [server messageWithFields:fields header:MessageHeaderBinary];
+
+    NSDictionary *decoded = nil;
+    XCTAssertNotNil([self decodeMessage:binary strings:[SyncBinaryStringTable new] chunkSize:3 fields:&decoded]);
+    XCTAssertEqualObjects(decoded, fields);
+}
+
+- (void)testTruncated {
+    SyncTestServer *server = [SyncTestServer new];
+    NSData *binary = [server syncMessageWithLogs:[_logs subarrayWithRange:NSMakeRange(0, 10)] versions:@{} remaining:0 header:MessageHeaderBinary];
+    NSData *truncated = [binary subdataWithRange:NSMakeRange(0, binary.length - 1)];
+
+    SyncBinaryStringTable *strings = [SyncBinaryStringTable new];
+    XCTAssertNil([self decodeMessage:truncated strings:strings chunkSize:NSUIntegerMax fields:NULL]);
+}
+
+- (void)testJSONSplitAtEveryOffset {
+    NSData *body = HandWrittenJSONBody(10);
+    NSDictionary *expectedFields = nil;
+    NSArray *expected = [self expectedLogsForJSON:body fields:&expectedFields];
+    XCTAssertEqual(expected.count, 10);
+    NSArray *expectedBatches = ExpectedBatches(expected.count, 3);
+
+    SyncTestServer *server = [SyncTestServer new];
+    for (NSNumber *header in @[@(MessageHeaderPlainText), @(MessageHeaderDeflate)]) {
+        NSData *message = [server messageWithJSON:body header:header.unsignedCharValue];
+        NSUInteger length = message.length - 1;
+
+        // In two pieces, split at every offset. In plain text that splits every escape, surrogate pair and number.
+        for (NSUInteger offset = 0; offset <= length; offset++) {
+            NSMutableArray *batches = [NSMutableArray new];
+            NSDictionary *fields = nil;
+            NSArray *logs = [self decodeJSONMessage:message splitAt:@[@(offset)] batchSize:3 batches:batches fields:&fields];
+            XCTAssertEqualObjects(logs, expected, @"header %@, split at %tu", header, offset);
+            XCTAssertEqualObjects(fields, expectedFields, @"header %@, split at %tu", header, offset);
+            XCTAssertEqualObjects(batches, expectedBatches, @"header %@, split at %tu", header, offset);
+        }
+
+        // A byte at a time
+        NSMutableArray *everyByte = [NSMutableArray arrayWithCapacity:length];
+        for (NSUInteger offset = 1; offset < length; offset++) {
+            [everyByte addObject:@(offset)];
+        }
+        NSMutableArray *batches = [NSMutableArray new];
+        NSDictionary *fields = nil;
+        NSArray *logs = [self decodeJSONMessage:message splitAt:everyByte batchSize:3 batches:batches fields:&fields];
+        XCTAssertEqualObjects(logs, expected, @"header %@, a byte at a time", header);
+        XCTAssertEqualObjects(fields, expectedFields, @"header %@, a byte at a time", header);
+        XCTAssertEqualObjects(batches, expectedBatches, @"header %@, a byte at a time", header);
+    }
+}
+
+- (void)testJSONRandomSplits {
+    SyncTestServer *server = [SyncTestServer new];
+    NSData *synthetic = [server syncMessageWithLogs:_logs versions:@{ @"repo" : @{ @"1" : @(12345) } } remaining:7 header:MessageHeaderPlainText];
+    NSArray *bodies = @[HandWrittenJSONBody(2 * SyncEntryBatchSize + 37), [synthetic subdataWithRange:NSMakeRange(1, synthetic.length - 1)]];
+
+    srandom(1);
+    for (NSData *body in bodies) {
+        NSDictionary *expectedFields = nil;
+        NSArray *expected = [self expectedLogsForJSON:body fields:&expectedFields];
+        XCTAssertGreaterThan(expected.count, SyncEntryBatchSize);
+        NSArray *expectedBatches = ExpectedBatches(expected.count, SyncEntryBatchSize);
+
+        for (NSNumber *header in @[@(MessageHeaderPlainText), @(MessageHeaderDeflate)]) {
+            NSData *message = [server messageWithJSON:body header:header.unsignedCharValue];
+            NSUInteger length = message.length - 1;
+
+            for (NSUInteger iteration = 0; iteration < 5; iteration++) {
+                // Mostly pieces the size a socket read might be, with runs of tiny ones
+                NSMutableArray *offsets = [NSMutableArray new];
+                for (NSUInteger offset = 0; ; ) {
+                    offset += random() % 4 ? 1 + random() % 4096 : 1 + random() % 8;
+                    if (offset >= length) break;
+                    [offsets addObject:@(offset)];
+                }
+
+                NSMutableArray *batches = [NSMutableArray new];
+                NSDictionary *fields = nil;
+                NSArray *logs = [self decodeJSONMessage:message splitAt:offsets batchSize:SyncEntryBatchSize batches:batches fields:&fields];
+                XCTAssertEqualObjects(logs, expected, @"header %@, split at %@", header, offsets);
+                XCTAssertEqualObjects(fields, expectedFields, @"header %@", header);
+                XCTAssertEqualObjects(batches, expectedBatches, @"header %@", header);
+            }
+        }
+    }
+}
+
+- (void)testDecodePerformance {
+    NSData *binary = [[SyncTestServer new] syncMessageWithLogs:_logs versions:@{} remaining:0 header:MessageHeaderBinary];
+    [self measureBlock:^{
+        NSArray *entries = [self decodeMessage:binary strings:[SyncBinaryStringTable new] chunkSize:NSUIntegerMax fields:NULL];
+        XCTAssertEqual(entries.count, _logs.count);
+    }];
+}
+
+- (void)testDecodeJSONPerformance {
+    NSData *json = [[SyncTestServer new] syncMessageWithLogs:_logs versions:@{} remaining:0 header:MessageHeaderDeflate];
+    [self measureBlock:^{
+        NSArray *entries = [self decodeMessage:json strings:nil chunkSize:NSUIntegerMax fields:NULL];
+        XCTAssertEqual(entries.count, _logs.count);
+    }];
+}
+
+@end
@@ -12,4 +12,7 @@
 
 @property (nonatomic, getter=isOffline) BOOL offline;
 
+// Hands entries to the delegate batchSize at a time, as if they had arrived in a series of sync messages.
+- (void)replayEntries:(NSArray<SyncEntry *> *)entries batchSize:(NSUInteger)batchSize;
+
 @end
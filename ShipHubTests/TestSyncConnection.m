@@ -97,13 +97,26 @@
             return e;
         }];
         
-        [self.delegate syncConnection:self receivedEntries:users versions:@{} progress:0.0];
+        [self.delegate syncConnection:self receivedEntries:users versions:@{} logProgress:0.0 spiderProgress:1.0];
         
-        [self.delegate syncConnection:self receivedEntries:orgs versions:@{} progress:0.0];
+        [self.delegate syncConnection:self receivedEntries:orgs versions:@{} logProgress:0.0 spiderProgress:1.0];
         
-        [self.delegate syncConnection:self receivedEntries:repos versions:@{} progress:0.0];
+        [self.delegate syncConnection:self receivedEntries:repos versions:@{} logProgress:0.0 spiderProgress:1.0];
         
-        [self.delegate syncConnection:self receivedEntries:milestones versions:@{} progress:0.0];
+        [self.delegate syncConnection:self receivedEntries:milestones versions:@{} logProgress:0.0 spiderProgress:1.0];
+        
+        _sentData = YES;
+    }
+}
+
+- (void)replayEntries:(NSArray<SyncEntry *> *)entries batchSize:(NSUInteger)batchSize {
+    NSParameterAssert(batchSize > 0);
+    
+    for (NSUInteger i = 0; i < entries.count; i += batchSize) {
+        NSUInteger length = MIN(batchSize, entries.count - i);
+        NSArray *batch = [entries subarrayWithRange:NSMakeRange(i, length)];
+        double progress = (double)(i + length) / (double)entries.count;
+        [self.delegate syncConnection:self receivedEntries:batch versions:@{} logProgress:progress spiderProgress:1.0];
     }
 }
 
@@ -0,0 +1,27 @@
+//
+//  TestSyncLog.h
+//  ShipHub
+//
+//  Created by James Howard on 3/5/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class SyncEntry;
+
+@interface TestSyncLog : NSObject
+
+// Loads a recorded sync log. The file is a JSON array of sync messages
+// (as received over the socket, each with a "logs" array), a JSON array of log entries,
+// or a recording made by running a DEBUG build with SHIP_SYNC_RECORD set (one sync message per line).
++ (NSArray<SyncEntry *> *)entriesWithContentsOfFile:(NSString *)path;
+
+// The path to a recorded sync log, as given by the SHIP_SYNC_LOG environment variable, or nil.
++ (NSString *)recordedLogPath;
+
+// Generates a synthetic sync log of count issues spread across a handful of repos,
+// with the accounts, milestones, labels and comments they reference.
++ (NSArray<SyncEntry *> *)syntheticEntriesWithIssueCount:(NSUInteger)count;
+
+@end
@@ -0,0 +1,134 @@
+//
+//  TestSyncLog.m
+//  ShipHub
+//
+//  Created by James Howard on 3/5/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import "TestSyncLog.h"
+
+#import "Extras.h"
+#import "SyncConnection.h"
+
+@implementation TestSyncLog
+
++ (NSArray<SyncEntry *> *)entriesWithContentsOfFile:(NSString *)path {
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    if (!data) return nil;
+    
+    NSArray *items = [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+    if (![items isKindOfClass:[NSArray class]]) {
+        // Try a recording made with SHIP_SYNC_RECORD: one sync message per line
+        NSString *text = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+        NSMutableArray *messages = [NSMutableArray new];
+        for (NSString *line in [text componentsSeparatedByString:@"\n"]) {
+            if (line.length == 0) continue;
+            NSDictionary *msg = [NSJSONSerialization JSONObjectWithData:[line dataUsingEncoding:NSUTF8StringEncoding] options:0 error:NULL];
+            if (![msg isKindOfClass:[NSDictionary class]]) return nil;
+            [messages addObject:msg];
+        }
+        items = messages.count ? messages : nil;
+    }
+    if (!items) return nil;
+    
+    NSMutableArray *entries = [NSMutableArray new];
+    for (NSDictionary *item in items) {
+        NSArray *logs = item[@"logs"];
+        if (logs) {
+            for (NSDictionary *log in logs) {
+                [entries addObject:[SyncEntry entryWithDictionary:log]];
+            }
+        } else {
+            [entries addObject:[SyncEntry entryWithDictionary:item]];
+        }
+    }
+    return entries;
+}
+
++ (NSString *)recordedLogPath {
+    NSString *path = [[[NSProcessInfo processInfo] environment][@"SHIP_SYNC_LOG"] stringByExpandingTildeInPath];
+    if (path && [[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        return path;
+    }
+    return nil;
+}
+
+static SyncEntry *SetEntry(NSString *type, NSDictionary *data) {
+    SyncEntry *e = [SyncEntry new];
+    e.action = SyncEntryActionSet;
+    e.entityName = type;
+    e.data = data;
+    return e;
+}
+
++ (NSArray<SyncEntry *> *)syntheticEntriesWithIssueCount:(NSUInteger)count {
+    const NSUInteger repoCount = MAX(count / 5000, 1);
+    const NSUInteger accountCount = MAX(count / 50, 2);
+    const NSUInteger milestonesPerRepo = 10;
+    const NSUInteger labelsPerRepo = 20;
+    
+    NSMutableArray *entries = [NSMutableArray arrayWithCapacity:count + repoCount * (1 + milestonesPerRepo) + accountCount];
+    
+    NSDate *epoch = [NSDate dateWithTimeIntervalSinceReferenceDate:0];
+    
+    for (NSUInteger i = 1; i <= accountCount; i++) {
+        [entries addObject:SetEntry(@"account", @{ @"identifier" : @(i),
+                                                   @"login" : [NSString stringWithFormat:@"user%tu", i],
+                                                   @"type" : @"User" })];
+    }
+    
+    for (NSUInteger r = 1; r <= repoCount; r++) {
+        NSMutableArray *labels = [NSMutableArray new];
+        for (NSUInteger l = 1; l <= labelsPerRepo; l++) {
+            [labels addObject:@{ @"identifier" : @(r * 1000 + l),
+                                 @"name" : [NSString stringWithFormat:@"label %tu", l],
+                                 @"color" : @"ff0000" }];
+        }
+        [entries addObject:SetEntry(@"repo", @{ @"identifier" : @(r),
+                                                @"name" : [NSString stringWithFormat:@"repo%tu", r],
+                                                @"fullName" : [NSString stringWithFormat:@"user1/repo%tu", r],
+                                                @"owner" : @1,
+                                                @"private" : @NO,
+                                                @"labels" : labels })];
+        for (NSUInteger m = 1; m <= milestonesPerRepo; m++) {
+            [entries addObject:SetEntry(@"milestone", @{ @"identifier" : @(r * 1000 + m),
+                                                         @"number" : @(m),
+                                                         @"title" : [NSString stringWithFormat:@"v%tu.0", m],
+                                                         @"state" : @"open",
+                                                         @"repository" : @(r) })];
+        }
+    }
+    
+    for (NSUInteger i = 1; i <= count; i++) {
+        NSUInteger r = 1 + (i % repoCount);
+        NSString *createdAt = [[epoch dateByAddingTimeInterval:i * 60.0] JSONString];
+        NSString *updatedAt = [[epoch dateByAddingTimeInterval:i * 60.0 + 3600.0] JSONString];
+        NSMutableArray *comments = [NSMutableArray new];
+        for (NSUInteger c = 0; c < i % 4; c++) {
+            [comments addObject:@{ @"identifier" : @(i * 10 + c),
+                                   @"body" : @"Looks good to me",
+                                   @"user" : @{ @"identifier" : @(1 + ((i + c) % accountCount)), @"type" : @"User" },
+                                   @"createdAt" : createdAt,
+                                   @"updatedAt" : updatedAt }];
+        }
+        [entries addObject:SetEntry(@"issue", @{ @"identifier" : @(i),
+                                                 @"number" : @(i),
+                                                 @"title" : [NSString stringWithFormat:@"Issue %tu", i],
+                                                 @"body" : @"Steps to reproduce:\n1. Sync\n2. Wait",
+                                                 @"state" : (i % 3 == 0) ? @"closed" : @"open",
+                                                 @"closed" : @(i % 3 == 0),
+                                                 @"createdAt" : createdAt,
+                                                 @"updatedAt" : updatedAt,
+                                                 @"repository" : @(r),
+                                                 @"milestone" : @(r * 1000 + 1 + (i % milestonesPerRepo)),
+                                                 @"user" : @(1 + (i % accountCount)),
+                                                 @"assignees" : @[@(1 + ((i + 1) % accountCount))],
+                                                 @"labels" : @[@{ @"identifier" : @(r * 1000 + 1 + (i % labelsPerRepo)) }],
+                                                 @"comments" : comments })];
+    }
+    
+    return entries;
+}
+
+@end
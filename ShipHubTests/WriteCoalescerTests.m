@@ -0,0 +1,265 @@
+//
+//  WriteCoalescerTests.m
+//  ShipHub
+//
+//  Created by James Howard on 3/13/18.
+//  Copyright © 2018 Real Artists, Inc. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <CoreData/CoreData.h>
+
+#import "DataStore.h"
+#import "DataStore+IssueCounts.h"
+#import "LocalIssue.h"
+#import "SyncConnection.h"
+#import "SyncWritePlan.h"
+#import "TestDataStore.h"
+#import "TestSyncLog.h"
+#import "WriteCoalescer.h"
+
+@interface DataStore (WriteCoalescerTestInternals)
+
+- (void)performWriteAndWait:(void (^)(NSManagedObjectContext *moc))block;
+- (void)performCoalescedWrite:(void (^)(NSManagedObjectContext *moc))block completion:(void (^)(NSError *error))completion;
+
+@end
+
+@interface WriteCoalescerTests : XCTestCase
+
+@property NSManagedObjectModel *mom;
+@property dispatch_queue_t writeQueue;
+
+@end
+
+@implementation WriteCoalescerTests
+
+- (void)setUp {
+    [super setUp];
+    
+    NSURL *momURL = [[NSBundle bundleForClass:[DataStore class]] URLForResource:@"LocalModel" withExtension:@"momd"];
+    _mom = [[NSManagedObjectModel alloc] initWithContentsOfURL:momURL];
+    XCTAssertNotNil(_mom);
+    
+    _writeQueue = dispatch_queue_create("WriteCoalescerTests.write", NULL);
+}
+
+- (NSManagedObjectContext *)inMemoryContextWithModel:(NSManagedObjectModel *)mom {
+    NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:mom];
+    NSError *err = nil;
+    [coordinator addPersistentStoreWithType:NSInMemoryStoreType configuration:nil URL:nil options:nil error:&err];
+    XCTAssertNil(err);
+    
+    NSManagedObjectContext *moc = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    moc.persistentStoreCoordinator = coordinator;
+    moc.undoManager = nil;
+    return moc;
+}
+
+- (WriteCoalescer *)coalescerForContext:(NSManagedObjectContext *)moc window:(NSTimeInterval)window {
+    __block WriteCoalescer *coalescer = nil;
+    dispatch_queue_t q = _writeQueue;
+    coalescer = [[WriteCoalescer alloc] initWithWindow:window maximumBatchSize:16 schedule:^{
+        dispatch_async(q, ^{
+            [moc performBlockAndWait:^{
+                [coalescer commitInContext:moc];
+            }];
+        });
+    }];
+    return coalescer;
+}
+
+- (NSUInteger)countOfEntity:(NSString *)entityName inContext:(NSManagedObjectContext *)moc {
+    __block NSUInteger count = 0;
+    [moc performBlockAndWait:^{
+        count = [moc countForFetchRequest:[NSFetchRequest fetchRequestWithEntityName:entityName] error:NULL];
+    }];
+    return count;
+}
+
+- (void)testCoalescedSyncFramesMatchSeparateSaves {
+    NSArray<SyncEntry *> *entries = [TestSyncLog syntheticEntriesWithIssueCount:2000];
+    NSDictionary *syncEntityNames = [SyncWritePlan syncEntityNamesForModel:_mom];
+    
+    NSManagedObjectContext *separate = [self inMemoryContextWithModel:_mom];
+    NSManagedObjectContext *coalesced = [self inMemoryContextWithModel:_mom];
+    WriteCoalescer *coalescer = [self coalescerForContext:coalesced window:0.05];
+    
+    NSMutableArray *completed = [NSMutableArray new];
+    XCTestExpectation *done = [self expectationWithDescription:@"frames"];
+    
+    NSUInteger frameSize = 50;
+    NSUInteger frames = (entries.count + frameSize - 1) / frameSize;
+    for (NSUInteger i = 0; i < frames; i++) {
+        NSArray *frame = [entries subarrayWithRange:NSMakeRange(i * frameSize, MIN(frameSize, entries.count - i * frameSize))];
+        
+        SyncWritePlan *plan = [[SyncWritePlan alloc] initWithModel:_mom syncEntityNames:syncEntityNames];
+        [plan addEntries:frame];
+        [coalescer addWrite:^(NSManagedObjectContext *moc) {
+            [plan executeInContext:moc];
+        } completion:^(NSError *error) {
+            XCTAssertNil(error);
+            [completed addObject:@(i)];
+            if (completed.count == frames) {
+                [done fulfill];
+            }
+        }];
+    }
+    
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    
+    for (NSUInteger i = 0; i < frames; i++) {
+        NSArray *frame = [entries subarrayWithRange:NSMakeRange(i * frameSize, MIN(frameSize, entries.count - i * frameSize))];
+        SyncWritePlan *plan = [[SyncWritePlan alloc] initWithModel:_mom syncEntityNames:syncEntityNames];
+        [plan addEntries:frame];
+        [separate performBlockAndWait:^{
+            [plan executeInContext:separate];
+            [separate save:NULL];
+            [separate reset];
+        }];
+    }
+    
+    // Completions run on the write queue, in the order the writes were added.
+    NSMutableArray *expected = [NSMutableArray new];
+    for (NSUInteger i = 0; i < frames; i++) [expected addObject:@(i)];
+    XCTAssertEqualObjects(completed, expected);
+    
+    // Frames saved together must not insert duplicates of objects pending from earlier frames.
+    for (NSString *entityName in @[@"LocalIssue", @"LocalAccount", @"LocalRepo", @"LocalLabel", @"LocalMilestone"]) {
+        XCTAssertEqual([self countOfEntity:entityName inContext:coalesced], [self countOfEntity:entityName inContext:separate], @"%@", entityName);
+    }
+    
+    WriteCoalescerStats *stats = [coalescer stats];
+    NSLog(@"%@", stats);
+    XCTAssertEqual(stats.writes, frames);
+    XCTAssertTrue(stats.batches < frames);
+    XCTAssertTrue(stats.maxBatchSize <= coalescer.maximumBatchSize);
+    XCTAssertEqual(stats.retriedBatches, 0);
+}
+
+- (void)testFailedBatchIsRetriedOneAtATime {
+    NSAttributeDescription *name = [NSAttributeDescription new];
+    name.name = @"name";
+    name.attributeType = NSStringAttributeType;
+    name.optional = NO;
+    
+    NSEntityDescription *item = [NSEntityDescription new];
+    item.name = @"Item";
+    item.managedObjectClassName = NSStringFromClass([NSManagedObject class]);
+    item.properties = @[name];
+    
+    NSManagedObjectModel *mom = [NSManagedObjectModel new];
+    mom.entities = @[item];
+    
+    NSManagedObjectContext *moc = [self inMemoryContextWithModel:mom];
+    WriteCoalescer *coalescer = [self coalescerForContext:moc window:0.05];
+    
+    NSMutableArray *errors = [NSMutableArray new];
+    XCTestExpectation *done = [self expectationWithDescription:@"writes"];
+    
+    for (NSUInteger i = 0; i < 5; i++) {
+        [coalescer addWrite:^(NSManagedObjectContext *ctx) {
+            NSManagedObject *obj = [NSEntityDescription insertNewObjectForEntityForName:@"Item" inManagedObjectContext:ctx];
+            if (i != 2) {
+                [obj setValue:[NSString stringWithFormat:@"item %tu", i] forKey:@"name"];
+            }
+        } completion:^(NSError *error) {
+            [errors addObject:error ?: [NSNull null]];
+            if (errors.count == 5) {
+                [done fulfill];
+            }
+        }];
+    }
+    
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    
+    // Only the invalid write fails. The others are saved on their own.
+    for (NSUInteger i = 0; i < 5; i++) {
+        if (i == 2) {
+            XCTAssertTrue([errors[i] isKindOfClass:[NSError class]]);
+        } else {
+            XCTAssertEqualObjects(errors[i], [NSNull null]);
+        }
+    }
+    XCTAssertEqual([self countOfEntity:@"Item" inContext:moc], 4);
+    XCTAssertEqual([coalescer stats].retriedBatches, 1);
+}
+
+- (void)testFailedBatchDiscardsIssueCountChanges {
+    TestDataStore *store = [TestDataStore testStore];
+    XCTAssertNotNil(store);
+    [store activate];
+    
+    @autoreleasepool {
+        [store.testSyncConnection replayEntries:[TestSyncLog syntheticEntriesWithIssueCount:250] batchSize:250];
+        [store performWriteAndWait:^(NSManagedObjectContext *moc) { }];
+    }
+    
+    // Keep the latest count posted for open issues
+    __block IssueCounts *posted = nil;
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:DataStoreDidUpdateIssueCountsNotification object:store queue:nil usingBlock:^(NSNotification *note) {
+        IssueCounts *counts = note.userInfo[DataStoreIssueCountsKey][@"open"];
+        if (counts) posted = counts;
+    }];
+    
+    XCTestExpectation *counted = [self expectationForNotification:DataStoreDidUpdateIssueCountsNotification object:store handler:nil];
+    [store setCountedPredicates:@{ @"open" : [NSPredicate predicateWithFormat:@"closed = NO"] }];
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    NSInteger openBefore = posted.total;
+    XCTAssertTrue(openBefore > 2);
+    
+    __block NSArray<NSNumber *> *numbers = nil;
+    [store performWriteAndWait:^(NSManagedObjectContext *moc) {
+        NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+        fetch.predicate = [NSPredicate predicateWithFormat:@"closed = NO"];
+        fetch.fetchLimit = 2;
+        numbers = [[moc executeFetchRequest:fetch error:NULL] valueForKey:@"number"];
+    }];
+    XCTAssertEqual(numbers.count, 2);
+    
+    // Both writes close an issue, but the second one can't be saved. The batch is rolled back
+    // and retried one at a time, so only the first issue ends up closed.
+    NSMutableArray *errors = [NSMutableArray new];
+    XCTestExpectation *written = [self expectationWithDescription:@"writes"];
+    for (NSUInteger i = 0; i < 2; i++) {
+        NSNumber *number = numbers[i];
+        [store performCoalescedWrite:^(NSManagedObjectContext *moc) {
+            NSFetchRequest *fetch = [NSFetchRequest fetchRequestWithEntityName:@"LocalIssue"];
+            fetch.predicate = [NSPredicate predicateWithFormat:@"number = %@", number];
+            LocalIssue *li = [[moc executeFetchRequest:fetch error:NULL] firstObject];
+            [li setValue:@YES forKey:@"closed"];
+            if (i == 1) {
+                [li setValue:nil forKey:@"pullRequest"]; // not optional
+            }
+        } completion:^(NSError *error) {
+            [errors addObject:error ?: [NSNull null]];
+            if (errors.count == 2) {
+                [written fulfill];
+            }
+        }];
+    }
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    
+    XCTAssertEqualObjects(errors[0], [NSNull null]);
+    XCTAssertTrue([errors[1] isKindOfClass:[NSError class]]);
+    
+    // Queued behind the writes, so anything they posted has been delivered by the time this completes
+    __block IssueCounts *queried = nil;
+    XCTestExpectation *recounted = [self expectationWithDescription:@"recount"];
+    [store issueCountsMatchingPredicates:@[[NSPredicate predicateWithFormat:@"closed = NO"]] completion:^(NSArray<IssueCounts *> *counts, NSError *error) {
+        XCTAssertNil(error);
+        queried = [counts firstObject];
+        [recounted fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+    
+    XCTAssertEqual(queried.total, openBefore - 1);
+    XCTAssertEqual(posted.total, queried.total);
+    
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    NSString *dir = [store.testDBPath stringByDeletingLastPathComponent];
+    [store deactivate];
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+}
+
+@end
@@ -17,6 +17,7 @@ struct SRDelegateAvailableMethods {
     unsigned int didReceiveMessage : 1;
     unsigned int didReceiveMessageWithString : 1;
     unsigned int didReceiveMessageWithData : 1;
+    unsigned int didReceiveMessageWithDispatchData : 1;
     unsigned int didOpen : 1;
     unsigned int didFailWithError : 1;
     unsigned int didCloseWithCode : 1;
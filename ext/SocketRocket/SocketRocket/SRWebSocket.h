@@ -359,6 +359,16 @@ extern NSString *const SRHTTPResponseErrorKey;
  */
 - (void)webSocket:(SRWebSocket *)webSocket didReceiveMessageWithData:(NSData *)data;
 
+/**
+ Called when a frame was received from a web socket.
+ Unlike `webSocket:didReceiveMessageWithData:`, the payload is not copied into one contiguous buffer,
+ but is made up of the regions of the buffers it was read into. Use `dispatch_data_apply` to visit them.
+
+ @param webSocket An instance of `SRWebSocket` that received a message.
+ @param data      Received data in a form of `dispatch_data_t`.
+ */
+- (void)webSocket:(SRWebSocket *)webSocket didReceiveMessageWithDispatchData:(dispatch_data_t)data;
+
 #pragma mark Status & Connection
 
 /**
@@ -102,8 +102,8 @@ NSString *const SRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
     uint8_t _currentFrameOpcode;
     size_t _currentFrameCount;
     size_t _readOpCount;
-    uint32_t _currentStringScanPosition;
-    NSMutableData *_currentFrameData;
+    dispatch_data_t _currentStringScanRemainder; // trailing bytes of a text frame not yet validated as UTF-8
+    NSMutableArray<dispatch_data_t> *_currentFrameSlices; // payload read so far, as slices of the read buffer
 
     NSString *_closeReason;
 
@@ -172,7 +172,8 @@ NSString *const SRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
     _readBuffer = dispatch_data_empty;
     _outputBuffer = dispatch_data_empty;
 
-    _currentFrameData = [[NSMutableData alloc] init];
+    _currentFrameSlices = [[NSMutableArray alloc] init];
+    _currentStringScanRemainder = dispatch_data_empty;
 
     _consumers = [[NSMutableArray alloc] init];
 
@@ -774,16 +775,14 @@ static inline BOOL closeCodeIsValid(int closeCode) {
     [self _pumpWriting];
 }
 
-- (void)_handleFrameWithData:(NSData *)frameData opCode:(SROpCode)opcode
+- (void)_handleFrameWithData:(dispatch_data_t)frameData opCode:(SROpCode)opcode
 {
-    // Check that the current data is valid UTF8
+    // Check that the current data is valid UTF8.
+    // Each slice of a text frame was validated as it arrived, so all that's left is whether it ended partway through a code point.
+    BOOL endsInPartialCodePoint = dispatch_data_get_size(_currentStringScanRemainder) > 0;
 
     BOOL isControlFrame = (opcode == SROpCodePing || opcode == SROpCodePong || opcode == SROpCodeConnectionClose);
     if (isControlFrame) {
-        //frameData will be copied before passing to handlers
-        //otherwise there can be misbehaviours when value at the pointer is changed
-        frameData = [frameData copy];
-
         dispatch_async(_workQueue, ^{
             [self _readFrameContinue];
         });
@@ -793,8 +792,7 @@ static inline BOOL closeCodeIsValid(int closeCode) {
 
     switch (opcode) {
         case SROpCodeTextFrame: {
-            NSString *string = [[NSString alloc] initWithData:frameData encoding:NSUTF8StringEncoding];
-            if (!string && frameData) {
+            if (endsInPartialCodePoint) {
                 [self closeWithCode:SRStatusCodeInvalidUTF8 reason:@"Text frames must be valid UTF-8."];
                 dispatch_async(_workQueue, ^{
                     [self closeConnection];
@@ -806,12 +804,16 @@ static inline BOOL closeCodeIsValid(int closeCode) {
                 // Don't convert into string - iff `delegate` tells us not to. Otherwise - create UTF8 string and handle that.
                 if (availableMethods.shouldConvertTextFrameToString && ![delegate webSocketShouldConvertTextFrameToString:self]) {
                     if (availableMethods.didReceiveMessage) {
-                        [delegate webSocket:self didReceiveMessage:frameData];
+                        [delegate webSocket:self didReceiveMessage:(NSData *)frameData];
                     }
                     if (availableMethods.didReceiveMessageWithData) {
-                        [delegate webSocket:self didReceiveMessageWithData:frameData];
+                        [delegate webSocket:self didReceiveMessageWithData:(NSData *)frameData];
+                    }
+                    if (availableMethods.didReceiveMessageWithDispatchData) {
+                        [delegate webSocket:self didReceiveMessageWithDispatchData:frameData];
                     }
                 } else {
+                    NSString *string = [[NSString alloc] initWithData:(NSData *)frameData encoding:NSUTF8StringEncoding];
                     if (availableMethods.didReceiveMessage) {
                         [delegate webSocket:self didReceiveMessage:string];
                     }
@@ -826,22 +828,25 @@ static inline BOOL closeCodeIsValid(int closeCode) {
             SRDebugLog(@"Received data message.");
             [self.delegateController performDelegateBlock:^(id<SRWebSocketDelegate>  _Nullable delegate, SRDelegateAvailableMethods availableMethods) {
                 if (availableMethods.didReceiveMessage) {
-                    [delegate webSocket:self didReceiveMessage:frameData];
+                    [delegate webSocket:self didReceiveMessage:(NSData *)frameData];
                 }
                 if (availableMethods.didReceiveMessageWithData) {
-                    [delegate webSocket:self didReceiveMessageWithData:frameData];
+                    [delegate webSocket:self didReceiveMessageWithData:(NSData *)frameData];
+                }
+                if (availableMethods.didReceiveMessageWithDispatchData) {
+                    [delegate webSocket:self didReceiveMessageWithDispatchData:frameData];
                 }
             }];
         }
             break;
         case SROpCodeConnectionClose:
-            [self handleCloseWithData:frameData];
+            [self handleCloseWithData:(NSData *)frameData];
             break;
         case SROpCodePing:
-            [self _handlePingWithData:frameData];
+            [self _handlePingWithData:(NSData *)frameData];
             break;
         case SROpCodePong:
-            [self handlePong:frameData];
+            [self handlePong:(NSData *)frameData];
             break;
         default:
             [self _closeWithProtocolError:[NSString stringWithFormat:@"Unknown opcode %ld", (long)opcode]];
@@ -850,7 +855,26 @@ static inline BOOL closeCodeIsValid(int closeCode) {
     }
 }
 
-- (void)_handleFrameHeader:(frame_header)frame_header curData:(NSData *)curData;
+// Joins the slices of a frame's payload pairwise. Each concatenation copies the region records of both
+// halves, so joining them one at a time would be quadratic in the number of reads that made up the frame.
+static dispatch_data_t SRDataCreateConcatenation(NSArray<dispatch_data_t> *slices)
+{
+    NSArray<dispatch_data_t> *level = slices;
+    while (level.count > 1) {
+        NSMutableArray<dispatch_data_t> *next = [[NSMutableArray alloc] initWithCapacity:(level.count + 1) / 2];
+        for (NSUInteger i = 0; i < level.count; i += 2) {
+            if (i + 1 < level.count) {
+                [next addObject:dispatch_data_create_concat(level[i], level[i + 1])];
+            } else {
+                [next addObject:level[i]];
+            }
+        }
+        level = next;
+    }
+    return level.firstObject ?: dispatch_data_empty;
+}
+
+- (void)_handleFrameHeader:(frame_header)frame_header;
 {
     assert(frame_header.opcode != 0);
 
@@ -878,10 +902,10 @@ static inline BOOL closeCodeIsValid(int closeCode) {
 
     if (frame_header.payload_length == 0) {
         if (isControlFrame) {
-            [self _handleFrameWithData:curData opCode:frame_header.opcode];
+            [self _handleFrameWithData:dispatch_data_empty opCode:frame_header.opcode];
         } else {
             if (frame_header.fin) {
-                [self _handleFrameWithData:_currentFrameData opCode:frame_header.opcode];
+                [self _handleFrameWithData:SRDataCreateConcatenation(_currentFrameSlices) opCode:frame_header.opcode];
             } else {
                 // TODO add assert that opcode is not a control;
                 [self _readFrameContinue];
@@ -891,10 +915,10 @@ static inline BOOL closeCodeIsValid(int closeCode) {
         assert(frame_header.payload_length <= SIZE_T_MAX);
         [self _addConsumerWithDataLength:(size_t)frame_header.payload_length callback:^(SRWebSocket *sself, NSData *newData) {
             if (isControlFrame) {
-                [sself _handleFrameWithData:newData opCode:frame_header.opcode];
+                [sself _handleFrameWithData:(dispatch_data_t)newData opCode:frame_header.opcode];
             } else {
                 if (frame_header.fin) {
-                    [sself _handleFrameWithData:sself->_currentFrameData opCode:frame_header.opcode];
+                    [sself _handleFrameWithData:SRDataCreateConcatenation(sself->_currentFrameSlices) opCode:frame_header.opcode];
                 } else {
                     // TODO add assert that opcode is not a control;
                     [sself _readFrameContinue];
@@ -986,7 +1010,7 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
         }
 
         if (extra_bytes_needed == 0) {
-            [sself _handleFrameHeader:header curData:sself->_currentFrameData];
+            [sself _handleFrameHeader:header];
         } else {
             [sself _addConsumerWithDataLength:extra_bytes_needed callback:^(SRWebSocket *eself, NSData *edata) {
                 size_t mapped_size = edata.length;
@@ -1019,7 +1043,7 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
                     memcpy(eself->_currentReadMaskKey, ((uint8_t *)mapped_buffer) + offset, sizeof(eself->_currentReadMaskKey));
                 }
 
-                [eself _handleFrameHeader:header curData:eself->_currentFrameData];
+                [eself _handleFrameHeader:header];
             } readToCurrentFrame:NO unmaskBytes:NO];
         }
     } readToCurrentFrame:NO unmaskBytes:NO];
@@ -1028,14 +1052,13 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
 - (void)_readFrameNew;
 {
     dispatch_async(_workQueue, ^{
-        // Don't reset the length, since Apple doesn't guarantee that this will free the memory (and in tests on
-        // some platforms, it doesn't seem to, effectively causing a leak the size of the biggest frame so far).
-        _currentFrameData = [[NSMutableData alloc] init];
+        // The last frame's slices now belong to whoever it was handed to.
+        _currentFrameSlices = [[NSMutableArray alloc] init];
 
         _currentFrameOpcode = 0;
         _currentFrameCount = 0;
         _readOpCount = 0;
-        _currentStringScanPosition = 0;
+        _currentStringScanRemainder = dispatch_data_empty;
 
         [self _readFrameContinue];
     });
@@ -1261,23 +1284,18 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
         }
 
         if (consumer.readToCurrentFrame) {
-            dispatch_data_apply(slice, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
-                [_currentFrameData appendBytes:buffer length:size];
-                return true;
-            });
+            // Keep the slice rather than copying its bytes out. It shares the buffers the socket was read into.
+            [_currentFrameSlices addObject:slice];
 
             _readOpCount += 1;
 
             if (_currentFrameOpcode == SROpCodeTextFrame) {
                 // Validate UTF8 stuff.
-                size_t currentDataSize = _currentFrameData.length;
-                if (_currentFrameOpcode == SROpCodeTextFrame && currentDataSize > 0) {
-                    // TODO: Optimize the crap out of this.  Don't really have to copy all the data each time
-
-                    size_t scanSize = currentDataSize - _currentStringScanPosition;
-
-                    NSData *scan_data = [_currentFrameData subdataWithRange:NSMakeRange(_currentStringScanPosition, scanSize)];
-                    int32_t valid_utf8_size = validate_dispatch_data_partial_string(scan_data);
+                // Only the new bytes, after any partial code point left over from the last slice, need scanning.
+                dispatch_data_t scan_data = dispatch_data_create_concat(_currentStringScanRemainder, slice);
+                size_t scanSize = dispatch_data_get_size(scan_data);
+                if (scanSize > 0) {
+                    int32_t valid_utf8_size = validate_dispatch_data_partial_string((NSData *)scan_data);
 
                     if (valid_utf8_size == -1) {
                         [self closeWithCode:SRStatusCodeInvalidUTF8 reason:@"Text frames must be valid UTF-8"];
@@ -1286,10 +1304,9 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
                         });
                         return didWork;
                     } else {
-                        _currentStringScanPosition += valid_utf8_size;
+                        _currentStringScanRemainder = dispatch_data_create_subrange(scan_data, valid_utf8_size, scanSize - valid_utf8_size);
                     }
                 }
-
             }
 
             consumer.bytesNeeded -= foundSize;
@@ -1331,6 +1348,9 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
 
 static const size_t SRFrameHeaderOverhead = 32;
 
+// Large enough that a big frame is made of few regions. Short reads are copied out of it, see below.
+static const size_t SRReadChunkSize = 64 * 1024;
+
 - (void)_sendFrameWithOpcode:(SROpCode)opCode data:(NSData *)data
 {
     [self assertOnWorkQueue];
@@ -1491,13 +1511,29 @@ static const size_t SRFrameHeaderOverhead = 32;
 
         case NSStreamEventHasBytesAvailable: {
             SRDebugLog(@"NSStreamEventHasBytesAvailable %@", aStream);
-            uint8_t buffer[SRDefaultBufferSize()];
+            // Read into heap chunks that the read buffer takes ownership of, so that payloads
+            // reach the delegate without being copied again.
+            uint8_t *buffer = NULL;
 
             while (_inputStream.hasBytesAvailable) {
-                NSInteger bytesRead = [_inputStream read:buffer maxLength:SRDefaultBufferSize()];
+                if (!buffer && !(buffer = malloc(SRReadChunkSize))) {
+                    NSError *error = SRErrorWithCodeDescription(SRStatusCodeMessageTooBig,
+                                                                @"Unable to allocate memory to read from socket.");
+                    [self _failWithError:error];
+                    return;
+                }
+                NSInteger bytesRead = [_inputStream read:buffer maxLength:SRReadChunkSize];
                 if (bytesRead > 0) {
-                    dispatch_data_t data = dispatch_data_create(buffer, bytesRead, nil, DISPATCH_DATA_DESTRUCTOR_DEFAULT);
+                    dispatch_data_t data = nil;
+                    if ((size_t)bytesRead >= SRReadChunkSize / 2) {
+                        data = dispatch_data_create(buffer, bytesRead, nil, DISPATCH_DATA_DESTRUCTOR_FREE);
+                        buffer = NULL;
+                    } else {
+                        // Copy short reads out, rather than pin a mostly empty chunk for as long as its frame lives.
+                        data = dispatch_data_create(buffer, bytesRead, nil, DISPATCH_DATA_DESTRUCTOR_DEFAULT);
+                    }
                     if (!data) {
+                        free(buffer);
                         NSError *error = SRErrorWithCodeDescription(SRStatusCodeMessageTooBig,
                                                                     @"Unable to allocate memory to read from socket.");
                         [self _failWithError:error];
@@ -1508,6 +1544,7 @@ static const size_t SRFrameHeaderOverhead = 32;
                     [self _failWithError:_inputStream.streamError];
                 }
             }
+            free(buffer);
             [self _pumpScanner];
             break;
         }